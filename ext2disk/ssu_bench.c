@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// ssu_ext2 벤치마크 드라이버
+// 시나리오마다 ssu_ext2를 -c 모드로 여러 번 실행해 벽시계 시간, CPU 시간, 최대 RSS를 재고
+// 결과를 한 줄에 한 시나리오씩 고정된 열로 출력 (-o 로 저장, -C 로 이전 결과와 비교)
+
+#define BENCH_MAX_RUNS 100
+#define BENCH_LINE_MAX 512
+#define BENCH_ERR_MAX 256
+
+// 시나리오: 이름과 ssu_ext2 인자
+typedef struct Scenario {
+    const char *name;
+    const char *flags;       // -c 앞에 붙는 옵션 (없으면 NULL)
+    const char *cmds;        // -c 로 넘길 명령
+} Scenario;
+
+// 시작(트리 적재) 비용은 startup으로 따로 재고, 나머지 시나리오는 startup을 뺀 값(net)도 함께 출력
+static const Scenario scenarios[] = {
+    { "startup",      NULL, "exit" },
+    { "startup-lazy", "-l", "exit" },
+    { "tree",         NULL, "tree / -r" },
+    { "tree-sp",      NULL, "tree / -r -s -p" },
+    { "tree-lazy",    "-l", "tree / -r" },
+    { "find-name",    NULL, "find / -name *7*" },
+    { "find-type",    NULL, "find / -type d" },
+    { "print-large",  NULL, "print /large0" },
+    { "print-sparse", NULL, "print /sparse0" },
+    { "print-head",   NULL, "print /large0 -n 100" },
+};
+#define NSCENARIOS ((int)(sizeof(scenarios) / sizeof(scenarios[0])))
+
+// 시나리오 하나의 측정 결과
+typedef struct Result {
+    bool ok;
+    char err[BENCH_ERR_MAX]; // 실패했을 때 ssu_ext2가 표준 에러에 쓴 첫 줄
+    double wall_ms, min_ms, max_ms, user_ms, sys_ms;
+    long maxrss_kb;
+} Result;
+
+// 이전 결과 파일의 한 줄
+typedef struct Baseline {
+    char name[64];
+    double wall_ms;
+    long maxrss_kb;
+} Baseline;
+
+static double tv_ms(struct timeval tv) {
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return x < y ? -1 : x > y;
+}
+
+// ssu_ext2를 한 번 실행: 표준 출력은 버리고, 표준 에러는 err가 있으면 파이프로 받아 첫 줄만 남김
+// 반환값: 정상 종료하고 표준 에러가 비었으면 0
+static int run_once(const char *prog, const char *image, const Scenario *sc,
+                    double *wall_ms, struct rusage *ru, char *err, size_t errlen) {
+    int pfd[2] = { -1, -1 };
+    if (err && pipe(pfd) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+        if (err) {
+            dup2(pfd[1], STDERR_FILENO);
+            close(pfd[0]);
+            close(pfd[1]);
+        } else if (null_fd >= 0) {
+            dup2(null_fd, STDERR_FILENO);
+        }
+        const char *argv[6];
+        int argc = 0;
+        argv[argc++] = prog;
+        if (sc->flags) argv[argc++] = sc->flags;
+        argv[argc++] = "-c";
+        argv[argc++] = sc->cmds;
+        argv[argc++] = image;
+        argv[argc] = NULL;
+        execv(prog, (char *const *)argv);
+        perror(prog);
+        _exit(127);
+    }
+    size_t len = 0;
+    if (err) {
+        close(pfd[1]);
+        char buf[BENCH_ERR_MAX];
+        ssize_t n;
+        while ((n = read(pfd[0], buf, sizeof(buf))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (ssize_t i = 0; i < n && len + 1 < errlen; i++)
+                err[len++] = buf[i];
+        }
+        close(pfd[0]);
+        err[len] = '\0';
+        char *nl = strchr(err, '\n');
+        if (nl) *nl = '\0';
+    }
+    int status;
+    while (wait4(pid, &status, 0, ru) < 0) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *wall_ms = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        if (err && len == 0)
+            snprintf(err, errlen, "exit status %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return -1;
+    }
+    return len == 0 ? 0 : -1;
+}
+
+// 한 번 예열 실행(실패하면 건너뜀) 후 runs번 실행해 중앙값/최솟값/최댓값 계산
+static void run_scenario(const char *prog, const char *image, const Scenario *sc, int runs, Result *r) {
+    memset(r, 0, sizeof(*r));
+    double wall;
+    struct rusage ru;
+    if (run_once(prog, image, sc, &wall, &ru, r->err, sizeof(r->err)) < 0)
+        return;
+    double walls[BENCH_MAX_RUNS], users[BENCH_MAX_RUNS], syss[BENCH_MAX_RUNS];
+    long rss[BENCH_MAX_RUNS];
+    for (int i = 0; i < runs; i++) {
+        if (run_once(prog, image, sc, &walls[i], &ru, NULL, 0) < 0) {
+            snprintf(r->err, sizeof(r->err), "failed on run %d", i + 1);
+            return;
+        }
+        users[i] = tv_ms(ru.ru_utime);
+        syss[i] = tv_ms(ru.ru_stime);
+        rss[i] = ru.ru_maxrss;
+    }
+    qsort(walls, runs, sizeof(double), cmp_double);
+    qsort(users, runs, sizeof(double), cmp_double);
+    qsort(syss, runs, sizeof(double), cmp_double);
+    qsort(rss, runs, sizeof(long), cmp_long);
+    r->ok = true;
+    r->wall_ms = walls[runs / 2];
+    r->min_ms = walls[0];
+    r->max_ms = walls[runs - 1];
+    r->user_ms = users[runs / 2];
+    r->sys_ms = syss[runs / 2];
+    r->maxrss_kb = rss[runs / 2];
+}
+
+// 이전 결과 파일 읽기 ('#' 줄은 건너뜀)
+static int load_baseline(const char *path, Baseline *base, int max) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char line[BENCH_LINE_MAX];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        double median, net, min, max_ms, user, sys;
+        long rss;
+        if (sscanf(line, "%63s %lf %lf %lf %lf %lf %lf %ld", base[n].name, &median, &net,
+                   &min, &max_ms, &user, &sys, &rss) != 8)
+            continue;
+        base[n].wall_ms = median;
+        base[n].maxrss_kb = rss;
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static const Baseline *find_baseline(const Baseline *base, int n, const char *name) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(base[i].name, name) == 0) return &base[i];
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage Error : %s [-n RUNS] [-p PROGRAM] [-o RESULT_FILE] [-C BASELINE_FILE] <EXT2_IMAGE>\n", prog);
+    fprintf(stderr, "  -n <RUNS> : measured runs per scenario after one warm-up run (default 5)\n");
+    fprintf(stderr, "  -p <PROGRAM> : ssu_ext2 binary to run (default ./ssu_ext2)\n");
+    fprintf(stderr, "  -o <RESULT_FILE> : also save the result table to <RESULT_FILE>\n");
+    fprintf(stderr, "  -C <BASELINE_FILE> : compare with a result table saved by -o\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *prog = "./ssu_ext2";
+    const char *out_path = NULL;
+    const char *base_path = NULL;
+    int runs = 5;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:o:C:")) != -1) {
+        if (opt == 'n') {
+            runs = atoi(optarg);
+            if (runs < 1 || runs > BENCH_MAX_RUNS) usage(argv[0]);
+        } else if (opt == 'p') {
+            prog = optarg;
+        } else if (opt == 'o') {
+            out_path = optarg;
+        } else if (opt == 'C') {
+            base_path = optarg;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1) usage(argv[0]);
+    const char *image = argv[optind];
+    if (access(prog, X_OK) < 0) {
+        perror(prog);
+        exit(EXIT_FAILURE);
+    }
+
+    Baseline base[NSCENARIOS];
+    int nbase = 0;
+    if (base_path && (nbase = load_baseline(base_path, base, NSCENARIOS)) < 0)
+        exit(EXIT_FAILURE);
+
+    Result res[NSCENARIOS];
+    for (int i = 0; i < NSCENARIOS; i++) {
+        fprintf(stderr, "bench: %s ...\n", scenarios[i].name);
+        run_scenario(prog, image, &scenarios[i], runs, &res[i]);
+    }
+
+    // 결과 표: 이름, 중앙값, startup을 뺀 값, 최솟값, 최댓값, user/sys CPU 중앙값, 최대 RSS 중앙값
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    if (out_path && !out) perror(out_path);
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    char header[BENCH_LINE_MAX];
+    snprintf(header, sizeof(header), "# ssu_bench %s image=%s program=%s runs=%d\n"
+             "# %-14s %10s %10s %10s %10s %10s %10s %10s\n",
+             stamp, image, prog, runs, "scenario", "median_ms", "net_ms", "min_ms", "max_ms",
+             "user_ms", "sys_ms", "maxrss_kb");
+    fputs(header, stdout);
+    if (out) fputs(header, out);
+    double startup = res[0].ok ? res[0].wall_ms : 0;
+    double startup_lazy = res[1].ok ? res[1].wall_ms : 0;
+    for (int i = 0; i < NSCENARIOS; i++) {
+        const Result *r = &res[i];
+        char line[BENCH_LINE_MAX];
+        if (!r->ok) {
+            snprintf(line, sizeof(line), "# %-14s skipped: %s\n", scenarios[i].name, r->err);
+            fputs(line, stdout);
+            if (out) fputs(line, out);
+            continue;
+        }
+        double base_ms = i < 2 ? 0 : (scenarios[i].flags ? startup_lazy : startup);
+        double net = r->wall_ms - base_ms;
+        snprintf(line, sizeof(line), "  %-14s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10ld",
+                 scenarios[i].name, r->wall_ms, net < 0 ? 0 : net, r->min_ms, r->max_ms,
+                 r->user_ms, r->sys_ms, r->maxrss_kb);
+        if (out) fprintf(out, "%s\n", line);
+        const Baseline *b = nbase ? find_baseline(base, nbase, scenarios[i].name) : NULL;
+        if (b && b->wall_ms > 0 && b->maxrss_kb > 0)
+            printf("%s   time %+6.1f%%  rss %+6.1f%%\n", line,
+                   (r->wall_ms - b->wall_ms) * 100.0 / b->wall_ms,
+                   (double)(r->maxrss_kb - b->maxrss_kb) * 100.0 / b->maxrss_kb);
+        else
+            printf("%s\n", line);
+    }
+    if (out) fclose(out);
+    return 0;
+}
@@ -1,4 +1,4 @@
-
+#define _GNU_SOURCE           // O_DIRECT 사용
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -10,12 +10,131 @@
 #include <errno.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/sysmacros.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <zlib.h>
 #define PATH_MAX_LEN 4096
 #define SUPERBLOCK_OFFSET 1024    // 슈퍼블록이 시작되는 바이트 오프셋
 #define EXT2_NAME_LEN 255         // 디렉토리 엔트리 이름 최대 길이
+#define EXT2_FT_REG_FILE 1  // ext2_dir_entry에서 일반 파일 타입 값
 #define EXT2_FT_DIR 2  // ext2_dir_entry에서 디렉토리 타입 값
+#define EXT2_FT_CHRDEV 3  // ext2_dir_entry에서 문자 장치 타입 값
+#define EXT2_FT_BLKDEV 4  // ext2_dir_entry에서 블록 장치 타입 값
+#define EXT2_FT_FIFO 5  // ext2_dir_entry에서 FIFO 타입 값
+#define EXT2_FT_SOCK 6  // ext2_dir_entry에서 소켓 타입 값
+#define EXT2_FT_SYMLINK 7  // ext2_dir_entry에서 심볼릭 링크 타입 값
+#define EXT2_ROOT_INO 2           // 루트 디렉토리 inode 번호
+#define EXT2_SUPER_MAGIC 0xEF53   // 슈퍼블록 매직 번호
+#define EXT2_RESIZE_INO 7         // 예약 GDT 블록을 소유하는 resize inode
+#define EXT2_GOOD_OLD_FIRST_INO 11  // 이보다 작은 inode는 예약됨 (저널, resize 등)
+#define EXT2_INDEX_FL 0x1000      // i_flags: htree 인덱스 디렉토리
+#define EXT4_EXTENTS_FL 0x80000   // i_flags: i_block에 extent 트리 저장 (ext4)
+#define EXT4_EXT_MAGIC 0xF30A     // extent 헤더 매직 번호
+#define EXT4_EXT_INIT_MAX_LEN 32768  // 이보다 긴 ee_len은 unwritten extent
+#define EXT4_EXT_MAX_DEPTH 5      // extent 트리 최대 깊이
+#define EXT2_FEATURE_INCOMPAT_META_BG 0x0010  // s_feature_incompat: 메타 블록 그룹 단위 디스크립터 배치
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x0080    // s_feature_incompat: 64바이트 그룹 디스크립터
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020  // s_feature_compat: dir_index
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002       // s_flags: unsigned char 해시
+
+// htree 해시 버전
+#define EXT2_HASH_LEGACY 0
+#define EXT2_HASH_HALF_MD4 1
+#define EXT2_HASH_TEA 2
+#define EXT2_HASH_LEGACY_UNSIGNED 3
+#define EXT2_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_HASH_TEA_UNSIGNED 5
+#define EXPORT_MAX_THREADS 16     // export 작업 스레드 최대 개수
+#define EXPORT_IO_BLOCKS 256      // export 시 한 번에 읽는 연속 블록 수
+#define FILE_STREAM_BLOCKS 64     // 파일 스트림이 한 번에 읽는 연속 블록 수
+#define SCAN_CHUNK (4 * 1024 * 1024)  // O_DIRECT 스캔 요청 하나의 크기
+#define SCAN_ALIGN 4096           // O_DIRECT 버퍼/오프셋 정렬 단위
+
+#define IO_URING_ENTRIES 64       // io_uring 제출 큐 크기
+#define IO_DEFAULT_DEPTH 32       // 기본 동시 읽기 요청 수 (queue depth)
+#define BUILD_BATCH_BLOCKS 1024   // build_tree가 한 번에 읽는 디렉토리 블록 수
+#define ANALYZE_MAX_THREADS 16    // df 등 그룹 단위 분석 스레드 최대 개수
+#define FRAG_TOP_FILES 10         // frag가 출력하는 가장 단편화된 파일 수
+#define INO_MAP_INIT_SIZE 1024    // inode → 노드 해시 맵 초기 버킷 수
+#define INODE_SCAN_BLOCKS 256     // inode 테이블 전체를 훑을 때 한 번에 읽는 블록 수
+#define CHECK_MAX_REPORT 20       // check가 문제 종류마다 출력하는 최대 개수
+#define DUPS_SEGMENT_BLOCKS 1024  // dups 전체 해시를 나눠 계산하는 구간 크기 (블록 수)
+#define SERVE_MAX_CLIENTS 64      // 서버 모드 동시 접속 클라이언트 최대 수
+#define SERVE_LINE_MAX 8192       // 서버가 받는 명령 한 줄 최대 길이
+
+// gzip 압축 이미지 임의 접근 ("<이미지>.gzidx" 체크포인트 색인 + 압축 해제 청크 캐시)
+#define GZIDX_SUFFIX ".gzidx"
+#define GZIDX_MAGIC "SSUGZIDX"
+#define GZIDX_VERSION 1
+#define GZ_SPAN (1024 * 1024)     // 체크포인트 간격 (압축 해제 바이트)
+#define GZ_WINSIZE 32768          // deflate 창 크기 (체크포인트마다 저장)
+#define GZ_CHUNK (64 * 1024)      // 캐시 단위 (압축 해제 바이트)
+#define GZ_CACHE_CHUNKS 1024      // 캐시할 청크 수 (64MB)
+#define GZ_INBUF (64 * 1024)      // 압축 파일을 한 번에 읽는 크기
+
+// 공유 블록 캐시 (open으로 연 모든 이미지가 메모리 예산 하나를 나눠 씀, 같은 내용의 블록은 한 번만 저장)
+#define BCACHE_DEFAULT_MB 64      // 기본 메모리 예산 (--cache-mb)
+#define BCACHE_MAX_REQ_BLOCKS 16  // 이 블록 수 이하의 읽기만 캐시를 거침 (파일 내용 스트림은 우회)
+#define BCACHE_RUN_BLOCKS 256     // 캐시에 없는 연속 블록을 한 요청으로 묶는 최대 길이
+#define SESSION_NAME_MAX 32       // open으로 붙이는 이미지 이름 최대 길이
+#define PREFETCH_CHUNK_BLOCKS 64  // 미리 읽기 한 번의 크기 (명령이 오면 이만큼 끝내고 멈춤)
+#define PREFETCH_IOPRIO_WHO 1     // ioprio_set 대상: IOPRIO_WHO_PROCESS (id 0이면 호출한 스레드)
+#define PREFETCH_IOPRIO_IDLE (3 << 13)  // IOPRIO_CLASS_IDLE: 다른 I/O가 없을 때만 디스크 사용
+#define SYMLINK_MAX_FOLLOW 40     // 경로 하나를 찾을 때 따라가는 심볼릭 링크 최대 수 (리눅스 MAXSYMLINKS)
+
+// blk2path 역색인 파일 ("<이미지>.blkidx")
+#define BLKIDX_SUFFIX ".blkidx"
+#define BLKIDX_MAGIC "SSUBLKIX"
+#define BLKIDX_VERSION 1
+
+// ext4 그룹 디스크립터 플래그 (bg_pad 자리): inode 테이블/블록 비트맵이 초기화되지 않음
+#define EXT4_BG_INODE_UNINIT 0x0001
+#define EXT4_BG_BLOCK_UNINIT 0x0002
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT4_FEATURE_RO_COMPAT_GDT_CSUM 0x0010
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM 0x0400
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002     // 디렉토리 엔트리에 파일 타입 저장
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002  // 2GB 이상 파일 (i_size_high)
+
+// import: 고쳐 써도 되는 기능 (filetype/extents/64bit/flex_bg, sparse_super/large_file/huge_file/dir_nlink/extra_isize)
+// 체크섬, 저널 복구 대기, 클러스터 할당, 쿼터, inline data 등이 켜진 이미지는 거부
+#define IMPORT_INCOMPAT_OK (0x0002 | 0x0040 | 0x0080 | 0x0200)
+#define IMPORT_RO_COMPAT_OK (0x0001 | 0x0002 | 0x0008 | 0x0020 | 0x0040)
+#define IMPORT_IO_BYTES (1024 * 1024)  // import가 호스트 파일을 읽어 이미지에 한 번에 쓰는 크기
+#define IMPORT_MAX_IOV 1024       // 메타데이터를 이어 쓸 때 pwritev 한 번에 묶는 블록 버퍼 수
+
+// 이미지 읽기 방식: 대화형 조회는 버퍼드, 대량 스캔은 O_DIRECT 선택 가능
+#define IO_BUFFERED 0
+#define IO_DIRECT   1
+
+// tree 출력 형식
+#define TREE_TEXT   0             // 상자 그림 문자 트리
+#define TREE_JSON   1             // 중첩된 JSON 문서 하나 (--json)
+#define TREE_NDJSON 2             // 항목마다 JSON 한 줄 (--ndjson)
+#define TREE_OUT_BUF (1024 * 1024)  // tree 출력 버퍼 크기 (가득 차면 write)
+
+// print 출력 형식
+#define PRINT_TEXT 0              // 파일 내용 그대로 (-n이면 그 줄 수까지)
+#define PRINT_HEX  1              // 16진 덤프 (-x)
+#define PRINT_RAW  2              // 원본 바이트를 표준 출력 fd로 바로 (-b)
+#define HEXDUMP_LINE 16           // print -x 한 줄의 바이트 수
+#define HEXDUMP_LINE_MAX 96       // print -x 한 줄의 최대 글자 수 (오프셋 16자리 포함)
 // 전역 변수: 블록 크기, inode 크기, 그룹당 inode 수
 uint32_t block_size;
 uint32_t inode_size;
@@ -36,8 +155,208 @@ struct ext2_inode {
     uint32_t i_flags;        // 플래그
     uint32_t osd1;           // OS 설정 필드
     uint32_t i_block[15];    // 직접/간접 블록 포인터
+    uint32_t i_generation;   // 파일 버전 (NFS용)
+    uint32_t i_file_acl;     // 확장 속성 블록
+    uint32_t i_size_high;    // 파일 크기 상위 32비트 (large_file)
+    uint32_t i_faddr;        // fragment 주소
+    uint8_t  osd2[12];       // OS 설정 필드 2
 };
 
+// 파일의 논리 블록 → 물리 블록 매핑 구간
+// hole 구간은 물리 블록이 없으며(physical = 0) 읽으면 0으로 채워진 데이터
+typedef struct BlockRun {
+    uint32_t logical;        // 시작 논리 블록 번호
+    uint32_t physical;       // 시작 물리 블록 번호 (hole이면 0)
+    uint32_t len;            // 구간 길이 (블록 수)
+    bool hole;               // hole 여부
+} BlockRun;
+
+// 블록 매핑 구간을 따라 파일 내용을 순서대로 읽는 스트림
+typedef struct FileStream {
+    const BlockRun *runs;    // 블록 매핑 구간 목록
+    int nruns;
+    int run_idx;             // 현재 구간 인덱스
+    uint32_t run_off;        // 현재 구간 내에서 소비한 블록 수
+    uint64_t pos;            // 현재 파일 내 바이트 위치
+    uint64_t size;           // 파일 크기
+    char *buf;               // 읽기 버퍼
+    char *zeros;             // hole 구간용 0 버퍼
+    struct ScanReader *scan; // O_DIRECT 모드일 때 데이터 구간 스캐너 (버퍼드면 NULL)
+    struct ScanRange *ranges;// scan이 읽는 데이터 구간 목록
+} FileStream;
+
+// 일괄 읽기 요청 하나 (io_read_batch)
+typedef struct IoReq {
+    void *buf;               // 읽어 올 버퍼
+    size_t len;              // 요청 길이
+    off_t off;               // 이미지 내 오프셋
+    ssize_t res;             // 결과: 읽은 바이트 수 (실패 시 음수)
+} IoReq;
+
+// 순차 스캔할 이미지 바이트 범위
+typedef struct ScanRange {
+    off_t off;               // 이미지 내 시작 오프셋
+    uint64_t len;            // 길이 (바이트)
+    uint64_t user_off;       // 호출자가 붙인 오프셋 (파일 내 위치 등)
+} ScanRange;
+
+// 스캔 버퍼 상태
+#define SCAN_SLOT_EMPTY 0
+#define SCAN_SLOT_FULL  1
+#define SCAN_SLOT_EOF   2
+#define SCAN_SLOT_ERR   3
+
+typedef struct ScanSlot {
+    char *buf;               // SCAN_ALIGN 정렬 버퍼
+    const char *data;        // buf 내 실제 데이터 시작 위치
+    size_t len;
+    uint64_t user_off;
+    int state;
+} ScanSlot;
+
+// O_DIRECT 순차 스캐너: 생산자 스레드가 두 버퍼를 번갈아 채움 (double buffering)
+typedef struct ScanReader {
+    int fd;                  // O_DIRECT fd (불가능하면 일반 fd)
+    bool direct;             // 실제로 O_DIRECT를 쓰는지
+    const ScanRange *ranges;
+    int nranges;
+    int prod_range;          // 생산자가 읽을 범위 인덱스
+    uint64_t prod_done;      // 현재 범위에서 읽은 바이트 수
+    int cons_slot;           // 소비자가 들고 있는 슬롯 (-1이면 없음)
+    ScanSlot slots[2];
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ScanReader;
+
+// df: 블록 그룹 하나의 비트맵 분석 결과
+typedef struct GroupSpace {
+    uint32_t blocks;         // 그룹 내 블록 수
+    uint32_t used;           // 사용 중인 블록 수
+    uint32_t lead;           // 그룹 시작부터 이어지는 여유 블록 수
+    uint32_t trail;          // 그룹 끝까지 이어지는 여유 블록 수
+    bool all_free;           // 그룹 전체가 여유 블록인지
+    bool error;              // 비트맵을 읽지 못함
+    uint32_t extents;        // 그룹 내부에 완전히 들어있는 여유 구간 수
+    uint32_t largest;        // 그 중 가장 큰 구간
+    uint32_t hist[32];       // 내부 여유 구간 크기 분포 (log2 버킷)
+} GroupSpace;
+
+// df: 작업 스레드들이 공유하는 상태
+typedef struct DfCtx {
+    GroupSpace *groups;      // 그룹별 결과
+    uint32_t next_group;     // 다음에 분석할 그룹 번호 (원자적으로 증가)
+} DfCtx;
+
+// blk2path: 물리 블록 구간의 소유자 종류
+#define BLK_OWNER_DATA 0          // 파일 데이터 (owner = inode)
+#define BLK_OWNER_MAP 1           // 간접 블록/extent 노드 (owner = inode)
+#define BLK_OWNER_BLOCK_BITMAP 2  // 블록 비트맵 (owner = 그룹 번호)
+#define BLK_OWNER_INODE_BITMAP 3  // inode 비트맵 (owner = 그룹 번호)
+#define BLK_OWNER_INODE_TABLE 4   // inode 테이블 (owner = 그룹 번호)
+
+// blk2path: 물리 블록 구간 하나와 소유자 (색인 파일에 그대로 저장됨)
+typedef struct BlkOwner {
+    uint32_t start;          // 물리 시작 블록
+    uint32_t len;            // 블록 수
+    uint32_t owner;          // inode 번호 또는 그룹 번호
+    uint32_t logical;        // 데이터 구간의 파일 내 논리 시작 블록
+    uint8_t kind;            // BLK_OWNER_*
+    uint8_t pad[3];
+} BlkOwner;
+
+// check: 문제 종류
+#define CHK_READ_ERROR 0          // 메타데이터 블록을 읽지 못함 (a = 블록)
+#define CHK_INODE_MARKED_UNUSED 1 // 비트맵은 사용 중인데 inode가 비어 있음 (a = inode)
+#define CHK_INODE_NOT_MARKED 2    // 사용 중 inode가 비트맵에서 빠짐 (a = inode)
+#define CHK_BAD_BLOCK 3           // 파일시스템 범위 밖 블록 참조 (a = inode, b = 블록)
+#define CHK_DUP_BLOCK 4           // 블록 중복 할당 (a = 블록, b = 두 번째 소유 inode)
+#define CHK_BAD_REC_LEN 5         // 잘못된 rec_len (a = 디렉토리, b = 논리 블록, c = 오프셋)
+#define CHK_BAD_DIRENT_INO 6      // 엔트리의 inode 번호가 범위 밖 (a = 디렉토리, b = inode)
+#define CHK_REF_FREE_INODE 7      // 사용하지 않는 inode를 가리키는 엔트리 (a = inode, b = 참조 수)
+#define CHK_UNATTACHED 8          // 어느 디렉토리에도 없는 사용 중 inode (a = inode)
+#define CHK_LINK_COUNT 9          // 링크 수 불일치 (a = inode, b = i_links_count, c = 참조 수)
+#define CHK_BLOCK_NOT_MARKED 10   // 소유된 블록이 비트맵에서 여유 (a = 시작, b = 길이)
+#define CHK_BLOCK_MARKED_UNUSED 11 // 비트맵은 사용 중인데 소유자 없음 (a = 시작, b = 길이)
+#define CHK_KINDS 12
+
+// check: 발견한 문제 하나
+typedef struct CheckIssue {
+    int kind;                // CHK_*
+    uint32_t a, b, c;
+} CheckIssue;
+
+// check: 그룹별 문제 목록 (작업 스레드가 자기 그룹에만 기록)
+typedef struct CheckGroup {
+    CheckIssue *issues;
+    int cnt, cap;
+} CheckGroup;
+
+// check: 작업 스레드들이 공유하는 상태
+typedef struct CheckCtx {
+    CheckGroup *groups;
+    uint64_t *owned;         // 소유자가 확인된 블록 (원자적으로 설정)
+    uint64_t *inuse;         // 사용 중 inode
+    uint64_t *isdir;         // 디렉토리 inode
+    uint32_t *refs;          // inode별 디렉토리 엔트리 참조 수 (원자적으로 증가)
+    uint16_t *links;         // inode별 i_links_count
+    int pass;                // 현재 단계 (0: inode/블록/디렉토리, 1: 링크 수/블록 비트맵)
+    uint32_t next_group;     // 다음에 처리할 그룹 번호 (원자적으로 증가)
+} CheckCtx;
+
+// dups: 64비트 단어 단위 해시 상태 (두 갈래로 128비트)
+typedef struct DupHash {
+    uint64_t h1, h2;
+} DupHash;
+
+// dups: 파일 하나의 단계별 상태
+typedef struct DupFile {
+    char *path;
+    uint32_t ino;
+    uint64_t size;
+    struct ext2_inode ino_rec;
+    BlockRun *runs;          // 후보 파일의 블록 구간
+    int nruns;
+    uint64_t blk_sig;        // 블록 구간 목록의 해시 (같으면 블록 공유 후보)
+    uint64_t first_hash;     // 첫 블록 해시
+    DupHash hash;            // 전체 내용 해시 (세그먼트 해시들의 해시)
+    DupHash *seg_hash;       // 세그먼트별 해시 (작업 스레드가 채움)
+    uint32_t nseg;
+    bool candidate;          // 같은 크기의 파일이 있음
+    bool shared;             // 앞 파일과 같은 블록을 쓰는 사본 (읽지 않음)
+    bool full;               // 전체 내용 비교까지 끝남
+    bool error;              // 읽기 실패
+} DupFile;
+
+// dups: 전체 해시 작업 하나 (파일의 한 세그먼트)
+typedef struct DupJob {
+    DupFile *file;
+    uint32_t seg;
+    uint32_t phys;           // 세그먼트 시작 물리 블록 (정렬용)
+} DupJob;
+
+// dups: 작업 스레드들이 공유하는 상태
+typedef struct DupCtx {
+    DupJob *jobs;
+    int njobs;
+    int next_job;            // 다음에 처리할 작업 (원자적으로 증가)
+    uint64_t bytes_read;
+} DupCtx;
+
+// dups: 내용이 같은 파일 묶음 (정렬된 파일 목록의 구간)
+typedef struct DupGroup {
+    int start, cnt;
+    uint64_t wasted;
+} DupGroup;
+
+// frag: 파일별 물리 구간 수
+typedef struct FragFile {
+    char *path;
+    uint32_t inode_no;
+    uint32_t runs;
+} FragFile;
+
 
 
 
@@ -70,6 +389,81 @@ struct ext2_super_block {
     uint16_t s_def_resgid;       // GID 기본 권한
     uint32_t s_first_ino;        // 첫 할당 가능한 inode 번호
     uint16_t s_inode_size;       // inode 구조 크기
+    uint16_t s_block_group_nr;   // 이 슈퍼블록이 있는 그룹 번호
+    uint32_t s_feature_compat;   // 호환 기능 플래그
+    uint32_t s_feature_incompat; // 비호환 기능 플래그
+    uint32_t s_feature_ro_compat;// 읽기 전용 호환 기능 플래그
+    uint8_t  s_uuid[16];         // 볼륨 UUID
+    char     s_volume_name[16];  // 볼륨 이름
+    char     s_last_mounted[64]; // 마지막 마운트 경로
+    uint32_t s_algorithm_usage_bitmap;
+    uint8_t  s_prealloc_blocks;
+    uint8_t  s_prealloc_dir_blocks;
+    uint16_t s_reserved_gdt_blocks;
+    uint8_t  s_journal_uuid[16];
+    uint32_t s_journal_inum;
+    uint32_t s_journal_dev;
+    uint32_t s_last_orphan;
+    uint32_t s_hash_seed[4];     // htree 해시 시드
+    uint8_t  s_def_hash_version; // 기본 htree 해시 버전
+    uint8_t  s_jnl_backup_type;
+    uint16_t s_desc_size;
+    uint32_t s_default_mount_opts;
+    uint32_t s_first_meta_bg;
+    uint32_t s_mkfs_time;
+    uint32_t s_jnl_blocks[17];
+    uint32_t s_blocks_count_hi;
+    uint32_t s_r_blocks_count_hi;
+    uint32_t s_free_blocks_hi;
+    uint16_t s_min_extra_isize;
+    uint16_t s_want_extra_isize;
+    uint32_t s_flags;            // 기타 플래그 (unsigned 해시 여부 등)
+};
+
+// extent 트리 노드 헤더 (i_block 또는 트리 블록 맨 앞)
+struct ext4_extent_header {
+    uint16_t eh_magic;           // EXT4_EXT_MAGIC
+    uint16_t eh_entries;         // 유효 엔트리 수
+    uint16_t eh_max;             // 최대 엔트리 수
+    uint16_t eh_depth;           // 0이면 리프 노드
+    uint32_t eh_generation;
+};
+
+// 리프 엔트리: 논리 블록 구간 → 물리 블록 구간
+struct ext4_extent {
+    uint32_t ee_block;           // 시작 논리 블록
+    uint16_t ee_len;             // 블록 수 (32768 초과면 unwritten)
+    uint16_t ee_start_hi;        // 물리 블록 상위 16비트
+    uint32_t ee_start_lo;        // 물리 블록 하위 32비트
+};
+
+// 인덱스 엔트리: 논리 블록 이상을 담당하는 하위 노드 블록
+struct ext4_extent_idx {
+    uint32_t ei_block;
+    uint32_t ei_leaf_lo;
+    uint16_t ei_leaf_hi;
+    uint16_t ei_unused;
+};
+
+// htree(dir_index) 루트 정보: 디렉토리 0번 블록의 '.', '..' 엔트리 뒤에 위치
+struct dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t  hash_version;       // 해시 종류
+    uint8_t  info_length;        // 이 구조체 길이 (8)
+    uint8_t  indirect_levels;    // 중간 인덱스 단계 수
+    uint8_t  unused_flags;
+};
+
+// htree 인덱스 엔트리: 해시 → 디렉토리 내 논리 블록 번호
+struct dx_entry {
+    uint32_t hash;
+    uint32_t block;
+};
+
+// 인덱스 엔트리 배열 맨 앞 (0번 엔트리의 hash 자리에 겹쳐 있음)
+struct dx_countlimit {
+    uint16_t limit;              // 최대 엔트리 수
+    uint16_t count;              // 현재 엔트리 수
 };
 
 // ext2 그룹 디스크립터 구조체 정의
@@ -99,30 +493,373 @@ typedef struct Node {
     char* name;              // 파일 또는 디렉토리 이름
     uint32_t inode_no;       // 해당 inode 번호
     uint8_t file_type;       // 파일 타입
+    bool loaded;             // 디렉토리 엔트리를 모두 읽었는지 (false면 조회된 자식만 있음)
+    bool mapped;             // inode → 노드 해시 맵에 등록되었는지
+    bool times_valid;        // dir_mtime/dir_ctime을 읽어 두었는지 (reload 비교용)
+    uint32_t dir_mtime;      // 디렉토리를 읽었을 때의 i_mtime
+    uint32_t dir_ctime;      // 디렉토리를 읽었을 때의 i_ctime
+    struct Node* parent;     // 부모 노드 포인터 (루트는 NULL)
     struct Node* first_child;// 첫 번째 자식 노드 포인터
     struct Node* next_sibling;// 다음 형제 노드 포인터
+    struct Node* ino_next;   // 해시 맵의 같은 버킷 다음 노드
+    struct NodeLink* link;   // 심볼릭 링크면 처음 따라갈 때 읽은 대상 (아니면 NULL)
 } Node;
 
+// 심볼릭 링크 노드의 대상 경로와 따라간 결과 (gen이 tree_gen과 다르면 다시 읽음)
+typedef struct NodeLink {
+    Node* node;              // 대상 경로를 따라간 노드 (아직 없으면 NULL)
+    uint64_t gen;            // 읽었을 때의 tree_gen
+    char target[];           // 대상 경로 문자열
+} NodeLink;
+
+// inode 번호 → 노드 해시 맵 (하드 링크면 한 inode에 노드가 여러 개)
+typedef struct InoMap {
+    Node** buckets;
+    uint32_t size;           // 버킷 수 (2의 거듭제곱)
+    uint32_t cnt;            // 등록된 노드 수
+} InoMap;
+
+// 부분 적재 디렉토리의 기존 자식 이름 집합 (엔트리마다 자식 목록을 훑지 않도록 load_dirs가 잠깐 만듦)
+typedef struct NameSet {
+    Node** slots;            // 열린 주소 해시 (빈 칸은 NULL)
+    uint32_t mask;           // 칸 수 - 1 (칸 수는 2의 거듭제곱)
+} NameSet;
+
+
+// 이미지 하나의 상태 (전역 변수들의 사본)
+// 두 번째 이미지를 다룰 때 전역 상태와 맞바꿔 기존 함수들을 그대로 사용
+typedef struct ImageState {
+    int fd;
+    int direct_fd;
+    const char *path;
+    struct ext2_super_block sb;
+    struct ext2_group_desc gd;
+    struct ext2_group_desc *gdt;
+    uint32_t group_count;
+    uint32_t block_size;
+    uint32_t inode_size;
+    uint32_t inodes_per_group;
+    Node *root;
+    InoMap ino_map;
+    struct BlkOwner *blk_index;
+    uint64_t blk_index_cnt;
+    uint32_t blk_index_maxlen;
+    bool blk_index_ready;
+    struct GzImage *gz;
+    struct timespec seen_mtime;
+} ImageState;
+
+// gzip 체크포인트: 압축 해제 위치 out은 압축 파일의 in 바이트 앞 bits 비트에서 시작
+// bits가 -1이면 gzip 헤더부터 (파일 시작), 그 외에는 직전 32KB 창으로 raw deflate 재개
+typedef struct GzPoint {
+    uint64_t out;
+    uint64_t in;
+    int32_t bits;
+    int32_t pad;
+    unsigned char window[GZ_WINSIZE];
+} GzPoint;
+
+// 압축 해제된 청크 하나 (LRU 캐시 칸)
+typedef struct GzChunk {
+    uint64_t no;             // 청크 번호 (압축 해제 오프셋 / GZ_CHUNK)
+    uint32_t len;            // 유효 길이 (마지막 청크는 짧을 수 있음)
+    int lru_prev, lru_next;  // LRU 리스트 (앞이 최근)
+    int hash_next;           // 해시 버킷 체인
+    unsigned char *data;
+} GzChunk;
+
+// gzip 이미지: 체크포인트 색인과 청크 캐시 (여러 스레드가 읽으므로 lock으로 보호)
+typedef struct GzImage {
+    int fd;                  // 압축 파일 fd
+    uint64_t usize;          // 압축 해제 크기
+    GzPoint *points;
+    int npoints;
+    GzChunk *chunks;
+    int nchunks;
+    int *hash;               // 청크 번호 해시 → 칸 번호 (GZ_CACHE_CHUNKS * 2 버킷)
+    int lru_head, lru_tail;
+    struct GzStream *cur;    // 마지막으로 풀던 스트림 (다음 실패가 더 뒤면 이어서 품)
+    uint64_t cur_pos;        // cur가 다음에 내놓을 압축 해제 오프셋
+    unsigned char *cbuf;     // 청크 하나를 푸는 작업 버퍼
+    uint64_t hits, misses;
+    pthread_mutex_t lock;
+    struct GzImage *next;    // 열린 gzip 이미지 목록 (fd로 찾기 위함)
+} GzImage;
+
+// 공유 블록 캐시: 블록 내용 하나 (내용이 같은 블록 키들이 함께 가리키고 refs가 0이 되면 해제)
+typedef struct BcData {
+    uint64_t h1, h2;         // 내용 해시 (dups와 같은 128비트 해시)
+    uint32_t len;
+    uint32_t refs;           // 이 내용을 가리키는 키 수
+    struct BcData *hnext;    // 내용 해시 버킷 체인
+    unsigned char data[];
+} BcData;
+
+// 공유 블록 캐시: (이미지, 세대, 블록 번호) → 내용
+typedef struct BcKey {
+    uint32_t id, gen;
+    uint64_t blk;
+    BcData *data;
+    struct BcKey *hnext;     // 키 해시 버킷 체인
+    struct BcKey *lru_prev, *lru_next;  // LRU 리스트 (앞이 최근)
+} BcKey;
+
+// 블록 캐시를 쓰는 이미지 (fd로 찾음, reload하면 gen을 올려 이전 블록을 무효화)
+typedef struct BcImage {
+    int fd;
+    uint32_t id, gen;
+    uint32_t block_size;
+    struct BcImage *next;
+} BcImage;
+
+// open으로 연 이름 붙은 이미지 (현재 use 중인 세션의 상태는 전역 변수에 있음)
+typedef struct Session {
+    char *name;
+    ImageState st;
+    struct Session *next;
+} Session;
+
+// import: 가져올 호스트 항목 하나 (호스트 트리를 그대로 옮긴 계획)
+typedef struct ImportEntry {
+    char *name;
+    char *host_path;
+    struct stat st;
+    uint8_t file_type;       // EXT2_FT_*
+    uint32_t ino;            // 할당한 inode (하드 링크면 link_of와 같음)
+    uint32_t nlinks;         // 이미지에서의 링크 수
+    struct ImportEntry *link_of;  // 같은 호스트 inode를 먼저 가져온 항목 (하드 링크)
+    struct ImportEntry *parent;
+    struct ImportEntry **children;
+    int nchildren, cap;
+    char *symlink;           // 심볼릭 링크 대상
+    BlockRun *ranges;        // 데이터가 있는 논리 블록 구간 (hole 제외)
+    int nranges;
+    char *content;           // 메모리에서 만든 블록 내용 (디렉토리, 긴 심볼릭 링크)
+    uint64_t size;           // 디렉토리 크기
+    uint32_t i_block[15];    // 배치한 블록 맵
+} ImportEntry;
+
+// import: 블록 맵 배치 상태 (높이 h: 0 = 데이터를 가리키는 간접 블록, 1 = 이중, 2 = 삼중)
+typedef struct ImportMap {
+    struct ImportCtx *ctx;   // NULL이면 블록 수만 셈
+    uint32_t i_block[15];
+    uint32_t *buf[3];        // 높이별 현재 간접 블록 내용
+    uint32_t phys[3];
+    uint64_t key[3];         // 현재 간접 블록이 담당하는 구간 (바뀌면 새 블록)
+    uint64_t count;          // 배치한 블록 수 (데이터 + 간접)
+    uint64_t meta;           // 간접 블록 수
+    uint32_t last_lb, last_phys;
+    bool has_last;
+} ImportMap;
+
+// import: 나중에 한꺼번에 쓸 메타데이터 블록 구간
+typedef struct ImportWrite {
+    uint32_t blk;
+    uint32_t nblk;
+    char *buf;
+} ImportWrite;
+
+// import: 나중에 inode 테이블에 쓸 inode (fresh면 확장 영역까지 새로 씀)
+typedef struct ImportInode {
+    uint32_t ino;
+    bool fresh;
+    struct ext2_inode rec;
+} ImportInode;
+
+// import: 비트맵/그룹 디스크립터 사본과 예약된 쓰기
+typedef struct ImportCtx {
+    int wfd;                 // 쓰기용 이미지 fd
+    uint8_t *bbm, *ibm;      // 그룹별 블록/inode 비트맵 (그룹마다 block_size 바이트)
+    bool *bbm_dirty, *ibm_dirty;
+    struct ext2_group_desc *gds;
+    uint32_t *goal;          // 그룹별 다음 블록 할당 시작 위치
+    uint32_t free_inodes, free_blocks;
+    uint32_t no_run_len;     // 이 길이 이상의 연속 여유 구간은 없음 (바로 나눠 할당)
+    BlockRun *runs;          // 현재 항목에 할당한 물리 구간
+    int nruns, runs_cap, run_idx;
+    uint32_t run_off;
+    ImportWrite *writes;
+    int nwrites, writes_cap;
+    ImportInode *inodes;
+    int ninodes, inodes_cap;
+    char *iobuf;
+    int ndirs, nfiles, nsymlinks, nspecial, hardlinks, failed, skipped, meta_writes;
+    uint64_t bytes, blocks, extents, meta_blocks;
+    bool error;              // 이미지 쓰기 실패 (중단)
+} ImportCtx;
+
+// imgdiff: 비교 진행 상태
+typedef struct DiffCtx {
+    ImageState *a;           // 기준 이미지 (현재 이미지)
+    ImageState *b;           // 비교 대상 이미지
+    uint64_t added, removed, modified;
+    uint64_t content_files;  // 내용까지 비교한 파일 수
+    uint64_t content_bytes;
+} DiffCtx;
+
+// 출력 버퍼: 한 번에 크게 모아 write로 내보냄 (stdio를 거치지 않음)
+typedef struct OutBuf {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fd;
+} OutBuf;
+
+// print -x 상태: 청크 경계에 걸친 줄과 같은 줄 반복 생략(*) 상태
+typedef struct HexDump {
+    uint64_t off;                         // 다음 줄의 파일 오프셋
+    unsigned char carry[HEXDUMP_LINE];    // 앞 청크 끝에 남은 한 줄 미만의 바이트
+    size_t ncarry;
+    unsigned char prev[HEXDUMP_LINE];     // 마지막으로 출력한 줄 (반복 비교)
+    bool have_prev;
+    bool prev_zero;                       // prev가 모두 0
+    bool squeezing;                       // prev와 같은 줄을 "*"로 생략하는 중
+} HexDump;
+
+// 반복 순회용 디렉토리 한 단계
+typedef struct TreeFrame {
+    Node *next;                  // 다음에 출력할 자식
+    struct ext2_inode *inodes;   // 자식들의 inode (크기/권한/JSON 출력일 때 일괄 읽기)
+    int idx;                     // next의 inodes 인덱스
+    size_t prefix_len;           // 이 단계 자식들이 쓰는 prefix 길이
+    size_t path_len;             // 이 디렉토리 경로 길이 (NDJSON)
+    bool first;                  // JSON: 아직 자식을 하나도 쓰지 않음
+} TreeFrame;
+
+// 이미지 읽기 통계 스냅샷 (--time)
+typedef struct IoStat {
+    uint64_t preads;
+    uint64_t uring;
+    uint64_t bytes;
+    uint64_t gz_hits;        // gzip 이미지 청크 캐시 적중
+    uint64_t gz_misses;      // 체크포인트부터 압축을 풀어야 했던 횟수
+} IoStat;
+
+// 계측 카운터 종류 (stats)
+enum StatId {
+    STAT_PREADS,             // pread 호출 수
+    STAT_URING,              // io_uring으로 완료된 읽기 수
+    STAT_BYTES,              // 이미지에서 읽은 바이트 수
+    STAT_GZ_HITS,            // gzip 청크 캐시 적중 수
+    STAT_GZ_MISSES,          // gzip 청크 캐시 실패 수
+    STAT_BCACHE_HITS,        // 공유 블록 캐시에서 찾은 블록 수
+    STAT_BCACHE_MISSES,      // 이미지에서 읽어 캐시에 넣은 블록 수
+    STAT_INODE_READS,        // 읽은 inode 수
+    STAT_INODE_BATCHED,      // 그중 일괄 읽기로 읽은 수
+    STAT_LOOKUP_HITS,        // 경로 구성 요소를 메모리 트리에서 찾은 수
+    STAT_LOOKUP_MISSES,      // 디스크의 디렉토리에서 찾아야 했던 수
+    STAT_SYMLINK_FOLLOWS,    // 경로 조회에서 따라간 심볼릭 링크 수
+    STAT_SYMLINK_MEMO_HITS,  // 그중 노드에 보관한 결과를 그대로 쓴 수
+    STAT_NODES_ALLOC,        // 만든 노드 수
+    STAT_NODES_FREED,        // 해제한 노드 수
+    STAT_NODE_BYTES_ALLOC,   // 노드 구조체 + 이름에 할당한 바이트
+    STAT_NODE_BYTES_FREED,
+    STAT_COUNT
+};
+
+// 구간 타이머 종류
+enum StatPhase {
+    PHASE_LOAD,              // 디렉토리 적재 (load_dirs)
+    PHASE_LOOKUP,            // 경로 조회 (find_node)
+    PHASE_RENDER,            // 트리 출력 (render_tree)
+    PHASE_COUNT
+};
+
+// 스레드마다 하나씩 있는 카운터 블록: 자기 스레드만 쓰므로 잠금/원자적 더하기 없이 갱신
+// 스레드가 끝나면 값을 stat_retired에 더하고 해제
+typedef struct StatBlock {
+    uint64_t v[STAT_COUNT];
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t phase_calls[PHASE_COUNT];
+    struct StatBlock *next;
+} StatBlock;
+
+// 구간 하나의 시작 시각 (같은 구간이 중첩되면 가장 바깥 것만 잼)
+typedef struct PhaseTimer {
+    int phase;
+    bool outer;
+    struct timespec t0;
+} PhaseTimer;
 
 // 전역 파일 디스크립터, 슈퍼블록, 그룹 디스크립터, 트리 루트
 int img_fd;
+int img_direct_fd = -1;      // 대량 스캔용 O_DIRECT fd (필요할 때 연다)
+const char* img_path;        // 이미지 파일 경로
 struct ext2_super_block sb;
 struct ext2_group_desc gd;
+struct ext2_group_desc* gdt;  // 전체 그룹 디스크립터 테이블
+uint32_t group_count;        // 블록 그룹 개수
+int io_queue_depth = IO_DEFAULT_DEPTH;  // 일괄 읽기 시 동시에 진행할 요청 수
+// 계측 카운터 (stats, --time): 스레드별 블록 목록과 끝난 스레드들의 합계
+StatBlock *stat_blocks;
+StatBlock stat_retired;
+StatBlock stat_base;         // stats -r 로 초기화한 시점의 합계
+pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t stat_key;
+pthread_once_t stat_key_once = PTHREAD_ONCE_INIT;
+__thread StatBlock *stat_tls;
+__thread int phase_depth[PHASE_COUNT];
+bool stats_at_exit;          // --stats: 종료할 때 계측 카운터를 표준 에러에 출력
+bool time_commands;          // --time: 명령마다 시간/읽기 통계를 표준 에러에 출력
+bool lazy_load;              // -l: 필요한 디렉토리만 적재 (reload도 새 디렉토리를 미리 읽지 않음)
+bool auto_reload;            // --auto-reload: 명령마다 이미지가 바뀌었는지 확인해 reload
+bool prefetch_enabled;       // --prefetch: 프롬프트에서 기다리는 동안 inode 테이블을 미리 읽음
+struct timespec img_seen_mtime;  // 마지막으로 트리를 맞춘 시점의 이미지 파일 수정 시간
 Node* root;
+InoMap ino_map;              // 전역 트리(root 아래)의 inode → 노드 맵
+uint64_t tree_gen;           // 노드를 해제하거나 reload할 때마다 증가 (심볼릭 링크 결과 무효화)
+BlkOwner *blk_index;         // blk2path 역색인 (처음 쓸 때 읽거나 만듦)
+uint64_t blk_index_cnt;
+uint32_t blk_index_maxlen;   // 가장 긴 구간의 블록 수 (겹친 구간을 찾을 때 거슬러 올라갈 범위)
+bool blk_index_ready;
+ImageState diff_image;       // imgdiff로 연 두 번째 이미지
+GzImage *img_gz;             // 현재 이미지가 gzip이면 체크포인트 색인/청크 캐시 (아니면 NULL)
+size_t bcache_budget = (size_t)BCACHE_DEFAULT_MB * 1024 * 1024;  // 공유 블록 캐시 예산 (0이면 사용 안 함)
+Session *sessions;           // open으로 연 이미지 목록 (처음 이미지는 "main")
+Session *cur_session;        // use로 고른 현재 세션
 
 // 함수 프로토타입
 void read_inode(int img_fd, uint32_t ino, struct ext2_inode* inode);
 void read_superblock(int img_fd, struct ext2_super_block *sb);
 void read_group_desc(int img_fd, uint32_t group, struct ext2_group_desc *gd, uint32_t block_size);
+void read_group_desc_table(int img_fd);
+size_t group_desc_size(void);
+void read_inodes_batch(int img_fd, const uint32_t *inos, int n, struct ext2_inode *out);
+int io_read_batch(int fd, IoReq *reqs, int n);
+int io_read_batch_raw(int fd, IoReq *reqs, int n);
+ssize_t img_pread(int fd, void *buf, size_t len, off_t off);
+ssize_t img_pread_raw(int fd, void *buf, size_t len, off_t off);
+const char *io_backend_name(void);
+bool gz_detect(int fd);
+GzImage *gz_open(int fd, const char *path);
+void gz_close(GzImage *gz);
+GzImage *gz_find(int fd);
+ssize_t gz_pread(GzImage *gz, void *buf, size_t len, off_t off);
+void bcache_register(int fd, uint32_t block_size);
+void bcache_unregister(int fd);
+void bcache_invalidate(int fd);
+BcImage *bcache_find(int fd);
+ssize_t bcache_pread(BcImage *im, void *buf, size_t len, off_t off);
+int bcache_read_batch(BcImage *im, IoReq *reqs, int n);
+void bcache_usage(uint64_t *keys, uint64_t *unique, uint64_t *bytes);
 
 void insert_child_sorted(Node* parent, Node* child);
 void build_tree(Node* parent);
+void load_dir(Node* dir);
 void format_perm(uint16_t mode, char buf[11]);
-void print_tree(Node* n, const char* prefix, int recursive, int show_size, int show_perm);
+void out_init(OutBuf *ob, int fd);
+void out_flush(OutBuf *ob);
+void out_free(OutBuf *ob);
+void out_write(OutBuf *ob, const char *s, size_t n);
+void out_str(OutBuf *ob, const char *s);
+void out_printf(OutBuf *ob, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void out_json_str(OutBuf *ob, const char *s, size_t n);
+void render_tree(OutBuf *ob, Node *n, const char *path, int recursive,
+                 int show_size, int show_perm, int format, int *dirs, int *files);
 void count_tree(Node* n, int* dirs, int* files);
 
-void command_tree(const char* path, int recursive, int show_size, int show_perm);
-void command_print(const char* path, int max_lines);
+void command_tree(const char* path, int recursive, int show_size, int show_perm, int format);
+void command_print(const char* path, int max_lines, int io_mode, int format);
 void command_help(const char* cmd);
 void command_help_all();
 void command_help_tree();
@@ -132,852 +869,8897 @@ void command_help_help();
 
 bool validate_path(const char *path);
 Node* find_node(Node* current, const char* path);
+int dir_lookup(uint32_t dir_ino, const char *name, uint32_t *out_ino, uint8_t *out_type);
+uint32_t inode_bmap(int img_fd, const struct ext2_inode *ino, uint32_t logical);
+int ext2_dirhash(const char *name, int len, int version, uint32_t *out_hash);
 Node* create_node(const char* name, uint32_t ino, uint8_t type);
 void free_tree(Node* n);
+void ino_map_insert(Node* n);
+void ino_map_remove(Node* n);
+Node* ino_map_first(uint32_t ino);
+Node* ino_map_next(Node* n);
+void node_path(const Node* n, char* buf, size_t len);
+void command_ino2path(uint32_t ino);
+void command_help_ino2path();
 
 int collect_data_blocks(int img_fd, const struct ext2_inode *ino, unsigned int block_size, uint32_t **out_blocks);
+int collect_block_runs(int img_fd, const struct ext2_inode *ino, unsigned int block_size, BlockRun **out_runs);
+int collect_block_map(int img_fd, const struct ext2_inode *ino, unsigned int block_size,
+                      BlockRun **out_runs, uint32_t **out_meta, int *out_nmeta);
+uint64_t inode_file_size(const struct ext2_inode *ino);
+void file_stream_init(FileStream *fs, const struct ext2_inode *ino, const BlockRun *runs, int nruns, int io_mode);
+ssize_t file_stream_next(FileStream *fs, const char **data, bool *hole);
+void file_stream_free(FileStream *fs);
+int scan_open(ScanReader *sr, const ScanRange *ranges, int nranges);
+ssize_t scan_next(ScanReader *sr, const char **data, uint64_t *user_off);
+void scan_close(ScanReader *sr);
+int runs_to_scan_ranges(const BlockRun *runs, int nruns, uint64_t size, ScanRange **out);
+
+void command_export(const char* img_path, const char* host_path, int nthreads, int io_mode);
+void command_bench(void);
+void command_help_bench();
+void command_help_export();
+void command_df(int nthreads);
+void command_frag(const char *path);
+void command_help_df();
+void command_help_frag();
+uint32_t group_block_count(uint32_t g);
+bool ext4_group_flags_valid(void);
+void command_check(int nthreads);
+void command_help_check();
+bool inode_path(uint32_t ino, char *buf, size_t len);
+void command_blk2path(uint32_t block, bool rebuild);
+void command_help_blk2path();
+int analyze_thread_count(int nthreads, int njobs);
+bool execute_command(char* line);
+void image_stash(ImageState *st);
+void image_restore(const ImageState *st);
+void image_switch(ImageState *from, ImageState *to);
+int image_open(ImageState *st, const char *path);
+void image_close(ImageState *st);
+Session *session_find(const char *name);
+void command_open(const char *name, const char *path);
+void command_use(const char *name);
+void command_close(const char *name);
+void command_help_open();
+void command_help_use();
+void command_help_close();
+void command_imgdiff(const char *other, const char *path);
+void command_dups(const char *path, int nthreads);
+void command_help_dups();
+void command_help_imgdiff();
+int find_type_code(char t);
+void command_find(const char *path, const char *pattern, int type);
+void command_du(const char *path, bool summary);
+void command_summary(const char *path);
+void command_help_summary();
+void command_help_find();
+void command_help_du();
+int serve_main(const char *sock_path);
+bool run_command(char* line);
+bool image_changed(void);
+void reload_tree(bool verbose);
+bool dir_times_settled(const struct ext2_inode *ino);
+void command_reload(void);
+void command_help_reload();
+void command_import(const char *host_dir, const char *img_dir, bool dry_run);
+void command_help_import();
+void io_stat_snapshot(IoStat *st);
+StatBlock *stat_register(void);
+void stat_sum(StatBlock *out);
+void phase_begin(PhaseTimer *pt, int phase);
+void phase_end(PhaseTimer *pt);
+void command_stats(bool reset, FILE *out);
+void prefetch_start(void);
+void prefetch_hold(bool busy);
+void prefetch_finish(void);
+void prefetch_report(FILE *out);
+void command_help_stats();
+void time_report(const char *label, const struct timespec *t0, const IoStat *before);
+int run_command_string(const char* cmds);
+int run_script(const char* path);
+int client_main(const char *sock_path, int argc, char *argv[]);
+
+// 현재 스레드의 카운터에 n을 더함 (다른 스레드가 합계를 읽으므로 relaxed store)
+static inline void stat_add(int id, uint64_t n) {
+    StatBlock *b = stat_tls ? stat_tls : stat_register();
+    __atomic_store_n(&b->v[id], b->v[id] + n, __ATOMIC_RELAXED);
+}
 
 int main(int argc, char* argv[]) {
-    // 인자 개수 검증
-    if (argc != 2) {
-        fprintf(stderr, "Usage Error : %s <EXT2_IMAGE>\n", argv[0]);
+    // 옵션 처리: -l 이면 시작 시 전체 트리를 만들지 않고 필요한 디렉토리만 적재
+    // --serve SOCKET: 적재한 트리를 유지한 채 소켓으로 명령을 받는 서버 모드
+    // --connect SOCKET [COMMAND]...: 실행 중인 서버에 명령을 보내는 클라이언트 모드
+    // -c "CMD; CMD" / -f SCRIPT: 프롬프트 없이 명령들을 실행하고 종료
+    // --time: 명령마다 걸린 시간, pread 수, 읽은 바이트 수를 표준 에러에 출력
+    // --auto-reload: 명령을 실행하기 전마다 이미지가 바뀌었는지 확인해 바뀐 디렉토리만 다시 읽음
+    // --stats: 종료할 때 I/O, inode, 노드, 구간 시간 카운터를 표준 에러에 출력
+    // --cache-mb N: 모든 이미지가 함께 쓰는 공유 블록 캐시 예산 (MB, 0이면 캐시 안 함)
+    // --prefetch: 명령을 기다리는 동안 낮은 우선순위 스레드가 inode 테이블을 그룹 순서대로 미리 읽음
+    static const struct option long_opts[] = {
+        {"serve",   required_argument, NULL, 'S'},
+        {"connect", required_argument, NULL, 'C'},
+        {"time",    no_argument,       NULL, 'T'},
+        {"auto-reload", no_argument,   NULL, 'R'},
+        {"stats",   no_argument,       NULL, 'A'},
+        {"cache-mb", required_argument, NULL, 'M'},
+        {"prefetch", no_argument,      NULL, 'P'},
+        {NULL, 0, NULL, 0}
+    };
+    const char* serve_path = NULL;
+    const char* connect_path = NULL;
+    const char* cmds = NULL;
+    const char* script = NULL;
+    bool usage_error = false;
+    bool cache_mb_set = false;   // --cache-mb를 줬는지 (기본값과 같은 값이어도 --connect와 함께 쓸 수 없음)
+    int opt;
+    // '+': 첫 비-옵션 인자에서 멈춤 (클라이언트 명령의 -r 등을 옵션으로 해석하지 않도록)
+    while ((opt = getopt_long(argc, argv, "+lc:f:", long_opts, NULL)) != -1) {
+        if (opt == 'l') {
+            lazy_load = true;
+        } else if (opt == 'S') {
+            serve_path = optarg;
+        } else if (opt == 'C') {
+            connect_path = optarg;
+        } else if (opt == 'c') {
+            cmds = optarg;
+        } else if (opt == 'f') {
+            script = optarg;
+        } else if (opt == 'T') {
+            time_commands = true;
+        } else if (opt == 'R') {
+            auto_reload = true;
+        } else if (opt == 'A') {
+            stats_at_exit = true;
+        } else if (opt == 'P') {
+            prefetch_enabled = true;
+        } else if (opt == 'M') {
+            char *end;
+            long mb = strtol(optarg, &end, 10);
+            if (*end || mb < 0 || mb > 1024 * 1024)
+                usage_error = true;
+            else
+                bcache_budget = (size_t)mb * 1024 * 1024;
+            cache_mb_set = true;
+        } else {
+            usage_error = true;
+        }
+    }
+    if (connect_path) {
+        if (serve_path || lazy_load || auto_reload || cmds || script || time_commands || stats_at_exit
+            || prefetch_enabled || cache_mb_set) {
+            fprintf(stderr, "Usage Error : %s --connect SOCKET [COMMAND]...\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        return client_main(connect_path, argc - optind, argv + optind) == 0 ? 0 : EXIT_FAILURE;
+    }
+    // 인자 개수 검증 (서버/-c/-f 는 함께 쓸 수 없음)
+    if (usage_error || argc - optind != 1 || (!!serve_path + !!cmds + !!script) > 1) {
+        fprintf(stderr, "Usage Error : %s [-l] [--time] [--stats] [--cache-mb N] [--prefetch] [--auto-reload] [--serve SOCKET | -c \"CMD; CMD\" | -f SCRIPT] <EXT2_IMAGE>\n", argv[0]);
+        fprintf(stderr, "              %s --connect SOCKET [COMMAND]...\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // ext2 이미지 파일 오픈
-    img_fd = open(argv[1], O_RDONLY);
+    // ext2 이미지 파일 오픈 (경로는 세션이 닫을 때 해제하므로 복사)
+    img_path = strdup(argv[optind]);
+    img_fd = open(img_path, O_RDONLY);
     if (img_fd < 0) {
         perror("open");
         exit(EXIT_FAILURE);
     }
+    // gzip 압축 이미지면 체크포인트 색인을 읽거나 만들어 임의 접근
+    if (gz_detect(img_fd) && !(img_gz = gz_open(img_fd, img_path)))
+        exit(EXIT_FAILURE);
 
     // 슈퍼블록과 첫 번째 그룹 디스크립터 로드
     read_superblock(img_fd, &sb);
+    struct stat img_st;
+    if (fstat(img_fd, &img_st) == 0)
+        img_seen_mtime = img_st.st_mtim;
 
+    // gzip 이미지는 자체 청크 캐시를 쓰므로 블록 캐시에 등록하지 않음
+    if (!img_gz)
+        bcache_register(img_fd, block_size);
     read_group_desc(img_fd, 0, &gd, block_size);
+    read_group_desc_table(img_fd);
 
     // 루트 노드 생성 (inode 2는 ROOT)
     root = create_node("/", 2, /*EXT2_FT_DIR=*/2);
-    build_tree(root);  // 디렉토리 구조 트리 빌드
-
-    // 명령 대기 루프
-    char line[256];
-    while (1) {
-        printf("20211519> ");
-        if (!fgets(line, sizeof(line), stdin)) break;
-        char* save = strdup(line);
-        char* cmd = strtok(line, " \t\n");
-        if (!cmd) {
-            free(save);
-            continue;
-        }
-        // tree 명령어
-        if (strcmp(cmd, "tree") == 0) {
-            int r = 0, s = 0, p = 0;
-            char* path = NULL;
-            char* tok = strtok(NULL, " \t\n");
-            int invalid = 0;
-
-            while (tok) {
-                if (tok[0] == '-') {
-                    // 옵션 문자열 한 글자씩 검사
-                    for (int i = 1; tok[i]; i++) {
-                        if (tok[i] == 'r') {
-                            if (r) { invalid = 1; break; }  // 이미 -r 이 켜진 상태라면 error
-                            r = 1;
-                        }
-                        else if (tok[i] == 's') {
-                            if (s) { invalid = 1; break; }
-                            s = 1;
-                        }
-                        else if (tok[i] == 'p') {
-                            if (p) { invalid = 1; break; }
-                            p = 1;
-                        }
-                        else {
-                            invalid = 1;  // 정의되지 않은 옵션 문자
-                            break;
-                        }
-                    }
-                    if (invalid) break;
-                }
-                else {
-                    if (!path) {
-                        path = tok; // 첫 번째 비-옵션 토큰은 경로
-                    }
-                    else {
-                        // 이미 경로가 정해졌는데 또 나왔다면 에러
-                        invalid = 1;
-                        break;
-                    }
-                }
-                tok = strtok(NULL, " \t\n");
-            }
-
-            // 잘못된 옵션이 하나라도 있으면 Usage만 출력하고 루프 재시작
-            if (invalid) {
-                command_help_tree();
-                free(save);
-                continue;
-            }
-
-            if (!path) path = ".";
-            if (!validate_path(path)) { 
-	        free(save);
-	        continue; 
-	    }
-
-            command_tree(path, r, s, p);
-            free(save);
-            continue;
-        }
-        //  print 분기
-        else if (strcmp(cmd, "print") == 0) {
-            int n = 0;
-	    bool has_n = false;
-	    bool zero_n = false;
-            int invalid = 0, missing_arg = 0;
-            char* path = NULL;
-            char* tok = strtok(NULL, " \t\n");
-
-	    while (tok) {
-	        if (strcmp(tok, "-n") == 0) {
-	            has_n = true;
-	            tok = strtok(NULL, " \t\n");
-	            if (!tok) {           // 숫자 없이 -n만 들어온 경우
-	                missing_arg = 1;
-	                break;
-	            }
-	            int raw_n = atoi(tok);
-	            if (raw_n < 0) {      // 음수면 에러
-	                fprintf(stderr, "print: invalid number of lines: %d\n", raw_n);
-	                invalid = 1;
-	                break;
-	            }
-	            if (raw_n == 0) {     // 0이면 출력 없이 바로 프롬프트
-	                zero_n = true;
-	                break;
-	            }
-	            n = raw_n;            // 정상 양수
-	        }
-	        else if (!path) {
-	            path = tok;           // 첫 번째 non-option은 경로
-	        }
-	        else {
-	            invalid = 1;          // 알 수 없는 토큰
-	            break;
-	        }
-	        tok = strtok(NULL, " \t\n");
-	    }
-
-            if(invalid){
-                command_help_print();
-                free(save);
-                continue;
-            }
-            if (missing_arg) {
-                fprintf(stderr, "print: option requires an argument -- 'n'\n\n");
-                free(save);
-                continue;
-            }
-	    if(zero_n){
-		free(save);
-		continue;
-	    }
+    ino_map_insert(root);  // root 아래에 붙는 노드들은 inode 맵에 자동 등록
+    if (!lazy_load) {
+        IoStat before;
+        struct timespec t0;
+        io_stat_snapshot(&before);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        build_tree(root);  // 디렉토리 구조 트리 빌드
+        if (time_commands)
+            time_report("(load tree)", &t0, &before);
+    }
+    // 처음 이미지는 "main" 세션 (상태는 전역 변수에 있고 다른 세션을 use하면 st에 보관)
+    cur_session = sessions = calloc(1, sizeof(Session));
+    cur_session->name = strdup("main");
+    // 트리 적재가 끝난 뒤 시작해 적재와 디스크를 다투지 않음
+    if (prefetch_enabled)
+        prefetch_start();
 
-            if (!path) {
-                command_help_print();
-                free(save);
-                continue;
-            }
+    int ret = 0;
+    if (serve_path) {
+        // 서버 모드: 프롬프트 대신 소켓으로 명령 대기
+        if (serve_main(serve_path) < 0) ret = EXIT_FAILURE;
+    } else if (cmds) {
+        run_command_string(cmds);
+    } else if (script) {
+        if (run_script(script) < 0) ret = EXIT_FAILURE;
+    } else {
+        // 명령 대기 루프 (줄 길이 제한 없이 getline으로 읽음)
+        char* line = NULL;
+        size_t cap = 0;
+        while (1) {
+            printf("20211519> ");
+            if (getline(&line, &cap, stdin) < 0) break;
+            if (!run_command(line)) break;
+        }
+        free(line);
+    }
 
-            if (!validate_path(path)) { 
-                free(save);
-                continue; 
-            }
+    prefetch_finish();
+    if (stats_at_exit) {
+        // stats -r 와 상관없이 시작부터의 합계
+        memset(&stat_base, 0, sizeof(stat_base));
+        fflush(stdout);
+        command_stats(false, stderr);
+    }
 
-            // 노드 찾기
-            Node* tgt = find_node(root, path);
-            if (!tgt) {
-                command_help_print();
-                free(save);
-                continue;
-            }
-            if (tgt->file_type != 1) {
-                fprintf(stderr, "Error: '%s' is not file\n\n", path);
-                free(save);
-                continue;
-            }
+    // 메모리 해제 및 파일 닫기: 현재 세션을 보관한 뒤 모든 세션을 같은 방식으로 닫음
+    image_close(&diff_image);
+    image_stash(&cur_session->st);
+    while (sessions) {
+        Session *s = sessions;
+        sessions = s->next;
+        image_close(&s->st);
+        free(s->name);
+        free(s);
+    }
+    return ret;
+}
 
-            // 실제 출력
-            command_print(path, has_n ? n : 0);
-            free(save);
-            continue;
-        }
+// 현재까지의 이미지 읽기 통계
+void io_stat_snapshot(IoStat *st) {
+    StatBlock t;
+    stat_sum(&t);
+    st->preads = t.v[STAT_PREADS];
+    st->uring = t.v[STAT_URING];
+    st->bytes = t.v[STAT_BYTES];
+    st->gz_hits = t.v[STAT_GZ_HITS];
+    st->gz_misses = t.v[STAT_GZ_MISSES];
+}
 
-        // help 명령어
-        else if (strcmp(cmd, "help") == 0) {
-            char* arg = strtok(NULL, " \t\n");
-            command_help(arg);
-        }
-        // exit
-        else if (strcmp(cmd, "exit") == 0) {
+// 끝나는 스레드의 카운터를 합계에 옮기고 블록 해제
+static void stat_retire(void *p) {
+    StatBlock *b = p;
+    pthread_mutex_lock(&stat_lock);
+    for (int i = 0; i < STAT_COUNT; i++)
+        stat_retired.v[i] += b->v[i];
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        stat_retired.phase_ns[i] += b->phase_ns[i];
+        stat_retired.phase_calls[i] += b->phase_calls[i];
+    }
+    for (StatBlock **pp = &stat_blocks; *pp; pp = &(*pp)->next) {
+        if (*pp == b) {
+            *pp = b->next;
             break;
         }
-        else {
-            command_help_all();
-        }
     }
+    pthread_mutex_unlock(&stat_lock);
+    free(b);
+}
 
-    // 메모리 해제 및 파일 닫기
-    free_tree(root);
-    close(img_fd);
-    return 0;
+static void stat_key_init(void) {
+    pthread_key_create(&stat_key, stat_retire);
 }
 
-// inode 로드: 그룹/인덱스 계산 후 해당 위치에서 읽기
-void read_inode(int img_fd, uint32_t ino, struct ext2_inode *inode) {
-    // 1) 그룹 번호, 그룹 내 인덱스
-    uint32_t group = (ino - 1) / inodes_per_group;
-    uint32_t index = (ino - 1) % inodes_per_group;
+// 현재 스레드의 카운터 블록을 만들어 목록에 등록 (스레드마다 처음 한 번)
+StatBlock *stat_register(void) {
+    StatBlock *b = calloc(1, sizeof(StatBlock));
+    pthread_once(&stat_key_once, stat_key_init);
+    pthread_mutex_lock(&stat_lock);
+    b->next = stat_blocks;
+    stat_blocks = b;
+    pthread_mutex_unlock(&stat_lock);
+    pthread_setspecific(stat_key, b);
+    stat_tls = b;
+    return b;
+}
 
-    // 2) 해당 그룹 디스크립터 읽기
-    struct ext2_group_desc gd;
-    read_group_desc(img_fd, group, &gd, block_size);
+// 모든 스레드 카운터의 합계
+void stat_sum(StatBlock *out) {
+    pthread_mutex_lock(&stat_lock);
+    *out = stat_retired;
+    for (StatBlock *b = stat_blocks; b; b = b->next) {
+        for (int i = 0; i < STAT_COUNT; i++)
+            out->v[i] += __atomic_load_n(&b->v[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            out->phase_ns[i] += __atomic_load_n(&b->phase_ns[i], __ATOMIC_RELAXED);
+            out->phase_calls[i] += __atomic_load_n(&b->phase_calls[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&stat_lock);
+    out->next = NULL;
+}
 
-    // 3) inode 테이블 시작 오프셋
-    off_t tbl_off = (off_t)gd.bg_inode_table * block_size;
+// 구간 시작: 같은 구간 안에서 다시 불리면(build_tree 안의 load_dirs 등) 바깥 구간만 잼
+void phase_begin(PhaseTimer *pt, int phase) {
+    pt->phase = phase;
+    pt->outer = phase_depth[phase]++ == 0;
+    if (pt->outer)
+        clock_gettime(CLOCK_MONOTONIC, &pt->t0);
+}
 
-    // 4) 테이블 내 offset
-    off_t ino_off = tbl_off + (off_t)index * inode_size;
+void phase_end(PhaseTimer *pt) {
+    phase_depth[pt->phase]--;
+    if (!pt->outer) return;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t ns = (uint64_t)(t1.tv_sec - pt->t0.tv_sec) * 1000000000ull + t1.tv_nsec - pt->t0.tv_nsec;
+    StatBlock *b = stat_tls ? stat_tls : stat_register();
+    __atomic_store_n(&b->phase_ns[pt->phase], b->phase_ns[pt->phase] + ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->phase_calls[pt->phase], b->phase_calls[pt->phase] + 1, __ATOMIC_RELAXED);
+}
 
-    // 5) 실제 inode 읽기
-    if (pread(img_fd, inode, sizeof(*inode), ino_off) != sizeof(*inode)) {
-        perror("pread inode, error");
-        exit(EXIT_FAILURE);
+// stats: 시작(또는 마지막 stats -r) 이후의 계측 카운터 출력, reset이면 출력 후 기준점을 지금으로 옮김
+void command_stats(bool reset, FILE *out) {
+    StatBlock t;
+    stat_sum(&t);
+    const StatBlock *b = &stat_base;
+    uint64_t v[STAT_COUNT];
+    for (int i = 0; i < STAT_COUNT; i++)
+        v[i] = t.v[i] - b->v[i];
+    static const char *phase_names[PHASE_COUNT] = { "load", "lookup", "render" };
+
+    fprintf(out, "I/O     : %llu preads, %llu io_uring reads, %llu bytes read\n",
+            (unsigned long long)v[STAT_PREADS], (unsigned long long)v[STAT_URING],
+            (unsigned long long)v[STAT_BYTES]);
+    fprintf(out, "inodes  : %llu read (%llu in batches)\n",
+            (unsigned long long)v[STAT_INODE_READS], (unsigned long long)v[STAT_INODE_BATCHED]);
+    fprintf(out, "lookups : %llu names found in memory, %llu read from disk; %llu symlinks followed (%llu memoized)\n",
+            (unsigned long long)v[STAT_LOOKUP_HITS], (unsigned long long)v[STAT_LOOKUP_MISSES],
+            (unsigned long long)v[STAT_SYMLINK_FOLLOWS], (unsigned long long)v[STAT_SYMLINK_MEMO_HITS]);
+    if (img_gz || v[STAT_GZ_HITS] || v[STAT_GZ_MISSES])
+        fprintf(out, "gzip    : %llu chunk cache hits, %llu misses\n",
+                (unsigned long long)v[STAT_GZ_HITS], (unsigned long long)v[STAT_GZ_MISSES]);
+    if (bcache_budget) {
+        // 캐시 크기는 기준점과 무관한 현재 값
+        uint64_t keys, unique, bytes;
+        bcache_usage(&keys, &unique, &bytes);
+        fprintf(out, "bcache  : %llu block hits, %llu misses; %llu blocks cached as %llu unique, %.1f of %zu MB\n",
+                (unsigned long long)v[STAT_BCACHE_HITS], (unsigned long long)v[STAT_BCACHE_MISSES],
+                (unsigned long long)keys, (unsigned long long)unique,
+                bytes / (1024.0 * 1024.0), bcache_budget / (1024 * 1024));
     }
+    prefetch_report(out);
+    // 노드 수/바이트의 live 값은 기준점과 무관하게 전체 누적으로 계산
+    fprintf(out, "nodes   : %llu allocated, %llu freed, %llu live using %llu bytes\n",
+            (unsigned long long)v[STAT_NODES_ALLOC], (unsigned long long)v[STAT_NODES_FREED],
+            (unsigned long long)(t.v[STAT_NODES_ALLOC] - t.v[STAT_NODES_FREED]),
+            (unsigned long long)(t.v[STAT_NODE_BYTES_ALLOC] - t.v[STAT_NODE_BYTES_FREED]));
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        uint64_t calls = t.phase_calls[i] - b->phase_calls[i];
+        uint64_t ns = t.phase_ns[i] - b->phase_ns[i];
+        fprintf(out, "%-8s: %.3f ms in %llu calls\n", phase_names[i], ns / 1e6, (unsigned long long)calls);
+    }
+    fputc('\n', out);
+    if (reset)
+        stat_base = t;
+}
 
-    
+// --time 한 줄 출력: t0/before 이후 걸린 시간과 늘어난 읽기 통계
+void time_report(const char *label, const struct timespec *t0, const IoStat *before) {
+    struct timespec t1;
+    IoStat after;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    io_stat_snapshot(&after);
+    double ms = (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+    fflush(stdout);
+    fprintf(stderr, "[time] %s : %.3f ms, %llu preads, %llu io_uring reads, %llu bytes read",
+            label, ms, (unsigned long long)(after.preads - before->preads),
+            (unsigned long long)(after.uring - before->uring),
+            (unsigned long long)(after.bytes - before->bytes));
+    if (after.gz_hits != before->gz_hits || after.gz_misses != before->gz_misses)
+        fprintf(stderr, ", gzip chunks %llu hit / %llu miss",
+                (unsigned long long)(after.gz_hits - before->gz_hits),
+                (unsigned long long)(after.gz_misses - before->gz_misses));
+    fputc('\n', stderr);
 }
 
-// 슈퍼블록 로드: offset 1024에서 읽어와 전역 블록 크기/정수 설정
-void read_superblock(int img_fd, struct ext2_super_block *sb) {
-    // 1) superblock 읽기 (offset 1024)
-    if (pread(img_fd, sb, sizeof(*sb), SUPERBLOCK_OFFSET) != sizeof(*sb)) {
-        perror("pread superblock, error");
-        exit(EXIT_FAILURE);
+// 명령 한 줄 실행: --time이면 명령 문자열과 함께 시간/읽기 통계 출력
+// 명령이 도는 동안에는 미리 읽기 스레드를 멈춤 (대화형 명령이 디스크를 먼저 씀)
+bool run_command(char* line) {
+    prefetch_hold(true);
+    if (auto_reload && image_changed())
+        reload_tree(false);
+    if (!time_commands) {
+        bool keep = execute_command(line);
+        prefetch_hold(false);
+        return keep;
     }
 
+    // execute_command가 strtok으로 line을 바꾸므로 출력용 사본을 미리 만듦
+    char label[128];
+    const char* p = line + strspn(line, " \t");
+    size_t len = strcspn(p, "\r\n");
+    while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) len--;
+    if (len >= sizeof(label)) len = sizeof(label) - 1;
+    memcpy(label, p, len);
+    label[len] = '\0';
 
-    // 2) block_size = 1024 << s_log_block_size
-    block_size         = 1024 << sb->s_log_block_size;
-    inode_size         = sb->s_inode_size;
-    inodes_per_group   = sb->s_inodes_per_group;
+    IoStat before;
+    struct timespec t0;
+    io_stat_snapshot(&before);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bool keep = execute_command(line);
+    if (len > 0)
+        time_report(label, &t0, &before);
+    prefetch_hold(false);
+    return keep;
 }
 
-// 그룹 디스크립터 로드: 특정 그룹 번호에 맞는 디스크립터를 읽음
-void read_group_desc(int img_fd,
-                     uint32_t group,
-                     struct ext2_group_desc *gd,
-                     uint32_t block_size)
-{
-    const size_t GD_SIZE = sizeof(*gd);  // 32
-
-    // 1) 슈퍼블록이 속한 블록 번호
-    uint32_t sb_block     = SUPERBLOCK_OFFSET / block_size;  
-    // 2) 그룹 디스크립터 테이블 시작 블록 번호
-    uint32_t gd_table_blk = sb_block + 1;                     
-    // 3) 바이트 오프셋
-    off_t    off         = (off_t)gd_table_blk * block_size
-                          + (off_t)group * GD_SIZE;
-
-    if (pread(img_fd, gd, GD_SIZE, off) != GD_SIZE) {
-        perror("pread group_desc");
-        exit(EXIT_FAILURE);
+// -c: ';'로 구분된 명령들을 프롬프트 없이 차례로 실행 (exit이면 중단)
+int run_command_string(const char* cmds) {
+    char* buf = strdup(cmds);
+    char* rest = buf;
+    char* one;
+    while ((one = strsep(&rest, ";")) != NULL) {
+        if (!run_command(one)) break;
     }
+    free(buf);
+    return 0;
 }
 
-// 노드 생성: 이름, inode 번호, 타입으로 초기화
-Node* create_node(const char* name, uint32_t ino, uint8_t type) {
-    Node* n = malloc(sizeof(Node));
-    n->name = strdup(name);
-    n->inode_no = ino;
-    n->file_type = type;
-    n->first_child = NULL;
-    n->next_sibling = NULL;
-    return n;
+// -f: 스크립트 파일("-"이면 표준 입력)의 명령을 한 줄씩 실행, '#'로 시작하는 줄은 주석
+int run_script(const char* path) {
+    FILE* fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char* line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) >= 0) {
+        if (line[strspn(line, " \t")] == '#') continue;
+        if (!run_command(line)) break;
+    }
+    free(line);
+    if (fp != stdin) fclose(fp);
+    return 0;
 }
 
+// 명령어 한 줄 실행: exit이면 false, 그 외에는 true
+// 대화형 루프와 서버 모드가 함께 사용
+bool execute_command(char* line) {
+    char* cmd = strtok(line, " \t\n");
+    if (!cmd)
+        return true;
+    // tree 명령어
+    if (strcmp(cmd, "tree") == 0) {
+        int r = 0, s = 0, p = 0;
+        int format = TREE_TEXT;
+        char* path = NULL;
+        char* tok = strtok(NULL, " \t\n");
+        int invalid = 0;
 
-// 자식 노드를 '디렉토리 우선, 같은 타입 내에서는 이름 사전순'으로 삽입
-void insert_child_sorted(Node* parent, Node* child) {
-    Node **cur = &parent->first_child;
-    while (*cur) {
-        Node *cur_node = *cur;
-        // 1) child가 디렉토리이고 cur_node가 파일이면, 지금(cur)이 삽입 위치
-        if (child->file_type == EXT2_FT_DIR && cur_node->file_type != EXT2_FT_DIR) {
-            break;
-        }
-        // 2) child가 파일이고 cur_node가 디렉토리이면, 디렉토리 뒤로 건너뜀
-        if (child->file_type != EXT2_FT_DIR && cur_node->file_type == EXT2_FT_DIR) {
-            cur = &cur_node->next_sibling;
-            continue;
-        }
-        // 3) 동일 타입(둘 다 디렉토리이거나 둘 다 파일)일 때 이름 비교
-        if (strcmp(cur_node->name, child->name) < 0) {
-            cur = &cur_node->next_sibling;
-        } else {
-            break;
+        while (tok) {
+            if (strcmp(tok, "--json") == 0 || strcmp(tok, "--ndjson") == 0) {
+                if (format != TREE_TEXT) { invalid = 1; break; }  // 형식은 하나만
+                format = tok[2] == 'j' ? TREE_JSON : TREE_NDJSON;
+            }
+            else if (tok[0] == '-') {
+                // 옵션 문자열 한 글자씩 검사
+                for (int i = 1; tok[i]; i++) {
+                    if (tok[i] == 'r') {
+                        if (r) { invalid = 1; break; }  // 이미 -r 이 켜진 상태라면 error
+                        r = 1;
+                    }
+                    else if (tok[i] == 's') {
+                        if (s) { invalid = 1; break; }
+                        s = 1;
+                    }
+                    else if (tok[i] == 'p') {
+                        if (p) { invalid = 1; break; }
+                        p = 1;
+                    }
+                    else {
+                        invalid = 1;  // 정의되지 않은 옵션 문자
+                        break;
+                    }
+                }
+                if (invalid) break;
+            }
+            else {
+                if (!path) {
+                    path = tok; // 첫 번째 비-옵션 토큰은 경로
+                }
+                else {
+                    // 이미 경로가 정해졌는데 또 나왔다면 에러
+                    invalid = 1;
+                    break;
+                }
+            }
+            tok = strtok(NULL, " \t\n");
         }
-    }
-    // child를 cur 위치에 삽입
-    child->next_sibling = *cur;
-    *cur = child;
-}
 
+        // 잘못된 옵션이 하나라도 있으면 Usage만 출력하고 루프 재시작
+        if (invalid) {
+            command_help_tree();
+            return true;
+        }
 
-// 디렉토리 트리 구성: direct+indirect 블록 모두 순회 → 디렉토리 엔트리 읽기 → 자식 노드 생성/재귀
-void build_tree(Node* parent) {
-    struct ext2_inode ino;
-    read_inode(img_fd, parent->inode_no, &ino);
+        if (!path) path = ".";
+        if (!validate_path(path)) { 
+            return true; 
+        }
 
-    // 1) collect_data_blocks 로 모든 데이터 블록 번호(직접·간접) 얻어오기
-    uint32_t *blocks = NULL;
-    int nblocks = collect_data_blocks(img_fd, &ino, block_size, &blocks);
-    if (nblocks < 0) {
-        perror("collect_data_blocks 실패");
-        return;
+        command_tree(path, r, s, p, format);
+        return true;
     }
+    //  print 분기
+    else if (strcmp(cmd, "print") == 0) {
+        int n = 0;
+        int io_mode = IO_BUFFERED;
+        int format = PRINT_TEXT;
+        bool has_n = false;
+        bool zero_n = false;
+        int invalid = 0, missing_arg = 0;
+        char* path = NULL;
+        char* tok = strtok(NULL, " \t\n");
 
-    // 2) 블록별로 디렉토리 엔트리 파싱
-    for (int bi = 0; bi < nblocks; bi++) {
-        off_t blk_off = (off_t)blocks[bi] * block_size;
-        off_t cur = 0;
+        while (tok) {
+            if (strcmp(tok, "-n") == 0) {
+                has_n = true;
+                tok = strtok(NULL, " \t\n");
+                if (!tok) {           // 숫자 없이 -n만 들어온 경우
+                    missing_arg = 1;
+                    break;
+                }
+                int raw_n = atoi(tok);
+                if (raw_n < 0) {      // 음수면 에러
+                    fprintf(stderr, "print: invalid number of lines: %d\n", raw_n);
+                    invalid = 1;
+                    break;
+                }
+                if (raw_n == 0) {     // 0이면 출력 없이 바로 프롬프트
+                    zero_n = true;
+                    break;
+                }
+                n = raw_n;            // 정상 양수
+            }
+            else if (strcmp(tok, "-d") == 0) {
+                io_mode = IO_DIRECT;  // O_DIRECT 순차 스캔으로 읽기
+            }
+            else if (strcmp(tok, "-x") == 0 || strcmp(tok, "-b") == 0) {
+                if (format != PRINT_TEXT) {   // -x와 -b는 함께 쓸 수 없음
+                    invalid = 1;
+                    break;
+                }
+                format = tok[1] == 'x' ? PRINT_HEX : PRINT_RAW;
+            }
+            else if (!path) {
+                path = tok;           // 첫 번째 non-option은 경로
+            }
+            else {
+                invalid = 1;          // 알 수 없는 토큰
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
 
-        while (cur < block_size) {
-            struct ext2_dir_entry e;
-            // entry header
-            pread(img_fd, &e,
-                  offsetof(struct ext2_dir_entry, name),
-                  blk_off + cur);
-            if (e.inode == 0) break;
+        if (!invalid && format == PRINT_RAW && has_n)
+            invalid = 1;              // 원본 바이트 출력에는 줄 수 제한이 없음
 
-            // name 읽기
-            char name[EXT2_NAME_LEN + 1] = { 0 };
-            pread(img_fd, name, e.name_len,
-                  blk_off + cur + offsetof(struct ext2_dir_entry, name));
-            name[e.name_len] = '\0';
+        if(invalid){
+            command_help_print();
+            return true;
+        }
+        if (missing_arg) {
+            fprintf(stderr, "print: option requires an argument -- 'n'\n\n");
+            return true;
+        }
+        if(zero_n){
+    	return true;
+        }
 
-            // '.', '..', 'lost+found' 제외
-            if (e.inode
-                && strcmp(name, ".")
-                && strcmp(name, "..")
-                && strcmp(name, "lost+found"))
-            {
-                Node* child = create_node(name, e.inode, e.file_type);
-                insert_child_sorted(parent, child);
+        if (!path) {
+            command_help_print();
+            return true;
+        }
 
-                // 디렉토리면 재귀 호출
-                if (e.file_type == EXT2_FT_DIR)
-                    build_tree(child);
+        if (!validate_path(path)) { 
+            return true; 
+        }
+
+        // 노드 찾기
+        Node* tgt = find_node(root, path);
+        if (!tgt) {
+            command_help_print();
+            return true;
+        }
+        if (tgt->file_type != 1) {
+            fprintf(stderr, "Error: '%s' is not file\n\n", path);
+            return true;
+        }
+
+        // 실제 출력
+        command_print(path, has_n ? n : 0, io_mode, format);
+        return true;
+    }
+
+    // export 분기
+    else if (strcmp(cmd, "export") == 0) {
+        int nthreads = 0;
+        int io_mode = IO_BUFFERED;
+        int invalid = 0;
+        char* img_path = NULL;
+        char* host_path = NULL;
+        char* tok = strtok(NULL, " \t\n");
+
+        while (tok) {
+            if (strcmp(tok, "-j") == 0) {
+                tok = strtok(NULL, " \t\n");
+                if (!tok || atoi(tok) <= 0) {   // 스레드 수는 양수만 허용
+                    invalid = 1;
+                    break;
+                }
+                nthreads = atoi(tok);
+            }
+            else if (strcmp(tok, "-d") == 0) {
+                io_mode = IO_DIRECT;      // O_DIRECT 순차 스캔으로 읽기
+            }
+            else if (!img_path) {
+                img_path = tok;       // 첫 번째 non-option은 이미지 내 경로
+            }
+            else if (!host_path) {
+                host_path = tok;      // 두 번째 non-option은 호스트 경로
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+
+        if (invalid || !img_path || !host_path) {
+            command_help_export();
+            return true;
+        }
+        if (!validate_path(img_path)) {
+            return true;
+        }
+        if (strlen(host_path) > PATH_MAX_LEN) {
+            fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
+                    strlen(host_path), PATH_MAX_LEN);
+            return true;
+        }
+
+        command_export(img_path, host_path, nthreads, io_mode);
+        return true;
+    }
+
+    // bench 명령어
+    else if (strcmp(cmd, "bench") == 0) {
+        if (strtok(NULL, " \t\n")) {
+            command_help_bench();
+        } else {
+            command_bench();
+        }
+    }
+
+    // df 명령어
+    else if (strcmp(cmd, "df") == 0) {
+        int nthreads = 0;         // 0이면 CPU 개수만큼
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-j") == 0) {
+                tok = strtok(NULL, " \t\n");
+                if (!tok || atoi(tok) <= 0) {
+                    invalid = 1;
+                    break;
+                }
+                nthreads = atoi(tok);
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid) {
+            command_help_df();
+        } else {
+            command_df(nthreads);
+        }
+    }
+
+    // frag 명령어
+    else if (strcmp(cmd, "frag") == 0) {
+        char* path = strtok(NULL, " \t\n");
+        if (path && strtok(NULL, " \t\n")) {
+            command_help_frag();
+        } else if (!path || validate_path(path)) {
+            command_frag(path ? path : ".");
+        }
+    }
+
+    // blk2path 명령어
+    else if (strcmp(cmd, "blk2path") == 0) {
+        bool rebuild = false;
+        char* num = NULL;
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-r") == 0) {
+                rebuild = true;       // 저장된 색인을 무시하고 다시 생성
+            }
+            else if (!num) {
+                num = tok;
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        char* end = NULL;
+        unsigned long block = num ? strtoul(num, &end, 0) : 0;
+        if (invalid || !num || *end != '\0' || block > UINT32_MAX) {
+            command_help_blk2path();
+        } else {
+            command_blk2path((uint32_t)block, rebuild);
+        }
+    }
+
+    // check 명령어
+    else if (strcmp(cmd, "check") == 0) {
+        int nthreads = 0;         // 0이면 CPU 개수만큼
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-j") == 0) {
+                tok = strtok(NULL, " \t\n");
+                if (!tok || atoi(tok) <= 0) {
+                    invalid = 1;
+                    break;
+                }
+                nthreads = atoi(tok);
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid) {
+            command_help_check();
+        } else {
+            command_check(nthreads);
+        }
+    }
+
+    // imgdiff 명령어
+    else if (strcmp(cmd, "imgdiff") == 0) {
+        char* other = strtok(NULL, " \t\n");
+        char* path = strtok(NULL, " \t\n");
+        if (!other || strtok(NULL, " \t\n")) {
+            command_help_imgdiff();
+        } else if (strlen(other) > PATH_MAX_LEN) {
+            fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
+                    strlen(other), PATH_MAX_LEN);
+        } else if (!path || validate_path(path)) {
+            command_imgdiff(other, path ? path : "/");
+        }
+    }
+
+    // open 명령어
+    else if (strcmp(cmd, "open") == 0) {
+        char* name = strtok(NULL, " \t\n");
+        char* path = strtok(NULL, " \t\n");
+        if (!name || !path || strtok(NULL, " \t\n")) {
+            command_help_open();
+        } else if (strlen(path) > PATH_MAX_LEN) {
+            fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
+                    strlen(path), PATH_MAX_LEN);
+        } else {
+            command_open(name, path);
+        }
+    }
+
+    // use 명령어
+    else if (strcmp(cmd, "use") == 0) {
+        char* name = strtok(NULL, " \t\n");
+        if (name && strtok(NULL, " \t\n")) {
+            command_help_use();
+        } else {
+            command_use(name);
+        }
+    }
+
+    // close 명령어
+    else if (strcmp(cmd, "close") == 0) {
+        char* name = strtok(NULL, " \t\n");
+        if (!name || strtok(NULL, " \t\n")) {
+            command_help_close();
+        } else {
+            command_close(name);
+        }
+    }
+
+    // dups 명령어
+    else if (strcmp(cmd, "dups") == 0) {
+        int nthreads = 0;         // 0이면 CPU 개수만큼
+        char* path = NULL;
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-j") == 0) {
+                tok = strtok(NULL, " \t\n");
+                if (!tok || atoi(tok) <= 0) {
+                    invalid = 1;
+                    break;
+                }
+                nthreads = atoi(tok);
+            }
+            else if (!path) {
+                path = tok;
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid) {
+            command_help_dups();
+        } else if (!path || validate_path(path)) {
+            command_dups(path ? path : ".", nthreads);
+        }
+    }
+
+    // reload 명령어
+    else if (strcmp(cmd, "reload") == 0) {
+        if (strtok(NULL, " \t\n")) {
+            command_help_reload();
+        } else {
+            command_reload();
+        }
+    }
+
+    // stats 명령어
+    else if (strcmp(cmd, "stats") == 0) {
+        char* opt = strtok(NULL, " \t\n");
+        if (opt && strcmp(opt, "-r") != 0) {
+            command_help_stats();
+        } else if (strtok(NULL, " \t\n")) {
+            command_help_stats();
+        } else {
+            fflush(stdout);
+            command_stats(opt != NULL, stdout);
+        }
+    }
+
+    // import 명령어
+    else if (strcmp(cmd, "import") == 0) {
+        char* host_path = NULL;
+        char* img_path = NULL;
+        bool dry_run = false;
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-n") == 0) {
+                dry_run = true;       // 필요한 공간만 계산
+            }
+            else if (!host_path) {
+                host_path = tok;      // 첫 번째 non-option은 호스트 경로
+            }
+            else if (!img_path) {
+                img_path = tok;       // 두 번째 non-option은 이미지 내 경로
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid || !host_path || !img_path) {
+            command_help_import();
+        } else if (strlen(host_path) > PATH_MAX_LEN) {
+            fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
+                    strlen(host_path), PATH_MAX_LEN);
+        } else if (validate_path(img_path)) {
+            command_import(host_path, img_path, dry_run);
+        }
+    }
+
+    // find 명령어
+    else if (strcmp(cmd, "find") == 0) {
+        char* path = NULL;
+        char* pattern = NULL;
+        int type = -1;
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-name") == 0) {
+                pattern = strtok(NULL, " \t\n");
+                if (!pattern) { invalid = 1; break; }
+            }
+            else if (strcmp(tok, "-type") == 0) {
+                tok = strtok(NULL, " \t\n");
+                if (!tok || tok[1] != '\0' || (type = find_type_code(tok[0])) < 0) {
+                    invalid = 1;
+                    break;
+                }
+            }
+            else if (!path && tok[0] != '-') {
+                path = tok;
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid) {
+            command_help_find();
+        } else if (!path || validate_path(path)) {
+            command_find(path ? path : ".", pattern, type);
+        }
+    }
+
+    // du 명령어
+    else if (strcmp(cmd, "du") == 0) {
+        char* path = NULL;
+        bool summary = false;
+        int invalid = 0;
+        char* tok = strtok(NULL, " \t\n");
+        while (tok) {
+            if (strcmp(tok, "-s") == 0) {
+                summary = true;       // 합계만 출력
+            }
+            else if (!path && tok[0] != '-') {
+                path = tok;
+            }
+            else {
+                invalid = 1;
+                break;
+            }
+            tok = strtok(NULL, " \t\n");
+        }
+        if (invalid) {
+            command_help_du();
+        } else if (!path || validate_path(path)) {
+            command_du(path ? path : ".", summary);
+        }
+    }
+
+    // summary 명령어
+    else if (strcmp(cmd, "summary") == 0) {
+        char* path = strtok(NULL, " \t\n");
+        if ((path && path[0] == '-') || strtok(NULL, " \t\n")) {
+            command_help_summary();
+        } else if (!path || validate_path(path)) {
+            command_summary(path ? path : ".");
+        }
+    }
+
+    // ino2path 명령어
+    else if (strcmp(cmd, "ino2path") == 0) {
+        char* num = strtok(NULL, " \t\n");
+        char* end = NULL;
+        unsigned long ino = num ? strtoul(num, &end, 0) : 0;
+        if (!num || *end != '\0' || strtok(NULL, " \t\n") || ino == 0 || ino > UINT32_MAX) {
+            command_help_ino2path();
+        } else {
+            command_ino2path((uint32_t)ino);
+        }
+    }
+
+    // help 명령어
+    else if (strcmp(cmd, "help") == 0) {
+        char* arg = strtok(NULL, " \t\n");
+        command_help(arg);
+    }
+    // exit
+    else if (strcmp(cmd, "exit") == 0) {
+        return false;
+    }
+    else {
+        command_help_all();
+    }
+    return true;
+}
+
+// inode 로드: 그룹/인덱스 계산 후 해당 위치에서 읽기
+void read_inode(int img_fd, uint32_t ino, struct ext2_inode *inode) {
+    // 1) 그룹 번호, 그룹 내 인덱스
+    uint32_t group = (ino - 1) / inodes_per_group;
+    uint32_t index = (ino - 1) % inodes_per_group;
+
+    // 2) 해당 그룹 디스크립터 (메모리에 적재된 테이블이 있으면 그대로 사용)
+    struct ext2_group_desc gd;
+    if (gdt && group < group_count)
+        gd = gdt[group];
+    else
+        read_group_desc(img_fd, group, &gd, block_size);
+
+    // 3) inode 테이블 시작 오프셋
+    off_t tbl_off = (off_t)gd.bg_inode_table * block_size;
+
+    // 4) 테이블 내 offset
+    off_t ino_off = tbl_off + (off_t)index * inode_size;
+
+    // 5) 실제 inode 읽기
+    if (img_pread(img_fd, inode, sizeof(*inode), ino_off) != sizeof(*inode)) {
+        perror("pread inode, error");
+        exit(EXIT_FAILURE);
+    }
+    stat_add(STAT_INODE_READS, 1);
+
+    
+}
+
+// 슈퍼블록 로드: offset 1024에서 읽어와 전역 블록 크기/정수 설정
+void read_superblock(int img_fd, struct ext2_super_block *sb) {
+    // 1) superblock 읽기 (offset 1024)
+    if (img_pread(img_fd, sb, sizeof(*sb), SUPERBLOCK_OFFSET) != sizeof(*sb)) {
+        perror("pread superblock, error");
+        exit(EXIT_FAILURE);
+    }
+
+
+    // 2) block_size = 1024 << s_log_block_size
+    block_size         = 1024 << sb->s_log_block_size;
+    inode_size         = sb->s_inode_size;
+    inodes_per_group   = sb->s_inodes_per_group;
+}
+
+// 그룹 디스크립터 로드: 특정 그룹 번호에 맞는 디스크립터를 읽음
+void read_group_desc(int img_fd,
+                     uint32_t group,
+                     struct ext2_group_desc *gd,
+                     uint32_t block_size)
+{
+    const size_t GD_SIZE = sizeof(*gd);  // 32
+
+    // 1) 슈퍼블록이 속한 블록 번호
+    uint32_t sb_block     = SUPERBLOCK_OFFSET / block_size;  
+    // 2) 그룹 디스크립터 테이블 시작 블록 번호
+    uint32_t gd_table_blk = sb_block + 1;                     
+    // 3) 바이트 오프셋 (64bit 이미지는 디스크립터 간격이 s_desc_size)
+    off_t    off         = (off_t)gd_table_blk * block_size
+                          + (off_t)group * group_desc_size();
+
+    if (img_pread(img_fd, gd, GD_SIZE, off) != GD_SIZE) {
+        perror("pread group_desc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// 디스크상의 그룹 디스크립터 크기: ext2는 32바이트, 64bit 기능이 켜진 ext4는 s_desc_size
+size_t group_desc_size(void) {
+    if ((sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && sb.s_desc_size >= sizeof(struct ext2_group_desc))
+        return sb.s_desc_size;
+    return sizeof(struct ext2_group_desc);
+}
+
+// 노드 생성: 이름, inode 번호, 타입으로 초기화
+Node* create_node(const char* name, uint32_t ino, uint8_t type) {
+    Node* n = malloc(sizeof(Node));
+    n->name = strdup(name);
+    stat_add(STAT_NODES_ALLOC, 1);
+    stat_add(STAT_NODE_BYTES_ALLOC, sizeof(Node) + strlen(name) + 1);
+    n->inode_no = ino;
+    n->file_type = type;
+    n->loaded = false;
+    n->mapped = false;
+    n->times_valid = false;
+    n->dir_mtime = n->dir_ctime = 0;
+    n->parent = NULL;
+    n->first_child = NULL;
+    n->next_sibling = NULL;
+    n->ino_next = NULL;
+    n->link = NULL;
+    return n;
+}
+
+// inode 번호 해시 (곱셈 해시, 상위 비트 사용)
+static uint32_t ino_hash(uint32_t ino, uint32_t size) {
+    return (uint32_t)((ino * 2654435761u) >> 7) & (size - 1);
+}
+
+// 버킷 수를 늘려 모든 노드 재배치
+static void ino_map_grow(void) {
+    uint32_t nsize = ino_map.size ? ino_map.size * 2 : INO_MAP_INIT_SIZE;
+    Node** nb = calloc(nsize, sizeof(Node*));
+    for (uint32_t i = 0; i < ino_map.size; i++) {
+        Node* n = ino_map.buckets[i];
+        while (n) {
+            Node* next = n->ino_next;
+            uint32_t h = ino_hash(n->inode_no, nsize);
+            n->ino_next = nb[h];
+            nb[h] = n;
+            n = next;
+        }
+    }
+    free(ino_map.buckets);
+    ino_map.buckets = nb;
+    ino_map.size = nsize;
+}
+
+// 노드를 inode 맵에 등록 (부하율 1을 넘으면 확장)
+void ino_map_insert(Node* n) {
+    if (ino_map.cnt >= ino_map.size)
+        ino_map_grow();
+    uint32_t h = ino_hash(n->inode_no, ino_map.size);
+    n->ino_next = ino_map.buckets[h];
+    ino_map.buckets[h] = n;
+    n->mapped = true;
+    ino_map.cnt++;
+}
+
+// 노드를 inode 맵에서 제거
+void ino_map_remove(Node* n) {
+    if (!n->mapped) return;
+    Node** p = &ino_map.buckets[ino_hash(n->inode_no, ino_map.size)];
+    while (*p && *p != n)
+        p = &(*p)->ino_next;
+    if (*p) {
+        *p = n->ino_next;
+        ino_map.cnt--;
+    }
+    n->mapped = false;
+    n->ino_next = NULL;
+}
+
+// inode 번호에 해당하는 첫 노드 (없으면 NULL)
+Node* ino_map_first(uint32_t ino) {
+    if (!ino_map.size) return NULL;
+    Node* n = ino_map.buckets[ino_hash(ino, ino_map.size)];
+    while (n && n->inode_no != ino)
+        n = n->ino_next;
+    return n;
+}
+
+// 같은 inode 번호의 다음 노드 (하드 링크)
+Node* ino_map_next(Node* n) {
+    uint32_t ino = n->inode_no;
+    n = n->ino_next;
+    while (n && n->inode_no != ino)
+        n = n->ino_next;
+    return n;
+}
+
+// 부모 포인터를 따라 올라가며 노드의 절대 경로 생성: O(깊이)
+void node_path(const Node* n, char* buf, size_t len) {
+    if (!n->parent) {
+        snprintf(buf, len, "/");
+        return;
+    }
+    // 끝에서부터 이름을 채워 나감
+    size_t pos = len - 1;
+    buf[pos] = '\0';
+    for (const Node* c = n; c->parent; c = c->parent) {
+        size_t nl = strlen(c->name);
+        if (nl + 1 > pos) {
+            // 버퍼 부족: 앞부분을 "..."로 줄인 꼬리 경로 (".../b/c")
+            // "..."가 들어갈 자리가 생길 때까지 꼬리의 앞 구성 요소를 버림
+            while (pos < 3 && buf[pos]) {
+                const char *slash = strchr(buf + pos + 1, '/');
+                pos = slash ? (size_t)(slash - buf) : len - 1;
+            }
+            if (pos < 3) {
+                snprintf(buf, len, "...");
+                return;
+            }
+            pos -= 3;
+            memcpy(buf + pos, "...", 3);
+            break;
+        }
+        pos -= nl;
+        memcpy(buf + pos, c->name, nl);
+        buf[--pos] = '/';
+    }
+    memmove(buf, buf + pos, len - pos);
+}
+
+
+// 자식 노드를 '디렉토리 우선, 같은 타입 내에서는 이름 사전순'으로 삽입
+void insert_child_sorted(Node* parent, Node* child) {
+    Node **cur = &parent->first_child;
+    while (*cur) {
+        Node *cur_node = *cur;
+        // 1) child가 디렉토리이고 cur_node가 파일이면, 지금(cur)이 삽입 위치
+        if (child->file_type == EXT2_FT_DIR && cur_node->file_type != EXT2_FT_DIR) {
+            break;
+        }
+        // 2) child가 파일이고 cur_node가 디렉토리이면, 디렉토리 뒤로 건너뜀
+        if (child->file_type != EXT2_FT_DIR && cur_node->file_type == EXT2_FT_DIR) {
+            cur = &cur_node->next_sibling;
+            continue;
+        }
+        // 3) 동일 타입(둘 다 디렉토리이거나 둘 다 파일)일 때 이름 비교
+        if (strcmp(cur_node->name, child->name) < 0) {
+            cur = &cur_node->next_sibling;
+        } else {
+            break;
+        }
+    }
+    // child를 cur 위치에 삽입
+    child->next_sibling = *cur;
+    *cur = child;
+    child->parent = parent;
+
+    // 전역 트리에 붙는 노드면 inode 맵에도 등록
+    if (parent->mapped)
+        ino_map_insert(child);
+}
+
+
+// 자식 목록 정렬 순서 (insert_child_sorted와 같음: 디렉토리 먼저, 같은 종류끼리 이름순)
+static int child_order(const Node *a, const Node *b) {
+    bool ad = (a->file_type == EXT2_FT_DIR), bd = (b->file_type == EXT2_FT_DIR);
+    if (ad != bd) return ad ? -1 : 1;
+    return strcmp(a->name, b->name);
+}
+
+// 자식 목록을 child_order 순으로 병합 정렬 (엔트리가 많은 디렉토리도 O(n log n))
+static Node* sort_children(Node* head, int n) {
+    if (n < 2) {
+        if (head) head->next_sibling = NULL;
+        return head;
+    }
+    Node* mid = head;
+    for (int i = 1; i < n / 2; i++)
+        mid = mid->next_sibling;
+    Node* right = mid->next_sibling;
+    mid->next_sibling = NULL;
+    Node* a = sort_children(head, n / 2);
+    Node* b = sort_children(right, n - n / 2);
+    Node* out = NULL;
+    Node** tail = &out;
+    while (a && b) {
+        Node** pick = child_order(a, b) <= 0 ? &a : &b;
+        *tail = *pick;
+        tail = &(*pick)->next_sibling;
+        *pick = (*pick)->next_sibling;
+    }
+    *tail = a ? a : b;
+    return out;
+}
+
+// 이름 해시 (FNV-1a)
+static uint32_t name_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (uint8_t)*name) * 16777619u;
+    return h;
+}
+
+// parent의 현재 자식들로 이름 집합 구성 (칸 수는 자식 수의 2배 이상)
+static void name_set_build(NameSet* set, Node* parent) {
+    uint32_t cnt = 0;
+    for (Node* c = parent->first_child; c; c = c->next_sibling) cnt++;
+    uint32_t size = 8;
+    while (size < cnt * 2) size *= 2;
+    set->slots = calloc(size, sizeof(Node*));
+    set->mask = size - 1;
+    for (Node* c = parent->first_child; c; c = c->next_sibling) {
+        uint32_t h = name_hash(c->name) & set->mask;
+        while (set->slots[h]) h = (h + 1) & set->mask;
+        set->slots[h] = c;
+    }
+}
+
+static bool name_set_has(const NameSet* set, const char* name) {
+    for (uint32_t h = name_hash(name) & set->mask; set->slots[h]; h = (h + 1) & set->mask)
+        if (strcmp(set->slots[h]->name, name) == 0)
+            return true;
+    return false;
+}
+
+// 디렉토리 블록 하나의 엔트리를 파싱해 parent의 자식으로 추가
+// 이름 조회로 이미 만들어진 자식(부분 적재)이 있으면 existing에서 찾아 그 노드를 그대로 둠
+// 앞에 붙이기만 하고, 정렬은 디렉토리를 다 읽은 뒤 sort_children으로 한 번에 함
+static void parse_dir_block(Node* parent, const char* buf, const NameSet* existing) {
+    uint32_t cur = 0;
+    while (cur + offsetof(struct ext2_dir_entry, name) <= block_size) {
+        const struct ext2_dir_entry* e = (const struct ext2_dir_entry*)(buf + cur);
+        // 손상된 rec_len이면 블록 나머지는 무시
+        if (e->rec_len < offsetof(struct ext2_dir_entry, name)
+            || cur + e->rec_len > block_size)
+            break;
+        // 이름이 엔트리 밖으로 넘어가도 손상으로 보고 중단 (블록 버퍼 밖을 읽지 않도록)
+        if (offsetof(struct ext2_dir_entry, name) + e->name_len > e->rec_len)
+            break;
+
+        char name[EXT2_NAME_LEN + 1];
+        memcpy(name, e->name, e->name_len);
+        name[e->name_len] = '\0';
+
+        // 삭제된 엔트리(inode 0)와 '.', '..', 'lost+found' 제외
+        if (e->inode
+            && strcmp(name, ".")
+            && strcmp(name, "..")
+            && strcmp(name, "lost+found"))
+        {
+            if (!existing || !name_set_has(existing, name)) {
+                Node* child = create_node(name, e->inode, e->file_type);
+                child->parent = parent;
+                child->next_sibling = parent->first_child;
+                parent->first_child = child;
+                if (parent->mapped)
+                    ino_map_insert(child);
+            }
+        }
+
+        cur += e->rec_len;  // 다음 엔트리
+    }
+}
+
+// 디렉토리 시간이 읽은 시점보다 충분히 과거인지
+// 시간 단위가 1초라 같은 초 안의 변경은 i_mtime/i_ctime으로 구별할 수 없으므로
+// 방금 바뀐 디렉토리는 기록을 믿지 않고 다음 reload에서 다시 읽음
+bool dir_times_settled(const struct ext2_inode *ino) {
+    int64_t now = (int64_t)time(NULL);
+    return (int64_t)ino->i_mtime < now - 1 && (int64_t)ino->i_ctime < now - 1;
+}
+
+// 디렉토리 적재: 같은 깊이의 디렉토리들을 한 단계씩 읽음
+// 각 단계에서 inode와 디렉토리 블록을 일괄 읽기로 가져와 여러 읽기가 동시에 진행되게 함
+// recursive면 하위 디렉토리까지 모두, 아니면 주어진 디렉토리들만 적재
+static void load_dirs(Node** dirs, int ndirs, bool recursive) {
+    PhaseTimer pt;
+    phase_begin(&pt, PHASE_LOAD);
+    Node** level = malloc(sizeof(Node*) * (ndirs ? ndirs : 1));
+    memcpy(level, dirs, sizeof(Node*) * ndirs);
+    int nlevel = ndirs;
+
+    char* buf = malloc((size_t)BUILD_BATCH_BLOCKS * block_size);
+    IoReq* reqs = malloc(sizeof(IoReq) * BUILD_BATCH_BLOCKS);
+    int* owners = malloc(sizeof(int) * BUILD_BATCH_BLOCKS);
+
+    while (nlevel > 0) {
+        // 1) 아직 적재되지 않은 디렉토리들의 inode 일괄 읽기
+        Node** todo = malloc(sizeof(Node*) * nlevel);
+        int ntodo = 0;
+        NameSet* existing = calloc(nlevel, sizeof(NameSet));
+        for (int i = 0; i < nlevel; i++) {
+            if (!level[i]->loaded) {
+                // 이름 조회로 만들어진 자식이 이미 있으면 중복 생성하지 않도록 이름 집합을 만듦
+                if (level[i]->first_child)
+                    name_set_build(&existing[ntodo], level[i]);
+                todo[ntodo++] = level[i];
+            }
+        }
+
+        uint32_t* inos = malloc(sizeof(uint32_t) * (ntodo ? ntodo : 1));
+        struct ext2_inode* inodes = malloc(sizeof(struct ext2_inode) * (ntodo ? ntodo : 1));
+        for (int i = 0; i < ntodo; i++)
+            inos[i] = todo[i]->inode_no;
+        read_inodes_batch(img_fd, inos, ntodo, inodes);
+        for (int i = 0; i < ntodo; i++) {
+            // reload가 바뀐 디렉토리를 찾을 수 있도록 읽은 시점의 시간 기록
+            todo[i]->dir_mtime = inodes[i].i_mtime;
+            todo[i]->dir_ctime = inodes[i].i_ctime;
+            todo[i]->times_valid = dir_times_settled(&inodes[i]);
+        }
+
+        // 2) 모든 디렉토리 블록을 BUILD_BATCH_BLOCKS 단위로 모아 일괄 읽기 후 파싱
+        int nreq = 0;
+        for (int i = 0; i <= ntodo; i++) {
+            uint32_t* blocks = NULL;
+            int nblocks = 0;
+            if (i < ntodo) {
+                nblocks = collect_data_blocks(img_fd, &inodes[i], block_size, &blocks);
+                if (nblocks < 0) {
+                    perror("collect_data_blocks 실패");
+                    nblocks = 0;
+                }
+            }
+
+            for (int bi = 0; bi <= nblocks; bi++) {
+                // 배치가 가득 찼거나 마지막이면 읽고 파싱
+                bool flush = (nreq == BUILD_BATCH_BLOCKS)
+                             || (i == ntodo && bi == nblocks);
+                if (flush && nreq > 0) {
+                    io_read_batch(img_fd, reqs, nreq);
+                    for (int r = 0; r < nreq; r++) {
+                        if (reqs[r].res != (ssize_t)block_size) continue;
+                        parse_dir_block(todo[owners[r]], reqs[r].buf,
+                                        existing[owners[r]].slots ? &existing[owners[r]] : NULL);
+                    }
+                    nreq = 0;
+                }
+                if (bi == nblocks) break;
+
+                reqs[nreq].buf = buf + (size_t)nreq * block_size;
+                reqs[nreq].len = block_size;
+                reqs[nreq].off = (off_t)blocks[bi] * block_size;
+                owners[nreq] = i;
+                nreq++;
+            }
+            free(blocks);
+        }
+        for (int i = 0; i < ntodo; i++) {
+            int cnt = 0;
+            for (Node* c = todo[i]->first_child; c; c = c->next_sibling) cnt++;
+            todo[i]->first_child = sort_children(todo[i]->first_child, cnt);
+            todo[i]->loaded = true;
+            free(existing[i].slots);
+        }
+
+        // 3) 다음 단계: 이번 단계 디렉토리들의 하위 디렉토리
+        Node** next = NULL;
+        int next_cnt = 0, next_cap = 0;
+        for (int i = 0; recursive && i < nlevel; i++) {
+            for (Node* c = level[i]->first_child; c; c = c->next_sibling) {
+                if (c->file_type != EXT2_FT_DIR) continue;
+                if (next_cnt == next_cap) {
+                    next_cap = next_cap ? next_cap * 2 : 64;
+                    next = realloc(next, sizeof(Node*) * next_cap);
+                }
+                next[next_cnt++] = c;
+            }
+        }
+
+        free(todo);
+        free(existing);
+        free(inos);
+        free(inodes);
+        free(level);
+        level = next;
+        nlevel = next_cnt;
+    }
+
+    free(level);
+    free(buf);
+    free(reqs);
+    free(owners);
+    phase_end(&pt);
+}
+
+// 디렉토리 트리 구성: parent 아래 모든 디렉토리를 적재 (이미 적재된 디렉토리는 다시 읽지 않음)
+void build_tree(Node* parent) {
+    load_dirs(&parent, 1, true);
+}
+
+// 디렉토리 한 단계만 적재 (지연 적재 모드에서 필요할 때 호출)
+void load_dir(Node* dir) {
+    if (!dir->loaded)
+        load_dirs(&dir, 1, false);
+}
+
+
+
+
+void out_init(OutBuf *ob, int fd) {
+    ob->cap = TREE_OUT_BUF;
+    ob->buf = malloc(ob->cap);
+    ob->len = 0;
+    ob->fd = fd;
+    fflush(stdout);   // 앞서 printf로 쓴 내용(프롬프트 등)이 먼저 나가도록
+}
+
+void out_flush(OutBuf *ob) {
+    size_t done = 0;
+    while (done < ob->len) {
+        ssize_t w = write(ob->fd, ob->buf + done, ob->len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;   // 받는 쪽이 닫힘: 남은 출력은 버림
+        done += (size_t)w;
+    }
+    ob->len = 0;
+}
+
+void out_free(OutBuf *ob) {
+    out_flush(ob);
+    free(ob->buf);
+}
+
+void out_write(OutBuf *ob, const char *s, size_t n) {
+    if (ob->len + n > ob->cap) {
+        out_flush(ob);
+        if (n > ob->cap) {
+            ob->cap = n;
+            ob->buf = realloc(ob->buf, ob->cap);
+        }
+    }
+    memcpy(ob->buf + ob->len, s, n);
+    ob->len += n;
+}
+
+void out_str(OutBuf *ob, const char *s) {
+    out_write(ob, s, strlen(s));
+}
+
+void out_printf(OutBuf *ob, const char *fmt, ...) {
+    char tmp[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(tmp)) {
+        out_write(ob, tmp, n);
+        return;
+    }
+    char *big = malloc(n + 1);
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    out_write(ob, big, n);
+    free(big);
+}
+
+// JSON 문자열 ("..." 포함): 따옴표, 역슬래시, 제어 문자 이스케이프
+void out_json_str(OutBuf *ob, const char *s, size_t n) {
+    out_write(ob, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char ch = (unsigned char)s[i];
+        if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+        out_write(ob, s + start, i - start);
+        if (ch == '"') out_write(ob, "\\\"", 2);
+        else if (ch == '\\') out_write(ob, "\\\\", 2);
+        else if (ch == '\n') out_write(ob, "\\n", 2);
+        else if (ch == '\t') out_write(ob, "\\t", 2);
+        else out_printf(ob, "\\u%04x", ch);
+        start = i + 1;
+    }
+    out_write(ob, s + start, n - start);
+    out_write(ob, "\"", 1);
+}
+
+// 디렉토리 엔트리 타입 → JSON 타입 문자열
+static const char *tree_type_name(uint8_t t) {
+    static const char *names[] = { "unknown", "file", "dir", "chrdev", "blkdev", "fifo", "socket", "symlink" };
+    return t < sizeof(names) / sizeof(names[0]) ? names[t] : "unknown";
+}
+
+// tree 출력에서 빼는 이름
+static bool tree_skip(const Node *c) {
+    return strcmp(c->name, ".") == 0 || strcmp(c->name, "..") == 0
+           || strcmp(c->name, "lost+found") == 0;
+}
+
+// 노드 하나의 JSON 필드 (닫는 중괄호 제외)
+static void tree_json_fields(OutBuf *ob, const Node *n, const struct ext2_inode *ino,
+                             const char *path, size_t path_len) {
+    out_str(ob, "{");
+    if (path) {
+        out_str(ob, "\"path\":");
+        out_json_str(ob, path, path_len);
+        out_str(ob, ",");
+    }
+    out_str(ob, "\"name\":");
+    out_json_str(ob, n->name, strlen(n->name));
+    out_printf(ob, ",\"inode\":%u,\"type\":\"%s\",\"size\":%llu,\"mode\":%u",
+               n->inode_no, tree_type_name(n->file_type),
+               (unsigned long long)inode_file_size(ino), (unsigned)ino->i_mode);
+}
+
+// 공유 문자열 스택(prefix/경로)의 len 위치에 s를 붙임 (필요하면 버퍼를 늘림)
+static size_t tree_stack_put(char **buf, size_t *cap, size_t len, const char *s, size_t n) {
+    if (len + n + 1 > *cap) {
+        *cap = (len + n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + len, s, n);
+    (*buf)[len + n] = '\0';
+    return len + n;
+}
+
+// 트리 출력: 재귀 호출 대신 디렉토리 스택으로 순회하고, prefix는 단계마다 새로 만들지 않고
+// 하나의 버퍼에 이어 붙였다가 길이만 되돌림. 모든 출력은 ob에 모아 write로 내보냄
+// 출력한 디렉토리/파일 수를 dirs/files에 더함
+void render_tree(OutBuf *ob, Node *n, const char *path, int recursive,
+                 int show_size, int show_perm, int format, int *dirs, int *files) {
+    PhaseTimer pt;
+    phase_begin(&pt, PHASE_RENDER);
+    bool need_inode = show_size || show_perm || format != TREE_TEXT;
+    char *prefix = NULL, *pbuf = NULL;
+    size_t prefix_cap = 0, pbuf_cap = 0;
+    tree_stack_put(&prefix, &prefix_cap, 0, "", 0);
+    size_t plen = tree_stack_put(&pbuf, &pbuf_cap, 0, path, strlen(path));
+
+    TreeFrame *stack = NULL;
+    int depth = 0, stack_cap = 0;
+    Node *push = n;
+    size_t push_prefix = 0, push_path = plen;
+
+    while (push || depth > 0) {
+        // 1) 새 디렉토리 단계: 자식 inode 일괄 읽기
+        if (push) {
+            if (depth == stack_cap) {
+                stack_cap = stack_cap ? stack_cap * 2 : 16;
+                stack = realloc(stack, sizeof(TreeFrame) * stack_cap);
+            }
+            TreeFrame *f = &stack[depth++];
+            f->next = push->first_child;
+            f->inodes = NULL;
+            f->idx = 0;
+            f->prefix_len = push_prefix;
+            f->path_len = push_path;
+            f->first = true;
+            if (need_inode) {
+                int cnt = 0;
+                for (Node *c = push->first_child; c; c = c->next_sibling) cnt++;
+                uint32_t *inos = malloc(sizeof(uint32_t) * (cnt ? cnt : 1));
+                f->inodes = malloc(sizeof(struct ext2_inode) * (cnt ? cnt : 1));
+                cnt = 0;
+                for (Node *c = push->first_child; c; c = c->next_sibling)
+                    inos[cnt++] = c->inode_no;
+                read_inodes_batch(img_fd, inos, cnt, f->inodes);
+                free(inos);
+            }
+            push = NULL;
+        }
+
+        TreeFrame *f = &stack[depth - 1];
+        while (f->next && tree_skip(f->next)) {
+            f->next = f->next->next_sibling;
+            f->idx++;
+        }
+        // 2) 자식을 다 출력했으면 한 단계 위로
+        if (!f->next) {
+            if (format == TREE_JSON)
+                out_str(ob, f->first ? "]}" : "\n]}");
+            free(f->inodes);
+            depth--;
+            continue;
+        }
+
+        Node *c = f->next;
+        const struct ext2_inode *ino = f->inodes ? &f->inodes[f->idx] : NULL;
+        f->next = c->next_sibling;
+        f->idx++;
+        bool is_dir = (c->file_type == EXT2_FT_DIR);
+        if (is_dir) (*dirs)++;
+        else (*files)++;
+        bool descend = recursive && is_dir;
+
+        // 3) 항목 한 줄 (또는 JSON 객체 하나)
+        if (format == TREE_TEXT) {
+            // 마지막 형제인지 판별 (branch 그릴 때 └ 혹은 ├ 선택)
+            bool is_last = (c->next_sibling == NULL);
+            out_write(ob, prefix, f->prefix_len);
+            out_str(ob, is_last ? "└" : "├");
+            if (show_perm || show_size) {
+                char perm[11];
+                format_perm(ino->i_mode, perm);
+                if (show_perm && show_size) out_printf(ob, " [%s %u]", perm, ino->i_size);
+                else if (show_perm) out_printf(ob, " [%s]", perm);
+                else out_printf(ob, " [%u]", ino->i_size);
+            }
+            out_str(ob, " ");
+            out_str(ob, c->name);
+            out_str(ob, "\n");
+            if (descend)
+                push_prefix = tree_stack_put(&prefix, &prefix_cap, f->prefix_len,
+                                             is_last ? " " : "│ ", is_last ? 1 : strlen("│ "));
+        }
+        else if (format == TREE_NDJSON) {
+            size_t clen = tree_stack_put(&pbuf, &pbuf_cap, f->path_len, "/",
+                                         f->path_len > 0 && pbuf[f->path_len - 1] == '/' ? 0 : 1);
+            clen = tree_stack_put(&pbuf, &pbuf_cap, clen, c->name, strlen(c->name));
+            tree_json_fields(ob, c, ino, pbuf, clen);
+            out_str(ob, "}\n");
+            push_path = clen;
+        }
+        else {
+            out_str(ob, f->first ? "\n" : ",\n");
+            f->first = false;
+            tree_json_fields(ob, c, ino, NULL, 0);
+            if (descend) out_str(ob, ",\"children\":[");
+            else out_str(ob, "}");
+        }
+        if (descend)
+            push = c;
+    }
+
+    free(stack);
+    free(prefix);
+    free(pbuf);
+    phase_end(&pt);
+}
+
+// 트리 내 디렉토리/파일 개수 세기
+void count_tree(Node* n, int* dirs, int* files) {
+    // 첫 번째 자식 노드부터 탐색
+    Node* c = n->first_child;
+    while (c) {
+        // '.' '..' 'lost+found' 은 결과에 포함하지 않음
+        if (strcmp(c->name, ".") == 0 ||
+            strcmp(c->name, "..") == 0 ||
+            strcmp(c->name, "lost+found") == 0)
+        {
+            c = c->next_sibling;
+            continue;
+        }
+        // 디렉토리인 경우
+        if (c->file_type == 2) {
+            (*dirs)++;    // 디렉토리 카운트 증가
+            count_tree(c, dirs, files);   // 재귀적으로 하위 트리도 세기
+        }
+        // 파일인 경우
+        else {
+            (*files)++;  // 파일 카운트 증가
+        }
+        // 다음 형제 노드로 이동
+        c = c->next_sibling;
+    }
+}
+
+// 파일/디렉토리 권한 비트(mode)를 문자열("drwxr-xr-x")로 변환
+void format_perm(uint16_t mode, char buf[11]) {
+    // 첫 문자는 디렉토리 여부 표시: 디렉토리이면 'd', 아니면 '-'
+    buf[0] = (mode & S_IFDIR) ? 'd' : '-';
+    // 사용자(owner), 그룹(group), 기타(other)에 대한 읽기(r), 쓰기(w), 실행(x) 권한 문자
+    const char* rwx = "rwx";
+
+    // 9비트 권한(rwx rwx rwx)을 하나씩 검사하여 buf[1]~buf[9]에 채워넣음
+    // 가장 상위 비트부터 차례대로 검사 (비트 8이 owner 읽기, 비트 0이 other 실행)
+    for (int i = 0; i < 9; i++) {
+        // (1 << (8 - i)) 위치에 해당하는 비트가 켜져 있으면
+        // rwx 문자열에서 i%3 인덱스 문자('r','w','x')를, 아니면 '-
+        buf[i + 1] = (mode & (1 << (8 - i))) ? rwx[i % 3] : '-';
+    }
+    // 문자열 끝에 NULL 문자 추가
+    buf[10] = '\0';
+}
+
+// tree 명령어
+void command_tree(const char* path, int recursive,
+              int show_size, int show_perm, int format)
+{
+    // 경로에 해당하는 노드 찾기
+    Node* tgt = find_node(root, path);
+    if (!tgt) {
+        // 존재하지 않는 경로면 도움말 출력
+        command_help_tree();
+        return;
+    }
+    //  디렉토리가 아니면 에러
+    if (tgt->file_type != 2) {
+        fprintf(stderr, "Error: '%s' is not directory\n", path);
+        return;
+    }
+
+    // 지연 적재 모드: 출력할 범위의 디렉토리만 읽음
+    if (recursive)
+        build_tree(tgt);
+    else
+        load_dir(tgt);
+
+    //  디렉토리 inode 정보 읽기
+    struct ext2_inode ino;
+    read_inode(img_fd, tgt->inode_no, &ino);
+
+    OutBuf ob;
+    out_init(&ob, STDOUT_FILENO);
+    int dirs = 0, files = 0;
+    if (format == TREE_NDJSON) {
+        // 대상 디렉토리 자신부터 한 줄씩
+        tree_json_fields(&ob, tgt, &ino, path, strlen(path));
+        out_str(&ob, "}\n");
+        render_tree(&ob, tgt, path, recursive, show_size, show_perm, format, &dirs, &files);
+    }
+    else if (format == TREE_JSON) {
+        tree_json_fields(&ob, tgt, &ino, NULL, 0);
+        out_str(&ob, ",\"children\":[");
+        render_tree(&ob, tgt, path, recursive, show_size, show_perm, format, &dirs, &files);
+        out_str(&ob, "\n");
+    }
+    else {
+        const char* shown = strcmp(path, "/") == 0 ? "." : path;
+        // 권한+크기, 권한, 크기, 아무 옵션 없을 때 로 분기
+        char perm[11];
+        format_perm(ino.i_mode, perm);
+        if (show_perm && show_size)
+            out_printf(&ob, "[%s %u] %s\n", perm, ino.i_size, shown);
+        else if (show_perm)
+            out_printf(&ob, "[%s] %s\n", perm, shown);
+        else if (show_size)
+            out_printf(&ob, "[%u] %s\n", ino.i_size, shown);
+        else
+            out_printf(&ob, "%s\n", shown);
+
+        //  실제 트리 구조 출력 (자식 노드들), 출력한 항목 수를 함께 셈
+        render_tree(&ob, tgt, path, recursive, show_size, show_perm, format, &dirs, &files);
+
+        // 항상 대상 디렉터리 자신도 하나의 directory 로 카운트
+        dirs++;
+        out_printf(&ob, "\n%d directories, %d files\n\n", dirs, files);
+    }
+    out_free(&ob);
+}
+
+// print -x 한 줄 (hexdump -C 형식): printf 없이 출력 버퍼에 바로 씀
+// 앞 줄과 같은 16바이트 줄은 연속 구간마다 "*" 한 줄로 생략
+static void hexdump_line(HexDump *hd, OutBuf *ob, const unsigned char *p, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    if (len == HEXDUMP_LINE && hd->have_prev && memcmp(p, hd->prev, HEXDUMP_LINE) == 0) {
+        if (!hd->squeezing)
+            out_write(ob, "*\n", 2);
+        hd->squeezing = true;
+        hd->off += len;
+        return;
+    }
+    hd->squeezing = false;
+    if (ob->cap - ob->len < HEXDUMP_LINE_MAX)
+        out_flush(ob);
+
+    char *d = ob->buf + ob->len;
+    int nd = 8;
+    while (nd < 16 && (hd->off >> (nd * 4)))
+        nd++;
+    for (int i = nd - 1; i >= 0; i--)
+        *d++ = hex[(hd->off >> (i * 4)) & 15];
+    *d++ = ' ';
+    *d++ = ' ';
+    for (size_t i = 0; i < HEXDUMP_LINE; i++) {
+        if (i < len) {
+            d[0] = hex[p[i] >> 4];
+            d[1] = hex[p[i] & 15];
+        } else {
+            d[0] = d[1] = ' ';
+        }
+        d[2] = ' ';
+        d += 3;
+        if (i == HEXDUMP_LINE / 2 - 1)
+            *d++ = ' ';
+    }
+    *d++ = ' ';
+    *d++ = '|';
+    for (size_t i = 0; i < len; i++)
+        *d++ = (p[i] >= 0x20 && p[i] < 0x7f) ? (char)p[i] : '.';
+    *d++ = '|';
+    *d++ = '\n';
+    ob->len = (size_t)(d - ob->buf);
+
+    if (len == HEXDUMP_LINE) {
+        memcpy(hd->prev, p, HEXDUMP_LINE);
+        hd->have_prev = true;
+        hd->prev_zero = true;
+        for (size_t i = 0; i < HEXDUMP_LINE && hd->prev_zero; i++)
+            hd->prev_zero = p[i] == 0;
+    }
+    hd->off += len;
+}
+
+// 청크 하나를 덤프: 청크 경계에 걸친 줄은 carry에 모아 이어 붙임
+// hole 청크는 0 줄을 이미 생략 중이면 바이트를 보지 않고 오프셋만 넘김
+static void hexdump_feed(HexDump *hd, OutBuf *ob, const unsigned char *p, size_t n, bool hole) {
+    if (hd->ncarry) {
+        size_t take = HEXDUMP_LINE - hd->ncarry;
+        if (take > n) take = n;
+        memcpy(hd->carry + hd->ncarry, p, take);
+        hd->ncarry += take;
+        p += take;
+        n -= take;
+        if (hd->ncarry < HEXDUMP_LINE)
+            return;
+        hexdump_line(hd, ob, hd->carry, HEXDUMP_LINE);
+        hd->ncarry = 0;
+    }
+    while (n >= HEXDUMP_LINE) {
+        if (hole && hd->squeezing && hd->prev_zero) {
+            size_t skip = n - n % HEXDUMP_LINE;
+            hd->off += skip;
+            p += skip;
+            n -= skip;
+            break;
+        }
+        hexdump_line(hd, ob, p, HEXDUMP_LINE);
+        p += HEXDUMP_LINE;
+        n -= HEXDUMP_LINE;
+    }
+    if (n) {
+        memcpy(hd->carry, p, n);
+        hd->ncarry = n;
+    }
+}
+
+// print -x: 파일 앞 limit 바이트(0이면 전체)를 16진 덤프
+static void print_hexdump(const struct ext2_inode *ino, const BlockRun *runs, int nruns,
+                          int io_mode, uint64_t limit) {
+    OutBuf ob;
+    out_init(&ob, STDOUT_FILENO);
+    HexDump hd;
+    memset(&hd, 0, sizeof(hd));
+    FileStream fs;
+    file_stream_init(&fs, ino, runs, nruns, io_mode);
+    const char *data;
+    bool hole;
+    ssize_t got;
+    while ((limit == 0 || hd.off + hd.ncarry < limit)
+           && (got = file_stream_next(&fs, &data, &hole)) > 0) {
+        size_t len = (size_t)got;
+        if (limit && hd.off + hd.ncarry + len > limit)
+            len = (size_t)(limit - hd.off - hd.ncarry);
+        hexdump_feed(&hd, &ob, (const unsigned char *)data, len, hole);
+    }
+    file_stream_free(&fs);
+    if (hd.ncarry)
+        hexdump_line(&hd, &ob, hd.carry, hd.ncarry);
+    // 마지막 줄: 덤프한 전체 길이
+    if (hd.off > 0)
+        out_printf(&ob, "%08llx\n", (unsigned long long)hd.off);
+    out_free(&ob);
+}
+
+// fd에 len 바이트를 끝까지 씀 (받는 쪽이 닫히면 false)
+static bool write_full(int fd, const char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = write(fd, buf + done, len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        done += (size_t)w;
+    }
+    return true;
+}
+
+// print -b: 파일 바이트를 stdio 버퍼 없이 표준 출력 fd로 바로 씀
+// 표준 출력이 이어 쓰기가 아닌 일반 파일이면 hole은 쓰지 않고 건너뛰어 출력 파일에서도 hole로 유지
+static void print_raw(const struct ext2_inode *ino, const BlockRun *runs, int nruns, int io_mode) {
+    fflush(stdout);
+    struct stat st;
+    int fl = fcntl(STDOUT_FILENO, F_GETFL);
+    bool seek_holes = fl >= 0 && !(fl & O_APPEND) && fstat(STDOUT_FILENO, &st) == 0
+                      && S_ISREG(st.st_mode) && lseek(STDOUT_FILENO, 0, SEEK_CUR) >= 0;
+    FileStream fs;
+    file_stream_init(&fs, ino, runs, nruns, io_mode);
+    const char *data;
+    bool hole, ends_in_hole = false;
+    ssize_t got;
+    while ((got = file_stream_next(&fs, &data, &hole)) > 0) {
+        if (hole && seek_holes) {
+            if (lseek(STDOUT_FILENO, got, SEEK_CUR) < 0) break;
+            ends_in_hole = true;
+            continue;
+        }
+        if (!write_full(STDOUT_FILENO, data, (size_t)got)) break;
+        ends_in_hole = false;
+    }
+    file_stream_free(&fs);
+    // 끝이 hole이면 건너뛴 만큼 파일 크기만 늘림
+    off_t end = ends_in_hole ? lseek(STDOUT_FILENO, 0, SEEK_CUR) : -1;
+    if (end >= 0 && fstat(STDOUT_FILENO, &st) == 0 && st.st_size < end
+        && ftruncate(STDOUT_FILENO, end) < 0)
+        perror("print: ftruncate");
+}
+
+// print 명령어
+// format이 PRINT_HEX면 max_lines는 덤프 줄 수, PRINT_RAW면 쓰지 않음
+void command_print(const char* path, int max_lines, int io_mode, int format) {
+    // 대상 노드 찾기 및 inode 읽기
+    Node* tgt = find_node(root, path);
+    struct ext2_inode ino;
+    read_inode(img_fd, tgt->inode_no, &ino);
+
+    // --- 1) 블록 매핑 구간(hole 포함) 모으기 ---
+    BlockRun *runs = NULL;
+    int nruns = collect_block_runs(img_fd, &ino, block_size, &runs);
+
+    // 바이너리 출력: 청크를 줄 단위로 나누지 않고 바로 변환/출력
+    if (format != PRINT_TEXT) {
+        if (format == PRINT_HEX)
+            print_hexdump(&ino, runs, nruns, io_mode, (uint64_t)max_lines * HEXDUMP_LINE);
+        else
+            print_raw(&ino, runs, nruns, io_mode);
+        free(runs);
+        return;
+    }
+
+    // 출력 제한(max_lines)이 있을 경우, 실제 출력 전에
+    //  파일에 줄이 더 있는지(has_more) 미리 검사
+    // --- 2) has_more 검사 (줄 제한이 있을 때만) ---
+    bool has_more = false;
+    if (max_lines > 0) {
+        FileStream fs;
+        file_stream_init(&fs, &ino, runs, nruns, io_mode);
+        const char *data;
+        bool hole;
+        ssize_t got;
+        int counted = 0;
+        while (!has_more && (got = file_stream_next(&fs, &data, &hole)) > 0) {
+            if (hole) continue;   // hole에는 개행이 없으므로 검사 불필요
+            for (const char *p = data; p < data + got; p++) {
+                if (*p == '\n' && ++counted > max_lines) {
+                    has_more = true;
+                    break;
+                }
+            }
+        }
+        file_stream_free(&fs);
+    }
+
+
+    // --- 3) 실제 출력 ---
+    // 줄 단위로 모으지 않고 청크를 바로 씀 (개행이 없는 긴 hole도 메모리를 쓰지 않음)
+    FileStream fs;
+    file_stream_init(&fs, &ino, runs, nruns, io_mode);
+    int printed = 0;
+    const char *tmp;
+    bool hole;
+    ssize_t got;
+
+    // hole 구간은 I/O 없이 0 버퍼가 그대로 전달됨
+    while ((max_lines == 0 || printed < max_lines)
+           && (got = file_stream_next(&fs, &tmp, &hole)) > 0)
+    {
+        size_t len = (size_t)got;
+        if (max_lines > 0 && !hole) {
+            // 줄 제한이 있으면 max_lines번째 개행까지만
+            for (size_t pos = 0; pos < (size_t)got; pos++) {
+                if (tmp[pos] == '\n' && ++printed == max_lines) {
+                    len = pos + 1;
+                    break;
+                }
+            }
+        }
+        fwrite(tmp, 1, len, stdout);
+    }
+    file_stream_free(&fs);
+    free(runs);
+
+
+    // --- 4) 더 볼 내용이 있으면 빈 줄 추가 ---
+    if (max_lines > 0 && printed == max_lines && has_more) {
+        putchar('\n');
+    }
+
+
+}
+
+// export 작업 단위: 호스트로 복사할 일반 파일 하나
+typedef struct ExportJob {
+    char* host_path;        // 호스트에 생성할 파일 경로
+    uint32_t inode_no;      // 이미지 내 inode 번호
+    uint32_t start_block;   // 첫 번째 물리 블록 번호 (정렬 기준)
+} ExportJob;
+
+// export 후 권한/시간을 복원할 디렉토리 (후위 순서로 저장)
+typedef struct ExportDir {
+    char* host_path;
+    uint32_t inode_no;
+} ExportDir;
+
+// export 전체 상태: 작업 목록과 작업 스레드 공유 정보
+typedef struct ExportCtx {
+    ExportJob* jobs;
+    int njobs, jobs_cap;
+    ExportDir* dirs;
+    int ndirs, dirs_cap;
+    int skipped;            // 일반 파일/디렉토리가 아니라 건너뛴 엔트리 수
+    int io_mode;            // IO_BUFFERED 또는 IO_DIRECT
+
+    pthread_mutex_t lock;   // next_job, 결과 합계 보호
+    int next_job;           // 다음에 가져갈 작업 인덱스
+    uint64_t bytes;         // 복사한 총 바이트 수
+    int copied;             // 복사 완료한 파일 수
+    int failed;             // 실패한 파일 수
+} ExportCtx;
+
+// inode의 시간 정보를 호스트 파일/디렉토리에 적용할 timespec 배열로 변환
+static void export_times(const struct ext2_inode* ino, struct timespec ts[2]) {
+    ts[0].tv_sec = ino->i_atime;
+    ts[0].tv_nsec = 0;
+    ts[1].tv_sec = ino->i_mtime;
+    ts[1].tv_nsec = 0;
+}
+
+// 하위 트리를 순회하며 디렉토리 생성 및 파일 작업 목록 구성
+static int export_walk(ExportCtx* ctx, Node* dir, const char* host_dir) {
+    // 디렉토리 자체 생성 (권한은 파일 복사 후 마지막에 복원)
+    if (mkdir(host_dir, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "export: mkdir '%s': %s\n", host_dir, strerror(errno));
+        return -1;
+    }
+
+    Node* c = dir->first_child;
+    while (c) {
+        // 호스트 경로 = host_dir/name
+        size_t len = strlen(host_dir) + 1 + strlen(c->name) + 1;
+        if (len > PATH_MAX_LEN) {
+            fprintf(stderr, "export: path too long under '%s'\n", host_dir);
+            ctx->skipped++;
+            c = c->next_sibling;
+            continue;
+        }
+        char* path = malloc(len);
+        if (!path || snprintf(path, len, "%s/%s", host_dir, c->name) >= (int)len) {
+            fprintf(stderr, "export: cannot build path for '%s' under '%s'\n", c->name, host_dir);
+            free(path);
+            ctx->skipped++;
+            c = c->next_sibling;
+            continue;
+        }
+
+        if (c->file_type == EXT2_FT_DIR) {
+            if (export_walk(ctx, c, path) < 0) {
+                free(path);
+                return -1;
+            }
+            free(path);
+        }
+        else if (c->file_type == EXT2_FT_REG_FILE) {
+            // 첫 데이터 블록의 물리 번호를 정렬 키로 기록 (extent 파일도 블록 맵을 따라 구함)
+            struct ext2_inode ino;
+            read_inode(img_fd, c->inode_no, &ino);
+            uint32_t start = inode_bmap(img_fd, &ino, 0);
+            if (!start) {
+                // 앞부분이 hole인 sparse 파일: 첫 데이터 구간의 시작
+                BlockRun *runs = NULL;
+                int nruns = collect_block_runs(img_fd, &ino, block_size, &runs);
+                for (int i = 0; i < nruns && !start; i++)
+                    if (!runs[i].hole)
+                        start = runs[i].physical;
+                free(runs);
+            }
+
+            if (ctx->njobs == ctx->jobs_cap) {
+                ctx->jobs_cap = ctx->jobs_cap ? ctx->jobs_cap * 2 : 64;
+                ctx->jobs = realloc(ctx->jobs, sizeof(ExportJob) * ctx->jobs_cap);
+            }
+            ctx->jobs[ctx->njobs].host_path = path;
+            ctx->jobs[ctx->njobs].inode_no = c->inode_no;
+            ctx->jobs[ctx->njobs].start_block = start;
+            ctx->njobs++;
+        }
+        else {
+            // 심볼릭 링크, 장치 파일 등은 복사하지 않음
+            ctx->skipped++;
+            free(path);
+        }
+        c = c->next_sibling;
+    }
+
+    // 자식이 모두 처리된 뒤에 디렉토리를 기록 → 후위 순서
+    if (ctx->ndirs == ctx->dirs_cap) {
+        ctx->dirs_cap = ctx->dirs_cap ? ctx->dirs_cap * 2 : 16;
+        ctx->dirs = realloc(ctx->dirs, sizeof(ExportDir) * ctx->dirs_cap);
+    }
+    ctx->dirs[ctx->ndirs].host_path = strdup(host_dir);
+    ctx->dirs[ctx->ndirs].inode_no = dir->inode_no;
+    ctx->ndirs++;
+    return 0;
+}
+
+// qsort 비교 함수: 물리 시작 블록 오름차순
+static int export_job_cmp(const void* a, const void* b) {
+    const ExportJob* x = a;
+    const ExportJob* y = b;
+    if (x->start_block != y->start_block)
+        return x->start_block < y->start_block ? -1 : 1;
+    return 0;
+}
+
+// 파일 하나 복사: 데이터 구간은 연속 블록을 묶어서 읽고, hole 구간은 쓰지 않고 건너뜀
+static int export_copy_file(const ExportJob* job, int io_mode, char* buf, uint64_t* copied_bytes) {
+    struct ext2_inode ino;
+    read_inode(img_fd, job->inode_no, &ino);
+
+    int out = open(job->host_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out < 0) {
+        fprintf(stderr, "export: open '%s': %s\n", job->host_path, strerror(errno));
+        return -1;
+    }
+
+    BlockRun *runs = NULL;
+    int nruns = collect_block_runs(img_fd, &ino, block_size, &runs);
+    uint64_t size = inode_file_size(&ino);
+    int ret = 0;
+
+    if (io_mode == IO_DIRECT) {
+        // O_DIRECT 스캐너가 데이터 구간을 큰 요청으로 미리 읽어 줌
+        ScanRange *ranges = NULL;
+        int nranges = runs_to_scan_ranges(runs, nruns, size, &ranges);
+        ScanReader sr;
+        if (scan_open(&sr, ranges, nranges) == 0) {
+            const char *data;
+            uint64_t file_off;
+            ssize_t got;
+            while ((got = scan_next(&sr, &data, &file_off)) > 0) {
+                if (pwrite(out, data, got, file_off) != got) break;
+                *copied_bytes += got;
+            }
+            if (got != 0) {
+                fprintf(stderr, "export: copy '%s' failed\n", job->host_path);
+                ret = -1;
+            }
+            scan_close(&sr);
+            nruns = 0;     // 아래 버퍼드 경로는 건너뜀
+        }
+        free(ranges);
+    }
+
+    for (int ri = 0; ri < nruns && ret == 0; ri++) {
+        if (runs[ri].hole) continue;   // hole은 호스트 파일에서도 hole로 남김
+
+        for (uint32_t done = 0; done < runs[ri].len; ) {
+            uint32_t run = runs[ri].len - done;
+            if (run > EXPORT_IO_BLOCKS) run = EXPORT_IO_BLOCKS;
+
+            uint64_t file_off = (uint64_t)(runs[ri].logical + done) * block_size;
+            size_t want = (size_t)run * block_size;
+            if (file_off + want > size) want = size - file_off;
+
+            off_t img_off = (off_t)(runs[ri].physical + done) * block_size;
+            if (img_pread(img_fd, buf, want, img_off) != (ssize_t)want
+                || pwrite(out, buf, want, file_off) != (ssize_t)want) {
+                fprintf(stderr, "export: copy '%s' failed\n", job->host_path);
+                ret = -1;
+                break;
+            }
+            *copied_bytes += want;
+            done += run;
+        }
+    }
+    free(runs);
+
+    // 파일 크기 맞추기: 끝부분 hole까지 크기만 늘리고 블록은 할당하지 않음
+    if (ret == 0 && ftruncate(out, size) < 0) {
+        fprintf(stderr, "export: truncate '%s': %s\n", job->host_path, strerror(errno));
+        ret = -1;
+    }
+
+    // 권한 및 수정 시간 복원
+    struct timespec ts[2];
+    export_times(&ino, ts);
+    fchmod(out, ino.i_mode & 07777);
+    futimens(out, ts);
+    close(out);
+    return ret;
+}
+
+// 작업 스레드: 공유 인덱스에서 작업을 하나씩 가져와 복사
+static void* export_worker(void* arg) {
+    ExportCtx* ctx = arg;
+    char* buf = malloc((size_t)EXPORT_IO_BLOCKS * block_size);
+    uint64_t bytes = 0;
+    int copied = 0, failed = 0;
+
+    while (1) {
+        pthread_mutex_lock(&ctx->lock);
+        int idx = ctx->next_job++;
+        pthread_mutex_unlock(&ctx->lock);
+        if (idx >= ctx->njobs) break;
+
+        if (export_copy_file(&ctx->jobs[idx], ctx->io_mode, buf, &bytes) < 0)
+            failed++;
+        else
+            copied++;
+    }
+    free(buf);
+
+    // 스레드별 결과를 마지막에 한 번만 합산
+    pthread_mutex_lock(&ctx->lock);
+    ctx->bytes += bytes;
+    ctx->copied += copied;
+    ctx->failed += failed;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// export 명령어: 이미지 내 디렉토리 하위 트리를 호스트에 복원
+void command_export(const char* img_path, const char* host_path, int nthreads, int io_mode) {
+    Node* tgt = find_node(root, img_path);
+    if (!tgt) {
+        command_help_export();
+        return;
+    }
+    if (tgt->file_type != EXT2_FT_DIR) {
+        fprintf(stderr, "Error: '%s' is not directory\n", img_path);
+        return;
+    }
+    build_tree(tgt);   // 지연 적재 모드라면 하위 트리 전체 적재
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // 1) 디렉토리 생성 및 파일 작업 목록 구성
+    ExportCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    pthread_mutex_init(&ctx.lock, NULL);
+    ctx.io_mode = io_mode;
+    int walk_ok = export_walk(&ctx, tgt, host_path) == 0;
+
+    // 2) 물리 시작 블록 순으로 정렬 → 스레드들이 대체로 순차적으로 읽게 됨
+    if (ctx.njobs > 1)
+        qsort(ctx.jobs, ctx.njobs, sizeof(ExportJob), export_job_cmp);
+
+    // 3) 작업 스레드 풀 실행
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    if (nthreads > EXPORT_MAX_THREADS) nthreads = EXPORT_MAX_THREADS;
+    if (nthreads > ctx.njobs) nthreads = ctx.njobs > 0 ? ctx.njobs : 1;
+
+    pthread_t tids[EXPORT_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&tids[i], NULL, export_worker, &ctx) != 0) break;
+        started++;
+    }
+    if (started == 0)
+        export_worker(&ctx);   // 스레드 생성 실패 시 현재 스레드에서 처리
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    // 4) 디렉토리 권한/시간 복원 (후위 순서라 자식 쓰기가 모두 끝난 뒤 적용됨)
+    for (int i = 0; i < ctx.ndirs; i++) {
+        struct ext2_inode ino;
+        read_inode(img_fd, ctx.dirs[i].inode_no, &ino);
+        struct timespec ts[2];
+        export_times(&ino, ts);
+        chmod(ctx.dirs[i].host_path, ino.i_mode & 07777);
+        utimensat(AT_FDCWD, ctx.dirs[i].host_path, ts, 0);
+        free(ctx.dirs[i].host_path);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (sec <= 0) sec = 1e-9;
+
+    // 5) 결과 보고
+    printf("%d directories, %d files exported", ctx.ndirs, ctx.copied);
+    if (ctx.failed) printf(", %d failed", ctx.failed);
+    if (ctx.skipped) printf(", %d skipped", ctx.skipped);
+    if (!walk_ok) printf(" (incomplete)");
+    printf("\n%llu bytes in %.3f s (%.2f MB/s, %.1f files/s, %d threads)\n\n",
+           (unsigned long long)ctx.bytes, sec,
+           ctx.bytes / sec / (1024.0 * 1024.0), ctx.copied / sec, started ? started : 1);
+
+    for (int i = 0; i < ctx.njobs; i++)
+        free(ctx.jobs[i].host_path);
+    free(ctx.jobs);
+    free(ctx.dirs);
+    pthread_mutex_destroy(&ctx.lock);
+}
+
+// help 명령어
+void command_help(const char* cmd) {
+    if (cmd == NULL) {
+        // 기본 help
+        command_help_all();
+    }
+    // tree 명령어 help
+    else if (strcmp(cmd, "tree") == 0) {
+        command_help_tree();
+    }
+    // print 명령어 help
+    else if (strcmp(cmd, "print") == 0) {
+        command_help_print();
+    }
+
+    // export 명령어 help
+    else if (strcmp(cmd, "export") == 0) {
+        command_help_export();
+    }
+    // bench 명령어 help
+    else if (strcmp(cmd, "bench") == 0) {
+        command_help_bench();
+    }
+    // df 명령어 help
+    else if (strcmp(cmd, "df") == 0) {
+        command_help_df();
+    }
+    // frag 명령어 help
+    else if (strcmp(cmd, "frag") == 0) {
+        command_help_frag();
+    }
+    // blk2path 명령어 help
+    else if (strcmp(cmd, "blk2path") == 0) {
+        command_help_blk2path();
+    }
+    // check 명령어 help
+    else if (strcmp(cmd, "check") == 0) {
+        command_help_check();
+    }
+    // imgdiff 명령어 help
+    else if (strcmp(cmd, "imgdiff") == 0) {
+        command_help_imgdiff();
+    }
+    // open 명령어 help
+    else if (strcmp(cmd, "open") == 0) {
+        command_help_open();
+    }
+    // use 명령어 help
+    else if (strcmp(cmd, "use") == 0) {
+        command_help_use();
+    }
+    // close 명령어 help
+    else if (strcmp(cmd, "close") == 0) {
+        command_help_close();
+    }
+    // dups 명령어 help
+    else if (strcmp(cmd, "dups") == 0) {
+        command_help_dups();
+    }
+    // reload 명령어 help
+    else if (strcmp(cmd, "reload") == 0) {
+        command_help_reload();
+    }
+    // import 명령어 help
+    else if (strcmp(cmd, "import") == 0) {
+        command_help_import();
+    }
+    // stats 명령어 help
+    else if (strcmp(cmd, "stats") == 0) {
+        command_help_stats();
+    }
+    // find 명령어 help
+    else if (strcmp(cmd, "find") == 0) {
+        command_help_find();
+    }
+    // du 명령어 help
+    else if (strcmp(cmd, "du") == 0) {
+        command_help_du();
+    }
+    // summary 명령어 help
+    else if (strcmp(cmd, "summary") == 0) {
+        command_help_summary();
+    }
+    // ino2path 명령어 help
+    else if (strcmp(cmd, "ino2path") == 0) {
+        command_help_ino2path();
+    }
+
+    // help 명령어 help
+    else if (strcmp(cmd, "help") == 0) {
+        command_help_help();
+    }
+    // exit 명령어 help
+    else if (strcmp(cmd, "exit") == 0) {
+        command_help_exit();
+    }
+    else {
+        // 올바르지 않은 명령어
+        fprintf(stderr, "invalid command -- '%s'\n", cmd);
+        command_help_all();
+    }
+}
+
+// 기본 help 명령어
+void command_help_all() {
+    printf("Usage :\n");
+    printf("  > tree <PATH> [OPTION]... : display the directory structure if <PATH> is a directory\n");
+    printf("    -r : display the directory structure recursively if <PATH> is a directory\n");
+    printf("    -s : display the directory structure if <PATH> is a directory, including the size of each file\n");
+    printf("    -p : display the directory structure if <PATH> is a directory, including the permissions of each directory and file\n");
+    printf("    --json : print the directory structure as one nested JSON document (name, inode, type, size, mode)\n");
+    printf("    --ndjson : print one JSON object per line, with its path, for the directory and each entry\n");
+    printf("  > print <PATH> [OPTION]... : print the contents on the standard output if <PATH> is a file\n");
+    printf("    -n <line_number> : print only the first <line_number> lines of its contents on the standard output if <PATH> is file\n");
+    printf("    -d : read with large O_DIRECT requests, bypassing the page cache\n");
+    printf("    -x : print a hex dump (offset, 16 bytes in hex, printable characters); with -n, only the first <line_number> rows\n");
+    printf("    -b : write the raw bytes to the standard output (holes stay holes when it is a regular file)\n");
+    printf("  > export <IMG_DIR> <HOST_DIR> [OPTION]... : copy the subtree of <IMG_DIR> to <HOST_DIR> on the host\n");
+    printf("    -j <threads> : number of worker threads copying files in parallel\n");
+    printf("    -d : read with large O_DIRECT requests, bypassing the page cache\n");
+    printf("  > bench : compare directory tree load time at several I/O queue depths\n");
+    printf("  > df [OPTION]... : show used/free blocks and the free extent size histogram from the block bitmaps\n");
+    printf("    -j <threads> : number of worker threads scanning block groups in parallel\n");
+    printf("  > frag [PATH] : show per-file fragmentation (number of physical runs) under <PATH>\n");
+    printf("  > blk2path <BLOCK> [OPTION]... : show the file (or metadata) that owns physical block <BLOCK>\n");
+    printf("    -r : rebuild the block index saved next to the image\n");
+    printf("  > ino2path <INODE> : show every path that links to inode number <INODE>\n");
+    printf("  > check [OPTION]... : read-only consistency check of bitmaps, block ownership, link counts and directory entries\n");
+    printf("    -j <threads> : number of worker threads checking block groups in parallel\n");
+    printf("  > imgdiff <OTHER_IMAGE> [PATH] : list paths under [PATH] added (A), removed (D) or modified (M) in <OTHER_IMAGE>\n");
+    printf("  > open <NAME> <IMAGE> : open another ext2 image under <NAME> without leaving the current one\n");
+    printf("  > use [NAME] : run the following commands on the image opened as [NAME] (list open images if omitted)\n");
+    printf("  > close <NAME> : close the image opened as <NAME>\n");
+    printf("  > dups [PATH] [OPTION]... : list groups of regular files under [PATH] with identical contents and the bytes they waste\n");
+    printf("    -j <threads> : number of worker threads hashing file contents in parallel\n");
+    printf("  > find [PATH] [OPTION]... : list paths under [PATH] matching every given test\n");
+    printf("    -name <PATTERN> : file name matches the shell pattern <PATTERN>\n");
+    printf("    -type <f|d|l> : regular file, directory or symbolic link\n");
+    printf("  > reload : re-read the image and update only the directories that changed since they were loaded\n");
+    printf("  > import <HOST_DIR> <IMG_DIR> [OPTION]... : copy the contents of <HOST_DIR> on the host into <IMG_DIR> in the image\n");
+    printf("    -n : only report the inodes and blocks that would be needed\n");
+    printf("  > stats [OPTION] : show I/O, inode, lookup and node counters and load/lookup/render time since start\n");
+    printf("    -r : show the counters, then count again from zero\n");
+    printf("  > du [PATH] [OPTION]... : show the disk usage (KB) of each directory under [PATH]\n");
+    printf("    -s : show only the total for [PATH]\n");
+    printf("  > summary [PATH] : count entries by type, hard links, and show size and mtime age histograms under [PATH]\n");
+    printf("  > help [COMMAND] : show commands for program\n");
+    printf("  > exit : exit program\n");
+}
+
+// tree 명령어 help
+void command_help_tree() {
+    printf("Usage :\n");
+    printf("  > tree <PATH> [OPTION]... : display the directory structure if <PATH> is a directory\n");
+    printf("    -r : display the directory structure recursively if <PATH> is a directory\n");
+    printf("    -s : display the directory structure if <PATH> is a directory, including the size of each file\n");
+    printf("    -p : display the directory structure if <PATH> is a directory, including the permissions of each directory and file\n");
+    printf("    --json : print the directory structure as one nested JSON document (name, inode, type, size, mode)\n");
+    printf("    --ndjson : print one JSON object per line, with its path, for the directory and each entry\n");
+}
+// print 명령어 help
+void command_help_print() {
+    printf("Usage :\n");
+    printf("  > print <PATH> [OPTION]... : print the contents on the standard output if <PATH> is a file\n");
+    printf("    -n <line_number> : print only the first <line_number> lines of its contents on the standard output if <PATH> is file\n");
+    printf("    -d : read with large O_DIRECT requests, bypassing the page cache\n");
+    printf("    -x : print a hex dump (offset, 16 bytes in hex, printable characters); with -n, only the first <line_number> rows\n");
+    printf("    -b : write the raw bytes to the standard output (holes stay holes when it is a regular file)\n");
+}
+// export 명령어 help
+void command_help_export() {
+    printf("Usage :\n");
+    printf("  > export <IMG_DIR> <HOST_DIR> [OPTION]... : copy the subtree of <IMG_DIR> to <HOST_DIR> on the host\n");
+    printf("    -j <threads> : number of worker threads copying files in parallel\n");
+    printf("    -d : read with large O_DIRECT requests, bypassing the page cache\n");
+}
+// bench 명령어 help
+void command_help_bench() {
+    printf("Usage :\n");
+    printf("  > bench : compare directory tree load time at several I/O queue depths\n");
+    printf("    each depth starts with an empty block cache and reports the reads it issued\n");
+}
+// df 명령어 help
+void command_help_df() {
+    printf("Usage :\n");
+    printf("  > df [OPTION]... : show used/free blocks and the free extent size histogram from the block bitmaps\n");
+    printf("    -j <threads> : number of worker threads scanning block groups in parallel\n");
+}
+// frag 명령어 help
+void command_help_frag() {
+    printf("Usage :\n");
+    printf("  > frag [PATH] : show per-file fragmentation (number of physical runs) under <PATH>\n");
+}
+// blk2path 명령어 help
+void command_help_blk2path() {
+    printf("Usage :\n");
+    printf("  > blk2path <BLOCK> [OPTION]... : show the file (or metadata) that owns physical block <BLOCK>\n");
+    printf("    -r : rebuild the block index saved next to the image\n");
+}
+// ino2path 명령어 help
+void command_help_ino2path() {
+    printf("Usage :\n");
+    printf("  > ino2path <INODE> : show every path that links to inode number <INODE>\n");
+}
+// check 명령어 help
+void command_help_check() {
+    printf("Usage :\n");
+    printf("  > check [OPTION]... : read-only consistency check of bitmaps, block ownership, link counts and directory entries\n");
+    printf("    -j <threads> : number of worker threads checking block groups in parallel\n");
+}
+// imgdiff 명령어 help
+void command_help_imgdiff() {
+    printf("Usage :\n");
+    printf("  > imgdiff <OTHER_IMAGE> [PATH] : list paths under [PATH] added (A), removed (D) or modified (M) in <OTHER_IMAGE>\n");
+    printf("    <OTHER_IMAGE> may also be a name given to an image with open\n");
+}
+// open 명령어 help
+void command_help_open() {
+    printf("Usage :\n");
+    printf("  > open <NAME> <IMAGE> : open another ext2 image under <NAME> without leaving the current one\n");
+    printf("    the first image is named main; all open images share one block cache (--cache-mb)\n");
+}
+// use 명령어 help
+void command_help_use() {
+    printf("Usage :\n");
+    printf("  > use [NAME] : run the following commands on the image opened as [NAME] (list open images if omitted)\n");
+}
+// close 명령어 help
+void command_help_close() {
+    printf("Usage :\n");
+    printf("  > close <NAME> : close the image opened as <NAME> (not the one in use)\n");
+}
+// dups 명령어 help
+void command_help_dups() {
+    printf("Usage :\n");
+    printf("  > dups [PATH] [OPTION]... : list groups of regular files under [PATH] with identical contents and the bytes they waste\n");
+    printf("    -j <threads> : number of worker threads hashing file contents in parallel\n");
+}
+// find 명령어 help
+void command_help_find() {
+    printf("Usage :\n");
+    printf("  > find [PATH] [OPTION]... : list paths under [PATH] matching every given test\n");
+    printf("    -name <PATTERN> : file name matches the shell pattern <PATTERN>\n");
+    printf("    -type <f|d|l> : regular file, directory or symbolic link\n");
+}
+// reload 명령어 help
+void command_help_reload() {
+    printf("Usage :\n");
+    printf("  > reload : re-read the image and update only the directories that changed since they were loaded\n");
+}
+// du 명령어 help
+void command_help_du() {
+    printf("Usage :\n");
+    printf("  > du [PATH] [OPTION]... : show the disk usage (KB) of each directory under [PATH]\n");
+    printf("    -s : show only the total for [PATH]\n");
+}
+// summary 명령어 help
+void command_help_summary() {
+    printf("Usage :\n");
+    printf("  > summary [PATH] : count entries by type, hard links, and show size and mtime age histograms under [PATH]\n");
+}
+// import 명령어 help
+void command_help_import() {
+    printf("Usage :\n");
+    printf("  > import <HOST_DIR> <IMG_DIR> [OPTION]... : copy the contents of <HOST_DIR> on the host into <IMG_DIR> in the image\n");
+    printf("    -n : only report the inodes and blocks that would be needed\n");
+}
+// stats 명령어 help
+void command_help_stats() {
+    printf("Usage :\n");
+    printf("  > stats [OPTION] : show I/O, inode, lookup and node counters and load/lookup/render time since start\n");
+    printf("    -r : show the counters, then count again from zero\n");
+}
+// exit 명령어 help
+void command_help_exit() {
+    printf("Usage :\n");
+    printf("  > exit : exit program\n");
+}
+// help 명령어 help
+void command_help_help() {
+    printf("Usage :\n");
+    printf("  > help [COMMAND] : show commands for program\n");
+}
+
+
+// 전체 경로 길이와 각 구성 요소 길이 검사
+bool validate_path(const char *path) {
+    size_t len = strlen(path);
+    if (len > PATH_MAX_LEN) {
+        fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
+                len, PATH_MAX_LEN);
+        return false;
+    }
+    // 각 디렉터리/파일 이름 부분 검사
+    // strdupa나 strdup을 쓰지 않고 안전하게 복사
+    char buf[PATH_MAX_LEN + 1];
+    strncpy(buf, path, PATH_MAX_LEN);
+    buf[PATH_MAX_LEN] = '\0';
+
+    char *p = buf;
+    char *tok;
+    while ((tok = strsep(&p, "/")) != NULL) {
+        if (strlen(tok) > EXT2_NAME_LEN) {
+            fprintf(stderr,
+                    "Error: component '%s' length %zu exceeds maximum %d bytes\n",
+                    tok, strlen(tok), EXT2_NAME_LEN);
+            return false;
+        }
+    }
+    return true;
+}
+
+static Node* lookup_path(Node* base, const char* path, bool follow_last, int* depth, bool* loop);
+
+// fast symlink인지: 대상 경로가 i_block에 직접 저장되어 블록 맵이 없음
+// 확장 속성 블록이 있으면 i_blocks가 0이 아니므로, 그 블록 몫만 있을 때도 fast symlink로 봄
+static bool inode_is_fast_symlink(const struct ext2_inode *ino, uint32_t block_size) {
+    if ((ino->i_mode & S_IFMT) != S_IFLNK || ino->i_size >= sizeof(ino->i_block))
+        return false;
+    uint32_t ea_sectors = ino->i_file_acl ? block_size / 512 : 0;
+    return ino->i_blocks == ea_sectors;
+}
+
+// 심볼릭 링크 노드의 대상 경로 (tree_gen이 바뀌지 않았으면 보관한 것을 그대로)
+// fast symlink는 i_block에 저장된 문자열을 I/O 없이, 그 외에는 첫 데이터 블록에서 읽음
+static const char* node_link_target(Node* n) {
+    if (n->link && n->link->gen == tree_gen)
+        return n->link->target;
+    if (n->link) {
+        stat_add(STAT_NODE_BYTES_FREED, sizeof(NodeLink) + strlen(n->link->target) + 1);
+        free(n->link);
+        n->link = NULL;
+    }
+    struct ext2_inode ino;
+    read_inode(img_fd, n->inode_no, &ino);
+    size_t len = ino.i_size;
+    if ((ino.i_mode & S_IFMT) != S_IFLNK || len == 0 || len >= block_size)
+        return NULL;
+    NodeLink* l = malloc(sizeof(NodeLink) + len + 1);
+    if (inode_is_fast_symlink(&ino, block_size)) {
+        memcpy(l->target, ino.i_block, len);
+    } else {
+        uint32_t blk = inode_bmap(img_fd, &ino, 0);
+        if (!blk || img_pread(img_fd, l->target, len, (off_t)blk * block_size) != (ssize_t)len) {
+            free(l);
+            return NULL;
+        }
+    }
+    l->target[len] = '\0';
+    l->node = NULL;
+    l->gen = tree_gen;
+    n->link = l;
+    stat_add(STAT_NODE_BYTES_ALLOC, sizeof(NodeLink) + len + 1);
+    return l->target;
+}
+
+// 심볼릭 링크를 따라간 노드 (상대 경로 대상은 링크가 있는 디렉토리 기준)
+// 성공한 결과는 링크 노드에 보관해 트리가 바뀌기 전까지는 다시 따라가지 않음
+static Node* follow_link(Node* n, int* depth, bool* loop) {
+    stat_add(STAT_SYMLINK_FOLLOWS, 1);
+    if (n->link && n->link->gen == tree_gen && n->link->node) {
+        stat_add(STAT_SYMLINK_MEMO_HITS, 1);
+        return n->link->node;
+    }
+    if (++*depth > SYMLINK_MAX_FOLLOW) {
+        *loop = true;
+        return NULL;
+    }
+    const char* target = node_link_target(n);
+    if (!target)
+        return NULL;
+    Node* t = lookup_path(n->parent ? n->parent : root, target, true, depth, loop);
+    if (t && n->link) {
+        n->link->node = t;
+        n->link->gen = tree_gen;
+    }
+    return t;
+}
+
+// base부터 path를 따라감: 중간 구성 요소의 심볼릭 링크는 항상, 마지막은 follow_last일 때 따라감
+// depth는 지금까지 따라간 링크 수 (SYMLINK_MAX_FOLLOW를 넘으면 *loop를 세우고 NULL)
+static Node* lookup_path(Node* base, const char* path, bool follow_last, int* depth, bool* loop) {
+    // 절대 경로라면 root부터, 상대 경로면 base 노드부터 탐색 시작
+    Node* cur = (path[0] == '/') ? root : base;
+    char* buf = strdup(path);
+    char* save;
+    char* tok = strtok_r(buf, "/", &save);
+    // 토큰(디렉토리/파일 이름)마다 하위 노드로 이동
+    while (tok && cur) {
+        char* next_tok = strtok_r(NULL, "/", &save);
+        Node* next = NULL;
+        if (strcmp(tok, ".") == 0 || strcmp(tok, "..") == 0) {
+            // 디렉토리에서만 의미가 있음, 루트의 ..는 루트
+            if (cur->file_type == EXT2_FT_DIR)
+                next = (tok[1] == '.' && cur->parent) ? cur->parent : cur;
+        } else {
+            // 현재 노드(cur)의 자식들 중에서 이름이 일치하는 노드 찾기
+            for (Node* child = cur->first_child; child; child = child->next_sibling) {
+                if (strcmp(child->name, tok) == 0) {
+                    next = child;
+                    break;
+                }
+            }
+            // 아직 적재되지 않은 디렉토리면 디스크에서 이름 하나만 조회해 노드 추가
+            // (htree 디렉토리는 해시 리프 블록 하나만 읽음)
+            if (next) {
+                stat_add(STAT_LOOKUP_HITS, 1);
+            } else if (!cur->loaded && cur->file_type == EXT2_FT_DIR) {
+                uint32_t ino;
+                uint8_t type;
+                stat_add(STAT_LOOKUP_MISSES, 1);
+                if (dir_lookup(cur->inode_no, tok, &ino, &type) == 1) {
+                    next = create_node(tok, ino, type);
+                    insert_child_sorted(cur, next);
+                }
+            }
+        }
+        if (next && next->file_type == EXT2_FT_SYMLINK && (next_tok || follow_last))
+            next = follow_link(next, depth, loop);
+        // 찾은 자식으로 현재 위치 이동
+        cur = next;
+        tok = next_tok;
+    }
+    // 복제했던 메모리 해제
+    free(buf);
+    return cur;
+}
+
+// 경로 문자열(path)에 해당하는 노드를 트리에서 찾아 반환 (심볼릭 링크는 대상으로 따라감)
+// current: 상대 경로 탐색 시 기준이 될 노드 (대부분 root)
+// path   : 절대("/") 또는 상대(".") 경로, 또는 "dir/sub/file" 등 ("."과 ".." 구성 요소 포함 가능)
+Node* find_node(Node* current, const char* path) {
+    if (strcmp(path, "/") == 0 || strcmp(path, ".") == 0)
+        return root;   // "/" 또는 "." 는 언제나 루트 디렉토리
+
+    PhaseTimer pt;
+    phase_begin(&pt, PHASE_LOOKUP);
+    int depth = 0;
+    bool loop = false;
+    Node* cur = lookup_path(current, path, true, &depth, &loop);
+    if (loop)
+        fprintf(stderr, "Error: too many levels of symbolic links in '%s'\n", path);
+    phase_end(&pt);
+    return cur;
+}
+
+
+// 트리 구조의 모든 노드를 재귀적으로 해제하는 함수
+void free_tree(Node* n) {
+    //  자식 노드부터 순회하며 재귀적으로 해제
+    Node* c = n->first_child;
+    while (c) {
+        Node* next = c->next_sibling;  // 다음 형제 노드를 미리 저장
+        free_tree(c);   // 자식 서브트리 해제
+        c = next;       // 다음 형제로 이동
+    }
+    //  현재 노드의 리소스 해제
+    ino_map_remove(n);
+    stat_add(STAT_NODES_FREED, 1);
+    stat_add(STAT_NODE_BYTES_FREED, sizeof(Node) + strlen(n->name) + 1);
+    if (n->link) {
+        stat_add(STAT_NODE_BYTES_FREED, sizeof(NodeLink) + strlen(n->link->target) + 1);
+        free(n->link);
+    }
+    tree_gen++;     // 이 노드를 가리키던 심볼릭 링크 결과 무효화
+    free(n->name);  // strdup으로 할당된 이름 문자열 메모리 해제
+    free(n);   // 노드 구조체 메모리 해제
+}
+
+// inode의 파일 크기 (일반 파일은 large_file 상위 32비트 포함)
+uint64_t inode_file_size(const struct ext2_inode *ino) {
+    uint64_t size = ino->i_size;
+    if ((ino->i_mode & S_IFMT) == S_IFREG)
+        size |= (uint64_t)ino->i_size_high << 32;
+    return size;
+}
+
+// 블록 매핑 구간 목록 (collect_block_runs 내부용)
+typedef struct RunList {
+    BlockRun *runs;
+    int cnt, cap;
+    uint32_t total;          // 파일 크기 기준 전체 논리 블록 수
+    uint32_t cursor;         // extent 매핑 시 다음에 올 논리 블록 번호
+    bool want_meta;          // 간접 블록/extent 노드 블록 번호도 모을지
+    uint32_t *meta;          // 블록 맵 자체가 차지하는 블록들
+    int meta_cnt, meta_cap;
+} RunList;
+
+// 블록 맵 메타데이터 블록(간접 블록, extent 인덱스/리프 블록) 기록
+static void meta_append(RunList *rl, uint32_t block) {
+    if (!rl->want_meta) return;
+    if (rl->meta_cnt == rl->meta_cap) {
+        rl->meta_cap = rl->meta_cap ? rl->meta_cap * 2 : 16;
+        rl->meta = realloc(rl->meta, sizeof(uint32_t) * rl->meta_cap);
+    }
+    rl->meta[rl->meta_cnt++] = block;
+}
+
+// 구간 추가: 직전 구간과 이어지면 병합
+static void run_append(RunList *rl, uint32_t logical, uint32_t physical, uint32_t len) {
+    // 파일 크기를 넘는 부분은 잘라냄
+    if (logical >= rl->total) return;
+    if (len > rl->total - logical) len = rl->total - logical;
+
+    bool hole = (physical == 0);
+    if (rl->cnt > 0) {
+        BlockRun *last = &rl->runs[rl->cnt - 1];
+        if (last->logical + last->len == logical && last->hole == hole
+            && (hole || last->physical + last->len == physical)) {
+            last->len += len;
+            return;
+        }
+    }
+    if (rl->cnt == rl->cap) {
+        rl->cap = rl->cap ? rl->cap * 2 : 16;
+        rl->runs = realloc(rl->runs, sizeof(BlockRun) * rl->cap);
+    }
+    BlockRun *r = &rl->runs[rl->cnt++];
+    r->logical = logical;
+    r->physical = physical;
+    r->len = len;
+    r->hole = hole;
+}
+
+// 간접 블록 한 단계 매핑: level 0이면 ptr 자체가 데이터 블록
+// span = 이 포인터가 담당하는 논리 블록 수
+static void map_indirect(int img_fd, unsigned int block_size, RunList *rl,
+                         uint32_t ptr, int level, uint32_t logical, uint64_t span)
+{
+    if (logical >= rl->total) return;
+
+    // 포인터가 0이면 담당 범위 전체가 hole (I/O 없음)
+    if (ptr == 0) {
+        uint64_t len = span;
+        if (len > rl->total - logical) len = rl->total - logical;
+        run_append(rl, logical, 0, (uint32_t)len);
+        return;
+    }
+    if (level == 0) {
+        run_append(rl, logical, ptr, 1);
+        return;
+    }
+
+    unsigned int ptrs_per_block = block_size / sizeof(uint32_t);
+    uint64_t child_span = span / ptrs_per_block;
+    meta_append(rl, ptr);
+    uint32_t *ptrs = malloc(block_size);
+    if (img_pread(img_fd, ptrs, block_size, (off_t)ptr * block_size) != (ssize_t)block_size)
+        memset(ptrs, 0, block_size);
+    for (unsigned i = 0; i < ptrs_per_block; i++) {
+        uint64_t l = logical + (uint64_t)i * child_span;
+        if (l >= rl->total) break;
+        map_indirect(img_fd, block_size, rl, ptrs[i], level - 1, (uint32_t)l, child_span);
+    }
+    free(ptrs);
+}
+
+// extent 트리 한 노드(i_block 또는 인덱스/리프 블록) 매핑
+// 리프의 extent 사이 빈 공간과 unwritten extent는 hole 구간으로 표현
+static void map_extent_node(int img_fd, unsigned int block_size, RunList *rl,
+                            const char *node, size_t node_size, int depth_left)
+{
+    const struct ext4_extent_header *eh = (const struct ext4_extent_header *)node;
+    if (eh->eh_magic != EXT4_EXT_MAGIC || depth_left < 0) return;
+    uint16_t entries = eh->eh_entries;
+    size_t max_entries = (node_size - sizeof(*eh)) / sizeof(struct ext4_extent);
+    if (entries > max_entries) entries = (uint16_t)max_entries;
+
+    if (eh->eh_depth == 0) {
+        const struct ext4_extent *ex = (const struct ext4_extent *)(eh + 1);
+        for (int i = 0; i < entries; i++) {
+            uint32_t len = ex[i].ee_len;
+            bool uninit = len > EXT4_EXT_INIT_MAX_LEN;
+            if (uninit) len -= EXT4_EXT_INIT_MAX_LEN;
+            // 48비트 물리 블록 번호 중 32비트를 넘는 것은 이 도구에서 다루지 않음
+            if (ex[i].ee_start_hi) continue;
+            if (ex[i].ee_block > rl->cursor)
+                run_append(rl, rl->cursor, 0, ex[i].ee_block - rl->cursor);
+            run_append(rl, ex[i].ee_block, uninit ? 0 : ex[i].ee_start_lo, len);
+            if (ex[i].ee_block + len > rl->cursor)
+                rl->cursor = ex[i].ee_block + len;
+        }
+        return;
+    }
+
+    // 인덱스 노드: 자식 블록을 읽어 재귀
+    const struct ext4_extent_idx *ix = (const struct ext4_extent_idx *)(eh + 1);
+    char *child = malloc(block_size);
+    for (int i = 0; i < entries; i++) {
+        if (ix[i].ei_leaf_hi) continue;
+        meta_append(rl, ix[i].ei_leaf_lo);
+        off_t off = (off_t)ix[i].ei_leaf_lo * block_size;
+        if (img_pread(img_fd, child, block_size, off) != (ssize_t)block_size) continue;
+        map_extent_node(img_fd, block_size, rl, child, block_size, depth_left - 1);
+    }
+    free(child);
+}
+
+// extent 트리에서 논리 블록 하나의 물리 블록 찾기 (없거나 unwritten이면 0)
+static uint32_t extent_bmap(int img_fd, const struct ext2_inode *ino, uint32_t logical) {
+    const char *node = (const char *)ino->i_block;
+    size_t node_size = sizeof(ino->i_block);
+    char *buf = NULL;
+    uint32_t result = 0;
+
+    for (int guard = 0; guard <= EXT4_EXT_MAX_DEPTH; guard++) {
+        const struct ext4_extent_header *eh = (const struct ext4_extent_header *)node;
+        if (eh->eh_magic != EXT4_EXT_MAGIC) break;
+        uint16_t entries = eh->eh_entries;
+        size_t max_entries = (node_size - sizeof(*eh)) / sizeof(struct ext4_extent);
+        if (entries > max_entries) entries = (uint16_t)max_entries;
+
+        if (eh->eh_depth == 0) {
+            const struct ext4_extent *ex = (const struct ext4_extent *)(eh + 1);
+            for (int i = 0; i < entries; i++) {
+                uint32_t len = ex[i].ee_len;
+                if (len > EXT4_EXT_INIT_MAX_LEN) continue;   // unwritten
+                if (logical >= ex[i].ee_block && logical - ex[i].ee_block < len && !ex[i].ee_start_hi) {
+                    result = ex[i].ee_start_lo + (logical - ex[i].ee_block);
+                    break;
+                }
+            }
+            break;
+        }
+
+        // logical 이하로 시작하는 마지막 인덱스 선택
+        const struct ext4_extent_idx *ix = (const struct ext4_extent_idx *)(eh + 1);
+        int pos = -1;
+        for (int i = 0; i < entries && ix[i].ei_block <= logical; i++)
+            pos = i;
+        if (pos < 0 || ix[pos].ei_leaf_hi) break;
+        if (!buf) buf = malloc(block_size);
+        if (img_pread(img_fd, buf, block_size, (off_t)ix[pos].ei_leaf_lo * block_size) != (ssize_t)block_size)
+            break;
+        node = buf;
+        node_size = block_size;
+    }
+    free(buf);
+    return result;
+}
+
+// inode의 블록 맵을 (논리 오프셋, 길이, hole) 구간 목록으로 변환
+// 0 블록 포인터는 버리지 않고 hole 구간으로 표현하므로 논리 오프셋이 보존됨
+int collect_block_runs(int img_fd,
+                       const struct ext2_inode *ino,
+                       unsigned int block_size,
+                       BlockRun **out_runs)
+{
+    return collect_block_map(img_fd, ino, block_size, out_runs, NULL, NULL);
+}
+
+// collect_block_runs + 블록 맵 자체가 차지하는 메타데이터 블록 목록
+// out_meta가 NULL이면 메타데이터 블록은 모으지 않음
+int collect_block_map(int img_fd,
+                      const struct ext2_inode *ino,
+                      unsigned int block_size,
+                      BlockRun **out_runs,
+                      uint32_t **out_meta,
+                      int *out_nmeta)
+{
+    RunList rl = { 0 };
+    rl.want_meta = (out_meta != NULL);
+    if (out_meta) {
+        *out_meta = NULL;
+        *out_nmeta = 0;
+    }
+
+    // fast symlink는 i_block에 경로 문자열이 직접 저장되므로 블록 맵이 없음
+    if (inode_is_fast_symlink(ino, block_size)) {
+        *out_runs = NULL;
+        return 0;
+    }
+    uint64_t total = (inode_file_size(ino) + block_size - 1) / block_size;
+    rl.total = total > UINT32_MAX ? UINT32_MAX : (uint32_t)total;
+
+    // extent 트리 inode: 간접 블록 경로와 같은 형태의 구간 목록 생성
+    if (ino->i_flags & EXT4_EXTENTS_FL) {
+        map_extent_node(img_fd, block_size, &rl, (const char *)ino->i_block,
+                        sizeof(ino->i_block), EXT4_EXT_MAX_DEPTH);
+        if (rl.cursor < rl.total)
+            run_append(&rl, rl.cursor, 0, rl.total - rl.cursor);   // 끝부분 hole
+        *out_runs = rl.runs;
+        if (out_meta) {
+            *out_meta = rl.meta;
+            *out_nmeta = rl.meta_cnt;
+        }
+        return rl.cnt;
+    }
+
+    uint64_t ptrs_per_block = block_size / sizeof(uint32_t);
+    uint32_t logical = 0;
+
+    // 1) direct blocks
+    for (int i = 0; i < 12; i++, logical++)
+        map_indirect(img_fd, block_size, &rl, ino->i_block[i], 0, logical, 1);
+
+    // 2) single / double / triple indirect
+    uint64_t span = ptrs_per_block;
+    uint64_t l = logical;
+    for (int level = 1; level <= 3 && l < rl.total; level++) {
+        map_indirect(img_fd, block_size, &rl, ino->i_block[11 + level], level, (uint32_t)l, span);
+        l += span;
+        span *= ptrs_per_block;
+    }
+
+    *out_runs = rl.runs;
+    if (out_meta) {
+        *out_meta = rl.meta;
+        *out_nmeta = rl.meta_cnt;
+    }
+    return rl.cnt;
+}
+
+// 실제 데이터가 있는 블록 번호만 순서대로 모음 (hole 제외)
+int collect_data_blocks(int img_fd,
+                               const struct ext2_inode *ino,
+                               unsigned int block_size,
+                               uint32_t **out_blocks)
+{
+    BlockRun *runs = NULL;
+    int nruns = collect_block_runs(img_fd, ino, block_size, &runs);
+
+    int cnt = 0;
+    for (int i = 0; i < nruns; i++)
+        if (!runs[i].hole)
+            cnt += runs[i].len;
+
+    uint32_t *blocks = malloc(sizeof(uint32_t) * (cnt ? cnt : 1));
+    cnt = 0;
+    for (int i = 0; i < nruns; i++) {
+        if (runs[i].hole) continue;
+        for (uint32_t j = 0; j < runs[i].len; j++)
+            blocks[cnt++] = runs[i].physical + j;
+    }
+    free(runs);
+
+    *out_blocks = blocks;
+    return cnt;
+}
+
+// 파일 스트림 초기화: 구간 목록을 앞에서부터 i_size까지 읽음
+// io_mode가 IO_DIRECT면 데이터 구간을 O_DIRECT 순차 스캐너로 읽어 페이지 캐시를 오염시키지 않음
+void file_stream_init(FileStream *fs, const struct ext2_inode *ino,
+                      const BlockRun *runs, int nruns, int io_mode)
+{
+    fs->runs = runs;
+    fs->nruns = nruns;
+    fs->run_idx = 0;
+    fs->run_off = 0;
+    fs->pos = 0;
+    fs->size = inode_file_size(ino);
+    fs->buf = NULL;
+    fs->zeros = calloc(FILE_STREAM_BLOCKS, block_size);
+    fs->scan = NULL;
+    fs->ranges = NULL;
+
+    if (io_mode == IO_DIRECT) {
+        int nranges = runs_to_scan_ranges(runs, nruns, fs->size, &fs->ranges);
+        fs->scan = malloc(sizeof(ScanReader));
+        if (scan_open(fs->scan, fs->ranges, nranges) < 0) {
+            // 스캐너를 만들 수 없으면 버퍼드 읽기로 대체
+            free(fs->scan);
+            free(fs->ranges);
+            fs->scan = NULL;
+            fs->ranges = NULL;
+        }
+    }
+    if (!fs->scan)
+        fs->buf = malloc((size_t)FILE_STREAM_BLOCKS * block_size);
+}
+
+// 다음 청크 반환: data 구간은 연속 블록을 한 번에 pread, hole 구간은 I/O 없이 0 버퍼
+// 반환값: 청크 길이 (끝이면 0, 오류면 -1)
+ssize_t file_stream_next(FileStream *fs, const char **data, bool *hole) {
+    if (fs->pos >= fs->size) return 0;
+
+    // 구간 목록 밖(파일 끝 부분이 매핑되지 않은 경우)은 hole로 취급
+    uint64_t max_blocks = FILE_STREAM_BLOCKS;
+    const BlockRun *r = fs->run_idx < fs->nruns ? &fs->runs[fs->run_idx] : NULL;
+    bool is_hole = (r == NULL) || r->hole;
+    if (r && r->len - fs->run_off < max_blocks)
+        max_blocks = r->len - fs->run_off;
+
+    uint64_t len = max_blocks * block_size;
+    if (len > fs->size - fs->pos) len = fs->size - fs->pos;
+
+    if (is_hole) {
+        *data = fs->zeros;
+    }
+    else if (fs->scan) {
+        // 스캐너 청크는 항상 현재 구간 안에 있음
+        ssize_t got = scan_next(fs->scan, data, NULL);
+        if (got <= 0) return -1;
+        len = (uint64_t)got;
+    }
+    else {
+        // 이어지는 데이터 구간들을 버퍼가 찰 때까지 모아 일괄 읽기
+        // → 물리적으로 흩어진 파일도 여러 읽기가 동시에 진행됨
+        IoReq reqs[FILE_STREAM_BLOCKS];
+        int nreq = 0;
+        uint64_t filled = 0;
+        uint64_t cap = (uint64_t)FILE_STREAM_BLOCKS * block_size;
+        uint64_t left = fs->size - fs->pos;
+        while (fs->run_idx < fs->nruns && !fs->runs[fs->run_idx].hole
+               && filled < cap && filled < left) {
+            const BlockRun *rr = &fs->runs[fs->run_idx];
+            uint64_t n = (uint64_t)(rr->len - fs->run_off) * block_size;
+            if (n > cap - filled) n = cap - filled;
+            if (n > left - filled) n = left - filled;
+            reqs[nreq].buf = fs->buf + filled;
+            reqs[nreq].len = n;
+            reqs[nreq].off = (off_t)(rr->physical + fs->run_off) * block_size;
+            nreq++;
+            filled += n;
+            fs->run_off += (uint32_t)((n + block_size - 1) / block_size);
+            if (fs->run_off >= rr->len) {
+                fs->run_idx++;
+                fs->run_off = 0;
+            }
+        }
+        if (io_read_batch(img_fd, reqs, nreq) > 0)
+            return -1;
+        fs->pos += filled;
+        *data = fs->buf;
+        *hole = false;
+        return (ssize_t)filled;
+    }
+    *hole = is_hole;
+
+    // 위치 전진
+    fs->pos += len;
+    if (r) {
+        fs->run_off += (uint32_t)((len + block_size - 1) / block_size);
+        if (fs->run_off >= r->len) {
+            fs->run_idx++;
+            fs->run_off = 0;
+        }
+    }
+    return (ssize_t)len;
+}
+
+void file_stream_free(FileStream *fs) {
+    if (fs->scan) {
+        scan_close(fs->scan);
+        free(fs->scan);
+        free(fs->ranges);
+    }
+    free(fs->buf);
+    free(fs->zeros);
+}
+
+// O_DIRECT 이미지 fd를 처음 사용할 때 한 번만 연다 (실패하면 -1)
+static pthread_once_t direct_once = PTHREAD_ONCE_INIT;
+// (gzip 이미지는 압축 해제를 거쳐야 하므로 열지 않음)
+static void open_direct_fd(void) {
+    img_direct_fd = img_gz ? -1 : open(img_path, O_RDONLY | O_DIRECT);
+}
+
+// 스캔 생산자 스레드가 채울 다음 청크 위치 계산 (없으면 false)
+static bool scan_next_chunk(ScanReader *sr, off_t *off, size_t *len, uint64_t *user_off) {
+    while (sr->prod_range < sr->nranges
+           && sr->prod_done >= sr->ranges[sr->prod_range].len) {
+        sr->prod_range++;
+        sr->prod_done = 0;
+    }
+    if (sr->prod_range >= sr->nranges) return false;
+
+    const ScanRange *r = &sr->ranges[sr->prod_range];
+    uint64_t n = r->len - sr->prod_done;
+    if (n > SCAN_CHUNK) n = SCAN_CHUNK;
+    *off = r->off + (off_t)sr->prod_done;
+    *len = (size_t)n;
+    *user_off = r->user_off + sr->prod_done;
+    sr->prod_done += n;
+    return true;
+}
+
+// 생산자 스레드: 두 버퍼를 번갈아 채워 소비자가 처리하는 동안 다음 청크를 미리 읽음
+static void *scan_producer(void *arg) {
+    ScanReader *sr = arg;
+    int slot = 0;
+    while (1) {
+        // 슬롯이 비워질 때까지 대기
+        pthread_mutex_lock(&sr->lock);
+        while (sr->slots[slot].state == SCAN_SLOT_FULL && !sr->stop)
+            pthread_cond_wait(&sr->cond, &sr->lock);
+        bool stop = sr->stop;
+        pthread_mutex_unlock(&sr->lock);
+        if (stop) break;
+
+        ScanSlot *s = &sr->slots[slot];
+        off_t off;
+        size_t len;
+        uint64_t user_off;
+        int state = SCAN_SLOT_FULL;
+        if (!scan_next_chunk(sr, &off, &len, &user_off)) {
+            state = SCAN_SLOT_EOF;
+        }
+        else {
+            // O_DIRECT는 오프셋/길이/버퍼가 정렬되어야 하므로 정렬된 범위를 읽고 앞부분은 건너뜀
+            off_t a_off = off & ~(off_t)(SCAN_ALIGN - 1);
+            size_t a_len = ((size_t)(off - a_off) + len + SCAN_ALIGN - 1) & ~(size_t)(SCAN_ALIGN - 1);
+            ssize_t got = img_pread(sr->fd, s->buf, a_len, a_off);
+            if (got < (ssize_t)(off - a_off + len)) {
+                state = SCAN_SLOT_ERR;
+            }
+            else if (!sr->direct) {
+                // 일반 fd로 대체된 경우 읽은 범위를 페이지 캐시에서 바로 내보냄
+                posix_fadvise(sr->fd, a_off, a_len, POSIX_FADV_DONTNEED);
+            }
+            s->data = s->buf + (off - a_off);
+            s->len = len;
+            s->user_off = user_off;
+        }
+
+        pthread_mutex_lock(&sr->lock);
+        s->state = state;
+        pthread_cond_broadcast(&sr->cond);
+        pthread_mutex_unlock(&sr->lock);
+        if (state != SCAN_SLOT_FULL) break;
+        slot ^= 1;
+    }
+    return NULL;
+}
+
+// 순차 스캔 시작: ranges 순서대로 읽으며 O_DIRECT가 불가능하면 일반 fd로 대체
+int scan_open(ScanReader *sr, const ScanRange *ranges, int nranges) {
+    memset(sr, 0, sizeof(*sr));
+    pthread_once(&direct_once, open_direct_fd);
+    sr->direct = (img_direct_fd >= 0);
+    sr->fd = sr->direct ? img_direct_fd : img_fd;
+    sr->ranges = ranges;
+    sr->nranges = nranges;
+    sr->cons_slot = -1;
+
+    for (int i = 0; i < 2; i++) {
+        if (posix_memalign((void **)&sr->slots[i].buf, SCAN_ALIGN, SCAN_CHUNK + 2 * SCAN_ALIGN) != 0) {
+            free(sr->slots[0].buf);
+            return -1;
+        }
+        sr->slots[i].state = SCAN_SLOT_EMPTY;
+    }
+    pthread_mutex_init(&sr->lock, NULL);
+    pthread_cond_init(&sr->cond, NULL);
+    if (pthread_create(&sr->thread, NULL, scan_producer, sr) != 0) {
+        pthread_mutex_destroy(&sr->lock);
+        pthread_cond_destroy(&sr->cond);
+        free(sr->slots[0].buf);
+        free(sr->slots[1].buf);
+        return -1;
+    }
+    return 0;
+}
+
+// 다음 청크 반환: 직전 청크 버퍼는 이 호출에서 생산자에게 돌려줌
+// 반환값: 청크 길이 (끝이면 0, 오류면 -1), user_off = 해당 범위의 사용자 오프셋
+ssize_t scan_next(ScanReader *sr, const char **data, uint64_t *user_off) {
+    pthread_mutex_lock(&sr->lock);
+    if (sr->cons_slot >= 0) {
+        sr->slots[sr->cons_slot].state = SCAN_SLOT_EMPTY;
+        pthread_cond_broadcast(&sr->cond);
+    }
+    int slot = sr->cons_slot < 0 ? 0 : sr->cons_slot ^ 1;
+    while (sr->slots[slot].state == SCAN_SLOT_EMPTY)
+        pthread_cond_wait(&sr->cond, &sr->lock);
+    int state = sr->slots[slot].state;
+    pthread_mutex_unlock(&sr->lock);
+
+    if (state == SCAN_SLOT_EOF) return 0;
+    if (state == SCAN_SLOT_ERR) return -1;
+    sr->cons_slot = slot;
+    *data = sr->slots[slot].data;
+    if (user_off) *user_off = sr->slots[slot].user_off;
+    return (ssize_t)sr->slots[slot].len;
+}
+
+void scan_close(ScanReader *sr) {
+    pthread_mutex_lock(&sr->lock);
+    sr->stop = true;
+    pthread_cond_broadcast(&sr->cond);
+    pthread_mutex_unlock(&sr->lock);
+    pthread_join(sr->thread, NULL);
+    pthread_mutex_destroy(&sr->lock);
+    pthread_cond_destroy(&sr->cond);
+    free(sr->slots[0].buf);
+    free(sr->slots[1].buf);
+}
+
+// 데이터 구간(hole 제외)을 i_size 범위 안의 스캔 범위 목록으로 변환
+int runs_to_scan_ranges(const BlockRun *runs, int nruns, uint64_t size, ScanRange **out) {
+    ScanRange *ranges = malloc(sizeof(ScanRange) * (nruns ? nruns : 1));
+    int cnt = 0;
+    for (int i = 0; i < nruns; i++) {
+        if (runs[i].hole) continue;
+        uint64_t file_off = (uint64_t)runs[i].logical * block_size;
+        if (file_off >= size) break;
+        uint64_t len = (uint64_t)runs[i].len * block_size;
+        if (len > size - file_off) len = size - file_off;
+        ranges[cnt].off = (off_t)runs[i].physical * block_size;
+        ranges[cnt].len = len;
+        ranges[cnt].user_off = file_off;
+        cnt++;
+    }
+    *out = ranges;
+    return cnt;
+}
+
+// ---------------------------------------------------------------------------
+// 일괄 블록 읽기 엔진: io_uring(raw syscall)으로 여러 읽기를 동시에 진행,
+// 커널이 지원하지 않으면 pread 반복으로 대체
+// ---------------------------------------------------------------------------
+
+// io_uring 링 상태 (SQ/CQ 공유 메모리)
+typedef struct Uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+} Uring;
+
+static Uring uring = { .fd = -1 };
+static int uring_state = 0;            // 0: 미시도, 1: 사용 가능, -1: 사용 불가
+static pthread_mutex_t uring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 링 생성: 실패하면 -1 (이후 pread로 대체)
+static int uring_setup(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return -1;
+
+    Uring *u = &uring;
+    u->fd = fd;
+    u->entries = p.sq_entries;
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    // 단일 mmap 기능이 있으면 SQ/CQ 링을 한 번에 매핑
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_len > u->sq_len) u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED) goto fail;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+
+    u->sq_head  = (unsigned *)((char *)u->sq_ptr + p.sq_off.head);
+    u->sq_tail  = (unsigned *)((char *)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask  = (unsigned *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)((char *)u->sq_ptr + p.sq_off.array);
+    u->cq_head  = (unsigned *)((char *)u->cq_ptr + p.cq_off.head);
+    u->cq_tail  = (unsigned *)((char *)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask  = (unsigned *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes     = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+    return 0;
+
+fail:
+    close(fd);
+    u->fd = -1;
+    return -1;
+}
+
+// 읽기 요청 하나를 SQ에 추가
+static void uring_queue_read(int fd, IoReq *r, uint64_t user_data) {
+    Uring *u = &uring;
+    unsigned tail = *u->sq_tail;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)r->buf;
+    sqe->len = (uint32_t)r->len;
+    sqe->off = (uint64_t)r->off;
+    sqe->user_data = user_data;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 이미지 읽기: pread와 같음
+// 블록 캐시에 등록된 이미지의 작은 읽기(메타데이터)는 공유 블록 캐시를 거침
+ssize_t img_pread(int fd, void *buf, size_t len, off_t off) {
+    BcImage *im = bcache_find(fd);
+    if (im && len <= (size_t)BCACHE_MAX_REQ_BLOCKS * im->block_size)
+        return bcache_pread(im, buf, len, off);
+    return img_pread_raw(fd, buf, len, off);
+}
+
+// 캐시를 거치지 않는 이미지 읽기: --time 통계에 호출 수/바이트 수를 더함
+// gzip 이미지의 fd면 압축 해제 기준 오프셋으로 읽음
+ssize_t img_pread_raw(int fd, void *buf, size_t len, off_t off) {
+    GzImage *gz = gz_find(fd);
+    ssize_t got = gz ? gz_pread(gz, buf, len, off) : pread(fd, buf, len, off);
+    stat_add(STAT_PREADS, 1);
+    if (got > 0)
+        stat_add(STAT_BYTES, (uint64_t)got);
+    return got;
+}
+
+// 요청 하나를 pread로 처리 (짧은 읽기는 끝까지 이어서 읽음)
+static void io_read_one(int fd, IoReq *r) {
+    size_t done = 0;
+    while (done < r->len) {
+        ssize_t got = img_pread_raw(fd, (char *)r->buf + done, r->len - done, r->off + (off_t)done);
+        if (got <= 0) break;
+        done += (size_t)got;
+    }
+    r->res = (ssize_t)done;
+}
+
+// 현재 일괄 읽기 백엔드 이름
+const char *io_backend_name(void) {
+    if (io_queue_depth <= 1 || uring_state < 0) return "pread";
+    return uring_state > 0 ? "io_uring" : "io_uring (not initialized)";
+}
+
+// 여러 읽기를 최대 io_queue_depth개까지 동시에 진행하고 모두 끝날 때까지 대기
+// 각 요청의 res에 읽은 바이트 수 저장, 반환값은 len만큼 읽지 못한 요청 수
+// 블록 캐시에 등록된 이미지면 캐시에 있는 요청은 바로 채우고 나머지 블록만 모아 읽음
+int io_read_batch(int fd, IoReq *reqs, int n) {
+    BcImage *im = bcache_find(fd);
+    if (im)
+        return bcache_read_batch(im, reqs, n);
+    return io_read_batch_raw(fd, reqs, n);
+}
+
+// 캐시를 거치지 않는 일괄 읽기 (io_uring, 쓸 수 없으면 pread)
+// CQ 링에 올라온 완료를 모두 거둠 (uring_lock을 잡은 상태에서 호출), 거둔 수 반환
+static unsigned uring_reap(int fd, IoReq *reqs, bool *completed, int *failed) {
+    Uring *u = &uring;
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned got = 0;
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        IoReq *r = &reqs[cqe->user_data];
+        if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+            uring_state = -1;      // IORING_OP_READ를 지원하지 않는 커널
+        r->res = cqe->res;
+        stat_add(STAT_URING, 1);
+        if (r->res > 0)
+            stat_add(STAT_BYTES, (uint64_t)r->res);
+        // 짧은 읽기나 실패는 pread로 마무리
+        if (r->res != (ssize_t)r->len)
+            io_read_one(fd, r);
+        if (r->res != (ssize_t)r->len) (*failed)++;
+        completed[cqe->user_data] = true;
+        head++;
+        got++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return got;
+}
+
+int io_read_batch_raw(int fd, IoReq *reqs, int n) {
+    int failed = 0;
+
+    pthread_mutex_lock(&uring_lock);
+    if (uring_state == 0 && io_queue_depth > 1)
+        uring_state = uring_setup(IO_URING_ENTRIES) == 0 ? 1 : -1;
+    // gzip 이미지는 파일 오프셋이 압축 해제 오프셋과 다르므로 io_uring을 쓰지 않음
+    bool use_uring = (uring_state > 0 && io_queue_depth > 1 && n > 1 && !gz_find(fd));
+
+    if (!use_uring) {
+        pthread_mutex_unlock(&uring_lock);
+        for (int i = 0; i < n; i++) {
+            io_read_one(fd, &reqs[i]);
+            if (reqs[i].res != (ssize_t)reqs[i].len) failed++;
+        }
+        return failed;
+    }
+
+    Uring *u = &uring;
+    unsigned depth = (unsigned)io_queue_depth;
+    if (depth > u->entries) depth = u->entries;
+    bool *completed = calloc(n, sizeof(bool));
+    int next = 0, done = 0;
+    unsigned inflight = 0, pending = 0;
+
+    while (done < n) {
+        // 1) 큐 깊이만큼 요청 채우기
+        while (inflight < depth && next < n) {
+            uring_queue_read(fd, &reqs[next], (uint64_t)next);
+            next++;
+            inflight++;
+            pending++;
+        }
+
+        // 2) 제출하면서 완료 하나 이상 대기
+        int ret = (int)syscall(__NR_io_uring_enter, u->fd, pending, 1,
+                               IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            // 링을 더 쓸 수 없으면 비활성화하고 남은 요청은 아래에서 pread로 처리
+            uring_state = -1;
+            break;
+        }
+        pending -= (unsigned)ret < pending ? (unsigned)ret : pending;
+
+        // 3) 완료 수확
+        unsigned got = uring_reap(fd, reqs, completed, &failed);
+        inflight -= got;
+        done += (int)got;
+    }
+
+    // 링 오류로 빠져나온 경우: 이미 제출된 요청은 아직 버퍼에 쓰는 중일 수 있으므로
+    // pread로 대체하거나 버퍼를 돌려주기 전에 완료를 모두 거둠 (제출 안 된 SQE는 커널로 가지 않음)
+    unsigned submitted = inflight - pending;
+    while (submitted > 0) {
+        unsigned got = uring_reap(fd, reqs, completed, &failed);
+        if (got == 0) {
+            // 완료 대기가 안 되는 상태면 커널이 CQE를 올릴 때까지 양보하며 링을 다시 확인
+            if (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+                && errno != EINTR)
+                sched_yield();
+            continue;
+        }
+        submitted -= got < submitted ? got : submitted;
+        done += (int)got;
+    }
+
+    // 링을 쓸 수 없게 된 경우: 끝나지 않은 요청은 pread로 처리
+    for (int i = 0; done < n && i < n; i++) {
+        if (completed[i]) continue;
+        io_read_one(fd, &reqs[i]);
+        if (reqs[i].res != (ssize_t)reqs[i].len) failed++;
+        done++;
+    }
+    free(completed);
+    pthread_mutex_unlock(&uring_lock);
+    return failed;
+}
+
+// 여러 inode를 한 번에 읽음: inode 테이블 위치는 메모리의 그룹 디스크립터 테이블로 계산
+// 범위를 벗어난 inode 번호(손상된 디렉토리 엔트리)는 읽지 않고 0으로 채움
+void read_inodes_batch(int img_fd, const uint32_t *inos, int n, struct ext2_inode *out) {
+    IoReq *reqs = malloc(sizeof(IoReq) * (n ? n : 1));
+    if (!reqs) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t group = (inos[i] - 1) / inodes_per_group;
+        uint32_t index = (inos[i] - 1) % inodes_per_group;
+        if (inos[i] == 0 || inos[i] > sb.s_inodes_count || group >= group_count) {
+            memset(&out[i], 0, sizeof(out[i]));
+            continue;
+        }
+        reqs[m].buf = &out[i];
+        reqs[m].len = sizeof(struct ext2_inode);
+        reqs[m].off = (off_t)gdt[group].bg_inode_table * block_size + (off_t)index * inode_size;
+        m++;
+    }
+    if (io_read_batch(img_fd, reqs, m) > 0) {
+        perror("pread inode, error");
+        exit(EXIT_FAILURE);
+    }
+    stat_add(STAT_INODE_READS, (uint64_t)m);
+    stat_add(STAT_INODE_BATCHED, (uint64_t)m);
+    free(reqs);
+}
+
+// 모든 그룹 디스크립터를 메모리에 적재 (각 디스크립터의 앞 32바이트만 사용)
+void read_group_desc_table(int img_fd) {
+    group_count = (sb.s_blocks_count - sb.s_first_data_block
+                   + sb.s_blocks_per_group - 1) / sb.s_blocks_per_group;
+    gdt = malloc(sizeof(struct ext2_group_desc) * group_count);
+    uint32_t gd_table_blk = SUPERBLOCK_OFFSET / block_size + 1;
+    size_t desc_size = group_desc_size();
+    size_t len = desc_size * group_count;
+    char *raw = malloc(len);
+    if (img_pread(img_fd, raw, len, (off_t)gd_table_blk * block_size) != (ssize_t)len) {
+        perror("pread group_desc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t g = 0; g < group_count; g++)
+        memcpy(&gdt[g], raw + (size_t)g * desc_size, sizeof(struct ext2_group_desc));
+    free(raw);
+}
+
+// 쿼리 깊이별 트리 적재 시간 비교
+void command_bench(void) {
+    static const int depths[] = { 1, 2, 4, 8, 16, 32, 64 };
+    int saved = io_queue_depth;
+
+    printf("%-6s %-10s %12s %10s %10s\n", "depth", "backend", "load (ms)", "nodes", "reads");
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        io_queue_depth = depths[i];
+        // 블록 캐시와 이미지의 페이지 캐시를 모두 비워 매번 실제 장치 읽기를 측정
+        // (블록 캐시를 두면 두 번째 깊이부터는 캐시 적중만 재게 됨)
+        bcache_invalidate(img_fd);
+        posix_fadvise(img_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+        IoStat before, after;
+        io_stat_snapshot(&before);
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        Node *r = create_node("/", 2, EXT2_FT_DIR);
+        build_tree(r);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        io_stat_snapshot(&after);
+
+        int dirs = 0, files = 0;
+        count_tree(r, &dirs, &files);
+        free_tree(r);
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        uint64_t reads = (after.preads - before.preads) + (after.uring - before.uring);
+        printf("%-6d %-10s %12.3f %10d %10llu\n", depths[i], io_backend_name(), ms,
+               dirs + files + 1, (unsigned long long)reads);
+    }
+    printf("\n");
+    io_queue_depth = saved;
+}
+
+// ---------------------------------------------------------------------------
+// 디렉토리 이름 조회: dir_index(htree) 디렉토리는 해시로 리프 블록 하나만 읽음
+// ---------------------------------------------------------------------------
+
+// 논리 블록 번호 → 물리 블록 번호 (간접 블록 경로만 읽음, hole이면 0)
+uint32_t inode_bmap(int img_fd, const struct ext2_inode *ino, uint32_t logical) {
+    if (ino->i_flags & EXT4_EXTENTS_FL)
+        return extent_bmap(img_fd, ino, logical);
+
+    uint32_t ptrs_per_block = block_size / sizeof(uint32_t);
+    if (logical < 12)
+        return ino->i_block[logical];
+    logical -= 12;
+
+    // 단계별 담당 범위: single, double, triple
+    uint64_t span = ptrs_per_block;
+    int level = 1;
+    while (level <= 3 && logical >= span) {
+        logical -= (uint32_t)span;
+        span *= ptrs_per_block;
+        level++;
+    }
+    if (level > 3) return 0;
+
+    uint32_t blk = ino->i_block[11 + level];
+    uint32_t ptr;
+    while (level > 0 && blk) {
+        span /= ptrs_per_block;
+        uint32_t idx = (uint32_t)(logical / span);
+        logical %= span;
+        off_t off = (off_t)blk * block_size + (off_t)idx * sizeof(uint32_t);
+        if (img_pread(img_fd, &ptr, sizeof(ptr), off) != sizeof(ptr)) return 0;
+        blk = ptr;
+        level--;
+    }
+    return blk;
+}
+
+// 해시 입력 버퍼 구성 (e2fsprogs str2hashbuf와 동일)
+static void str2hashbuf(const char *msg, int len, uint32_t *buf, int num, bool unsigned_flag) {
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    uint32_t val = pad;
+    if (len > num * 4) len = num * 4;
+    for (int i = 0; i < len; i++) {
+        int c = unsigned_flag ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = val;
+    while (--num >= 0) *buf++ = pad;
+}
+
+#define ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = ROL32(a, s))
+#define MD4_K2 013240474631U
+#define MD4_K3 015666365641U
+
+// half-MD4 변환 (입력 8워드)
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    MD4_ROUND(MD4_F, a, b, c, d, in[0], 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[1], 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[2], 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[3], 19);
+    MD4_ROUND(MD4_F, a, b, c, d, in[4], 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[5], 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[6], 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[7], 19);
+
+    MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+    MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+    MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+    MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+// TEA 변환 (입력 4워드)
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+// legacy(dx_hack) 해시
+static uint32_t dx_hack_hash(const char *name, int len, bool unsigned_flag) {
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (int i = 0; i < len; i++) {
+        int c = unsigned_flag ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000) hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// 디렉토리 엔트리 이름의 htree 해시 계산 (실패 시 -1)
+int ext2_dirhash(const char *name, int len, int version, uint32_t *out_hash) {
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash;
+    bool unsigned_flag = false;
+
+    // 슈퍼블록의 해시 시드 (모두 0이면 기본값)
+    if (sb.s_hash_seed[0] | sb.s_hash_seed[1] | sb.s_hash_seed[2] | sb.s_hash_seed[3])
+        memcpy(buf, sb.s_hash_seed, sizeof(buf));
+
+    switch (version) {
+    case EXT2_HASH_LEGACY_UNSIGNED:
+        unsigned_flag = true;
+        /* fall through */
+    case EXT2_HASH_LEGACY:
+        hash = dx_hack_hash(name, len, unsigned_flag);
+        break;
+    case EXT2_HASH_HALF_MD4_UNSIGNED:
+        unsigned_flag = true;
+        /* fall through */
+    case EXT2_HASH_HALF_MD4:
+        for (const char *p = name; len > 0; len -= 32, p += 32) {
+            str2hashbuf(p, len, in, 8, unsigned_flag);
+            half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    case EXT2_HASH_TEA_UNSIGNED:
+        unsigned_flag = true;
+        /* fall through */
+    case EXT2_HASH_TEA:
+        for (const char *p = name; len > 0; len -= 16, p += 16) {
+            str2hashbuf(p, len, in, 4, unsigned_flag);
+            tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
+    default:
+        return -1;
+    }
+    *out_hash = hash & ~1U;
+    return 0;
+}
+
+// 디렉토리 블록 하나에서 이름 찾기 (찾으면 1)
+static int dir_block_find(const char *buf, const char *name, size_t name_len,
+                          uint32_t *out_ino, uint8_t *out_type)
+{
+    uint32_t cur = 0;
+    while (cur + offsetof(struct ext2_dir_entry, name) <= block_size) {
+        const struct ext2_dir_entry *e = (const struct ext2_dir_entry *)(buf + cur);
+        if (e->rec_len < offsetof(struct ext2_dir_entry, name)
+            || cur + e->rec_len > block_size
+            || offsetof(struct ext2_dir_entry, name) + e->name_len > e->rec_len)
+            break;
+        if (e->inode && e->name_len == name_len && memcmp(e->name, name, name_len) == 0) {
+            *out_ino = e->inode;
+            *out_type = e->file_type;
+            return 1;
+        }
+        cur += e->rec_len;
+    }
+    return 0;
+}
+
+// htree 인덱스를 따라 이름이 들어 있을 리프 블록만 읽어 조회
+// 반환값: 1 찾음, 0 없음, -1 인덱스를 해석할 수 없음 (선형 탐색으로 대체)
+static int htree_lookup(const struct ext2_inode *dir, const char *name,
+                        uint32_t *out_ino, uint8_t *out_type)
+{
+    char *buf = malloc(block_size);
+    int ret = -1;
+
+    uint32_t blk = inode_bmap(img_fd, dir, 0);
+    if (!blk || img_pread(img_fd, buf, block_size, (off_t)blk * block_size) != (ssize_t)block_size)
+        goto out;
+
+    // dx_root: '.'(12) + '..'(12) 뒤에 dx_root_info
+    const struct dx_root_info *info = (const struct dx_root_info *)(buf + 24);
+    if (info->reserved_zero != 0 || info->info_length < 8 || info->indirect_levels > 2)
+        goto out;
+
+    int version = info->hash_version;
+    if (version <= EXT2_HASH_TEA && (sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH))
+        version += 3;   // unsigned char 해시 사용 이미지
+    uint32_t hash;
+    if (ext2_dirhash(name, (int)strlen(name), version, &hash) < 0)
+        goto out;
+
+    uint32_t entries_off = 24 + info->info_length;
+    int levels = info->indirect_levels;
+    while (1) {
+        const struct dx_countlimit *cl = (const struct dx_countlimit *)(buf + entries_off);
+        const struct dx_entry *ent = (const struct dx_entry *)(buf + entries_off);
+        uint16_t count = cl->count;
+        if (count == 0 || count > cl->limit
+            || entries_off + (uint32_t)count * sizeof(struct dx_entry) > block_size)
+            goto out;
+
+        // hash 이하인 마지막 엔트리 이진 탐색 (0번 엔트리의 해시는 0으로 간주)
+        int lo = 1, hi = count - 1, pos = 0;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (ent[mid].hash <= hash) {
+                pos = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        if (levels > 0) {
+            // 중간 인덱스 블록(dx_node): 빈 디렉토리 엔트리(8바이트) 뒤에 엔트리 배열
+            blk = inode_bmap(img_fd, dir, ent[pos].block);
+            if (!blk || img_pread(img_fd, buf, block_size, (off_t)blk * block_size) != (ssize_t)block_size)
+                goto out;
+            entries_off = 8;
+            levels--;
+            continue;
+        }
+
+        // 리프 블록 탐색: 해시 충돌로 다음 블록에 이어질 수 있음 (다음 엔트리 해시의 최하위 비트)
+        ret = 0;
+        uint32_t leaf = ent[pos].block;
+        uint32_t next_hash = pos + 1 < count ? ent[pos + 1].hash : 0;
+        char *leaf_buf = malloc(block_size);
+        while (1) {
+            blk = inode_bmap(img_fd, dir, leaf);
+            if (!blk || img_pread(img_fd, leaf_buf, block_size, (off_t)blk * block_size) != (ssize_t)block_size)
+                break;
+            if (dir_block_find(leaf_buf, name, strlen(name), out_ino, out_type)) {
+                ret = 1;
+                break;
+            }
+            if (!(next_hash & 1) || (next_hash & ~1U) != hash || pos + 1 >= count)
+                break;
+            pos++;
+            leaf = ent[pos].block;
+            next_hash = pos + 1 < count ? ent[pos + 1].hash : 0;
+        }
+        free(leaf_buf);
+        break;
+    }
+
+out:
+    free(buf);
+    return ret;
+}
+
+// 디렉토리 inode에서 이름 하나 조회 (전체 디렉토리를 적재하지 않음)
+// htree 디렉토리는 해시 리프 블록만, 일반 디렉토리는 찾을 때까지 블록을 순서대로 읽음
+int dir_lookup(uint32_t dir_ino, const char *name, uint32_t *out_ino, uint8_t *out_type) {
+    // 트리에 포함하지 않는 이름들
+    if (!strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, "lost+found"))
+        return 0;
+
+    struct ext2_inode dir;
+    read_inode(img_fd, dir_ino, &dir);
+
+    if ((dir.i_flags & EXT2_INDEX_FL) && (sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        int r = htree_lookup(&dir, name, out_ino, out_type);
+        if (r >= 0) return r;
+    }
+
+    // 선형 탐색
+    uint32_t nblocks = (uint32_t)((inode_file_size(&dir) + block_size - 1) / block_size);
+    char *buf = malloc(block_size);
+    int found = 0;
+    for (uint32_t l = 0; l < nblocks && !found; l++) {
+        uint32_t blk = inode_bmap(img_fd, &dir, l);
+        if (!blk) continue;
+        if (img_pread(img_fd, buf, block_size, (off_t)blk * block_size) != (ssize_t)block_size)
+            break;
+        found = dir_block_find(buf, name, strlen(name), out_ino, out_type);
+    }
+    free(buf);
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// 블록 비트맵 분석: 여유 공간(df)과 파일 단편화(frag)
+// ---------------------------------------------------------------------------
+
+// 그룹 디스크립터의 ext4 초기화 플래그(BLOCK_UNINIT 등)를 믿을 수 있는지 (체크섬 기능이 있어야 유효)
+bool ext4_group_flags_valid(void) {
+    return sb.s_feature_ro_compat & (EXT4_FEATURE_RO_COMPAT_GDT_CSUM | EXT4_FEATURE_RO_COMPAT_METADATA_CSUM);
+}
+
+// 그룹 g에 속한 블록 수 (마지막 그룹은 짧을 수 있음)
+uint32_t group_block_count(uint32_t g) {
+    uint32_t first = sb.s_first_data_block + g * sb.s_blocks_per_group;
+    uint32_t n = sb.s_blocks_count - first;
+    return n < sb.s_blocks_per_group ? n : sb.s_blocks_per_group;
+}
+
+// 64비트 워드 배열의 켜진 비트 수 (일반 구현)
+static uint64_t popcount_words_generic(const uint64_t *w, size_t n) {
+    uint64_t cnt = 0;
+    for (size_t i = 0; i < n; i++)
+        cnt += (uint64_t)__builtin_popcountll(w[i]);
+    return cnt;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// POPCNT 명령어로 컴파일된 버전 (CPU가 지원할 때만 호출)
+__attribute__((target("popcnt")))
+static uint64_t popcount_words_hw(const uint64_t *w, size_t n) {
+    uint64_t cnt = 0;
+    for (size_t i = 0; i < n; i++)
+        cnt += (uint64_t)__builtin_popcountll(w[i]);
+    return cnt;
+}
+#endif
+
+// 실행 중인 CPU에 맞는 popcount 선택
+static uint64_t popcount_words(const uint64_t *w, size_t n) {
+#if defined(__x86_64__) || defined(__i386__)
+    static int has_popcnt = -1;
+    if (has_popcnt < 0) {
+        __builtin_cpu_init();
+        has_popcnt = __builtin_cpu_supports("popcnt") ? 1 : 0;
+    }
+    if (has_popcnt)
+        return popcount_words_hw(w, n);
+#endif
+    return popcount_words_generic(w, n);
+}
+
+// log2 버킷 번호: 1 → 0, 2~3 → 1, 4~7 → 2 ...
+static int log2_bucket(uint64_t n) {
+    return 63 - __builtin_clzll(n);
+}
+
+// pos부터 값이 bit(0 또는 1)인 첫 비트 위치, 없으면 nbits
+static uint32_t bitmap_find_next(const uint64_t *w, uint32_t nbits, uint32_t pos, int bit) {
+    while (pos < nbits) {
+        uint64_t word = bit ? w[pos / 64] : ~w[pos / 64];
+        word >>= pos % 64;
+        if (word) {
+            pos += (uint32_t)__builtin_ctzll(word);
+            return pos < nbits ? pos : nbits;
+        }
+        pos = (pos / 64 + 1) * 64;
+    }
+    return nbits;
+}
+
+// 비트맵의 [0, nbits) 범위에서 여유(0 비트) 구간 분석
+// 앞쪽/뒤쪽 구간은 인접 그룹과 이어질 수 있으므로 따로 기록
+static void scan_free_runs(const uint64_t *w, uint32_t nbits, GroupSpace *gs) {
+    uint32_t pos = 0;
+    while ((pos = bitmap_find_next(w, nbits, pos, 0)) < nbits) {
+        uint32_t start = pos;
+        pos = bitmap_find_next(w, nbits, pos, 1);
+        uint32_t len = pos - start;
+
+        if (start == 0) {
+            gs->lead = len;
+            gs->all_free = (len == nbits);
+        }
+        else if (pos == nbits) {
+            gs->trail = len;
+        }
+        else {
+            gs->hist[log2_bucket(len)]++;
+            gs->extents++;
+            if (len > gs->largest) gs->largest = len;
+        }
+    }
+}
+
+// 그룹 하나의 블록 비트맵 분석
+static void analyze_group(uint32_t g, uint64_t *bitmap, GroupSpace *gs) {
+    memset(gs, 0, sizeof(*gs));
+    uint32_t nbits = group_block_count(g);
+    gs->blocks = nbits;
+
+    // 초기화되지 않은 비트맵(ext4 BLOCK_UNINIT): 메타데이터 뒤 나머지가 모두 여유라고 봄
+    if ((gdt[g].bg_pad & EXT4_BG_BLOCK_UNINIT) && ext4_group_flags_valid()) {
+        uint32_t free_cnt = gdt[g].bg_free_blocks_count;
+        gs->used = nbits - free_cnt;
+        if (free_cnt == nbits) {
+            gs->lead = nbits;         // 백업 슈퍼블록도 없는 그룹은 통째로 여유
+            gs->all_free = true;
+        }
+        else {
+            gs->trail = free_cnt;
+        }
+        return;
+    }
+
+    if (img_pread(img_fd, bitmap, block_size, (off_t)gdt[g].bg_block_bitmap * block_size) != (ssize_t)block_size) {
+        gs->error = true;
+        return;
+    }
+    // 유효 범위 밖 비트는 사용 중으로 채워 계산에서 제외
+    uint8_t *bytes = (uint8_t *)bitmap;
+    for (uint32_t b = nbits; b < block_size * 8; b++)
+        bytes[b / 8] |= (uint8_t)(1 << (b % 8));
+
+    gs->used = popcount_words(bitmap, block_size / 8) - (block_size * 8 - nbits);
+    scan_free_runs(bitmap, nbits, gs);
+}
+
+// 그룹 분석 작업 스레드: 공유 인덱스에서 그룹을 하나씩 가져감
+static void *df_worker(void *arg) {
+    DfCtx *ctx = arg;
+    uint64_t *bitmap = malloc(block_size);
+    while (1) {
+        uint32_t g = __atomic_fetch_add(&ctx->next_group, 1, __ATOMIC_RELAXED);
+        if (g >= group_count) break;
+        analyze_group(g, bitmap, &ctx->groups[g]);
+    }
+    free(bitmap);
+    return NULL;
+}
+
+// 작업 스레드 수 결정: 0이면 CPU 개수, 최대 ANALYZE_MAX_THREADS
+int analyze_thread_count(int nthreads, int njobs) {
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    if (nthreads > ANALYZE_MAX_THREADS) nthreads = ANALYZE_MAX_THREADS;
+    if (nthreads > njobs) nthreads = njobs > 0 ? njobs : 1;
+    return nthreads;
+}
+
+// df 명령어: 모든 그룹의 블록 비트맵으로 사용량과 여유 구간 분포 출력
+void command_df(int nthreads) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    DfCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.groups = calloc(group_count, sizeof(GroupSpace));
+
+    // 1) 그룹들을 병렬로 분석
+    nthreads = analyze_thread_count(nthreads, (int)group_count);
+    pthread_t tids[ANALYZE_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&tids[i], NULL, df_worker, &ctx) != 0) break;
+        started++;
+    }
+    if (started == 0) df_worker(&ctx);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    // 2) 그룹 순서대로 합치기: 그룹 경계를 넘는 여유 구간은 이어 붙임
+    uint64_t total = 0, used = 0, extents = 0, largest = 0;
+    uint64_t hist[64] = { 0 };
+    uint64_t carry = 0;
+    int errors = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        GroupSpace *gs = &ctx.groups[g];
+        if (gs->error) {
+            errors++;
+            continue;
+        }
+        total += gs->blocks;
+        used += gs->used;
+        if (gs->all_free) {
+            carry += gs->lead;
+            continue;
+        }
+        uint64_t run = carry + gs->lead;
+        if (run) {
+            hist[log2_bucket(run)]++;
+            extents++;
+            if (run > largest) largest = run;
+        }
+        for (int b = 0; b < 32; b++)
+            hist[b] += gs->hist[b];
+        extents += gs->extents;
+        if (gs->largest > largest) largest = gs->largest;
+        carry = gs->trail;
+    }
+    if (carry) {
+        hist[log2_bucket(carry)]++;
+        extents++;
+        if (carry > largest) largest = carry;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // 3) 출력
+    uint64_t free_blocks = total - used;
+    printf("block size   : %u\n", block_size);
+    printf("groups       : %u (%d threads)\n", group_count, started ? started : 1);
+    printf("blocks       : %llu total, %llu used (%.1f%%), %llu free (%.1f%%)\n",
+           (unsigned long long)total, (unsigned long long)used,
+           total ? used * 100.0 / total : 0.0,
+           (unsigned long long)free_blocks,
+           total ? free_blocks * 100.0 / total : 0.0);
+    if (free_blocks != sb.s_free_blocks_count)
+        printf("warning      : superblock free count is %u\n", sb.s_free_blocks_count);
+    if (errors)
+        printf("warning      : %d block bitmaps could not be read\n", errors);
+    printf("free extents : %llu, largest %llu blocks, average %.1f blocks\n",
+           (unsigned long long)extents, (unsigned long long)largest,
+           extents ? (double)free_blocks / extents : 0.0);
+    printf("free extent size histogram (blocks):\n");
+    for (int b = 0; b < 64; b++) {
+        if (!hist[b]) continue;
+        uint64_t lo = 1ULL << b, hi = (lo << 1) - 1;
+        printf("  %10llu - %-10llu : %llu\n",
+               (unsigned long long)lo, (unsigned long long)hi, (unsigned long long)hist[b]);
+    }
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("elapsed      : %.3f ms\n\n", ms);
+
+    free(ctx.groups);
+}
+
+// 하위 트리의 일반 파일을 경로와 함께 모음
+static void frag_collect(Node *dir, const char *path, FragFile **files, int *cnt, int *cap) {
+    for (Node *c = dir->first_child; c; c = c->next_sibling) {
+        size_t len = strlen(path) + 1 + strlen(c->name) + 1;
+        char *p = malloc(len);
+        snprintf(p, len, "%s/%s", strcmp(path, "/") == 0 ? "" : path, c->name);
+        if (c->file_type == EXT2_FT_DIR) {
+            frag_collect(c, p, files, cnt, cap);
+            free(p);
+        }
+        else if (c->file_type == EXT2_FT_REG_FILE) {
+            if (*cnt == *cap) {
+                *cap = *cap ? *cap * 2 : 256;
+                *files = realloc(*files, sizeof(FragFile) * *cap);
+            }
+            (*files)[*cnt].path = p;
+            (*files)[*cnt].inode_no = c->inode_no;
+            (*files)[*cnt].runs = 0;
+            (*cnt)++;
+        }
+        else {
+            free(p);
+        }
+    }
+}
+
+// qsort 비교 함수: 물리 구간 수 내림차순
+static int frag_cmp(const void *a, const void *b) {
+    const FragFile *x = a, *y = b;
+    if (x->runs != y->runs) return x->runs > y->runs ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// qsort 비교 함수: inode 번호 → 경로 순 (하드 링크 중 첫 경로만 남길 때)
+static int frag_ino_cmp(const void *x, const void *y) {
+    const FragFile *a = x, *b = y;
+    if (a->inode_no != b->inode_no) return a->inode_no < b->inode_no ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+// 하드 링크는 inode당 첫 경로(경로 사전순)만 남기고 나머지 경로는 해제, 남은 개수 반환
+static int frag_unique_inodes(FragFile *files, int cnt) {
+    if (cnt > 1)
+        qsort(files, cnt, sizeof(FragFile), frag_ino_cmp);
+    int nuniq = 0;
+    for (int i = 0; i < cnt; i++) {
+        if (nuniq > 0 && files[nuniq - 1].inode_no == files[i].inode_no) {
+            free(files[i].path);
+            continue;
+        }
+        files[nuniq++] = files[i];
+    }
+    return nuniq;
+}
+
+// frag 명령어: 하위 트리 파일들의 물리 구간 수(단편화) 보고
+void command_frag(const char *path) {
+    Node *tgt = find_node(root, path);
+    if (!tgt) {
+        command_help_frag();
+        return;
+    }
+    if (tgt->file_type != EXT2_FT_DIR) {
+        fprintf(stderr, "Error: '%s' is not directory\n", path);
+        return;
+    }
+    build_tree(tgt);
+
+    FragFile *files = NULL;
+    int cnt = 0, cap = 0;
+    frag_collect(tgt, strcmp(path, ".") == 0 ? "/" : path, &files, &cnt, &cap);
+    cnt = frag_unique_inodes(files, cnt);   // 하드 링크된 파일은 한 번만 셈
+
+    // inode 일괄 읽기 후 파일별 데이터 구간 수 계산
+    uint32_t *inos = malloc(sizeof(uint32_t) * (cnt ? cnt : 1));
+    struct ext2_inode *inodes = malloc(sizeof(struct ext2_inode) * (cnt ? cnt : 1));
+    for (int i = 0; i < cnt; i++)
+        inos[i] = files[i].inode_no;
+    read_inodes_batch(img_fd, inos, cnt, inodes);
+
+    uint64_t total_runs = 0;
+    int fragmented = 0;
+    for (int i = 0; i < cnt; i++) {
+        BlockRun *runs = NULL;
+        int nruns = collect_block_runs(img_fd, &inodes[i], block_size, &runs);
+        uint32_t data = 0;
+        for (int r = 0; r < nruns; r++)
+            if (!runs[r].hole) data++;
+        free(runs);
+        files[i].runs = data;
+        total_runs += data;
+        if (data > 1) fragmented++;
+    }
+    if (cnt > 1)
+        qsort(files, cnt, sizeof(FragFile), frag_cmp);
+
+    printf("files        : %d\n", cnt);
+    printf("fragmented   : %d (%.1f%%)\n", fragmented, cnt ? fragmented * 100.0 / cnt : 0.0);
+    printf("runs per file: %.2f average\n", cnt ? (double)total_runs / cnt : 0.0);
+    for (int i = 0; i < cnt && i < FRAG_TOP_FILES && files[i].runs > 1; i++)
+        printf("  %6u runs  %s\n", files[i].runs, files[i].path);
+    printf("\n");
+
+    for (int i = 0; i < cnt; i++)
+        free(files[i].path);
+    free(files);
+    free(inos);
+    free(inodes);
+}
+
+// ---------------------------------------------------------------------------
+// 물리 블록 → 소유 파일 역색인 (blk2path)
+// ---------------------------------------------------------------------------
+
+// 색인 파일 헤더: 이미지 크기/수정 시간이 달라지면 색인을 다시 만듦
+typedef struct BlkIndexHeader {
+    char magic[8];           // BLKIDX_MAGIC
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t blocks_count;
+    uint32_t reserved;
+    uint64_t count;          // 구간 수
+    uint64_t img_size;
+    int64_t img_mtime_sec;
+    int64_t img_mtime_nsec;
+} BlkIndexHeader;
+
+// 색인 파일 경로: 이미지 옆에 "<이미지>.blkidx" (경로가 너무 길면 -1)
+static int blk_index_path(char *buf, size_t len) {
+    int n = snprintf(buf, len, "%s%s", img_path, BLKIDX_SUFFIX);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+// 구간 추가
+static void owner_append(BlkOwner **v, uint64_t *cnt, uint64_t *cap,
+                         uint32_t start, uint32_t len, uint32_t owner, uint32_t logical, uint8_t kind) {
+    if (len == 0) return;
+    if (*cnt == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *v = realloc(*v, sizeof(BlkOwner) * *cap);
+    }
+    BlkOwner *o = &(*v)[(*cnt)++];
+    memset(o, 0, sizeof(*o));
+    o->start = start;
+    o->len = len;
+    o->owner = owner;
+    o->logical = logical;
+    o->kind = kind;
+}
+
+// qsort 비교 함수: 물리 시작 블록 오름차순
+static int owner_cmp(const void *a, const void *b) {
+    const BlkOwner *x = a, *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return 0;
+}
+
+// 모든 사용 중 inode의 블록 맵과 그룹 메타데이터를 구간 표로 만듦
+static int blk_index_build(BlkOwner **out, uint64_t *out_cnt, uint32_t *out_inodes) {
+    BlkOwner *v = NULL;
+    uint64_t cnt = 0, cap = 0;
+    uint32_t ninodes = 0;
+    uint32_t itable_blocks = (inodes_per_group * inode_size + block_size - 1) / block_size;
+    uint8_t *bitmap = malloc(block_size);
+    size_t chunk = (size_t)INODE_SCAN_BLOCKS * block_size;
+    char *buf = malloc(chunk);
+
+    for (uint32_t g = 0; g < group_count; g++) {
+        // 1) 그룹 메타데이터: 비트맵, inode 테이블
+        owner_append(&v, &cnt, &cap, gdt[g].bg_block_bitmap, 1, g, 0, BLK_OWNER_BLOCK_BITMAP);
+        owner_append(&v, &cnt, &cap, gdt[g].bg_inode_bitmap, 1, g, 0, BLK_OWNER_INODE_BITMAP);
+        owner_append(&v, &cnt, &cap, gdt[g].bg_inode_table, itable_blocks, g, 0, BLK_OWNER_INODE_TABLE);
+
+        // 초기화되지 않은 inode 테이블(ext4 INODE_UNINIT)에는 사용 중 inode가 없음
+        if ((gdt[g].bg_pad & EXT4_BG_INODE_UNINIT) && ext4_group_flags_valid())
+            continue;
+        if (img_pread(img_fd, bitmap, block_size, (off_t)gdt[g].bg_inode_bitmap * block_size) != (ssize_t)block_size)
+            continue;
+
+        // 2) inode 테이블을 큰 단위로 읽으며 사용 중 inode의 블록 맵 수집
+        for (uint32_t tb = 0; tb < itable_blocks; tb += INODE_SCAN_BLOCKS) {
+            uint32_t nb = itable_blocks - tb < INODE_SCAN_BLOCKS ? itable_blocks - tb : INODE_SCAN_BLOCKS;
+            ssize_t want = (ssize_t)nb * block_size;
+            if (img_pread(img_fd, buf, want, (off_t)(gdt[g].bg_inode_table + tb) * block_size) != want)
+                break;
+            uint32_t first = tb * (block_size / inode_size);
+            uint32_t last = first + nb * (block_size / inode_size);
+            if (last > inodes_per_group) last = inodes_per_group;
+            for (uint32_t idx = first; idx < last; idx++) {
+                if (!(bitmap[idx / 8] & (1 << (idx % 8)))) continue;
+                struct ext2_inode ino;
+                memcpy(&ino, buf + (size_t)(idx - first) * inode_size, sizeof(ino));
+                if (ino.i_mode == 0 || ino.i_blocks == 0) continue;
+                uint32_t ino_no = g * inodes_per_group + idx + 1;
+
+                BlockRun *runs = NULL;
+                uint32_t *meta = NULL;
+                int nmeta = 0;
+                int nruns = collect_block_map(img_fd, &ino, block_size, &runs, &meta, &nmeta);
+                for (int r = 0; r < nruns; r++)
+                    if (!runs[r].hole)
+                        owner_append(&v, &cnt, &cap, runs[r].physical, runs[r].len,
+                                     ino_no, runs[r].logical, BLK_OWNER_DATA);
+                for (int m = 0; m < nmeta; m++)
+                    owner_append(&v, &cnt, &cap, meta[m], 1, ino_no, 0, BLK_OWNER_MAP);
+                free(runs);
+                free(meta);
+                ninodes++;
+            }
+        }
+    }
+    free(buf);
+    free(bitmap);
+
+    qsort(v, cnt, sizeof(BlkOwner), owner_cmp);
+    *out = v;
+    *out_cnt = cnt;
+    *out_inodes = ninodes;
+    return 0;
+}
+
+// 저장된 색인 읽기: 없거나 이미지가 바뀌었으면 -1
+static int blk_index_load(const char *path, const struct stat *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    BlkIndexHeader h;
+    int ret = -1;
+    if (read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h)
+        && memcmp(h.magic, BLKIDX_MAGIC, sizeof(h.magic)) == 0
+        && h.version == BLKIDX_VERSION
+        && h.block_size == block_size
+        && h.blocks_count == sb.s_blocks_count
+        && h.img_size == (uint64_t)st->st_size
+        && h.img_mtime_sec == (int64_t)st->st_mtim.tv_sec
+        && h.img_mtime_nsec == (int64_t)st->st_mtim.tv_nsec) {
+        size_t bytes = sizeof(BlkOwner) * h.count;
+        BlkOwner *v = malloc(bytes ? bytes : 1);
+        if (pread(fd, v, bytes, sizeof(h)) == (ssize_t)bytes) {
+            blk_index = v;
+            blk_index_cnt = h.count;
+            ret = 0;
+        }
+        else {
+            free(v);
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+// 색인 저장: 임시 파일에 쓴 뒤 rename으로 교체
+static int blk_index_save(const char *path, const struct stat *st) {
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (n < 0 || (size_t)n >= sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    BlkIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BLKIDX_MAGIC, sizeof(h.magic));
+    h.version = BLKIDX_VERSION;
+    h.block_size = block_size;
+    h.blocks_count = sb.s_blocks_count;
+    h.count = blk_index_cnt;
+    h.img_size = st->st_size;
+    h.img_mtime_sec = st->st_mtim.tv_sec;
+    h.img_mtime_nsec = st->st_mtim.tv_nsec;
+
+    size_t bytes = sizeof(BlkOwner) * blk_index_cnt;
+    bool ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h)
+              && write(fd, blk_index, bytes) == (ssize_t)bytes;
+    if (close(fd) != 0) ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// 가장 긴 구간 길이: 어떤 블록을 덮을 수 있는 구간은 시작이 이 길이 안쪽에 있음
+static void blk_index_set_maxlen(void) {
+    blk_index_maxlen = 0;
+    for (uint64_t i = 0; i < blk_index_cnt; i++)
+        if (blk_index[i].len > blk_index_maxlen)
+            blk_index_maxlen = blk_index[i].len;
+}
+
+// 역색인 준비: 저장된 색인이 유효하면 읽고, 아니면 만들어 저장
+// 색인 파일 경로를 만들 수 없으면 메모리에만 만들어 씀
+static int blk_index_prepare(bool rebuild) {
+    struct stat st;
+    if (fstat(img_fd, &st) < 0) {
+        perror("fstat");
+        return -1;
+    }
+    char path[PATH_MAX];
+    bool have_path = blk_index_path(path, sizeof(path)) == 0;
+
+    if (blk_index_ready && !rebuild) return 0;
+    free(blk_index);
+    blk_index = NULL;
+    blk_index_cnt = 0;
+    blk_index_ready = false;
+
+    if (!rebuild && have_path && blk_index_load(path, &st) == 0) {
+        blk_index_set_maxlen();
+        blk_index_ready = true;
+        return 0;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint32_t ninodes = 0;
+    blk_index_build(&blk_index, &blk_index_cnt, &ninodes);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    blk_index_set_maxlen();
+    blk_index_ready = true;
+
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("blk2path: indexed %llu runs from %u inodes in %.3f ms\n",
+           (unsigned long long)blk_index_cnt, ninodes, ms);
+    if (!have_path)
+        fprintf(stderr, "blk2path: image path too long, index kept in memory only\n");
+    else if (blk_index_save(path, &st) == 0)
+        printf("blk2path: index saved to %s\n", path);
+    else
+        fprintf(stderr, "blk2path: cannot save index to %s: %s\n", path, strerror(errno));
+    return 0;
+}
+
+// inode 번호 → 경로 (트리에 없으면 false, 하드 링크면 첫 경로)
+bool inode_path(uint32_t ino, char *buf, size_t len) {
+    build_tree(root);   // 지연 적재 모드라면 전체 트리 적재
+    Node *n = ino_map_first(ino);
+    if (!n) return false;
+    node_path(n, buf, len);
+    return true;
+}
+
+// 구간 o가 덮는 block의 소유자 한 줄 출력
+static void blk_owner_print(uint32_t block, const BlkOwner *o) {
+    switch (o->kind) {
+    case BLK_OWNER_BLOCK_BITMAP:
+        printf("block %u: block bitmap of group %u\n", block, o->owner);
+        return;
+    case BLK_OWNER_INODE_BITMAP:
+        printf("block %u: inode bitmap of group %u\n", block, o->owner);
+        return;
+    case BLK_OWNER_INODE_TABLE: {
+        uint32_t first = o->owner * inodes_per_group + 1
+                         + (block - o->start) * (block_size / inode_size);
+        printf("block %u: inode table of group %u (inodes %u-%u)\n",
+               block, o->owner, first, first + block_size / inode_size - 1);
+        return;
+    }
+    default:
+        break;
+    }
+
+    char path[PATH_MAX];
+    if (!inode_path(o->owner, path, sizeof(path)))
+        snprintf(path, sizeof(path), o->owner < EXT2_GOOD_OLD_FIRST_INO ? "<reserved inode>" : "<no path>");
+    if (o->kind == BLK_OWNER_DATA)
+        printf("block %u: %s (inode %u, logical block %u)\n",
+               block, path, o->owner, o->logical + (block - o->start));
+    else
+        printf("block %u: block map of %s (inode %u, indirect/extent block)\n",
+               block, path, o->owner);
+}
+
+// blk2path 명령어: 물리 블록 번호를 소유한 파일(또는 메타데이터) 출력
+void command_blk2path(uint32_t block, bool rebuild) {
+    if (blk_index_prepare(rebuild) < 0) return;
+    if (block >= sb.s_blocks_count) {
+        fprintf(stderr, "blk2path: block %u is out of range (0-%u)\n", block, sb.s_blocks_count - 1);
+        return;
+    }
+
+    // start <= block 인 마지막 구간을 이진 탐색
+    uint64_t lo = 0, hi = blk_index_cnt;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (blk_index[mid].start <= block) lo = mid + 1;
+        else hi = mid;
+    }
+    // 손상된 이미지에서는 구간이 겹칠 수 있음 (교차 연결된 블록):
+    // 시작이 block - maxlen 안쪽인 앞 구간들까지 거슬러 올라가며 block을 덮는 것을 모두 출력
+    int owners = 0;
+    uint64_t first = lo;
+    while (first > 0 && block - blk_index[first - 1].start < blk_index_maxlen)
+        first--;
+    for (uint64_t i = first; i < lo; i++) {
+        if (block - blk_index[i].start < blk_index[i].len) {
+            blk_owner_print(block, &blk_index[i]);
+            owners++;
+        }
+    }
+    if (owners > 1)
+        printf("block %u: cross-linked, claimed by %d owners\n", block, owners);
+
+    if (owners == 0) {
+        // 어떤 inode에도 속하지 않음: 블록 비트맵으로 여유/메타데이터 구분
+        uint32_t g = (block - sb.s_first_data_block) / sb.s_blocks_per_group;
+        uint32_t bit = (block - sb.s_first_data_block) % sb.s_blocks_per_group;
+        uint8_t *bitmap = malloc(block_size);
+        bool used = true;
+        if (bitmap && block >= sb.s_first_data_block && g < group_count
+            && img_pread(img_fd, bitmap, block_size, (off_t)gdt[g].bg_block_bitmap * block_size) == (ssize_t)block_size)
+            used = bitmap[bit / 8] & (1 << (bit % 8));
+        free(bitmap);
+        if (used)
+            printf("block %u: filesystem metadata (superblock / group descriptors)\n", block);
+        else
+            printf("block %u: free\n", block);
+    }
+    printf("\n");
+}
+
+// ino2path 명령어: inode 번호를 가리키는 모든 경로 출력 (하드 링크 포함)
+void command_ino2path(uint32_t ino) {
+    if (ino > sb.s_inodes_count) {
+        fprintf(stderr, "ino2path: inode %u is out of range (1-%u)\n", ino, sb.s_inodes_count);
+        return;
+    }
+    build_tree(root);   // 지연 적재 모드라면 전체 트리 적재
+
+    char path[PATH_MAX];
+    int cnt = 0;
+    for (Node* n = ino_map_first(ino); n; n = ino_map_next(n)) {
+        node_path(n, path, sizeof(path));
+        printf("%s\n", path);
+        cnt++;
+    }
+    if (cnt == 0)
+        printf("ino2path: inode %u is not linked from the directory tree\n", ino);
+    printf("\n");
+}
+
+// ---------------------------------------------------------------------------
+// 읽기 전용 일관성 검사 (check)
+// ---------------------------------------------------------------------------
+
+// 그룹 g에 슈퍼블록/그룹 디스크립터 백업이 있는지 (sparse_super면 0, 1, 3/5/7의 거듭제곱)
+static bool group_has_super(uint32_t g) {
+    if (g <= 1 || !(sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER))
+        return true;
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint32_t p = base;
+        while (p < g) p *= base;
+        if (p == g) return true;
+    }
+    return false;
+}
+
+// 원자적 비트 설정: 이미 켜져 있었으면 true
+static bool bit_test_and_set(uint64_t *bits, uint32_t n) {
+    uint64_t mask = 1ULL << (n % 64);
+    return __atomic_fetch_or(&bits[n / 64], mask, __ATOMIC_RELAXED) & mask;
+}
+
+static bool bit_test(const uint64_t *bits, uint32_t n) {
+    return (bits[n / 64] >> (n % 64)) & 1;
+}
+
+// 그룹별 문제 목록에 추가
+static void check_issue(CheckGroup *cg, int kind, uint32_t a, uint32_t b, uint32_t c) {
+    if (cg->cnt == cg->cap) {
+        cg->cap = cg->cap ? cg->cap * 2 : 16;
+        cg->issues = realloc(cg->issues, sizeof(CheckIssue) * cg->cap);
+    }
+    CheckIssue *is = &cg->issues[cg->cnt++];
+    is->kind = kind;
+    is->a = a;
+    is->b = b;
+    is->c = c;
+}
+
+// 블록 하나를 소유 표시: 범위 밖이면 잘못된 참조, 이미 소유자가 있으면 중복 할당
+static void check_claim(CheckCtx *ctx, CheckGroup *cg, uint32_t block, uint32_t owner) {
+    if (block < sb.s_first_data_block || block >= sb.s_blocks_count) {
+        check_issue(cg, CHK_BAD_BLOCK, owner, block, 0);
+        return;
+    }
+    if (bit_test_and_set(ctx->owned, block))
+        check_issue(cg, CHK_DUP_BLOCK, block, owner, 0);
+}
+
+// 디렉토리 블록 검사: rec_len 검증, 엔트리가 가리키는 inode의 참조 수 증가
+static void check_dir_block(CheckCtx *ctx, CheckGroup *cg, uint32_t dir_ino,
+                            uint32_t logical, const char *buf) {
+    uint32_t cur = 0;
+    while (cur < block_size) {
+        const struct ext2_dir_entry *e = (const struct ext2_dir_entry *)(buf + cur);
+        uint32_t min_len = (offsetof(struct ext2_dir_entry, name) + e->name_len + 3) & ~3u;
+        if (cur + offsetof(struct ext2_dir_entry, name) > block_size
+            || e->rec_len < offsetof(struct ext2_dir_entry, name)
+            || e->rec_len % 4 != 0
+            || cur + e->rec_len > block_size
+            || (e->inode && e->rec_len < min_len)) {
+            check_issue(cg, CHK_BAD_REC_LEN, dir_ino, logical, cur);
+            return;
+        }
+        if (e->inode) {
+            if (e->inode > sb.s_inodes_count)
+                check_issue(cg, CHK_BAD_DIRENT_INO, dir_ino, e->inode, 0);
+            else
+                __atomic_fetch_add(&ctx->refs[e->inode], 1, __ATOMIC_RELAXED);
+        }
+        cur += e->rec_len;
+    }
+}
+
+// 1단계: 그룹의 inode 테이블을 읽어 inode 비트맵 대조, 블록 소유 표시, 디렉토리 엔트리 검사
+static void check_group_inodes(CheckCtx *ctx, uint32_t g) {
+    CheckGroup *cg = &ctx->groups[g];
+    uint32_t first_ino = sb.s_rev_level ? sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+    uint32_t itable_blocks = (inodes_per_group * inode_size + block_size - 1) / block_size;
+
+    // 그룹 메타데이터 블록: 슈퍼블록/디스크립터 백업(예약 GDT 포함), 비트맵, inode 테이블
+    uint32_t gstart = sb.s_first_data_block + g * sb.s_blocks_per_group;
+    uint32_t has_super = group_has_super(g) ? 1 : 0;
+    if (sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_META_BG) {
+        // meta_bg: 디스크립터 블록은 메타 그룹의 첫째, 둘째, 마지막 그룹에 하나씩
+        uint32_t per_block = block_size / group_desc_size();
+        uint32_t idx = g % per_block;
+        if (has_super)
+            check_claim(ctx, cg, gstart, 0);
+        if (idx == 0 || idx == 1 || idx == per_block - 1)
+            check_claim(ctx, cg, gstart + has_super, 0);
+    }
+    else if (has_super) {
+        uint32_t gdt_blocks = (uint32_t)((group_count * group_desc_size() + block_size - 1) / block_size);
+        uint32_t n = 1 + gdt_blocks + sb.s_reserved_gdt_blocks;
+        for (uint32_t b = 0; b < n; b++)
+            check_claim(ctx, cg, gstart + b, 0);
+    }
+    check_claim(ctx, cg, gdt[g].bg_block_bitmap, 0);
+    check_claim(ctx, cg, gdt[g].bg_inode_bitmap, 0);
+    for (uint32_t b = 0; b < itable_blocks; b++)
+        check_claim(ctx, cg, gdt[g].bg_inode_table + b, 0);
+
+    // 초기화되지 않은 inode 테이블에는 사용 중 inode가 없음
+    if ((gdt[g].bg_pad & EXT4_BG_INODE_UNINIT) && ext4_group_flags_valid())
+        return;
+
+    uint8_t *bitmap = malloc(block_size);
+    if (img_pread(img_fd, bitmap, block_size, (off_t)gdt[g].bg_inode_bitmap * block_size) != (ssize_t)block_size) {
+        check_issue(cg, CHK_READ_ERROR, gdt[g].bg_inode_bitmap, 0, 0);
+        free(bitmap);
+        return;
+    }
+    size_t chunk = (size_t)INODE_SCAN_BLOCKS * block_size;
+    char *buf = malloc(chunk);
+    char *dbuf = malloc((size_t)EXPORT_IO_BLOCKS * block_size);
+
+    for (uint32_t tb = 0; tb < itable_blocks; tb += INODE_SCAN_BLOCKS) {
+        uint32_t nb = itable_blocks - tb < INODE_SCAN_BLOCKS ? itable_blocks - tb : INODE_SCAN_BLOCKS;
+        ssize_t want = (ssize_t)nb * block_size;
+        if (img_pread(img_fd, buf, want, (off_t)(gdt[g].bg_inode_table + tb) * block_size) != want) {
+            check_issue(cg, CHK_READ_ERROR, gdt[g].bg_inode_table + tb, 0, 0);
+            break;
+        }
+        uint32_t first = tb * (block_size / inode_size);
+        uint32_t last = first + nb * (block_size / inode_size);
+        if (last > inodes_per_group) last = inodes_per_group;
+
+        for (uint32_t idx = first; idx < last; idx++) {
+            uint32_t ino_no = g * inodes_per_group + idx + 1;
+            if (ino_no > sb.s_inodes_count) break;
+            struct ext2_inode ino;
+            memcpy(&ino, buf + (size_t)(idx - first) * inode_size, sizeof(ino));
+            bool marked = bitmap[idx / 8] & (1 << (idx % 8));
+            bool live = ino.i_links_count > 0 && ino.i_mode != 0;
+
+            // inode 비트맵과 inode 내용 대조 (예약 inode는 루트만 검사)
+            if (ino_no >= first_ino || ino_no == EXT2_ROOT_INO) {
+                if (marked && !live)
+                    check_issue(cg, CHK_INODE_MARKED_UNUSED, ino_no, 0, 0);
+                else if (!marked && live)
+                    check_issue(cg, CHK_INODE_NOT_MARKED, ino_no, 0, 0);
+            }
+            if (!marked || ino.i_mode == 0) continue;
+            bit_test_and_set(ctx->inuse, ino_no);
+            ctx->links[ino_no] = ino.i_links_count;
+            if ((ino.i_mode & S_IFMT) == S_IFDIR)
+                bit_test_and_set(ctx->isdir, ino_no);
+
+            if (ino.i_blocks == 0) continue;
+            // 확장 속성 블록: 여러 inode가 같은 블록을 공유할 수 있으므로 중복으로 보지 않음
+            if (ino.i_file_acl) {
+                if (ino.i_file_acl < sb.s_first_data_block || ino.i_file_acl >= sb.s_blocks_count)
+                    check_issue(cg, CHK_BAD_BLOCK, ino_no, ino.i_file_acl, 0);
+                else
+                    bit_test_and_set(ctx->owned, ino.i_file_acl);
+            }
+            // resize inode: 간접 블록들은 예약 GDT 블록으로 이미 표시됨, 이중 간접 블록만 소유
+            if (ino_no == EXT2_RESIZE_INO) {
+                if (ino.i_block[13])
+                    check_claim(ctx, cg, ino.i_block[13], ino_no);
+                continue;
+            }
+
+            BlockRun *runs = NULL;
+            uint32_t *meta = NULL;
+            int nmeta = 0;
+            int nruns = collect_block_map(img_fd, &ino, block_size, &runs, &meta, &nmeta);
+            for (int m = 0; m < nmeta; m++)
+                check_claim(ctx, cg, meta[m], ino_no);
+            for (int r = 0; r < nruns; r++) {
+                if (runs[r].hole) continue;
+                for (uint32_t j = 0; j < runs[r].len; j++)
+                    check_claim(ctx, cg, runs[r].physical + j, ino_no);
+            }
+
+            // 디렉토리면 데이터 블록을 읽어 엔트리 검사
+            if ((ino.i_mode & S_IFMT) == S_IFDIR) {
+                for (int r = 0; r < nruns; r++) {
+                    if (runs[r].hole || runs[r].physical + runs[r].len > sb.s_blocks_count) continue;
+                    for (uint32_t done = 0; done < runs[r].len; ) {
+                        uint32_t n = runs[r].len - done;
+                        if (n > EXPORT_IO_BLOCKS) n = EXPORT_IO_BLOCKS;
+                        ssize_t dw = (ssize_t)n * block_size;
+                        if (img_pread(img_fd, dbuf, dw, (off_t)(runs[r].physical + done) * block_size) != dw) {
+                            check_issue(cg, CHK_READ_ERROR, runs[r].physical + done, 0, 0);
+                            break;
+                        }
+                        for (uint32_t k = 0; k < n; k++)
+                            check_dir_block(ctx, cg, ino_no, runs[r].logical + done + k,
+                                            dbuf + (size_t)k * block_size);
+                        done += n;
+                    }
+                }
+            }
+            free(runs);
+            free(meta);
+        }
+    }
+    free(dbuf);
+    free(buf);
+    free(bitmap);
+}
+
+// 2단계: 링크 수와 디렉토리 참조 수 대조, 블록 비트맵과 실제 소유 블록 대조
+static void check_group_links(CheckCtx *ctx, uint32_t g) {
+    CheckGroup *cg = &ctx->groups[g];
+    uint32_t first_ino = sb.s_rev_level ? sb.s_first_ino : EXT2_GOOD_OLD_FIRST_INO;
+
+    // 1) inode 링크 수
+    for (uint32_t idx = 0; idx < inodes_per_group; idx++) {
+        uint32_t ino_no = g * inodes_per_group + idx + 1;
+        if (ino_no > sb.s_inodes_count) break;
+        uint32_t refs = ctx->refs[ino_no];
+        if (!bit_test(ctx->inuse, ino_no)) {
+            if (refs) check_issue(cg, CHK_REF_FREE_INODE, ino_no, refs, 0);
+            continue;
+        }
+        if (ino_no < first_ino && ino_no != EXT2_ROOT_INO) continue;
+        if (refs == 0) {
+            check_issue(cg, CHK_UNATTACHED, ino_no, 0, 0);
+            continue;
+        }
+        // dir_nlink: 하위 디렉토리가 너무 많으면 링크 수를 1로 둠
+        if (bit_test(ctx->isdir, ino_no) && ctx->links[ino_no] == 1) continue;
+        if (refs != ctx->links[ino_no])
+            check_issue(cg, CHK_LINK_COUNT, ino_no, ctx->links[ino_no], refs);
+    }
+
+    // 2) 블록 비트맵 (초기화되지 않은 비트맵은 건너뜀)
+    if ((gdt[g].bg_pad & EXT4_BG_BLOCK_UNINIT) && ext4_group_flags_valid())
+        return;
+    uint8_t *bitmap = malloc(block_size);
+    if (img_pread(img_fd, bitmap, block_size, (off_t)gdt[g].bg_block_bitmap * block_size) != (ssize_t)block_size) {
+        check_issue(cg, CHK_READ_ERROR, gdt[g].bg_block_bitmap, 0, 0);
+        free(bitmap);
+        return;
+    }
+    uint32_t gstart = sb.s_first_data_block + g * sb.s_blocks_per_group;
+    uint32_t nbits = group_block_count(g);
+    // 어긋난 구간을 (시작, 길이)로 묶어 보고
+    int run_kind = -1;
+    uint32_t run_start = 0;
+    for (uint32_t b = 0; b <= nbits; b++) {
+        int kind = -1;
+        if (b < nbits) {
+            bool marked = bitmap[b / 8] & (1 << (b % 8));
+            bool owned = bit_test(ctx->owned, gstart + b);
+            if (owned && !marked) kind = CHK_BLOCK_NOT_MARKED;
+            else if (!owned && marked) kind = CHK_BLOCK_MARKED_UNUSED;
+        }
+        if (kind != run_kind) {
+            if (run_kind >= 0)
+                check_issue(cg, run_kind, gstart + run_start, b - run_start, 0);
+            run_kind = kind;
+            run_start = b;
+        }
+    }
+    free(bitmap);
+}
+
+// 검사 작업 스레드: 현재 단계에서 그룹을 하나씩 가져가 처리
+static void *check_worker(void *arg) {
+    CheckCtx *ctx = arg;
+    uint32_t g;
+    while ((g = __atomic_fetch_add(&ctx->next_group, 1, __ATOMIC_RELAXED)) < group_count) {
+        if (ctx->pass == 0)
+            check_group_inodes(ctx, g);
+        else
+            check_group_links(ctx, g);
+    }
+    return NULL;
+}
+
+// 한 단계를 작업 스레드들로 실행하고 모두 끝날 때까지 대기
+static int check_run_pass(CheckCtx *ctx, int pass, int nthreads) {
+    ctx->pass = pass;
+    ctx->next_group = 0;
+    pthread_t tids[ANALYZE_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&tids[i], NULL, check_worker, ctx) != 0) break;
+        started++;
+    }
+    if (started == 0)
+        check_worker(ctx);      // 스레드를 만들 수 없으면 현재 스레드에서 처리
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    return started ? started : 1;
+}
+
+// 문제 하나 출력
+static void check_print_issue(const CheckIssue *is) {
+    switch (is->kind) {
+    case CHK_READ_ERROR:
+        printf("  block %u: read error\n", is->a);
+        break;
+    case CHK_INODE_MARKED_UNUSED:
+        printf("  inode %u: marked in use in the inode bitmap but has no mode or links\n", is->a);
+        break;
+    case CHK_INODE_NOT_MARKED:
+        printf("  inode %u: in use but not marked in the inode bitmap\n", is->a);
+        break;
+    case CHK_BAD_BLOCK:
+        printf("  inode %u: references invalid block %u\n", is->a, is->b);
+        break;
+    case CHK_DUP_BLOCK:
+        if (is->b)
+            printf("  block %u: claimed more than once (again by inode %u)\n", is->a, is->b);
+        else
+            printf("  block %u: filesystem metadata overlaps another owner\n", is->a);
+        break;
+    case CHK_BAD_REC_LEN:
+        printf("  inode %u: bad rec_len in directory block %u at offset %u\n", is->a, is->b, is->c);
+        break;
+    case CHK_BAD_DIRENT_INO:
+        printf("  inode %u: directory entry refers to invalid inode %u\n", is->a, is->b);
+        break;
+    case CHK_REF_FREE_INODE:
+        printf("  inode %u: referenced by %u directory entries but not in use\n", is->a, is->b);
+        break;
+    case CHK_UNATTACHED:
+        printf("  inode %u: in use but not referenced by any directory\n", is->a);
+        break;
+    case CHK_LINK_COUNT:
+        printf("  inode %u: link count is %u, should be %u\n", is->a, is->b, is->c);
+        break;
+    case CHK_BLOCK_NOT_MARKED:
+    case CHK_BLOCK_MARKED_UNUSED:
+        if (is->b == 1)
+            printf("  block %u: ", is->a);
+        else
+            printf("  blocks %u-%u: ", is->a, is->a + is->b - 1);
+        if (is->kind == CHK_BLOCK_NOT_MARKED)
+            printf("in use but marked free in the block bitmap\n");
+        else
+            printf("marked in use in the block bitmap but not owned\n");
+        break;
+    }
+}
+
+// check 명령어: 그룹마다 작업 스레드가 검사하고 결과를 그룹 순서대로 합쳐 출력 (이미지에 쓰지 않음)
+void command_check(int nthreads) {
+    static const char *titles[CHK_KINDS] = {
+        "read errors", "inode bitmap (unused inodes marked)", "inode bitmap (used inodes not marked)",
+        "invalid block references", "duplicate blocks", "directory rec_len",
+        "directory entries (invalid inode)", "directory entries (free inode)",
+        "unattached inodes", "link counts",
+        "block bitmap (used blocks not marked)", "block bitmap (unowned blocks marked)",
+    };
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    CheckCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.groups = calloc(group_count, sizeof(CheckGroup));
+    ctx.owned = calloc(sb.s_blocks_count / 64 + 1, sizeof(uint64_t));
+    ctx.inuse = calloc(sb.s_inodes_count / 64 + 1, sizeof(uint64_t));
+    ctx.isdir = calloc(sb.s_inodes_count / 64 + 1, sizeof(uint64_t));
+    ctx.refs = calloc(sb.s_inodes_count + 1, sizeof(uint32_t));
+    ctx.links = calloc(sb.s_inodes_count + 1, sizeof(uint16_t));
+
+    // 1단계가 모든 그룹을 끝내야 참조 수/블록 소유가 확정되므로 단계 사이에서 합류
+    nthreads = analyze_thread_count(nthreads, (int)group_count);
+    check_run_pass(&ctx, 0, nthreads);
+    int started = check_run_pass(&ctx, 1, nthreads);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // 종류별로 그룹 순서대로 모아 출력 (종류마다 CHECK_MAX_REPORT개까지)
+    uint64_t total = 0;
+    for (int kind = 0; kind < CHK_KINDS; kind++) {
+        uint64_t n = 0;
+        for (uint32_t g = 0; g < group_count; g++)
+            for (int i = 0; i < ctx.groups[g].cnt; i++)
+                if (ctx.groups[g].issues[i].kind == kind) {
+                    if (n == 0) printf("%s:\n", titles[kind]);
+                    if (n < CHECK_MAX_REPORT) check_print_issue(&ctx.groups[g].issues[i]);
+                    n++;
+                }
+        if (n > CHECK_MAX_REPORT)
+            printf("  ... %llu more\n", (unsigned long long)(n - CHECK_MAX_REPORT));
+        total += n;
+    }
+
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("check: %llu problems found in %u groups (%d threads, %.3f ms)\n\n",
+           (unsigned long long)total, group_count, started, ms);
+
+    for (uint32_t g = 0; g < group_count; g++)
+        free(ctx.groups[g].issues);
+    free(ctx.groups);
+    free(ctx.owned);
+    free(ctx.inuse);
+    free(ctx.isdir);
+    free(ctx.refs);
+    free(ctx.links);
+}
+
+// ---------------------------------------------------------------------------
+// 두 번째 이미지와 비교 (imgdiff)
+// ---------------------------------------------------------------------------
+
+// 현재 전역 이미지 상태를 st에 보관
+void image_stash(ImageState *st) {
+    st->fd = img_fd;
+    st->direct_fd = img_direct_fd;
+    st->path = img_path;
+    st->sb = sb;
+    st->gd = gd;
+    st->gdt = gdt;
+    st->group_count = group_count;
+    st->block_size = block_size;
+    st->inode_size = inode_size;
+    st->inodes_per_group = inodes_per_group;
+    st->root = root;
+    st->ino_map = ino_map;
+    st->blk_index = blk_index;
+    st->blk_index_cnt = blk_index_cnt;
+    st->blk_index_maxlen = blk_index_maxlen;
+    st->blk_index_ready = blk_index_ready;
+    st->gz = img_gz;
+    st->seen_mtime = img_seen_mtime;
+}
+
+// st에 보관된 이미지 상태를 전역으로 되돌림
+void image_restore(const ImageState *st) {
+    img_fd = st->fd;
+    img_direct_fd = st->direct_fd;
+    img_path = st->path;
+    sb = st->sb;
+    gd = st->gd;
+    gdt = st->gdt;
+    group_count = st->group_count;
+    block_size = st->block_size;
+    inode_size = st->inode_size;
+    inodes_per_group = st->inodes_per_group;
+    root = st->root;
+    ino_map = st->ino_map;
+    blk_index = st->blk_index;
+    blk_index_cnt = st->blk_index_cnt;
+    blk_index_maxlen = st->blk_index_maxlen;
+    blk_index_ready = st->blk_index_ready;
+    img_gz = st->gz;
+    img_seen_mtime = st->seen_mtime;
+}
+
+// 이미지를 열어 st에 상태를 만듦 (전역 상태는 호출 전 그대로 유지)
+// 트리는 루트만 만들고 필요할 때 적재
+int image_open(ImageState *st, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    GzImage *gz = NULL;
+    if (gz_detect(fd) && !(gz = gz_open(fd, path))) {
+        close(fd);
+        return -1;
+    }
+    struct ext2_super_block tmp;
+    if (img_pread(fd, &tmp, sizeof(tmp), SUPERBLOCK_OFFSET) != (ssize_t)sizeof(tmp)
+        || tmp.s_magic != EXT2_SUPER_MAGIC || tmp.s_blocks_per_group == 0) {
+        fprintf(stderr, "Error: '%s' is not an ext2 image\n", path);
+        gz_close(gz);
+        close(fd);
+        return -1;
+    }
+
+    ImageState saved;
+    image_stash(&saved);
+
+    img_fd = fd;
+    img_direct_fd = -1;
+    img_gz = gz;
+    img_path = strdup(path);
+    read_superblock(img_fd, &sb);
+    struct stat fst;
+    if (fstat(fd, &fst) == 0)
+        img_seen_mtime = fst.st_mtim;
+    if (!gz)
+        bcache_register(fd, block_size);
+    gdt = NULL;
+    read_group_desc(img_fd, 0, &gd, block_size);
+    read_group_desc_table(img_fd);
+    memset(&ino_map, 0, sizeof(ino_map));
+    root = create_node("/", EXT2_ROOT_INO, EXT2_FT_DIR);
+    ino_map_insert(root);
+    blk_index = NULL;
+    blk_index_cnt = 0;
+    blk_index_ready = false;
+
+    image_stash(st);
+    image_restore(&saved);
+    return 0;
+}
+
+// 작업 대상 이미지 전환: 현재 전역 상태를 from에 보관하고 to를 전역으로
+// (트리 적재로 전역 상태가 바뀌므로 전환할 때마다 보관해야 함)
+void image_switch(ImageState *from, ImageState *to) {
+    image_stash(from);
+    image_restore(to);
+}
+
+// image_open으로 연 이미지 해제
+void image_close(ImageState *st) {
+    if (!st->root) return;
+    ImageState saved;
+    image_stash(&saved);
+    image_restore(st);
+    free_tree(root);
+    free(ino_map.buckets);
+    free(gdt);
+    free(blk_index);
+    if (img_direct_fd >= 0) close(img_direct_fd);
+    bcache_unregister(img_fd);
+    gz_close(img_gz);
+    close(img_fd);
+    free((char *)img_path);
+    image_restore(&saved);
+    memset(st, 0, sizeof(*st));
+}
+
+// 트리 노드 순서 (insert_child_sorted와 같음): 디렉토리 먼저, 같은 종류는 이름순
+// NULL은 가장 뒤
+static int diff_node_cmp(const Node *x, const Node *y) {
+    if (!x) return y ? 1 : 0;
+    if (!y) return -1;
+    bool dx = x->file_type == EXT2_FT_DIR, dy = y->file_type == EXT2_FT_DIR;
+    if (dx != dy) return dx ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+// 블록 구간 목록에서 파일의 [off, off+len) 바이트를 buf로 읽음 (hole은 0)
+static int read_runs_at(int fd, uint32_t bs, const BlockRun *runs, int nruns,
+                        uint64_t off, size_t len, char *buf) {
+    memset(buf, 0, len);
+    for (int i = 0; i < nruns; i++) {
+        if (runs[i].hole) continue;
+        uint64_t rs = (uint64_t)runs[i].logical * bs;
+        uint64_t re = rs + (uint64_t)runs[i].len * bs;
+        uint64_t s = off > rs ? off : rs;
+        uint64_t e = off + len < re ? off + len : re;
+        if (s >= e) continue;
+        off_t src = (off_t)runs[i].physical * bs + (off_t)(s - rs);
+        if (img_pread(fd, buf + (s - off), e - s, src) != (ssize_t)(e - s))
+            return -1;
+    }
+    return 0;
+}
+
+// 두 파일 내용 비교: 같으면 0, 다르면 1, 읽기 실패면 -1
+static int diff_contents(DiffCtx *ctx, const struct ext2_inode *ia, const struct ext2_inode *ib) {
+    uint64_t size = inode_file_size(ia);
+    // fast symlink: 대상 경로가 i_block에 직접 저장됨
+    bool fast_a = inode_is_fast_symlink(ia, ctx->a->block_size);
+    bool fast_b = inode_is_fast_symlink(ib, ctx->b->block_size);
+    if (fast_a || fast_b) {
+        if (fast_a != fast_b || size > sizeof(ia->i_block)) return 1;
+        return memcmp(ia->i_block, ib->i_block, size) != 0;
+    }
+
+    ctx->content_files++;
+    BlockRun *ra = NULL, *rb = NULL;
+    int na = collect_block_runs(ctx->a->fd, ia, ctx->a->block_size, &ra);
+    int nb = collect_block_runs(ctx->b->fd, ib, ctx->b->block_size, &rb);
+    size_t chunk = (size_t)EXPORT_IO_BLOCKS * ctx->a->block_size;
+    char *ba = malloc(chunk), *bb = malloc(chunk);
+    int result = 0;
+    for (uint64_t off = 0; off < size && result == 0; off += chunk) {
+        size_t n = size - off < chunk ? (size_t)(size - off) : chunk;
+        if (read_runs_at(ctx->a->fd, ctx->a->block_size, ra, na, off, n, ba) < 0
+            || read_runs_at(ctx->b->fd, ctx->b->block_size, rb, nb, off, n, bb) < 0)
+            result = -1;
+        else if (memcmp(ba, bb, n) != 0)
+            result = 1;
+        ctx->content_bytes += n;
+    }
+    free(ba);
+    free(bb);
+    free(ra);
+    free(rb);
+    return result;
+}
+
+// 경로 출력: 상태 문자, 경로 (디렉토리는 끝에 '/'), 변경 이유
+static void diff_report(const char *status, const char *path, bool dir, const char *why) {
+    printf("%s %s%s", status, path, dir && strcmp(path, "/") ? "/" : "");
+    if (why && *why) printf("  (%s)", why);
+    printf("\n");
+}
+
+// 양쪽에 모두 있는 두 노드 비교: inode 메타데이터를 먼저 보고, 애매할 때만 내용 비교
+static void diff_pair(DiffCtx *ctx, Node *na, Node *nb,
+                      const struct ext2_inode *ia, const struct ext2_inode *ib, char *path);
+
+// 디렉토리 한 쌍의 자식들을 정렬 순서대로 병합하며 비교
+static void diff_dir(DiffCtx *ctx, Node *da, Node *db, char *path) {
+    // 양쪽 디렉토리를 한 단계만 적재 (하위는 실제로 내려갈 때 적재)
+    image_switch(ctx->a, ctx->b);
+    load_dir(db);
+    image_switch(ctx->b, ctx->a);
+    load_dir(da);
+
+    // 1) 병합 순서대로 짝 맞추기
+    int cap = 16, cnt = 0;
+    Node **pa = malloc(sizeof(Node *) * cap), **pb = malloc(sizeof(Node *) * cap);
+    Node *ca = da->first_child, *cb = db->first_child;
+    while (ca || cb) {
+        if (cnt == cap) {
+            cap *= 2;
+            pa = realloc(pa, sizeof(Node *) * cap);
+            pb = realloc(pb, sizeof(Node *) * cap);
+        }
+        int c = diff_node_cmp(ca, cb);
+        pa[cnt] = c <= 0 ? ca : NULL;
+        pb[cnt] = c >= 0 ? cb : NULL;
+        if (c <= 0) ca = ca->next_sibling;
+        if (c >= 0) cb = cb->next_sibling;
+        cnt++;
+    }
+
+    // 2) 짝이 맞은 항목의 inode를 이미지별로 한 번에 읽음
+    uint32_t *inos = malloc(sizeof(uint32_t) * (cnt ? cnt : 1));
+    int *slot = malloc(sizeof(int) * (cnt ? cnt : 1));
+    struct ext2_inode *ia = calloc(cnt ? cnt : 1, sizeof(struct ext2_inode));
+    struct ext2_inode *ib = calloc(cnt ? cnt : 1, sizeof(struct ext2_inode));
+    struct ext2_inode *tmp = malloc(sizeof(struct ext2_inode) * (cnt ? cnt : 1));
+    int npairs = 0;
+    for (int i = 0; i < cnt; i++)
+        if (pa[i] && pb[i]) {
+            slot[npairs] = i;
+            inos[npairs++] = pa[i]->inode_no;
+        }
+    if (npairs > 0) {
+        read_inodes_batch(img_fd, inos, npairs, tmp);
+        for (int k = 0; k < npairs; k++) {
+            ia[slot[k]] = tmp[k];
+            inos[k] = pb[slot[k]]->inode_no;
+        }
+        image_switch(ctx->a, ctx->b);
+        read_inodes_batch(img_fd, inos, npairs, tmp);
+        image_switch(ctx->b, ctx->a);
+        for (int k = 0; k < npairs; k++)
+            ib[slot[k]] = tmp[k];
+    }
+    free(tmp);
+    free(inos);
+    free(slot);
+
+    // 3) 정렬 순서대로 결과 출력, 양쪽에 있는 디렉토리는 재귀
+    size_t plen = strlen(path);
+    for (int i = 0; i < cnt; i++) {
+        Node *n = pa[i] ? pa[i] : pb[i];
+        if (plen + 1 + strlen(n->name) >= PATH_MAX) continue;
+        snprintf(path + plen, PATH_MAX - plen, "%s%s", plen == 1 ? "" : "/", n->name);
+        if (!pb[i]) {
+            diff_report("D", path, n->file_type == EXT2_FT_DIR, NULL);
+            ctx->removed++;
+        }
+        else if (!pa[i]) {
+            diff_report("A", path, n->file_type == EXT2_FT_DIR, NULL);
+            ctx->added++;
+        }
+        else {
+            diff_pair(ctx, pa[i], pb[i], &ia[i], &ib[i], path);
+        }
+        path[plen] = '\0';
+    }
+    free(pa);
+    free(pb);
+    free(ia);
+    free(ib);
+}
+
+static void diff_pair(DiffCtx *ctx, Node *na, Node *nb,
+                      const struct ext2_inode *ia, const struct ext2_inode *ib, char *path) {
+    bool dir = na->file_type == EXT2_FT_DIR;
+    char why[64] = "";
+
+    // 같은 inode 번호에 inode 레코드까지 같으면 내용도 같음 (ctime, 블록 맵 포함)
+    bool same_record = na->inode_no == nb->inode_no && memcmp(ia, ib, sizeof(*ia)) == 0;
+    if (!same_record) {
+        if ((ia->i_mode & S_IFMT) != (ib->i_mode & S_IFMT)) strcat(why, "type, ");
+        else if (ia->i_mode != ib->i_mode) strcat(why, "mode, ");
+        if (!dir) {
+            if (inode_file_size(ia) != inode_file_size(ib)) strcat(why, "size, ");
+            if (ia->i_mtime != ib->i_mtime) strcat(why, "mtime, ");
+        }
+        // 메타데이터가 같은데 레코드가 다르면(ctime, 블록 위치 등) 내용으로 판정
+        if (!why[0] && !dir) {
+            mode_t type = ia->i_mode & S_IFMT;
+            if (type == S_IFREG || type == S_IFLNK) {
+                int r = diff_contents(ctx, ia, ib);
+                if (r > 0) strcat(why, "content, ");
+                else if (r < 0) strcat(why, "read error, ");
+            }
+            else if (memcmp(ia->i_block, ib->i_block, sizeof(ia->i_block)) != 0) {
+                strcat(why, "device, ");     // 장치 파일은 i_block에 장치 번호
+            }
+        }
+    }
+    if (why[0]) {
+        why[strlen(why) - 2] = '\0';
+        diff_report("M", path, dir, why);
+        ctx->modified++;
+    }
+    if (dir && (ib->i_mode & S_IFMT) == S_IFDIR)
+        diff_dir(ctx, na, nb, path);
+}
+
+// imgdiff 명령어: 현재 이미지(기준)와 other 이미지의 PATH 하위 트리 비교
+// other가 open으로 붙인 이름이면 그 세션의 이미지(적재한 트리 포함)와 비교
+void command_imgdiff(const char *other, const char *path) {
+    Session *s = session_find(other);
+    if (s == cur_session) {
+        fprintf(stderr, "Error: '%s' is the current image\n", other);
+        return;
+    }
+    ImageState *ob = s ? &s->st : &diff_image;
+    // 두 번째 이미지는 열어 두고 같은 이미지면 다시 사용 (적재한 트리 재사용)
+    if (!s && (!diff_image.path || strcmp(diff_image.path, other) != 0)) {
+        image_close(&diff_image);
+        if (image_open(&diff_image, other) < 0)
+            return;
+    }
+
+    ImageState cur;
+    Node *na = find_node(root, path);
+    image_switch(&cur, ob);
+    Node *nb = find_node(root, path);
+    image_switch(ob, &cur);
+    if (!na || !nb) {
+        fprintf(stderr, "Error: '%s' does not exist in %s\n", path, na ? "the second image" : "the current image");
+        return;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DiffCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.a = &cur;
+    ctx.b = ob;
+
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", na == root ? "/" : path);
+    struct ext2_inode ia, ib;
+    read_inode(img_fd, na->inode_no, &ia);
+    image_switch(&cur, ob);
+    read_inode(img_fd, nb->inode_no, &ib);
+    image_switch(ob, &cur);
+    diff_pair(&ctx, na, nb, &ia, &ib, buf);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("imgdiff: %llu added, %llu removed, %llu modified; %llu files (%llu bytes) compared by content in %.3f ms\n\n",
+           (unsigned long long)ctx.added, (unsigned long long)ctx.removed, (unsigned long long)ctx.modified,
+           (unsigned long long)ctx.content_files, (unsigned long long)ctx.content_bytes, ms);
+}
+
+// ---------------------------------------------------------------------------
+// 여러 이미지 세션 (open/use/close)
+// ---------------------------------------------------------------------------
+
+// 이름으로 세션 찾기 (없으면 NULL)
+Session *session_find(const char *name) {
+    for (Session *s = sessions; s; s = s->next)
+        if (strcmp(s->name, name) == 0)
+            return s;
+    return NULL;
+}
+
+// open 명령어: path 이미지를 name으로 열어 둠 (현재 이미지는 그대로, 트리는 use할 때 적재)
+void command_open(const char *name, const char *path) {
+    size_t len = strlen(name);
+    bool ok = len > 0 && len <= SESSION_NAME_MAX;
+    for (size_t i = 0; ok && i < len; i++)
+        ok = (name[i] >= 'a' && name[i] <= 'z') || (name[i] >= 'A' && name[i] <= 'Z')
+             || (name[i] >= '0' && name[i] <= '9') || name[i] == '_' || name[i] == '-' || name[i] == '.';
+    if (!ok) {
+        fprintf(stderr, "Error: image name must be 1-%d letters, digits, '_', '-' or '.'\n", SESSION_NAME_MAX);
+        return;
+    }
+    if (session_find(name)) {
+        fprintf(stderr, "Error: an image named '%s' is already open\n", name);
+        return;
+    }
+    Session *s = calloc(1, sizeof(Session));
+    if (image_open(&s->st, path) < 0) {
+        free(s);
+        return;
+    }
+    s->name = strdup(name);
+    Session **tail = &sessions;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = s;
+    printf("%s: %s, %u blocks of %u bytes in %u groups\n\n", s->name, s->st.path,
+           s->st.sb.s_blocks_count, s->st.block_size, s->st.group_count);
+}
+
+// use 명령어: 이후 명령들의 대상 이미지를 name 세션으로 전환 (name이 없으면 세션 목록)
+void command_use(const char *name) {
+    if (!name) {
+        for (Session *s = sessions; s; s = s->next)
+            printf("%c %-8s %s\n", s == cur_session ? '*' : ' ', s->name,
+                   s == cur_session ? img_path : s->st.path);
+        printf("\n");
+        return;
+    }
+    Session *s = session_find(name);
+    if (!s) {
+        fprintf(stderr, "Error: no image named '%s' is open\n", name);
+        return;
+    }
+    if (s != cur_session) {
+        image_switch(&cur_session->st, &s->st);
+        cur_session = s;
+    }
+    // -l 이 아니면 시작할 때처럼 처음 전환할 때 전체 트리 적재
+    if (!lazy_load && !root->loaded)
+        build_tree(root);
+    printf("using %s (%s)\n\n", cur_session->name, img_path);
+}
+
+// close 명령어: 현재 쓰고 있지 않은 세션을 닫음
+void command_close(const char *name) {
+    Session **p = &sessions;
+    while (*p && strcmp((*p)->name, name) != 0)
+        p = &(*p)->next;
+    if (!*p) {
+        fprintf(stderr, "Error: no image named '%s' is open\n", name);
+        return;
+    }
+    if (*p == cur_session) {
+        fprintf(stderr, "Error: '%s' is in use (use another image first)\n", name);
+        return;
+    }
+    Session *s = *p;
+    *p = s->next;
+    image_close(&s->st);
+    free(s->name);
+    free(s);
+}
+
+// ---------------------------------------------------------------------------
+// 중복 파일 탐지 (dups)
+// ---------------------------------------------------------------------------
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static void dup_hash_init(DupHash *h, uint64_t seed) {
+    h->h1 = seed ^ 0x9E3779B97F4A7C15ULL;
+    h->h2 = rotl64(seed, 32) ^ 0xC2B2AE3D27D4EB4FULL;
+}
+
+// buf를 해시에 반영 (길이가 8의 배수가 아니면 나머지는 0으로 채운 단어로 처리)
+static void dup_hash_update(DupHash *h, const char *buf, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, buf + i, 8);
+        h->h1 = rotl64(h->h1 ^ (w * 0x87C37B91114253D5ULL), 31) * 0x4CF5AD432745937FULL;
+        h->h2 = rotl64(h->h2 + (w * 0x4CF5AD432745937FULL), 27) * 0x87C37B91114253D5ULL ^ h->h1;
+    }
+    if (i < len) {
+        char tail[8] = { 0 };
+        memcpy(tail, buf + i, len - i);
+        dup_hash_update(h, tail, 8);
+    }
+}
+
+// 마무리 섞기 (길이 포함)
+static void dup_hash_final(DupHash *h, uint64_t len) {
+    h->h1 ^= len;
+    h->h2 ^= rotl64(len, 17);
+    for (int r = 0; r < 2; r++) {
+        h->h1 = (h->h1 ^ (h->h1 >> 33)) * 0xFF51AFD7ED558CCDULL;
+        h->h2 = (h->h2 ^ (h->h2 >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+        h->h1 += h->h2;
+        h->h2 += h->h1;
+    }
+}
+
+// 크기(큰 순) → 첫 블록 해시 → 전체 해시 → 블록 구간 서명 순으로 정렬
+// 블록을 공유하는 파일들은 서명이 같아 항상 붙어 있게 됨
+static int dup_file_cmp(const void *x, const void *y) {
+    const DupFile *a = x, *b = y;
+    if (a->size != b->size) return a->size > b->size ? -1 : 1;
+    if (a->first_hash != b->first_hash) return a->first_hash < b->first_hash ? -1 : 1;
+    if (a->hash.h1 != b->hash.h1) return a->hash.h1 < b->hash.h1 ? -1 : 1;
+    if (a->hash.h2 != b->hash.h2) return a->hash.h2 < b->hash.h2 ? -1 : 1;
+    if (a->blk_sig != b->blk_sig) return a->blk_sig < b->blk_sig ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+// qsort 비교 함수: 낭비 용량 큰 순
+static int dup_group_cmp(const void *x, const void *y) {
+    const DupGroup *a = x, *b = y;
+    if (a->wasted != b->wasted) return a->wasted > b->wasted ? -1 : 1;
+    return a->start - b->start;
+}
+
+// 두 파일의 데이터 블록 구간이 같은지 (같으면 읽지 않아도 내용이 같음)
+static bool dup_same_blocks(const DupFile *a, const DupFile *b) {
+    if (a->blk_sig != b->blk_sig || a->nruns != b->nruns) return false;
+    for (int i = 0; i < a->nruns; i++)
+        if (a->runs[i].logical != b->runs[i].logical || a->runs[i].len != b->runs[i].len
+            || a->runs[i].hole != b->runs[i].hole || a->runs[i].physical != b->runs[i].physical)
+            return false;
+    return true;
+}
+
+// 정렬된 목록에서 files[i]가 앞 파일과 블록을 공유하는 사본인지 (대표 파일이 아님)
+static bool dup_is_shared(const DupFile *files, int i, int start) {
+    for (int k = i - 1; k >= start && files[k].blk_sig == files[i].blk_sig; k--)
+        if (dup_same_blocks(&files[k], &files[i]))
+            return true;
+    return false;
+}
+
+// 전체 해시 작업 스레드: 파일의 한 구간(세그먼트)씩 가져가 해시
+static void *dups_worker(void *arg) {
+    DupCtx *ctx = arg;
+    size_t seg_bytes = (size_t)DUPS_SEGMENT_BLOCKS * block_size;
+    char *buf = malloc(seg_bytes);
+    while (1) {
+        int j = __atomic_fetch_add(&ctx->next_job, 1, __ATOMIC_RELAXED);
+        if (j >= ctx->njobs) break;
+        DupJob *job = &ctx->jobs[j];
+        DupFile *f = job->file;
+        // 버퍼를 만들지 못했으면 파일을 오류로 표시해 묶음에서 빠지게 함
+        if (!buf) {
+            __atomic_store_n(&f->error, true, __ATOMIC_RELAXED);
+            continue;
+        }
+        uint64_t off = (uint64_t)job->seg * seg_bytes;
+        size_t len = f->size - off < seg_bytes ? (size_t)(f->size - off) : seg_bytes;
+        DupHash h;
+        dup_hash_init(&h, job->seg);
+        if (read_runs_at(img_fd, block_size, f->runs, f->nruns, off, len, buf) < 0)
+            __atomic_store_n(&f->error, true, __ATOMIC_RELAXED);
+        dup_hash_update(&h, buf, len);
+        dup_hash_final(&h, len);
+        f->seg_hash[job->seg] = h;
+        __atomic_fetch_add(&ctx->bytes_read, len, __ATOMIC_RELAXED);
+    }
+    free(buf);
+    return NULL;
+}
+
+// qsort 비교 함수: 세그먼트의 물리 위치 순 (대체로 순차 읽기가 되도록)
+static int dup_job_cmp(const void *x, const void *y) {
+    const DupJob *a = x, *b = y;
+    if (a->phys != b->phys) return a->phys < b->phys ? -1 : 1;
+    return a->seg < b->seg ? -1 : a->seg > b->seg;
+}
+
+// 세그먼트 시작의 물리 블록 (정렬용, hole이면 0)
+static uint32_t dup_seg_phys(const DupFile *f, uint32_t seg) {
+    uint64_t lb = (uint64_t)seg * DUPS_SEGMENT_BLOCKS;
+    for (int i = 0; i < f->nruns; i++)
+        if (lb >= f->runs[i].logical && lb - f->runs[i].logical < f->runs[i].len)
+            return f->runs[i].hole ? 0 : f->runs[i].physical + (uint32_t)(lb - f->runs[i].logical);
+    return 0;
+}
+
+// dups 명령어: 하위 트리에서 내용이 같은 일반 파일 묶음과 낭비 용량 출력
+void command_dups(const char *path, int nthreads) {
+    Node *tgt = find_node(root, path);
+    if (!tgt) {
+        command_help_dups();
+        return;
+    }
+    if (tgt->file_type != EXT2_FT_DIR) {
+        fprintf(stderr, "Error: '%s' is not directory\n", path);
+        return;
+    }
+    build_tree(tgt);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // 1) 일반 파일 수집, 하드 링크는 inode당 첫 경로만 사용
+    FragFile *ff = NULL;
+    int nff = 0, cap = 0;
+    frag_collect(tgt, strcmp(path, ".") == 0 ? "/" : path, &ff, &nff, &cap);
+    int nuniq = frag_unique_inodes(ff, nff);
+    // 파일이 없으면 inode 배열은 만들지 않음 (아래에서는 nuniq개만 씀)
+    uint32_t *inos = NULL;
+    struct ext2_inode *inodes = NULL;
+    if (nuniq > 0) {
+        inos = malloc(sizeof(uint32_t) * nuniq);
+        inodes = malloc(sizeof(struct ext2_inode) * nuniq);
+        if (!inos || !inodes) {
+            fprintf(stderr, "dups: out of memory\n");
+            for (int i = 0; i < nuniq; i++)
+                free(ff[i].path);
+            free(ff);
+            free(inos);
+            free(inodes);
+            return;
+        }
+        for (int i = 0; i < nuniq; i++)
+            inos[i] = ff[i].inode_no;
+        read_inodes_batch(img_fd, inos, nuniq, inodes);
+    }
+
+    DupFile *files = calloc(nuniq > 0 ? (size_t)nuniq : 1, sizeof(DupFile));
+    int n = 0;
+    for (int i = 0; i < nuniq; i++) {
+        uint64_t size = inode_file_size(&inodes[i]);
+        if (size == 0) {             // 빈 파일은 제외
+            free(ff[i].path);
+            continue;
+        }
+        files[n].path = ff[i].path;
+        files[n].ino = ff[i].inode_no;
+        files[n].size = size;
+        files[n].ino_rec = inodes[i];
+        n++;
+    }
+    free(ff);
+    free(inos);
+    free(inodes);
+
+    // 2) 크기로 묶기: 같은 크기의 파일이 있는 것만 후보, 후보는 블록 구간과 그 서명을 구함
+    qsort(files, n, sizeof(DupFile), dup_file_cmp);
+    for (int s = 0, e; s < n; s = e) {
+        for (e = s + 1; e < n && files[e].size == files[s].size; e++);
+        if (e - s < 2) continue;
+        for (int i = s; i < e; i++) {
+            DupFile *f = &files[i];
+            f->candidate = true;
+            f->nruns = collect_block_runs(img_fd, &f->ino_rec, block_size, &f->runs);
+            // 구조체 패딩이 섞이지 않도록 필드를 직접 묶어 해시
+            DupHash h;
+            dup_hash_init(&h, f->size);
+            for (int r = 0; r < f->nruns; r++) {
+                uint64_t w[2];
+                w[0] = (uint64_t)f->runs[r].logical << 32 | f->runs[r].len;
+                w[1] = (uint64_t)f->runs[r].physical << 1 | f->runs[r].hole;
+                dup_hash_update(&h, (const char *)w, sizeof(w));
+            }
+            dup_hash_final(&h, f->nruns);
+            f->blk_sig = h.h1;
+        }
+    }
+
+    // 3) 블록 구간이 같은 파일은 읽지 않고 같은 내용으로 처리: 대표 파일만 첫 블록 해시
+    qsort(files, n, sizeof(DupFile), dup_file_cmp);
+    char *blk = malloc(block_size);
+    uint64_t first_reads = 0;
+    for (int i = 0; i < n; i++) {
+        DupFile *f = &files[i];
+        if (!f->candidate) continue;
+        if (dup_is_shared(files, i, 0)) {
+            f->shared = true;
+            continue;
+        }
+        if (!blk) {
+            f->error = true;
+            continue;
+        }
+        size_t len = f->size < block_size ? (size_t)f->size : block_size;
+        DupHash h;
+        dup_hash_init(&h, 0);
+        if (read_runs_at(img_fd, block_size, f->runs, f->nruns, 0, len, blk) < 0)
+            f->error = true;
+        dup_hash_update(&h, blk, len);
+        dup_hash_final(&h, len);
+        f->first_hash = h.h1;
+        first_reads++;
+    }
+    for (int i = 1; i < n; i++)
+        if (files[i].shared)
+            files[i].first_hash = files[i - 1].first_hash;
+    free(blk);
+
+    // 4) 크기 + 첫 블록 해시가 같은 대표 파일이 둘 이상인 묶음만 전체 해시 대상
+    qsort(files, n, sizeof(DupFile), dup_file_cmp);
+    DupCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    int jcap = 0;
+    uint64_t seg_bytes = (uint64_t)DUPS_SEGMENT_BLOCKS * block_size;
+    for (int s = 0, e; s < n; s = e) {
+        for (e = s + 1; e < n && files[e].size == files[s].size
+                        && files[e].first_hash == files[s].first_hash; e++);
+        if (!files[s].candidate || e - s < 2) continue;
+        int reps = 0;
+        for (int i = s; i < e; i++) {
+            files[i].shared = dup_is_shared(files, i, s);
+            if (!files[i].shared) reps++;
+        }
+        for (int i = s; i < e; i++) {
+            files[i].full = true;
+            if (files[i].shared || reps < 2) continue;   // 블록을 공유하는 사본뿐이면 읽을 필요 없음
+            uint32_t nseg = (uint32_t)((files[i].size + seg_bytes - 1) / seg_bytes);
+            files[i].nseg = nseg;
+            files[i].seg_hash = calloc(nseg, sizeof(DupHash));
+            if (!files[i].seg_hash) {
+                files[i].error = true;
+                continue;
+            }
+            for (uint32_t g = 0; g < nseg; g++) {
+                if (ctx.njobs == jcap) {
+                    int ncap = jcap ? jcap * 2 : 64;
+                    DupJob *jobs = realloc(ctx.jobs, sizeof(DupJob) * ncap);
+                    if (!jobs) {            // 남은 세그먼트는 해시하지 못하므로 오류로 표시
+                        files[i].error = true;
+                        break;
+                    }
+                    ctx.jobs = jobs;
+                    jcap = ncap;
+                }
+                ctx.jobs[ctx.njobs].file = &files[i];
+                ctx.jobs[ctx.njobs].seg = g;
+                ctx.jobs[ctx.njobs].phys = dup_seg_phys(&files[i], g);
+                ctx.njobs++;
+            }
+        }
+    }
+
+    // 5) 세그먼트 해시를 작업 스레드들이 병렬로 계산한 뒤 파일 단위로 합침
+    if (ctx.njobs > 1)
+        qsort(ctx.jobs, ctx.njobs, sizeof(DupJob), dup_job_cmp);
+    nthreads = analyze_thread_count(nthreads, ctx.njobs);
+    pthread_t tids[ANALYZE_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < nthreads && ctx.njobs > 0; i++) {
+        if (pthread_create(&tids[i], NULL, dups_worker, &ctx) != 0) break;
+        started++;
+    }
+    if (started == 0) dups_worker(&ctx);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    uint64_t hashed_files = 0;
+    for (int i = 0; i < n; i++) {
+        if (!files[i].seg_hash) continue;
+        DupHash h;
+        dup_hash_init(&h, files[i].size);
+        dup_hash_update(&h, (const char *)files[i].seg_hash, sizeof(DupHash) * files[i].nseg);
+        dup_hash_final(&h, files[i].size);
+        files[i].hash = h;
+        hashed_files++;
+    }
+    for (int i = 1; i < n; i++)
+        if (files[i].shared)
+            files[i].hash = files[i - 1].hash;
+
+    // 6) 크기 + 첫 블록 해시 + 전체 해시가 같은 묶음 (낭비 용량 큰 순)
+    qsort(files, n, sizeof(DupFile), dup_file_cmp);
+    int ngroups = 0, gcap = 0;
+    DupGroup *groups = NULL;
+    uint64_t wasted_total = 0;
+    for (int s = 0, e; s < n; s = e) {
+        bool error = files[s].error;
+        for (e = s + 1; e < n && files[e].size == files[s].size
+                        && files[e].first_hash == files[s].first_hash
+                        && files[e].hash.h1 == files[s].hash.h1 && files[e].hash.h2 == files[s].hash.h2; e++)
+            error |= files[e].error;
+        if (e - s < 2 || !files[s].full || error) continue;
+        // 서로 다른 블록에 저장된 사본 수 - 1 만큼 낭비
+        int copies = 0;
+        for (int i = s; i < e; i++) {
+            files[i].shared = dup_is_shared(files, i, s);
+            if (!files[i].shared) copies++;
+        }
+        if (ngroups == gcap) {
+            gcap = gcap ? gcap * 2 : 16;
+            groups = realloc(groups, sizeof(DupGroup) * gcap);
+        }
+        groups[ngroups].start = s;
+        groups[ngroups].cnt = e - s;
+        groups[ngroups].wasted = (uint64_t)(copies - 1) * files[s].size;
+        wasted_total += groups[ngroups].wasted;
+        ngroups++;
+    }
+    if (ngroups > 1)
+        qsort(groups, ngroups, sizeof(DupGroup), dup_group_cmp);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (int g = 0; g < ngroups; g++) {
+        DupFile *f = &files[groups[g].start];
+        printf("%d files, %llu bytes each, %llu bytes wasted\n", groups[g].cnt,
+               (unsigned long long)f->size, (unsigned long long)groups[g].wasted);
+        for (int i = 0; i < groups[g].cnt; i++)
+            printf("  %s%s\n", f[i].path, f[i].shared ? "  (shares blocks)" : "");
+    }
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("dups: %d groups, %llu bytes wasted; %d files, %llu first-block reads, %llu files (%llu bytes) fully hashed with %d threads in %.3f ms\n\n",
+           ngroups, (unsigned long long)wasted_total, n, (unsigned long long)first_reads,
+           (unsigned long long)hashed_files, (unsigned long long)ctx.bytes_read,
+           started ? started : 1, ms);
+
+    for (int i = 0; i < n; i++) {
+        free(files[i].path);
+        free(files[i].runs);
+        free(files[i].seg_hash);
+    }
+    free(files);
+    free(groups);
+    free(ctx.jobs);
+}
+
+// ---------------------------------------------------------------------------
+// find / du
+// ---------------------------------------------------------------------------
+
+// find 타입 문자 → 디렉토리 엔트리 타입 (f: 일반 파일, d: 디렉토리, l: 심볼릭 링크)
+int find_type_code(char t) {
+    switch (t) {
+    case 'f': return EXT2_FT_REG_FILE;
+    case 'd': return EXT2_FT_DIR;
+    case 'l': return EXT2_FT_SYMLINK;
+    default:  return -1;
+    }
+}
+
+// path(길이 len) 뒤에 "/name" 을 붙이고 새 길이 반환 (PATH_MAX_LEN을 넘으면 0)
+// 호출한 쪽은 path[len] = '\0' 으로 되돌림
+static size_t path_append(char *path, size_t len, const char *name) {
+    bool slash = !(len > 0 && path[len - 1] == '/');
+    size_t nlen = len + slash + strlen(name);
+    if (nlen > PATH_MAX_LEN) return 0;
+    if (slash) path[len] = '/';
+    strcpy(path + len + slash, name);
+    return nlen;
+}
+
+// 하위 트리를 깊이 우선으로 돌며 이름 패턴/타입이 맞는 경로 출력
+static void find_walk(const Node *n, char *path, size_t len, const char *pattern, int type) {
+    bool match = (type < 0 || n->file_type == type)
+                 && (!pattern || fnmatch(pattern, n->name, 0) == 0);
+    if (match)
+        printf("%s\n", path);
+    if (n->file_type != EXT2_FT_DIR)
+        return;
+    for (Node *c = n->first_child; c; c = c->next_sibling) {
+        size_t clen = path_append(path, len, c->name);
+        if (clen == 0) continue;
+        find_walk(c, path, clen, pattern, type);
+        path[len] = '\0';
+    }
+}
+
+// find 명령어: [PATH] 아래에서 이름(-name, glob)과 타입(-type)이 맞는 경로 나열
+void command_find(const char *path, const char *pattern, int type) {
+    Node *tgt = find_node(root, path);
+    if (!tgt) {
+        command_help_find();
+        return;
+    }
+    if (tgt->file_type == EXT2_FT_DIR)
+        build_tree(tgt);
+
+    char buf[PATH_MAX_LEN + 1];
+    snprintf(buf, sizeof(buf), "%s", path);
+    find_walk(tgt, buf, strlen(buf), pattern, type);
+}
+
+// 하위 트리 노드를 전위 순서로 모음 (du가 inode를 한 번에 읽기 위해 사용)
+static void du_collect(Node *n, Node ***nodes, int *cnt, int *cap) {
+    if (*cnt == *cap) {
+        *cap = *cap ? *cap * 2 : 256;
+        *nodes = realloc(*nodes, sizeof(Node*) * *cap);
+    }
+    (*nodes)[(*cnt)++] = n;
+    if (n->file_type != EXT2_FT_DIR)
+        return;
+    for (Node *c = n->first_child; c; c = c->next_sibling)
+        du_collect(c, nodes, cnt, cap);
+}
+
+// du_collect와 같은 순서로 돌며 사용량 합산, 디렉토리는 후위 순서로 출력
+// 하드 링크된 파일은 처음 만난 경로에서만 계산
+static uint64_t du_walk(Node *n, const struct ext2_inode *inodes, int *idx, uint8_t *seen,
+                        char *path, size_t len, bool summary) {
+    const struct ext2_inode *ino = &inodes[(*idx)++];
+    uint64_t bytes = (uint64_t)ino->i_blocks * 512;
+    if (n->file_type != EXT2_FT_DIR) {
+        if (ino->i_links_count > 1 && n->inode_no <= sb.s_inodes_count) {
+            uint32_t b = n->inode_no;
+            if (seen[b / 8] & (1u << (b % 8)))
+                return 0;
+            seen[b / 8] |= (uint8_t)(1u << (b % 8));
+        }
+        return bytes;
+    }
+    for (Node *c = n->first_child; c; c = c->next_sibling) {
+        size_t clen = path_append(path, len, c->name);
+        if (clen == 0) {
+            // 경로는 출력할 수 없어도 합계에는 포함
+            bytes += du_walk(c, inodes, idx, seen, path, len, true);
+            continue;
+        }
+        bytes += du_walk(c, inodes, idx, seen, path, clen, summary);
+        path[len] = '\0';
+    }
+    if (!summary)
+        printf("%llu\t%s\n", (unsigned long long)((bytes + 1023) / 1024), path);
+    return bytes;
+}
+
+// du 명령어: [PATH] 아래 디렉토리별 디스크 사용량(KB, i_blocks 기준) 출력
+// -s면 [PATH] 합계만 출력
+void command_du(const char *path, bool summary) {
+    Node *tgt = find_node(root, path);
+    if (!tgt) {
+        command_help_du();
+        return;
+    }
+    if (tgt->file_type == EXT2_FT_DIR)
+        build_tree(tgt);
+
+    Node **nodes = NULL;
+    int cnt = 0, cap = 0;
+    du_collect(tgt, &nodes, &cnt, &cap);
+
+    // 모든 inode를 일괄 읽기
+    uint32_t *inos = malloc(sizeof(uint32_t) * cnt);
+    struct ext2_inode *inodes = malloc(sizeof(struct ext2_inode) * cnt);
+    for (int i = 0; i < cnt; i++)
+        inos[i] = nodes[i]->inode_no;
+    read_inodes_batch(img_fd, inos, cnt, inodes);
+
+    uint8_t *seen = calloc(sb.s_inodes_count / 8 + 1, 1);
+    char buf[PATH_MAX_LEN + 1];
+    snprintf(buf, sizeof(buf), "%s", path);
+    int idx = 0;
+    uint64_t total = du_walk(tgt, inodes, &idx, seen, buf, strlen(buf), summary);
+    // 디렉토리가 아니거나 -s면 대상 합계 한 줄
+    if (summary || tgt->file_type != EXT2_FT_DIR)
+        printf("%llu\t%s\n", (unsigned long long)((total + 1023) / 1024), path);
+
+    free(seen);
+    free(inos);
+    free(inodes);
+    free(nodes);
+}
+
+// summary mtime 경과 시간 버킷 (초, 마지막은 상한 없음)
+static const struct {
+    const char *label;
+    int64_t limit;
+} summary_ages[] = {
+    { "< 1 hour",  3600 },
+    { "< 1 day",   86400 },
+    { "< 1 week",  7 * 86400 },
+    { "< 30 days", 30 * 86400 },
+    { "< 1 year",  365 * 86400 },
+    { ">= 1 year", INT64_MAX },
+};
+#define SUMMARY_AGE_BUCKETS ((int)(sizeof(summary_ages) / sizeof(summary_ages[0])))
+
+// summary 명령어: [PATH] 하위 트리를 한 번 돌며 타입별 개수, 하드 링크, 크기/수정 시간 분포 출력
+// inode는 du처럼 전위 순서로 모아 한 번에 읽고, 타입은 디렉토리 엔트리가 아닌 i_mode 기준
+// 타입 개수는 경로마다, 크기/시간 분포는 inode마다(하드 링크는 한 번) 셈
+void command_summary(const char *path) {
+    Node *tgt = find_node(root, path);
+    if (!tgt) {
+        command_help_summary();
+        return;
+    }
+    if (tgt->file_type == EXT2_FT_DIR)
+        build_tree(tgt);
+
+    Node **nodes = NULL;
+    int cnt = 0, cap = 0;
+    du_collect(tgt, &nodes, &cnt, &cap);
+    uint32_t *inos = malloc(sizeof(uint32_t) * cnt);
+    struct ext2_inode *inodes = malloc(sizeof(struct ext2_inode) * cnt);
+    for (int i = 0; i < cnt; i++)
+        inos[i] = nodes[i]->inode_no;
+    read_inodes_batch(img_fd, inos, cnt, inodes);
+
+    uint64_t ndir = 0, nreg = 0, nlnk = 0, nchr = 0, nblk = 0, nfifo = 0, nsock = 0, nother = 0;
+    uint64_t hl_inodes = 0, hl_paths = 0, max_links = 0, distinct = 0;
+    uint64_t size_zero = 0, size_hist[64] = { 0 }, total_size = 0, largest = 0, nsized = 0;
+    uint64_t age_hist[SUMMARY_AGE_BUCKETS] = { 0 }, future = 0;
+    int64_t now = (int64_t)time(NULL);
+    uint8_t *seen = calloc(sb.s_inodes_count / 8 + 1, 1);
+
+    for (int i = 0; i < cnt; i++) {
+        const struct ext2_inode *ino = &inodes[i];
+        switch (ino->i_mode & S_IFMT) {
+        case S_IFDIR:  ndir++; break;
+        case S_IFREG:  nreg++; break;
+        case S_IFLNK:  nlnk++; break;
+        case S_IFCHR:  nchr++; break;
+        case S_IFBLK:  nblk++; break;
+        case S_IFIFO:  nfifo++; break;
+        case S_IFSOCK: nsock++; break;
+        default:       nother++; break;
+        }
+        // 디렉토리가 아닌 inode의 두 번째 이후 경로는 분포에서 제외
+        bool is_dir = (ino->i_mode & S_IFMT) == S_IFDIR;
+        if (!is_dir && ino->i_links_count > 1) {
+            hl_paths++;
+            if (ino->i_links_count > max_links) max_links = ino->i_links_count;
+            uint32_t b = inos[i];
+            if (b <= sb.s_inodes_count) {
+                if (seen[b / 8] & (1u << (b % 8)))
+                    continue;
+                seen[b / 8] |= (uint8_t)(1u << (b % 8));
+            }
+            hl_inodes++;
+        }
+        distinct++;
+        if ((ino->i_mode & S_IFMT) == S_IFREG) {
+            uint64_t size = inode_file_size(ino);
+            nsized++;
+            total_size += size;
+            if (size > largest) largest = size;
+            if (size == 0) size_zero++;
+            else size_hist[log2_bucket(size)]++;
+        }
+        int64_t age = now - (int64_t)ino->i_mtime;
+        if (age < 0) {
+            future++;
+        } else {
+            for (int b = 0; b < SUMMARY_AGE_BUCKETS; b++) {
+                if (age < summary_ages[b].limit) {
+                    age_hist[b]++;
+                    break;
+                }
+            }
+        }
+    }
+
+    printf("path         : %s\n", path);
+    printf("entries      : %d paths, %llu distinct inodes\n", cnt, (unsigned long long)distinct);
+    printf("types        : %llu directories, %llu regular files, %llu symlinks, %llu character devices, "
+           "%llu block devices, %llu fifos, %llu sockets",
+           (unsigned long long)ndir, (unsigned long long)nreg, (unsigned long long)nlnk,
+           (unsigned long long)nchr, (unsigned long long)nblk, (unsigned long long)nfifo,
+           (unsigned long long)nsock);
+    if (nother)
+        printf(", %llu unknown", (unsigned long long)nother);
+    printf("\n");
+    printf("hard links   : %llu inodes with more than one link, %llu paths to them",
+           (unsigned long long)hl_inodes, (unsigned long long)hl_paths);
+    if (max_links)
+        printf(", up to %llu links", (unsigned long long)max_links);
+    printf("\n");
+    printf("regular size : %llu bytes total, average %.1f bytes, largest %llu bytes\n",
+           (unsigned long long)total_size, nsized ? (double)total_size / nsized : 0.0,
+           (unsigned long long)largest);
+    printf("size histogram (bytes, regular files):\n");
+    if (size_zero)
+        printf("  %10s   %-10s : %llu\n", "0", "", (unsigned long long)size_zero);
+    for (int b = 0; b < 64; b++) {
+        if (!size_hist[b]) continue;
+        uint64_t lo = 1ULL << b, hi = b == 63 ? UINT64_MAX : (lo << 1) - 1;
+        printf("  %10llu - %-10llu : %llu\n",
+               (unsigned long long)lo, (unsigned long long)hi, (unsigned long long)size_hist[b]);
+    }
+    printf("mtime age histogram:\n");
+    for (int b = 0; b < SUMMARY_AGE_BUCKETS; b++)
+        printf("  %-10s : %llu\n", summary_ages[b].label, (unsigned long long)age_hist[b]);
+    if (future)
+        printf("  %-10s : %llu\n", "future", (unsigned long long)future);
+    printf("\n");
+
+    free(seen);
+    free(inos);
+    free(inodes);
+    free(nodes);
+}
+
+// ---------------------------------------------------------------------------
+// 상주 조회 서버 (--serve) / 클라이언트 (--connect)
+// ---------------------------------------------------------------------------
+
+// 접속한 클라이언트 하나의 상태: 명령 한 줄씩 받아 실행 결과를 응답으로 돌려줌
+typedef struct ServeClient {
+    int fd;
+    char in[SERVE_LINE_MAX];   // 아직 줄바꿈을 받지 못한 입력
+    size_t in_len;
+    char *out;                 // 보내지 못한 응답 (길이 헤더 포함)
+    size_t out_len, out_off, out_cap;
+    bool closing;              // exit를 받았으면 응답을 다 보낸 뒤 연결 종료
+} ServeClient;
+
+static volatile sig_atomic_t serve_stop;
+
+static void serve_on_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+// 응답 버퍼에 len 바이트를 넣을 공간 확보
+static char *serve_reserve(ServeClient *c, size_t len) {
+    if (c->out_off > 0 && c->out_off == c->out_len)
+        c->out_off = c->out_len = 0;
+    if (c->out_len + len > c->out_cap) {
+        c->out_cap = c->out_len + len > c->out_cap * 2 ? c->out_len + len : c->out_cap * 2;
+        c->out = realloc(c->out, c->out_cap);
+    }
+    char *p = c->out + c->out_len;
+    c->out_len += len;
+    return p;
+}
+
+// 명령 한 줄 실행: stdout/stderr를 cap_fd(memfd)로 돌려 출력을 모은 뒤
+// [4바이트 빅엔디언 길이][출력] 형태로 응답 버퍼에 추가
+static void serve_execute(ServeClient *c, int cap_fd, char *line) {
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    if (ftruncate(cap_fd, 0) < 0 || lseek(cap_fd, 0, SEEK_SET) < 0)
+        perror("serve: reset output");
+    dup2(cap_fd, STDOUT_FILENO);
+    dup2(cap_fd, STDERR_FILENO);
+
+    if (!run_command(line))
+        c->closing = true;
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    off_t n = lseek(cap_fd, 0, SEEK_CUR);
+    if (n < 0 || n > UINT32_MAX) n = 0;
+    unsigned char *hdr = (unsigned char *)serve_reserve(c, 4 + (size_t)n);
+    hdr[0] = (uint32_t)n >> 24;
+    hdr[1] = (uint32_t)n >> 16;
+    hdr[2] = (uint32_t)n >> 8;
+    hdr[3] = (uint32_t)n;
+    off_t got = 0;
+    while (got < n) {
+        ssize_t r = pread(cap_fd, hdr + 4 + got, n - got, got);
+        if (r <= 0) {
+            memset(hdr + 4 + got, 0, n - got);
+            break;
+        }
+        got += r;
+    }
+}
+
+// 받은 입력에서 완성된 줄을 모두 실행 (false면 연결을 끊어야 함)
+static bool serve_input(ServeClient *c, int cap_fd) {
+    ssize_t r = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+    if (r == 0) return false;
+    if (r < 0) return errno == EAGAIN || errno == EINTR;
+    c->in_len += r;
+
+    size_t start = 0;
+    char *nl;
+    while (!c->closing && (nl = memchr(c->in + start, '\n', c->in_len - start)) != NULL) {
+        *nl = '\0';
+        serve_execute(c, cap_fd, c->in + start);
+        start = nl - c->in + 1;
+    }
+    if (c->closing) {
+        c->in_len = 0;
+        return true;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    // 한 줄이 버퍼보다 길면 더 받을 수 없으므로 연결 종료
+    return c->in_len < sizeof(c->in);
+}
+
+// 밀린 응답 전송 (false면 연결을 끊어야 함)
+static bool serve_output(ServeClient *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t w = send(c->fd, c->out + c->out_off, c->out_len - c->out_off,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w < 0)
+            return errno == EAGAIN || errno == EINTR;
+        c->out_off += w;
+    }
+    c->out_off = c->out_len = 0;
+    return !c->closing;
+}
+
+static void serve_drop(ServeClient *clients, int *n, int i) {
+    close(clients[i].fd);
+    free(clients[i].out);
+    clients[i] = clients[--*n];
+}
+
+// 서버 모드: 이미지와 트리를 한 번 적재해 둔 채 Unix 도메인 소켓으로 명령을 받음
+// 트리와 캐시가 전역 상태라 명령은 poll 이벤트 루프 한 스레드에서 차례로 실행하고,
+// 여러 클라이언트의 연결/송수신은 non-blocking으로 동시에 처리
+int serve_main(const char *sock_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "serve: socket path too long: %s\n", sock_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, sock_path);
+
+    // 이전 서버가 남긴 소켓 파일만 지움
+    struct stat st;
+    if (lstat(sock_path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(sock_path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, SOMAXCONN) < 0) {
+        perror("bind");
+        close(lfd);
+        return -1;
+    }
+    int cap_fd = memfd_create("ssu_ext2-output", MFD_CLOEXEC);
+    if (cap_fd < 0) {
+        perror("memfd_create");
+        close(lfd);
+        unlink(sock_path);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serve_on_signal;   // SA_RESTART 없이: poll이 EINTR로 깨어남
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "serving %s on %s\n", img_path, sock_path);
+
+    ServeClient *clients = calloc(SERVE_MAX_CLIENTS, sizeof(ServeClient));
+    struct pollfd pfds[SERVE_MAX_CLIENTS + 1];
+    int nclients = 0;
+    while (!serve_stop) {
+        pfds[0].fd = lfd;
+        pfds[0].events = nclients < SERVE_MAX_CLIENTS ? POLLIN : 0;
+        for (int i = 0; i < nclients; i++) {
+            pfds[i + 1].fd = clients[i].fd;
+            pfds[i + 1].events = (clients[i].closing ? 0 : POLLIN)
+                                 | (clients[i].out_off < clients[i].out_len ? POLLOUT : 0);
+        }
+        if (poll(pfds, nclients + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // 뒤에서부터 처리해야 serve_drop이 옮겨 온 클라이언트를 건너뛰지 않음
+        int polled = nclients;
+        for (int i = polled - 1; i >= 0; i--) {
+            short re = pfds[i + 1].revents;
+            bool keep = true;
+            if (re & POLLIN)
+                keep = serve_input(&clients[i], cap_fd);
+            else if (re & (POLLHUP | POLLERR))
+                keep = false;
+            if (keep && (clients[i].out_off < clients[i].out_len || clients[i].closing))
+                keep = serve_output(&clients[i]);
+            if (!keep)
+                serve_drop(clients, &nclients, i);
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (cfd >= 0) {
+                memset(&clients[nclients], 0, sizeof(ServeClient));
+                clients[nclients++].fd = cfd;
+            }
+        }
+    }
+
+    for (int i = 0; i < nclients; i++) {
+        close(clients[i].fd);
+        free(clients[i].out);
+    }
+    free(clients);
+    close(cap_fd);
+    close(lfd);
+    unlink(sock_path);
+    return 0;
+}
+
+// 소켓에서 정확히 len 바이트 읽기 (연결이 끊기면 false)
+static bool client_read_full(int fd, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = read(fd, (char *)buf + got, len - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += r;
+    }
+    return true;
+}
+
+// 명령 한 줄을 보내고 응답을 받아 표준 출력에 씀
+static bool client_request(int fd, const char *line, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t w = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return false;
+        sent += w;
+    }
+    unsigned char hdr[4];
+    if (!client_read_full(fd, hdr, 4)) return false;
+    uint32_t n = (uint32_t)hdr[0] << 24 | (uint32_t)hdr[1] << 16 | (uint32_t)hdr[2] << 8 | hdr[3];
+    char buf[65536];
+    while (n > 0) {
+        size_t chunk = n < sizeof(buf) ? n : sizeof(buf);
+        if (!client_read_full(fd, buf, chunk)) return false;
+        fwrite(buf, 1, chunk, stdout);
+        n -= chunk;
+    }
+    fflush(stdout);
+    return true;
+}
+
+// 클라이언트 모드: 인자로 받은 명령 하나, 없으면 표준 입력의 명령을 한 줄씩 서버에 보냄
+int client_main(const char *sock_path, int argc, char *argv[]) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "connect: socket path too long: %s\n", sock_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, sock_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    int ret = 0;
+    if (argc > 0) {
+        // 인자들을 공백으로 이어 명령 한 줄로 만듦
+        size_t len = 1;
+        for (int i = 0; i < argc; i++)
+            len += strlen(argv[i]) + 1;
+        char *line = malloc(len);
+        line[0] = '\0';
+        for (int i = 0; i < argc; i++) {
+            strcat(line, argv[i]);
+            strcat(line, i + 1 < argc ? " " : "\n");
+        }
+        if (!client_request(fd, line, strlen(line))) ret = -1;
+        free(line);
+    } else {
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+        while ((len = getline(&line, &cap, stdin)) > 0) {
+            if (line[len - 1] != '\n') {
+                if ((size_t)len + 2 > cap) {
+                    cap = len + 2;
+                    line = realloc(line, cap);
+                }
+                line[len++] = '\n';
+                line[len] = '\0';
+            }
+            if (!client_request(fd, line, len)) break;  // exit 등으로 서버가 연결 종료
+        }
+        free(line);
+    }
+    close(fd);
+    return ret;
+}
+
+// ---------------------------------------------------------------------------
+// 이미지 변경 반영 (reload)
+// ---------------------------------------------------------------------------
+
+// 이미지가 마지막 적재/reload 이후 바뀌었는지: 슈퍼블록 쓰기 시간과 이미지 파일 수정 시간 비교
+// (슈퍼블록 한 번 읽기 + fstat이므로 명령마다 확인해도 부담이 적음)
+bool image_changed(void) {
+    struct ext2_super_block cur;
+    if (img_pread_raw(img_fd, &cur, sizeof(cur), SUPERBLOCK_OFFSET) != (ssize_t)sizeof(cur))
+        return false;
+    if (cur.s_wtime != sb.s_wtime)
+        return true;
+    struct stat st;
+    return fstat(img_fd, &st) == 0
+           && (st.st_mtim.tv_sec != img_seen_mtime.tv_sec || st.st_mtim.tv_nsec != img_seen_mtime.tv_nsec);
+}
+
+// 다시 읽은 엔트리(fresh의 자식)를 dir의 기존 자식과 정렬 순서대로 병합
+// 이름/inode/타입이 그대로인 자식은 하위 트리째 유지, 사라진 자식은 해제, 새 자식은 옮겨 붙임
+// 새로 생긴 디렉토리는 added_dirs에 모음
+static void reload_merge(Node *dir, Node *fresh, int *added, int *removed,
+                         Node ***added_dirs, int *nadded_dirs, int *added_cap) {
+    Node *old = dir->first_child, *nw = fresh->first_child;
+    Node *head = NULL, **tail = &head;
+    while (old || nw) {
+        int c = !old ? 1 : !nw ? -1 : child_order(old, nw);
+        Node *take = NULL;
+        if (c == 0 && old->inode_no == nw->inode_no && old->file_type == nw->file_type) {
+            // 바뀌지 않은 엔트리: 기존 노드(하위 트리 포함) 유지
+            Node *on = old->next_sibling, *nn = nw->next_sibling;
+            free_tree(nw);
+            take = old;
+            old = on;
+            nw = nn;
+        }
+        else if (c <= 0) {
+            // 사라졌거나 같은 이름의 다른 inode로 바뀐 엔트리: 기존 하위 트리 해제
+            Node *on = old->next_sibling;
+            free_tree(old);
+            (*removed)++;
+            old = on;
+            continue;
+        }
+        else {
+            take = nw;
+            nw = nw->next_sibling;
+            take->parent = dir;
+            if (dir->mapped)
+                ino_map_insert(take);
+            (*added)++;
+            if (take->file_type == EXT2_FT_DIR) {
+                if (*nadded_dirs == *added_cap) {
+                    *added_cap = *added_cap ? *added_cap * 2 : 64;
+                    *added_dirs = realloc(*added_dirs, sizeof(Node*) * *added_cap);
+                }
+                (*added_dirs)[(*nadded_dirs)++] = take;
+            }
+        }
+        *tail = take;
+        tail = &take->next_sibling;
+    }
+    *tail = NULL;
+    dir->first_child = head;
+    fresh->first_child = NULL;
+    dir->dir_mtime = fresh->dir_mtime;
+    dir->dir_ctime = fresh->dir_ctime;
+    dir->times_valid = fresh->times_valid;
+}
+
+// 이름 조회로 일부 자식만 있는 디렉토리: 자식마다 다시 조회해 사라지거나 바뀐 것만 정리
+static void reload_partial(Node *dir, const struct ext2_inode *ino, int *removed) {
+    Node **p = &dir->first_child;
+    while (*p) {
+        Node *c = *p;
+        uint32_t cino;
+        uint8_t ctype;
+        if (dir_lookup(dir->inode_no, c->name, &cino, &ctype) == 1
+            && cino == c->inode_no && ctype == c->file_type) {
+            p = &c->next_sibling;
+            continue;
+        }
+        *p = c->next_sibling;
+        free_tree(c);
+        (*removed)++;
+    }
+    dir->dir_mtime = ino->i_mtime;
+    dir->dir_ctime = ino->i_ctime;
+    dir->times_valid = dir_times_settled(ino);
+}
+
+// 트리를 이미지의 현재 상태에 맞춤
+// 적재된 디렉토리들의 inode만 한 단계씩 일괄로 읽어 i_mtime/i_ctime이 바뀐 디렉토리의 엔트리만 다시 읽음
+// 바뀌지 않은 하위 트리는 그대로 두므로 비용은 디렉토리 수(inode 읽기) + 바뀐 양에 비례
+void reload_tree(bool verbose) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // 0) gzip 이미지 파일이 바뀌었으면 체크포인트 색인과 청크 캐시를 새로 만듦
+    struct stat st;
+    if (img_gz && fstat(img_fd, &st) == 0
+        && (st.st_mtim.tv_sec != img_seen_mtime.tv_sec || st.st_mtim.tv_nsec != img_seen_mtime.tv_nsec)) {
+        GzImage *gz = gz_open(img_fd, img_path);
+        if (!gz) {
+            fprintf(stderr, "reload: cannot reindex compressed image, tree unchanged\n");
+            return;
+        }
+        gz_close(img_gz);
+        img_gz = gz;
+    }
+
+    // 1) 슈퍼블록과 그룹 디스크립터 테이블 다시 읽기, 이전 이미지 기준 색인/캐시 블록/심볼릭 링크 결과 무효화
+    bcache_invalidate(img_fd);
+    tree_gen++;
+    read_superblock(img_fd, &sb);
+    read_group_desc(img_fd, 0, &gd, block_size);
+    free(gdt);
+    read_group_desc_table(img_fd);
+    free(blk_index);
+    blk_index = NULL;
+    blk_index_cnt = 0;
+    blk_index_ready = false;
+    if (fstat(img_fd, &st) == 0)
+        img_seen_mtime = st.st_mtim;
+
+    int checked = 0, changed = 0, added = 0, removed = 0;
+    Node **added_dirs = NULL;
+    int nadded_dirs = 0, added_cap = 0;
+    Node **level = malloc(sizeof(Node*));
+    level[0] = root;
+    int nlevel = 1;
+
+    while (nlevel > 0) {
+        // 2) 이번 단계 디렉토리들의 inode 일괄 읽기
+        uint32_t *inos = malloc(sizeof(uint32_t) * nlevel);
+        struct ext2_inode *inodes = malloc(sizeof(struct ext2_inode) * nlevel);
+        for (int i = 0; i < nlevel; i++)
+            inos[i] = level[i]->inode_no;
+        read_inodes_batch(img_fd, inos, nlevel, inodes);
+        checked += nlevel;
+
+        // 3) 시간이 바뀐 적재 디렉토리는 임시 노드로 엔트리를 다시 읽어 병합
+        Node **fresh = malloc(sizeof(Node*) * nlevel);
+        Node **targets = malloc(sizeof(Node*) * nlevel);
+        int nfresh = 0;
+        for (int i = 0; i < nlevel; i++) {
+            Node *d = level[i];
+            bool same = d->times_valid && d->dir_mtime == inodes[i].i_mtime
+                        && d->dir_ctime == inodes[i].i_ctime;
+            if (same) continue;
+            changed++;
+            if (d->loaded) {
+                targets[nfresh] = d;
+                fresh[nfresh++] = create_node(d->name, d->inode_no, EXT2_FT_DIR);
+            } else {
+                reload_partial(d, &inodes[i], &removed);
+            }
+        }
+        if (nfresh > 0)
+            load_dirs(fresh, nfresh, false);
+        for (int i = 0; i < nfresh; i++) {
+            reload_merge(targets[i], fresh[i], &added, &removed, &added_dirs, &nadded_dirs, &added_cap);
+            free_tree(fresh[i]);
+        }
+
+        // 4) 다음 단계: 적재되었거나 조회된 자식이 있는 하위 디렉토리 (새로 붙은 디렉토리 제외)
+        Node **next = NULL;
+        int next_cnt = 0, next_cap = 0;
+        for (int i = 0; i < nlevel; i++) {
+            for (Node *c = level[i]->first_child; c; c = c->next_sibling) {
+                if (c->file_type != EXT2_FT_DIR || (!c->loaded && !c->first_child)) continue;
+                if (next_cnt == next_cap) {
+                    next_cap = next_cap ? next_cap * 2 : 64;
+                    next = realloc(next, sizeof(Node*) * next_cap);
+                }
+                next[next_cnt++] = c;
+            }
+        }
+        free(inos);
+        free(inodes);
+        free(fresh);
+        free(targets);
+        free(level);
+        level = next;
+        nlevel = next_cnt;
+    }
+    free(level);
+
+    // 5) 새로 생긴 디렉토리는 시작할 때와 같은 방식으로 적재 (지연 적재 모드면 필요할 때)
+    if (!lazy_load && nadded_dirs > 0)
+        load_dirs(added_dirs, nadded_dirs, true);
+    free(added_dirs);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    if (verbose || changed > 0) {
+        fflush(stdout);
+        fprintf(verbose ? stdout : stderr,
+                "reload: %d directories checked, %d changed, %d entries added, %d removed in %.3f ms\n%s",
+                checked, changed, added, removed, ms, verbose ? "\n" : "");
+    }
+}
+
+// reload 명령어
+void command_reload(void) {
+    reload_tree(true);
+}
+
+// ---------------------------------------------------------------------------
+// 호스트 디렉토리를 이미지로 가져오기 (import)
+// ---------------------------------------------------------------------------
+// 1) 호스트 트리를 훑어 계획(ImportEntry 트리)을 세우고 필요한 inode/블록 수를 미리 확인
+// 2) 비트맵을 메모리에 올려 inode는 디렉토리의 그룹에, 블록은 파일마다 한 구간으로 할당
+// 3) 파일 데이터는 할당 순서대로 바로 쓰고, 메타데이터(디렉토리/간접 블록, inode 테이블, 비트맵)는
+//    모아 두었다가 블록 번호순으로 이어 붙여 쓴 뒤 그룹 디스크립터와 슈퍼블록을 마지막에 씀
+// 데이터를 먼저 쓰고 동기화하므로 중간에 실패해도 이미지의 메타데이터는 바뀌지 않음
+
+static inline bool imp_bit(const uint8_t *map, uint32_t i) {
+    return map[i / 8] & (1u << (i % 8));
+}
+
+static inline void imp_set_bit(uint8_t *map, uint32_t i) {
+    map[i / 8] |= (uint8_t)(1u << (i % 8));
+}
+
+// 물리 블록 b가 사용 중인지 (파일시스템 범위 밖은 사용 중으로 취급)
+static bool imp_blk_used(const ImportCtx *c, uint32_t b) {
+    if (b < sb.s_first_data_block || b >= sb.s_blocks_count) return true;
+    uint32_t r = b - sb.s_first_data_block;
+    return imp_bit(c->bbm + (size_t)(r / sb.s_blocks_per_group) * block_size, r % sb.s_blocks_per_group);
+}
+
+// 물리 블록 [b, b+n) 할당 표시와 그룹별 여유 블록 수 갱신
+static void imp_take_blocks(ImportCtx *c, uint32_t b, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t r = b + i - sb.s_first_data_block;
+        uint32_t g = r / sb.s_blocks_per_group;
+        imp_set_bit(c->bbm + (size_t)g * block_size, r % sb.s_blocks_per_group);
+        c->gds[g].bg_free_blocks_count--;
+        c->bbm_dirty[g] = true;
+    }
+    c->free_blocks -= n;
+}
+
+// 그룹 g에 inode 하나 할당 (여유가 없으면 0)
+static uint32_t imp_take_inode(ImportCtx *c, uint32_t g, bool is_dir) {
+    if (c->gds[g].bg_free_inodes_count == 0) return 0;
+    uint8_t *map = c->ibm + (size_t)g * block_size;
+    // 0번 그룹의 예약 inode(s_first_ino 미만)는 건너뜀
+    uint32_t first = (g == 0 && sb.s_rev_level > 0) ? sb.s_first_ino - 1
+                     : (g == 0 ? EXT2_GOOD_OLD_FIRST_INO - 1 : 0);
+    for (uint32_t i = first; i < inodes_per_group; i++) {
+        if (imp_bit(map, i)) continue;
+        imp_set_bit(map, i);
+        c->ibm_dirty[g] = true;
+        c->gds[g].bg_free_inodes_count--;
+        if (is_dir) c->gds[g].bg_used_dirs_count++;
+        c->free_inodes--;
+        return g * inodes_per_group + i + 1;
+    }
+    return 0;
+}
+
+// inode 할당 그룹 선택 (ext2의 find_group_dir/find_group_other와 같은 방식)
+// 가져오는 최상위 디렉토리는 여유 inode가 평균 이상인 그룹 중 여유 블록이 가장 많은 곳으로 분산,
+// 그 밖의 항목은 부모 디렉토리의 그룹부터 차례로 찾음
+static uint32_t imp_alloc_inode(ImportCtx *c, uint32_t parent_ino, bool is_dir, bool spread) {
+    if (is_dir && spread) {
+        uint32_t avefree = c->free_inodes / group_count;
+        int best = -1;
+        for (uint32_t g = 0; g < group_count; g++) {
+            if (c->gds[g].bg_free_inodes_count == 0 || c->gds[g].bg_free_inodes_count < avefree) continue;
+            if (best < 0 || c->gds[g].bg_free_blocks_count > c->gds[best].bg_free_blocks_count)
+                best = (int)g;
+        }
+        if (best >= 0) {
+            uint32_t ino = imp_take_inode(c, (uint32_t)best, true);
+            if (ino) return ino;
+        }
+    }
+    uint32_t pg = (parent_ino - 1) / inodes_per_group;
+    // 부모 그룹부터 돌며 블록도 남은 그룹을 먼저 찾고, 없으면 inode만 남은 그룹이라도 사용
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t k = 0; k < group_count; k++) {
+            uint32_t g = (pg + k) % group_count;
+            if (pass == 0 && c->gds[g].bg_free_blocks_count == 0) continue;
+            uint32_t ino = imp_take_inode(c, g, is_dir);
+            if (ino) return ino;
+        }
+    }
+    return 0;
+}
+
+// goal부터 n 블록짜리 연속 여유 구간 찾기 (끝에 닿으면 처음부터 goal까지)
+static bool imp_find_run(const ImportCtx *c, uint32_t goal, uint32_t n, uint32_t *out) {
+    uint32_t first = sb.s_first_data_block, end = sb.s_blocks_count;
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t b = pass == 0 ? goal : first;
+        uint32_t stop = pass == 0 ? end : goal;
+        uint32_t run = 0, start = 0;
+        while (b < stop) {
+            // 8비트가 모두 찬 바이트는 한 번에 건너뜀
+            uint32_t r = b - first;
+            if (run == 0 && r % 8 == 0 && b + 8 <= stop
+                && c->bbm[(size_t)(r / sb.s_blocks_per_group) * block_size + (r % sb.s_blocks_per_group) / 8] == 0xFF
+                && (r % sb.s_blocks_per_group) + 8 <= sb.s_blocks_per_group) {
+                b += 8;
+                continue;
+            }
+            if (imp_blk_used(c, b)) {
+                run = 0;
+            } else {
+                if (run == 0) start = b;
+                if (++run == n) {
+                    *out = start;
+                    return true;
+                }
+            }
+            b++;
+        }
+    }
+    return false;
+}
+
+// 파일 하나에 필요한 n 블록 할당: 가능하면 goal 이후의 연속 구간 하나, 없으면 goal부터 앞에서 채움
+// 할당한 물리 구간을 c->runs에 남김
+static int imp_alloc_blocks(ImportCtx *c, uint32_t group, uint32_t n) {
+    c->nruns = 0;
+    c->run_idx = 0;
+    c->run_off = 0;
+    if (n == 0) return 0;
+    if (c->runs_cap == 0) {
+        c->runs_cap = 16;
+        c->runs = malloc(sizeof(BlockRun) * c->runs_cap);
+    }
+    if (n > c->free_blocks) return -1;
+    uint32_t goal = c->goal[group];
+    uint32_t start;
+    if (n < c->no_run_len && imp_find_run(c, goal, n, &start)) {
+        imp_take_blocks(c, start, n);
+        c->runs[0] = (BlockRun){ .physical = start, .len = n };
+        c->nruns = 1;
+    } else {
+        // 이만큼 긴 구간은 없으므로 다음부터는 찾지 않고 바로 나눠 할당
+        if (n < c->no_run_len) c->no_run_len = n;
+        uint32_t left = n, b = goal;
+        uint32_t wrap = 0;
+        while (left > 0) {
+            if (b >= sb.s_blocks_count) {
+                b = sb.s_first_data_block;
+                if (++wrap > 1) return -1;
+            }
+            if (imp_blk_used(c, b)) {
+                b++;
+                continue;
+            }
+            uint32_t s = b, len = 0;
+            while (len < left && b < sb.s_blocks_count && !imp_blk_used(c, b)) {
+                b++;
+                len++;
+            }
+            imp_take_blocks(c, s, len);
+            if (c->nruns == c->runs_cap) {
+                c->runs_cap = c->runs_cap ? c->runs_cap * 2 : 16;
+                c->runs = realloc(c->runs, sizeof(BlockRun) * c->runs_cap);
+            }
+            c->runs[c->nruns++] = (BlockRun){ .physical = s, .len = len };
+            left -= len;
+        }
+        start = c->runs[c->nruns - 1].physical;
+        n = c->runs[c->nruns - 1].len;
+    }
+    c->goal[group] = start + n;
+    c->extents += c->nruns;
+    return 0;
+}
+
+// 할당해 둔 구간에서 다음 물리 블록 하나
+static uint32_t imp_next_block(ImportCtx *c) {
+    BlockRun *r = &c->runs[c->run_idx];
+    uint32_t b = r->physical + c->run_off;
+    if (++c->run_off == r->len) {
+        c->run_idx++;
+        c->run_off = 0;
+    }
+    return b;
+}
+
+// 메타데이터 블록 쓰기 예약 (buf 소유권을 넘겨받음)
+static void imp_queue_write(ImportCtx *c, uint32_t blk, uint32_t nblk, char *buf) {
+    if (c->nwrites == c->writes_cap) {
+        c->writes_cap = c->writes_cap ? c->writes_cap * 2 : 256;
+        c->writes = realloc(c->writes, sizeof(ImportWrite) * c->writes_cap);
+    }
+    c->writes[c->nwrites++] = (ImportWrite){ blk, nblk, buf };
+}
+
+// pwrite를 끝까지 반복 (실패하면 -1)
+static int imp_pwrite(int fd, const void *buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, off + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// 블록 맵 배치: 논리 블록을 순서대로 받아 필요한 간접 블록을 데이터 앞에 끼워 넣음 (커널과 같은 배치)
+// c가 NULL이면 필요한 블록 수만 셈
+static void imp_map_flush(ImportMap *m, int h) {
+    if (!m->buf[h]) return;
+    if (m->ctx)
+        imp_queue_write(m->ctx, m->phys[h], 1, (char *)m->buf[h]);
+    else
+        free(m->buf[h]);
+    m->buf[h] = NULL;
+}
+
+static void imp_map_block(ImportMap *m, uint32_t lb) {
+    uint64_t P = block_size / sizeof(uint32_t);
+    uint32_t phys = 0;
+    if (lb < 12) {
+        for (int h = 0; h < 3; h++)
+            imp_map_flush(m, h);
+        phys = m->ctx ? imp_next_block(m->ctx) : 0;
+        m->i_block[lb] = phys;
+        m->count++;
+        m->last_lb = lb;
+        m->last_phys = phys;
+        m->has_last = true;
+        return;
+    }
+    // 단계(L) 결정과 그 단계 안에서의 위치 x
+    uint64_t x = lb - 12, span = P;
+    int L = 1;
+    while (x >= span) {
+        x -= span;
+        span *= P;
+        L++;
+    }
+    // 위에서부터 각 높이(h = L-1 .. 0)의 현재 간접 블록이 x를 담당하는지 확인
+    for (int h = L - 1; h >= 0; h--) {
+        uint64_t cover = 1;
+        for (int k = 0; k <= h; k++) cover *= P;
+        uint64_t key = ((uint64_t)L << 56) | (x / cover);
+        if (m->buf[h] && m->key[h] == key) continue;
+        // 새 간접 블록: 같은 높이 이하의 이전 블록들은 끝났으므로 내보냄
+        for (int k = h; k >= 0; k--)
+            imp_map_flush(m, k);
+        uint32_t nb = m->ctx ? imp_next_block(m->ctx) : 0;
+        m->buf[h] = calloc(P, sizeof(uint32_t));
+        m->phys[h] = nb;
+        m->key[h] = key;
+        m->count++;
+        m->meta++;
+        if (h == L - 1)
+            m->i_block[11 + L] = nb;
+        else
+            m->buf[h + 1][(x / cover) % P] = nb;
+    }
+    phys = m->ctx ? imp_next_block(m->ctx) : 0;
+    m->buf[0][x % P] = phys;
+    m->count++;
+    m->last_lb = lb;
+    m->last_phys = phys;
+    m->has_last = true;
+}
+
+static void imp_map_finish(ImportMap *m) {
+    for (int h = 2; h >= 0; h--)
+        imp_map_flush(m, h);
+}
+
+// 항목의 논리 블록 목록(데이터가 있는 구간)을 배치하고, 데이터 구간을 runs로 모음
+// c가 NULL이면 필요한 블록 수(간접 블록 포함)만 반환
+static uint64_t imp_layout(ImportCtx *c, ImportEntry *e, BlockRun **out, int *nout) {
+    ImportMap m;
+    memset(&m, 0, sizeof(m));
+    m.ctx = c;
+    BlockRun *runs = NULL;
+    int n = 0, cap = 0;
+    for (int i = 0; i < e->nranges; i++) {
+        for (uint32_t k = 0; k < e->ranges[i].len; k++) {
+            uint32_t lb = e->ranges[i].logical + k;
+            bool had = m.has_last;
+            uint32_t plb = m.last_lb, pphys = m.last_phys;
+            imp_map_block(&m, lb);
+            if (!c) continue;
+            // 앞 블록과 논리/물리 모두 이어지면 구간 연장
+            if (had && n > 0 && lb == plb + 1 && m.last_phys == pphys + 1) {
+                runs[n - 1].len++;
+                continue;
+            }
+            if (n == cap) {
+                cap = cap ? cap * 2 : 8;
+                runs = realloc(runs, sizeof(BlockRun) * cap);
             }
+            runs[n++] = (BlockRun){ .logical = lb, .physical = m.last_phys, .len = 1 };
+        }
+    }
+    imp_map_finish(&m);
+    if (c) {
+        memcpy(e->i_block, m.i_block, sizeof(m.i_block));
+        *out = runs;
+        *nout = n;
+        c->meta_blocks += m.meta;
+    }
+    return m.count;
+}
+
+// 디렉토리 엔트리 하나가 차지하는 최소 크기
+static uint32_t imp_rec_len(uint32_t name_len) {
+    return (8 + name_len + 3) & ~3u;
+}
 
-            cur += e.rec_len;  // 다음 엔트리
+// 디렉토리 엔트리 기록 (rec_len은 호출자가 정함)
+static void imp_put_dirent(char *p, uint32_t ino, uint16_t rec_len, const char *name, uint8_t name_len, uint8_t type) {
+    struct ext2_dir_entry *d = (struct ext2_dir_entry *)p;
+    d->inode = ino;
+    d->rec_len = rec_len;
+    d->name_len = name_len;
+    // filetype 기능이 없는 이미지에서는 이 바이트가 이름 길이 상위 바이트
+    d->file_type = (sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) ? type : 0;
+    memcpy(d->name, name, name_len);
+}
+
+// 엔트리 목록을 디렉토리 블록들로 채움 (블록에 안 들어가면 앞 엔트리를 블록 끝까지 늘리고 다음 블록)
+static char *imp_dir_blocks(ImportEntry **ents, int n, uint32_t self, uint32_t parent, uint32_t *nblocks) {
+    uint32_t nb = 1, cap = 4;
+    char *buf = calloc(cap, block_size);
+    uint32_t off = 0, last = 0;
+    for (int i = -2; i < n; i++) {
+        const char *name = i == -2 ? "." : i == -1 ? ".." : ents[i]->name;
+        uint32_t ino = i == -2 ? self : i == -1 ? parent : ents[i]->ino;
+        uint8_t type = i < 0 ? EXT2_FT_DIR : ents[i]->file_type;
+        uint32_t len = (uint32_t)strlen(name);
+        uint32_t need = imp_rec_len(len);
+        if (off + need > nb * block_size) {
+            struct ext2_dir_entry *d = (struct ext2_dir_entry *)(buf + last);
+            d->rec_len = (uint16_t)(nb * block_size - last);
+            if (nb == cap) {
+                cap *= 2;
+                buf = realloc(buf, (size_t)cap * block_size);
+            }
+            memset(buf + (size_t)nb * block_size, 0, block_size);
+            off = nb * block_size;
+            nb++;
         }
+        imp_put_dirent(buf + off, ino, (uint16_t)need, name, (uint8_t)len, type);
+        last = off;
+        off += need;
     }
+    ((struct ext2_dir_entry *)(buf + last))->rec_len = (uint16_t)(nb * block_size - last);
+    *nblocks = nb;
+    return buf;
+}
 
-    free(blocks);
+static ImportEntry *imp_entry_new(const char *name, const char *path, const struct stat *st) {
+    ImportEntry *e = calloc(1, sizeof(ImportEntry));
+    e->name = strdup(name);
+    e->host_path = strdup(path);
+    e->st = *st;
+    return e;
 }
 
+static void imp_entry_free(ImportEntry *e) {
+    for (int i = 0; i < e->nchildren; i++)
+        imp_entry_free(e->children[i]);
+    free(e->children);
+    free(e->name);
+    free(e->host_path);
+    free(e->symlink);
+    free(e->ranges);
+    free(e->content);
+    free(e);
+}
 
+static int imp_name_cmp(const void *a, const void *b) {
+    return strcmp((*(ImportEntry *const *)a)->name, (*(ImportEntry *const *)b)->name);
+}
 
+// 호스트 파일의 데이터 구간을 블록 단위로 구함 (SEEK_DATA/SEEK_HOLE, 지원하지 않으면 전체)
+static void imp_file_ranges(ImportEntry *e) {
+    uint64_t size = (uint64_t)e->st.st_size;
+    uint64_t nblk = (size + block_size - 1) / block_size;
+    e->nranges = 0;
+    if (nblk == 0) return;
+    int cap = 1;
+    e->ranges = malloc(sizeof(BlockRun) * cap);
+    // 할당된 블록이 크기보다 적을 때만 hole이 있을 수 있음
+    int fd = -1;
+    if ((uint64_t)e->st.st_blocks * 512 < size)
+        fd = open(e->host_path, O_RDONLY);
+    off_t pos = 0;
+    while (fd >= 0 && (uint64_t)pos < size) {
+        off_t ds = lseek(fd, pos, SEEK_DATA);
+        if (ds < 0) {
+            if (errno == ENXIO) break;   // 뒤는 모두 hole
+            e->nranges = 0;
+            close(fd);
+            fd = -1;
+            break;
+        }
+        off_t de = lseek(fd, ds, SEEK_HOLE);
+        if (de < 0 || (uint64_t)de > size) de = (off_t)size;
+        uint32_t bs = (uint32_t)(ds / block_size);
+        uint32_t be = (uint32_t)(((uint64_t)de + block_size - 1) / block_size);
+        if (e->nranges > 0 && e->ranges[e->nranges - 1].logical + e->ranges[e->nranges - 1].len >= bs) {
+            BlockRun *r = &e->ranges[e->nranges - 1];
+            if (be > r->logical + r->len) r->len = be - r->logical;
+        } else if (be > bs) {
+            if (e->nranges == cap) {
+                cap *= 2;
+                e->ranges = realloc(e->ranges, sizeof(BlockRun) * cap);
+            }
+            e->ranges[e->nranges++] = (BlockRun){ .logical = bs, .len = be - bs };
+        }
+        pos = de;
+    }
+    if (fd >= 0) {
+        close(fd);
+        return;
+    }
+    e->ranges[0] = (BlockRun){ .logical = 0, .len = (uint32_t)nblk };
+    e->nranges = 1;
+}
 
-// 트리 출력: 재귀/크기/권한 옵션에 따라 분기
-void print_tree(Node* n, const char* prefix,
-    int recursive, int show_size, int show_perm)
-{   
-    // 현재 노드(n)의 첫 번째 자식부터 순회
-    Node* c = n->first_child;
-    while (c) {
-        // '.', '..', 'lost+found' 디렉토리는 건너뛴다
-        if (strcmp(c->name, ".") == 0 ||
-            strcmp(c->name, "..") == 0 ||
-            strcmp(c->name, "lost+found") == 0)
-        {
-            c = c->next_sibling;
+// 호스트 디렉토리 dir의 자식들로 계획 트리를 만듦 (가져올 수 없는 항목은 알리고 건너뜀)
+static int imp_scan(ImportCtx *c, ImportEntry *dir) {
+    DIR *d = opendir(dir->host_path);
+    if (!d) {
+        fprintf(stderr, "import: opendir '%s': %s\n", dir->host_path, strerror(errno));
+        c->skipped++;
+        return -1;
+    }
+    uint64_t P = block_size / sizeof(uint32_t);
+    uint64_t max_blocks = 12 + P + P * P + P * P * P;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        size_t nlen = strlen(de->d_name);
+        size_t plen = strlen(dir->host_path) + 1 + nlen + 1;
+        if (nlen > EXT2_NAME_LEN || plen > PATH_MAX_LEN) {
+            fprintf(stderr, "import: name too long under '%s', skipped\n", dir->host_path);
+            c->skipped++;
+            continue;
+        }
+        // 잘린 경로로 lstat 하면 엉뚱한 파일을 가져오므로 잘리면 오류로 건너뜀
+        char *path = malloc(plen);
+        int w = path ? snprintf(path, plen, "%s/%s", dir->host_path, de->d_name) : -1;
+        if (w < 0 || (size_t)w >= plen) {
+            fprintf(stderr, "import: cannot build path for '%s' under '%s', skipped\n",
+                    de->d_name, dir->host_path);
+            c->skipped++;
+            free(path);
             continue;
         }
-        // 마지막 형제인지 판별 (branch 그릴 때 └ 혹은 ├ 선택)
-        bool is_last = (c->next_sibling == NULL);
-        const char* branch = is_last ? "└" : "├";
+        struct stat st;
+        if (lstat(path, &st) < 0) {
+            fprintf(stderr, "import: lstat '%s': %s\n", path, strerror(errno));
+            c->skipped++;
+            free(path);
+            continue;
+        }
+        uint8_t type;
+        switch (st.st_mode & S_IFMT) {
+        case S_IFREG:  type = EXT2_FT_REG_FILE; break;
+        case S_IFDIR:  type = EXT2_FT_DIR; break;
+        case S_IFLNK:  type = EXT2_FT_SYMLINK; break;
+        case S_IFCHR:  type = EXT2_FT_CHRDEV; break;
+        case S_IFBLK:  type = EXT2_FT_BLKDEV; break;
+        case S_IFIFO:  type = EXT2_FT_FIFO; break;
+        default:       type = EXT2_FT_SOCK; break;
+        }
+        if (type == EXT2_FT_REG_FILE && ((uint64_t)st.st_size + block_size - 1) / block_size > max_blocks) {
+            fprintf(stderr, "import: '%s' is too large for this block size, skipped\n", path);
+            c->skipped++;
+            free(path);
+            continue;
+        }
+        ImportEntry *e = imp_entry_new(de->d_name, path, &st);
+        free(path);
+        e->file_type = type;
+        e->parent = dir;
+        if (type == EXT2_FT_SYMLINK) {
+            char target[PATH_MAX_LEN + 1];
+            ssize_t n = readlink(e->host_path, target, sizeof(target) - 1);
+            if (n < 0 || (uint32_t)n >= block_size) {
+                fprintf(stderr, "import: readlink '%s' failed or target too long, skipped\n", e->host_path);
+                c->skipped++;
+                imp_entry_free(e);
+                continue;
+            }
+            target[n] = '\0';
+            e->symlink = strdup(target);
+        }
+        if (dir->nchildren == dir->cap) {
+            dir->cap = dir->cap ? dir->cap * 2 : 16;
+            dir->children = realloc(dir->children, sizeof(ImportEntry *) * dir->cap);
+        }
+        dir->children[dir->nchildren++] = e;
+        if (type == EXT2_FT_DIR)
+            imp_scan(c, e);
+    }
+    closedir(d);
+    // 이름순으로 정렬해 같은 입력이면 같은 이미지가 되도록
+    if (dir->nchildren > 1)
+        qsort(dir->children, dir->nchildren, sizeof(ImportEntry *), imp_name_cmp);
+    return 0;
+}
 
-        // 옵션이 모두 켜진 경우: 권한 + 크기
-        if (show_perm && show_size) {
-            // 권한과 크기를 한 줄로: [perm size]
-            struct ext2_inode ino;
-            read_inode(img_fd, c->inode_no, &ino);
+// 계획 트리를 전위 순서로 펼침 (디렉토리 다음에 그 자식들)
+static void imp_flatten(ImportEntry *dir, ImportEntry ***list, int *n, int *cap) {
+    for (int i = 0; i < dir->nchildren; i++) {
+        if (*n == *cap) {
+            *cap = *cap ? *cap * 2 : 256;
+            *list = realloc(*list, sizeof(ImportEntry *) * *cap);
+        }
+        (*list)[(*n)++] = dir->children[i];
+    }
+    for (int i = 0; i < dir->nchildren; i++)
+        if (dir->children[i]->file_type == EXT2_FT_DIR)
+            imp_flatten(dir->children[i], list, n, cap);
+}
+
+static int imp_hostino_cmp(const void *a, const void *b) {
+    const ImportEntry *x = *(ImportEntry *const *)a, *y = *(ImportEntry *const *)b;
+    if (x->st.st_dev != y->st.st_dev) return x->st.st_dev < y->st.st_dev ? -1 : 1;
+    if (x->st.st_ino != y->st.st_ino) return x->st.st_ino < y->st.st_ino ? -1 : 1;
+    return 0;
+}
+
+// 항목의 블록 내용 준비: 디렉토리 엔트리 블록 또는 긴 심볼릭 링크 대상
+static void imp_prepare_content(ImportEntry *e) {
+    if (e->file_type == EXT2_FT_DIR) {
+        uint32_t nb;
+        e->content = imp_dir_blocks(e->children, e->nchildren, e->ino, e->parent->ino, &nb);
+        e->ranges = malloc(sizeof(BlockRun));
+        e->ranges[0] = (BlockRun){ .logical = 0, .len = nb };
+        e->nranges = 1;
+        e->size = (uint64_t)nb * block_size;
+    } else if (e->file_type == EXT2_FT_SYMLINK && strlen(e->symlink) >= sizeof(e->i_block)) {
+        e->content = calloc(1, block_size);
+        strcpy(e->content, e->symlink);
+        e->ranges = malloc(sizeof(BlockRun));
+        e->ranges[0] = (BlockRun){ .logical = 0, .len = 1 };
+        e->nranges = 1;
+    }
+}
+
+// 새 inode 내용 기록 예약
+static void imp_queue_inode(ImportCtx *c, uint32_t ino, const struct ext2_inode *rec, bool fresh) {
+    if (c->ninodes == c->inodes_cap) {
+        c->inodes_cap = c->inodes_cap ? c->inodes_cap * 2 : 256;
+        c->inodes = realloc(c->inodes, sizeof(ImportInode) * c->inodes_cap);
+    }
+    c->inodes[c->ninodes++] = (ImportInode){ ino, fresh, *rec };
+}
+
+// 호스트 파일 데이터를 할당한 구간에 복사 (마지막 블록의 남는 부분은 0)
+static int imp_copy_file(ImportCtx *c, ImportEntry *e, const BlockRun *runs, int nruns) {
+    int fd = open(e->host_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "import: open '%s': %s\n", e->host_path, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < nruns; i++) {
+        uint64_t left = (uint64_t)runs[i].len * block_size;
+        off_t src = (off_t)runs[i].logical * block_size;
+        off_t dst = (off_t)runs[i].physical * block_size;
+        while (left > 0) {
+            size_t want = left < IMPORT_IO_BYTES ? (size_t)left : IMPORT_IO_BYTES;
+            size_t got = 0;
+            while (got < want) {
+                ssize_t n = pread(fd, c->iobuf + got, want - got, src + (off_t)got);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += (size_t)n;
+            }
+            c->bytes += got;
+            memset(c->iobuf + got, 0, want - got);   // 파일 끝 또는 도중에 줄어든 파일
+            if (imp_pwrite(c->wfd, c->iobuf, want, dst) < 0) {
+                fprintf(stderr, "import: write image: %s\n", strerror(errno));
+                close(fd);
+                c->error = true;
+                return -1;
+            }
+            src += (off_t)want;
+            dst += (off_t)want;
+            left -= want;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// 항목 하나의 inode 내용 (블록 맵 포함) 작성
+static void imp_fill_inode(const ImportEntry *e, uint64_t nblocks, uint32_t now, struct ext2_inode *rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->i_mode = (uint16_t)e->st.st_mode;
+    rec->i_uid = (uint16_t)e->st.st_uid;
+    rec->i_gid = (uint16_t)e->st.st_gid;
+    uint16_t uid_hi = (uint16_t)(e->st.st_uid >> 16), gid_hi = (uint16_t)(e->st.st_gid >> 16);
+    memcpy(rec->osd2 + 4, &uid_hi, 2);   // linux osd2: l_i_uid_high
+    memcpy(rec->osd2 + 6, &gid_hi, 2);   // linux osd2: l_i_gid_high
+    rec->i_atime = (uint32_t)e->st.st_atime;
+    rec->i_mtime = (uint32_t)e->st.st_mtime;
+    rec->i_ctime = now;
+    rec->i_links_count = (uint16_t)e->nlinks;
+    rec->i_blocks = (uint32_t)(nblocks * (block_size / 512));
+    switch (e->file_type) {
+    case EXT2_FT_REG_FILE:
+        rec->i_size = (uint32_t)e->st.st_size;
+        rec->i_size_high = (uint32_t)((uint64_t)e->st.st_size >> 32);
+        memcpy(rec->i_block, e->i_block, sizeof(rec->i_block));
+        break;
+    case EXT2_FT_DIR:
+        rec->i_size = (uint32_t)e->size;
+        memcpy(rec->i_block, e->i_block, sizeof(rec->i_block));
+        break;
+    case EXT2_FT_SYMLINK:
+        rec->i_size = (uint32_t)strlen(e->symlink);
+        if (e->content)
+            memcpy(rec->i_block, e->i_block, sizeof(rec->i_block));
+        else
+            memcpy(rec->i_block, e->symlink, rec->i_size);   // fast symlink
+        break;
+    case EXT2_FT_CHRDEV:
+    case EXT2_FT_BLKDEV: {
+        uint32_t ma = major(e->st.st_rdev), mi = minor(e->st.st_rdev);
+        if (ma < 256 && mi < 256)
+            rec->i_block[0] = (ma << 8) | mi;   // 옛 형식
+        else
+            rec->i_block[1] = (mi & 0xff) | (ma << 8) | ((mi & ~0xffu) << 12);
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-            char perm[11];
-            format_perm(ino.i_mode, perm);
-            printf("%s%s [%s %u] %s",
-                   prefix, branch, perm, ino.i_size, c->name);
+// i_block 안에만 있는 extent 트리(깊이 0)에 블록 하나 추가: 마지막 extent와 이어지면 늘리고 아니면 새 엔트리
+static int imp_extent_append(struct ext2_inode *dino, uint32_t lb, uint32_t pb) {
+    struct ext4_extent_header *eh = (struct ext4_extent_header *)dino->i_block;
+    struct ext4_extent *ex = (struct ext4_extent *)(eh + 1);
+    if (eh->eh_entries > 0) {
+        struct ext4_extent *last = &ex[eh->eh_entries - 1];
+        if (last->ee_start_hi == 0 && last->ee_len < EXT4_EXT_INIT_MAX_LEN
+            && last->ee_block + last->ee_len == lb && last->ee_start_lo + last->ee_len == pb) {
+            last->ee_len++;
+            return 0;
         }
+    }
+    if (eh->eh_entries >= eh->eh_max) return -1;
+    ex[eh->eh_entries++] = (struct ext4_extent){ .ee_block = lb, .ee_len = 1, .ee_start_lo = pb };
+    return 0;
+}
 
-        // 크기만 보여주기
-        else if (show_size) {
-            struct ext2_inode ino;
-            read_inode(img_fd, c->inode_no, &ino);
-            printf("%s%s [%u] %s", prefix, branch, ino.i_size, c->name);
+// 이미 있는 디렉토리 tgt에 새 엔트리들 추가: 기존 블록의 남는 공간을 먼저 쓰고 모자라면 블록을 붙임
+// 새 블록은 직접 블록과 단일 간접 블록 범위, extent 디렉토리는 i_block 안의 extent 4개까지만 붙임
+static int imp_link_into(ImportCtx *c, uint32_t dir_ino, struct ext2_inode *dino,
+                         ImportEntry **ents, int n, uint32_t *grow_blocks) {
+    BlockRun *runs = NULL;
+    int nruns = collect_block_runs(img_fd, dino, block_size, &runs);
+    bool *placed = calloc(n > 0 ? n : 1, sizeof(bool));
+    int left = n;
+    char *buf = malloc(block_size);
+    uint32_t nlogical = 0;
+    for (int r = 0; r < nruns && left > 0; r++) {
+        nlogical = runs[r].logical + runs[r].len;
+        if (runs[r].hole) continue;
+        for (uint32_t k = 0; k < runs[r].len && left > 0; k++) {
+            uint32_t blk = runs[r].physical + k;
+            if (img_pread(img_fd, buf, block_size, (off_t)blk * block_size) != (ssize_t)block_size) continue;
+            bool changed = false;
+            uint32_t off = 0;
+            while (off + 8 <= block_size && left > 0) {
+                struct ext2_dir_entry *d = (struct ext2_dir_entry *)(buf + off);
+                if (d->rec_len < 8 || off + d->rec_len > block_size) break;
+                uint32_t used = d->inode ? imp_rec_len(d->name_len) : 0;
+                for (int i = 0; i < n; i++) {
+                    if (placed[i]) continue;
+                    uint32_t need = imp_rec_len((uint32_t)strlen(ents[i]->name));
+                    if (d->rec_len - used < need) continue;
+                    uint16_t rest = (uint16_t)(d->rec_len - used);
+                    if (used) d->rec_len = (uint16_t)used;
+                    char *p = buf + off + used;
+                    imp_put_dirent(p, ents[i]->ino, rest, ents[i]->name,
+                                   (uint8_t)strlen(ents[i]->name), ents[i]->file_type);
+                    d = (struct ext2_dir_entry *)p;
+                    off += used;
+                    used = need;
+                    placed[i] = true;
+                    left--;
+                    changed = true;
+                }
+                off += d->rec_len;
+            }
+            if (changed) {
+                char *copy = malloc(block_size);
+                memcpy(copy, buf, block_size);
+                imp_queue_write(c, blk, 1, copy);
+            }
         }
-        else if (show_perm) {
-            // 권한만: [perm]
-            struct ext2_inode ino;
-            read_inode(img_fd, c->inode_no, &ino);
+    }
+    if (nruns > 0) nlogical = runs[nruns - 1].logical + runs[nruns - 1].len;
+    free(runs);
+    free(buf);
 
-            char perm[11];
-            format_perm(ino.i_mode, perm);
-            printf("%s%s [%s] %s",
-                   prefix, branch, perm, c->name);
-        }
-        // 옵션 없는 경우: 이름만
-	    else{
-            printf("%s%s %s", prefix, branch, c->name);
-	    }
-	    printf("\n");
-
-        // 디렉토리이고 재귀 옵션이 켜진 경우, 하위로 내려가서 출력
-        if (recursive && c->file_type == 2) {
-            char np[256];
-            // 다음 레벨에서 prefix로 사용할 문자열 생성
-            // 마지막 형제면 공백, 아니면 “│ ”
-            snprintf(np, sizeof(np), "%s%s",
-                prefix, is_last ? " " : "│ ");
-            print_tree(c, np, recursive, show_size, show_perm);
+    *grow_blocks = 0;
+    if (left > 0) {
+        // 남은 엔트리로 새 블록들을 만들어 디렉토리 끝에 붙임
+        ImportEntry **rest = malloc(sizeof(ImportEntry *) * left);
+        int m = 0;
+        for (int i = 0; i < n; i++)
+            if (!placed[i]) rest[m++] = ents[i];
+        uint32_t P = block_size / sizeof(uint32_t);
+        uint32_t nb = 0;
+        char *blocks = imp_dir_blocks(rest, m, 0, 0, &nb);
+        // imp_dir_blocks는 '.', '..'을 앞에 넣으므로 첫 블록에서 그 두 엔트리를 빈 엔트리로 바꿈
+        struct ext2_dir_entry *d0 = (struct ext2_dir_entry *)blocks;
+        struct ext2_dir_entry *d1 = (struct ext2_dir_entry *)(blocks + d0->rec_len);
+        d0->inode = 0;
+        d0->rec_len = (uint16_t)(d0->rec_len + d1->rec_len);
+        d0->name_len = 0;
+        d0->file_type = 0;
+        free(rest);
+        bool extents = (dino->i_flags & EXT4_EXTENTS_FL) != 0;
+        bool need_ind = !extents && nlogical + nb > 12 && dino->i_block[12] == 0;
+        const struct ext4_extent_header *eh = (const struct ext4_extent_header *)dino->i_block;
+        if (extents ? (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth != 0) : nlogical + nb > 12 + P) {
+            fprintf(stderr, "import: no room for %d more entries in target directory\n", m);
+            free(blocks);
+            free(placed);
+            return -1;
         }
-        // 다음 형제 노드로 이동
-        c = c->next_sibling;
+        uint32_t g = (dir_ino - 1) / inodes_per_group;
+        if (imp_alloc_blocks(c, g, nb + (need_ind ? 1 : 0)) < 0) {
+            free(blocks);
+            free(placed);
+            return -1;
+        }
+        uint32_t *ind = NULL;
+        uint32_t ind_blk = dino->i_block[12];
+        if (!extents && nlogical + nb > 12) {
+            ind = calloc(P, sizeof(uint32_t));
+            if (need_ind)
+                ind_blk = imp_next_block(c);
+            else if (img_pread(img_fd, ind, block_size, (off_t)ind_blk * block_size) != (ssize_t)block_size) {
+                free(ind);
+                free(blocks);
+                free(placed);
+                return -1;
+            }
+            dino->i_block[12] = ind_blk;
+        }
+        for (uint32_t k = 0; k < nb; k++) {
+            uint32_t lb = nlogical + k, pb = imp_next_block(c);
+            if (extents) {
+                if (imp_extent_append(dino, lb, pb) < 0) {
+                    fprintf(stderr, "import: no room for %d more entries in target directory\n", m);
+                    free(blocks);
+                    free(placed);
+                    return -1;
+                }
+            }
+            else if (lb < 12) dino->i_block[lb] = pb;
+            else ind[lb - 12] = pb;
+            char *copy = malloc(block_size);
+            memcpy(copy, blocks + (size_t)k * block_size, block_size);
+            imp_queue_write(c, pb, 1, copy);
+        }
+        if (ind) {
+            imp_queue_write(c, ind_blk, 1, (char *)ind);
+            if (need_ind) c->meta_blocks++;
+        }
+        free(blocks);
+        dino->i_size = (nlogical + nb) * block_size;
+        *grow_blocks = nb + (need_ind ? 1 : 0);
     }
+    free(placed);
+    return 0;
 }
 
-// 트리 내 디렉토리/파일 개수 세기
-void count_tree(Node* n, int* dirs, int* files) {
-    // 첫 번째 자식 노드부터 탐색
-    Node* c = n->first_child;
-    while (c) {
-        // '.' '..' 'lost+found' 은 결과에 포함하지 않음
-        if (strcmp(c->name, ".") == 0 ||
-            strcmp(c->name, "..") == 0 ||
-            strcmp(c->name, "lost+found") == 0)
-        {
-            c = c->next_sibling;
-            continue;
+// 모아 둔 inode들을 inode 테이블 블록 단위로 읽어 고친 뒤 쓰기 예약 (연속된 테이블 블록은 한 번에)
+static int imp_queue_inode_tables(ImportCtx *c) {
+    for (int i = 0; i < c->ninodes; ) {
+        uint32_t g = (c->inodes[i].ino - 1) / inodes_per_group;
+        uint32_t idx = (c->inodes[i].ino - 1) % inodes_per_group;
+        uint32_t first = (uint32_t)(((uint64_t)idx * inode_size) / block_size);
+        uint32_t last = first;
+        int j = i + 1;
+        // 같은 그룹에서 인접한 테이블 블록에 들어가는 inode들을 묶음
+        while (j < c->ninodes) {
+            uint32_t g2 = (c->inodes[j].ino - 1) / inodes_per_group;
+            uint32_t idx2 = (c->inodes[j].ino - 1) % inodes_per_group;
+            uint32_t b2 = (uint32_t)(((uint64_t)idx2 * inode_size) / block_size);
+            if (g2 != g || b2 > last + 1) break;
+            last = b2;
+            j++;
         }
-        // 디렉토리인 경우
-        if (c->file_type == 2) {
-            (*dirs)++;    // 디렉토리 카운트 증가
-            count_tree(c, dirs, files);   // 재귀적으로 하위 트리도 세기
+        uint32_t nblk = last - first + 1;
+        size_t len = (size_t)nblk * block_size;
+        char *buf = malloc(len);
+        uint32_t tblk = c->gds[g].bg_inode_table + first;
+        if (img_pread(img_fd, buf, len, (off_t)tblk * block_size) != (ssize_t)len) {
+            fprintf(stderr, "import: cannot read inode table block %u\n", tblk);
+            free(buf);
+            return -1;
         }
-        // 파일인 경우
-        else {
-            (*files)++;  // 파일 카운트 증가
+        for (int k = i; k < j; k++) {
+            uint32_t idx2 = (c->inodes[k].ino - 1) % inodes_per_group;
+            char *p = buf + (size_t)idx2 * inode_size - (size_t)first * block_size;
+            if (c->inodes[k].fresh) {
+                memset(p, 0, inode_size);
+                // 큰 inode는 mke2fs/커널처럼 확장 영역 크기를 32로 둠
+                if (inode_size >= 160) {
+                    uint16_t extra = 32;
+                    memcpy(p + 128, &extra, 2);
+                }
+            }
+            memcpy(p, &c->inodes[k].rec, sizeof(struct ext2_inode));
         }
-        // 다음 형제 노드로 이동
-        c = c->next_sibling;
+        imp_queue_write(c, tblk, nblk, buf);
+        i = j;
     }
+    return 0;
 }
 
-// 파일/디렉토리 권한 비트(mode)를 문자열("drwxr-xr-x")로 변환
-void format_perm(uint16_t mode, char buf[11]) {
-    // 첫 문자는 디렉토리 여부 표시: 디렉토리이면 'd', 아니면 '-'
-    buf[0] = (mode & S_IFDIR) ? 'd' : '-';
-    // 사용자(owner), 그룹(group), 기타(other)에 대한 읽기(r), 쓰기(w), 실행(x) 권한 문자
-    const char* rwx = "rwx";
+static int imp_inode_cmp(const void *a, const void *b) {
+    uint32_t x = ((const ImportInode *)a)->ino, y = ((const ImportInode *)b)->ino;
+    return x < y ? -1 : x > y;
+}
 
-    // 9비트 권한(rwx rwx rwx)을 하나씩 검사하여 buf[1]~buf[9]에 채워넣음
-    // 가장 상위 비트부터 차례대로 검사 (비트 8이 owner 읽기, 비트 0이 other 실행)
-    for (int i = 0; i < 9; i++) {
-        // (1 << (8 - i)) 위치에 해당하는 비트가 켜져 있으면
-        // rwx 문자열에서 i%3 인덱스 문자('r','w','x')를, 아니면 '-
-        buf[i + 1] = (mode & (1 << (8 - i))) ? rwx[i % 3] : '-';
+static int imp_write_cmp(const void *a, const void *b) {
+    uint32_t x = ((const ImportWrite *)a)->blk, y = ((const ImportWrite *)b)->blk;
+    return x < y ? -1 : x > y;
+}
+
+// 예약한 메타데이터 쓰기를 블록 번호순으로 정렬해 이어지는 것끼리 pwritev 한 번으로
+static int imp_flush_writes(ImportCtx *c) {
+    qsort(c->writes, c->nwrites, sizeof(ImportWrite), imp_write_cmp);
+    struct iovec iov[IMPORT_MAX_IOV];
+    for (int i = 0; i < c->nwrites; ) {
+        int j = i, niov = 0;
+        uint32_t next = c->writes[i].blk;
+        size_t total = 0;
+        while (j < c->nwrites && niov < IMPORT_MAX_IOV && c->writes[j].blk == next) {
+            iov[niov].iov_base = c->writes[j].buf;
+            iov[niov].iov_len = (size_t)c->writes[j].nblk * block_size;
+            total += iov[niov].iov_len;
+            next += c->writes[j].nblk;
+            niov++;
+            j++;
+        }
+        ssize_t n;
+        do {
+            n = pwritev(c->wfd, iov, niov, (off_t)c->writes[i].blk * block_size);
+        } while (n < 0 && errno == EINTR);
+        if (n != (ssize_t)total) {
+            // 짧게 쓰였으면 하나씩 다시 씀
+            for (int k = i; k < j; k++)
+                if (imp_pwrite(c->wfd, c->writes[k].buf, (size_t)c->writes[k].nblk * block_size,
+                               (off_t)c->writes[k].blk * block_size) < 0)
+                    return -1;
+        }
+        c->meta_writes++;
+        i = j;
     }
-    // 문자열 끝에 NULL 문자 추가
-    buf[10] = '\0';
+    return 0;
 }
 
-// tree 명령어
-void command_tree(const char* path, int recursive,
-              int show_size, int show_perm)
-{
-    // 경로에 해당하는 노드 찾기
-    Node* tgt = find_node(root, path);
+// 이미지가 import로 안전하게 고칠 수 있는 형식인지 (체크섬/저널 복구/클러스터 할당 등은 지원하지 않음)
+static bool imp_supported(void) {
+    if (img_gz) {
+        fprintf(stderr, "import: compressed images are read-only\n");
+        return false;
+    }
+    if (sb.s_rev_level > 0 && ((sb.s_feature_incompat & ~IMPORT_INCOMPAT_OK)
+                               || (sb.s_feature_ro_compat & ~IMPORT_RO_COMPAT_OK))) {
+        fprintf(stderr, "import: unsupported filesystem features (incompat 0x%x, ro_compat 0x%x)\n",
+                sb.s_feature_incompat, sb.s_feature_ro_compat);
+        return false;
+    }
+    return true;
+}
+
+// import 명령: HOST_DIR의 내용을 이미지의 IMG_DIR 아래로 복사
+void command_import(const char *host_dir, const char *img_dir, bool dry_run) {
+    Node *tgt = find_node(root, img_dir);
     if (!tgt) {
-        // 존재하지 않는 경로면 도움말 출력
-        command_help_tree();
+        command_help_import();
         return;
     }
-    //  디렉토리가 아니면 에러
-    if (tgt->file_type != 2) {
-        fprintf(stderr, "Error: '%s' is not directory\n", path);
+    if (tgt->file_type != EXT2_FT_DIR) {
+        fprintf(stderr, "Error: '%s' is not directory\n", img_dir);
+        return;
+    }
+    struct stat hst;
+    if (stat(host_dir, &hst) < 0 || !S_ISDIR(hst.st_mode)) {
+        fprintf(stderr, "Error: '%s' is not a host directory\n", host_dir);
         return;
     }
+    if (!imp_supported()) return;
 
-    //  디렉토리 inode 정보 읽기
-    struct ext2_inode ino;
-    read_inode(img_fd, tgt->inode_no, &ino);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ImportCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.wfd = -1;
+    ImportCtx *c = &ctx;
 
-    // 권한+크기, 권한, 크기, 아무 옵션 없을 때 로 분기
-    if (show_perm && show_size) {
-        char perm[11];
-        format_perm(ino.i_mode, perm);
-        printf("[%s %u] %s\n",
-               perm, ino.i_size,
-               strcmp(path, "/") == 0 ? "." : path);
+    // 1) 호스트 트리 계획, 이미 있는 이름은 건너뜀
+    ImportEntry *top = imp_entry_new("", host_dir, &hst);
+    top->file_type = EXT2_FT_DIR;
+    top->ino = tgt->inode_no;
+    imp_scan(c, top);
+    load_dir(tgt);
+    int kept = 0;
+    for (int i = 0; i < top->nchildren; i++) {
+        ImportEntry *e = top->children[i];
+        bool exists = false;
+        for (Node *n = tgt->first_child; n && !exists; n = n->next_sibling)
+            exists = strcmp(n->name, e->name) == 0;
+        if (exists) {
+            fprintf(stderr, "import: '%s' already exists in '%s', skipped\n", e->name, img_dir);
+            c->skipped++;
+            imp_entry_free(e);
+            continue;
+        }
+        top->children[kept++] = e;
     }
-    else if (show_perm) {
-        char perm[11];
-        format_perm(ino.i_mode, perm);
-        printf("[%s] %s\n",
-               perm,
-               strcmp(path, "/") == 0 ? "." : path);
+    top->nchildren = kept;
+
+    ImportEntry **list = NULL;
+    int n = 0, cap = 0;
+    imp_flatten(top, &list, &n, &cap);
+    if (n == 0) {
+        printf("import: nothing to import\n\n");
+        goto out;
     }
-    else if (show_size) {
-        printf("[%u] %s\n",
-               ino.i_size,
-               strcmp(path, "/") == 0 ? "." : path);
+
+    // 2) 하드 링크 묶기: 같은 호스트 inode는 이미지에서도 inode 하나
+    ImportEntry **byino = malloc(sizeof(ImportEntry *) * (n ? n : 1));
+    int nl = 0;
+    for (int i = 0; i < n; i++) {
+        list[i]->nlinks = list[i]->file_type == EXT2_FT_DIR ? 2 : 1;
+        if (list[i]->file_type != EXT2_FT_DIR && list[i]->st.st_nlink > 1)
+            byino[nl++] = list[i];
     }
-    else {
-        // 옵션 없으면 기존 방식
-        printf("%s\n",
-               strcmp(path, "/") == 0 ? "." : path);
+    qsort(byino, nl, sizeof(ImportEntry *), imp_hostino_cmp);
+    for (int i = 1; i < nl; i++) {
+        if (imp_hostino_cmp(&byino[i - 1], &byino[i]) != 0) continue;
+        ImportEntry *first = byino[i - 1]->link_of ? byino[i - 1]->link_of : byino[i - 1];
+        byino[i]->link_of = first;
+        first->nlinks++;
+        c->hardlinks++;
     }
-    //  실제 트리 구조 출력 (자식 노드들)
-    print_tree(tgt, "", recursive, show_size, show_perm);
+    free(byino);
+    for (int i = 0; i < n; i++)
+        if (list[i]->file_type == EXT2_FT_DIR)
+            list[i]->parent->nlinks++;   // 하위 디렉토리의 ".."
 
-    //  요약용 카운트
-    int dirs = 0, files = 0;
-    Node* c = tgt->first_child;
-    while (c) {
-        // 스킵할 이름들
-        if (strcmp(c->name, ".") == 0 ||
-            strcmp(c->name, "..") == 0 ||
-            strcmp(c->name, "lost+found") == 0)
-        {
-            c = c->next_sibling;
+    // 3) 필요한 inode/블록 수 확인 (디렉토리 블록은 inode 번호와 무관하게 크기가 정해짐)
+    uint64_t need_inodes = 0, need_blocks = 0;
+    for (int i = 0; i < n; i++) {
+        ImportEntry *e = list[i];
+        if (e->link_of) continue;
+        need_inodes++;
+        if (e->file_type == EXT2_FT_REG_FILE)
+            imp_file_ranges(e);
+        else
+            imp_prepare_content(e);
+        need_blocks += imp_layout(NULL, e, NULL, NULL);
+    }
+    uint32_t top_nb = 0;
+    free(imp_dir_blocks(top->children, top->nchildren, 0, 0, &top_nb));
+    need_blocks += top_nb + 1;   // 대상 디렉토리가 늘어날 때의 최대치 (간접 블록 포함)
+
+    c->free_inodes = 0;
+    c->free_blocks = 0;
+    c->gds = malloc(sizeof(struct ext2_group_desc) * group_count);
+    memcpy(c->gds, gdt, sizeof(struct ext2_group_desc) * group_count);
+    for (uint32_t g = 0; g < group_count; g++) {
+        c->free_inodes += c->gds[g].bg_free_inodes_count;
+        c->free_blocks += c->gds[g].bg_free_blocks_count;
+    }
+    if (dry_run || need_inodes > c->free_inodes || need_blocks > c->free_blocks) {
+        bool fits = need_inodes <= c->free_inodes && need_blocks <= c->free_blocks;
+        printf("import: %llu inodes and up to %llu blocks needed, %u inodes and %u blocks free%s\n\n",
+               (unsigned long long)need_inodes, (unsigned long long)need_blocks,
+               c->free_inodes, c->free_blocks, fits ? "" : " (not enough space, nothing written)");
+        goto out;
+    }
+
+    ctx.wfd = open(img_path, O_RDWR);
+    if (ctx.wfd < 0) {
+        fprintf(stderr, "import: open '%s' for writing: %s\n", img_path, strerror(errno));
+        goto out;
+    }
+
+    // 4) 비트맵 전체를 메모리로 (그룹마다 블록 비트맵, inode 비트맵 한 블록씩 일괄 읽기)
+    c->bbm = malloc((size_t)group_count * block_size);
+    c->ibm = malloc((size_t)group_count * block_size);
+    c->bbm_dirty = calloc(group_count, sizeof(bool));
+    c->ibm_dirty = calloc(group_count, sizeof(bool));
+    c->goal = malloc(sizeof(uint32_t) * group_count);
+    c->no_run_len = UINT32_MAX;
+    IoReq *reqs = malloc(sizeof(IoReq) * group_count * 2);
+    for (uint32_t g = 0; g < group_count; g++) {
+        reqs[2 * g] = (IoReq){ c->bbm + (size_t)g * block_size, block_size,
+                               (off_t)c->gds[g].bg_block_bitmap * block_size, 0 };
+        reqs[2 * g + 1] = (IoReq){ c->ibm + (size_t)g * block_size, block_size,
+                                   (off_t)c->gds[g].bg_inode_bitmap * block_size, 0 };
+        c->goal[g] = sb.s_first_data_block + g * sb.s_blocks_per_group;
+    }
+    int bad = io_read_batch(img_fd, reqs, (int)group_count * 2);
+    free(reqs);
+    if (bad) {
+        fprintf(stderr, "import: cannot read %d bitmap blocks\n", bad);
+        goto out;
+    }
+
+    // 5) inode 할당: 전위 순서라 디렉토리가 자식보다 먼저 번호를 받음
+    for (int i = 0; i < n; i++) {
+        ImportEntry *e = list[i];
+        if (e->link_of) continue;
+        bool is_dir = e->file_type == EXT2_FT_DIR;
+        e->ino = imp_alloc_inode(c, e->parent->ino, is_dir, e->parent == top);
+        if (!e->ino) {
+            fprintf(stderr, "import: out of inodes\n");
+            goto out;
+        }
+    }
+    for (int i = 0; i < n; i++)
+        if (list[i]->link_of) list[i]->ino = list[i]->link_of->ino;
+
+    // 6) 블록 할당과 데이터 쓰기: 디렉토리 블록, 그 디렉토리의 파일들 순서로 그룹 안에서 이어 붙임
+    uint32_t now = (uint32_t)time(NULL);
+    bool large_file = false;
+    c->iobuf = malloc(IMPORT_IO_BYTES);
+    for (int i = 0; i < n; i++) {
+        ImportEntry *e = list[i];
+        if (e->link_of) continue;
+        if (e->file_type == EXT2_FT_DIR) {
+            // inode 번호가 정해졌으므로 '.'/'..'/자식 번호로 내용을 다시 만듦
+            free(e->content);
+            free(e->ranges);
+            e->content = NULL;
+            e->ranges = NULL;
+            imp_prepare_content(e);
+        }
+        uint64_t nblk = imp_layout(NULL, e, NULL, NULL);
+        uint32_t g = (e->ino - 1) / inodes_per_group;
+        if (imp_alloc_blocks(c, g, (uint32_t)nblk) < 0) {
+            fprintf(stderr, "import: out of blocks\n");
+            goto out;
+        }
+        BlockRun *runs = NULL;
+        int nruns = 0;
+        imp_layout(c, e, &runs, &nruns);
+        c->blocks += nblk;
+        if (e->file_type == EXT2_FT_REG_FILE) {
+            if (imp_copy_file(c, e, runs, nruns) < 0) {
+                if (c->error) {
+                    free(runs);
+                    goto out;
+                }
+                c->failed++;    // 읽지 못한 파일은 0으로 채워진 채 남음
+            }
+            if ((uint64_t)e->st.st_size >= 0x80000000ull) large_file = true;
+        } else if (e->content) {
+            for (int r = 0; r < nruns; r++) {
+                size_t len = (size_t)runs[r].len * block_size;
+                char *copy = malloc(len);
+                memcpy(copy, e->content + (size_t)runs[r].logical * block_size, len);
+                imp_queue_write(c, runs[r].physical, runs[r].len, copy);
+            }
+        }
+        free(runs);
+        struct ext2_inode rec;
+        imp_fill_inode(e, nblk, now, &rec);
+        imp_queue_inode(c, e->ino, &rec, true);
+        switch (e->file_type) {
+        case EXT2_FT_DIR: c->ndirs++; break;
+        case EXT2_FT_REG_FILE: c->nfiles++; break;
+        case EXT2_FT_SYMLINK: c->nsymlinks++; break;
+        default: c->nspecial++; break;
+        }
+    }
+
+    // 7) 대상 디렉토리에 엔트리 추가, 링크 수/시간 갱신 (htree 색인은 지워 선형 디렉토리로)
+    struct ext2_inode dino;
+    read_inode(img_fd, tgt->inode_no, &dino);
+    uint32_t grow = 0;
+    if (top->nchildren > 0) {
+        if (imp_link_into(c, tgt->inode_no, &dino, top->children, top->nchildren, &grow) < 0)
+            goto out;
+        dino.i_blocks += grow * (block_size / 512);
+        dino.i_links_count += (uint16_t)top->nlinks;   // 새 하위 디렉토리들의 ".."
+        dino.i_mtime = dino.i_ctime = now;
+        dino.i_flags &= ~EXT2_INDEX_FL;
+        imp_queue_inode(c, tgt->inode_no, &dino, false);
+        c->blocks += grow;
+    }
+
+    // 8) 데이터가 디스크에 닿은 뒤에 메타데이터를 씀
+    if (fdatasync(c->wfd) < 0) {
+        fprintf(stderr, "import: fdatasync: %s\n", strerror(errno));
+        goto out;
+    }
+    qsort(c->inodes, c->ninodes, sizeof(ImportInode), imp_inode_cmp);
+    if (imp_queue_inode_tables(c) < 0)
+        goto out;
+    for (uint32_t g = 0; g < group_count; g++) {
+        if (c->bbm_dirty[g]) {
+            char *copy = malloc(block_size);
+            memcpy(copy, c->bbm + (size_t)g * block_size, block_size);
+            imp_queue_write(c, c->gds[g].bg_block_bitmap, 1, copy);
+        }
+        if (c->ibm_dirty[g]) {
+            char *copy = malloc(block_size);
+            memcpy(copy, c->ibm + (size_t)g * block_size, block_size);
+            imp_queue_write(c, c->gds[g].bg_inode_bitmap, 1, copy);
+        }
+    }
+    if (imp_flush_writes(c) < 0) {
+        fprintf(stderr, "import: write metadata: %s\n", strerror(errno));
+        goto out;
+    }
+
+    // 9) 그룹 디스크립터 테이블 (각 디스크립터의 앞 32바이트만 바뀜)과 슈퍼블록
+    size_t dsz = group_desc_size();
+    size_t gdlen = dsz * group_count;
+    off_t gdoff = (off_t)(SUPERBLOCK_OFFSET / block_size + 1) * block_size;
+    char *gdraw = malloc(gdlen);
+    char sbraw[SUPERBLOCK_OFFSET];
+    bool ok = img_pread(img_fd, gdraw, gdlen, gdoff) == (ssize_t)gdlen
+              && img_pread(img_fd, sbraw, sizeof(sbraw), SUPERBLOCK_OFFSET) == (ssize_t)sizeof(sbraw);
+    if (ok) {
+        for (uint32_t g = 0; g < group_count; g++)
+            memcpy(gdraw + g * dsz, &c->gds[g], sizeof(struct ext2_group_desc));
+        struct ext2_super_block nsb;
+        memcpy(&nsb, sbraw, sizeof(nsb));
+        nsb.s_free_blocks_count = c->free_blocks;
+        nsb.s_free_inodes_count = c->free_inodes;
+        nsb.s_wtime = now;
+        if (large_file)
+            nsb.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+        memcpy(sbraw, &nsb, sizeof(nsb));
+        ok = imp_pwrite(c->wfd, gdraw, gdlen, gdoff) == 0
+             && imp_pwrite(c->wfd, sbraw, sizeof(sbraw), SUPERBLOCK_OFFSET) == 0
+             && fsync(c->wfd) == 0;
+    }
+    free(gdraw);
+    if (!ok) {
+        fprintf(stderr, "import: write group descriptors/superblock: %s\n", strerror(errno));
+        goto out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (sec <= 0) sec = 1e-9;
+    printf("%d directories, %d files, %d symlinks imported", c->ndirs, c->nfiles, c->nsymlinks);
+    if (c->nspecial) printf(", %d special files", c->nspecial);
+    if (c->hardlinks) printf(", %d hard links", c->hardlinks);
+    if (c->failed) printf(", %d failed", c->failed);
+    if (c->skipped) printf(", %d skipped", c->skipped);
+    printf("\n%llu bytes in %.3f s (%.2f MB/s); %llu blocks in %llu extents, %llu indirect blocks, %d metadata writes\n\n",
+           (unsigned long long)c->bytes, sec, c->bytes / sec / (1024.0 * 1024.0),
+           (unsigned long long)c->blocks, (unsigned long long)c->extents,
+           (unsigned long long)c->meta_blocks, c->meta_writes);
+
+    // 10) 메모리 트리를 바뀐 이미지에 맞춤
+    reload_tree(false);
+
+out:
+    if (ctx.wfd >= 0) {
+        close(ctx.wfd);
+        bcache_invalidate(img_fd);  // 중간에 실패했어도 일부 블록은 바뀌었을 수 있음
+    }
+    for (int i = 0; i < ctx.nwrites; i++)
+        free(ctx.writes[i].buf);
+    free(ctx.writes);
+    free(ctx.inodes);
+    free(ctx.runs);
+    free(ctx.bbm);
+    free(ctx.ibm);
+    free(ctx.bbm_dirty);
+    free(ctx.ibm_dirty);
+    free(ctx.goal);
+    free(ctx.gds);
+    free(ctx.iobuf);
+    free(list);
+    imp_entry_free(top);
+}
+
+// ---------------------------------------------------------------------------
+// gzip 압축 이미지 임의 접근
+// ---------------------------------------------------------------------------
+// 처음 열 때 전체를 한 번 풀면서 GZ_SPAN 간격의 deflate 블록 경계마다
+// 체크포인트(입력 비트 위치 + 직전 32KB 창)를 기록해 "<이미지>.gzidx"에 저장
+// 이후 읽기는 가장 가까운 앞 체크포인트부터 풀어 GZ_CHUNK 단위로 LRU 캐시에 넣고 복사
+
+// 체크포인트 색인 파일 헤더: 압축 파일 크기/수정 시간이 달라지면 다시 만듦
+typedef struct GzIndexHeader {
+    char magic[8];           // GZIDX_MAGIC
+    uint32_t version;
+    uint32_t span;
+    uint64_t npoints;
+    uint64_t usize;          // 압축 해제 크기
+    uint64_t img_size;
+    int64_t img_mtime_sec;
+    int64_t img_mtime_nsec;
+} GzIndexHeader;
+
+// 색인 파일의 체크포인트 하나 (뒤에 clen 바이트의 압축한 창이 이어짐)
+typedef struct GzPointRec {
+    uint64_t out;
+    uint64_t in;
+    int32_t bits;
+    uint32_t clen;
+} GzPointRec;
+
+// 압축 파일에서 순차로 풀어 내는 스트림 (체크포인트에서 시작)
+typedef struct GzStream {
+    z_stream strm;
+    int fd;
+    bool raw;                // 체크포인트에서 시작한 raw deflate (gzip 헤더/트레일러 없음)
+    bool eof;
+    uint64_t in_off;         // 다음에 읽을 압축 파일 오프셋
+    uint32_t skip;           // 아직 건너뛰지 못한 트레일러 바이트
+    unsigned char in[GZ_INBUF];
+} GzStream;
+
+static bool gz_fill_input(GzStream *gs) {
+    ssize_t n;
+    do {
+        n = pread(gs->fd, gs->in, sizeof(gs->in), (off_t)gs->in_off);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+    gs->in_off += (uint64_t)n;
+    gs->strm.next_in = gs->in;
+    gs->strm.avail_in = (uInt)n;
+    return true;
+}
+
+// 체크포인트 p에서 풀기 시작
+static int gz_stream_open(GzStream *gs, int fd, const GzPoint *p) {
+    memset(&gs->strm, 0, sizeof(gs->strm));
+    gs->fd = fd;
+    gs->eof = false;
+    gs->skip = 0;
+    gs->raw = (p->bits >= 0);
+    if (inflateInit2(&gs->strm, gs->raw ? -15 : 31) != Z_OK)
+        return -1;
+    gs->in_off = p->in;
+    if (gs->raw) {
+        if (p->bits > 0) {
+            unsigned char ch;
+            if (pread(fd, &ch, 1, (off_t)p->in - 1) != 1) {
+                inflateEnd(&gs->strm);
+                return -1;
+            }
+            inflatePrime(&gs->strm, p->bits, ch >> (8 - p->bits));
+        }
+        inflateSetDictionary(&gs->strm, p->window, GZ_WINSIZE);
+    }
+    return 0;
+}
+
+// 최대 len 바이트를 풀어 out에 씀 (반환값 < len이면 끝 또는 오류)
+// 여러 멤버가 이어진 gzip 파일은 멤버 경계에서 다음 멤버로 넘어감
+static size_t gz_stream_read(GzStream *gs, unsigned char *out, size_t len) {
+    gs->strm.next_out = out;
+    gs->strm.avail_out = (uInt)len;
+    while (gs->strm.avail_out > 0 && !gs->eof) {
+        if (gs->strm.avail_in == 0 && !gz_fill_input(gs)) {
+            gs->eof = true;
+            break;
+        }
+        if (gs->skip > 0) {
+            uint32_t n = gs->skip < gs->strm.avail_in ? gs->skip : gs->strm.avail_in;
+            gs->strm.next_in += n;
+            gs->strm.avail_in -= n;
+            gs->skip -= n;
             continue;
         }
-        if (c->file_type == 2) {
-            dirs++;
-            // -r 옵션일 때만 하위도 재귀 카운트
-            if (recursive) {
-                count_tree(c, &dirs, &files);
+        int ret = inflate(&gs->strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            // raw로 시작했으면 8바이트 트레일러를 직접 건너뛰고 다음 멤버는 gzip 헤더부터
+            if (gs->raw) {
+                gs->skip = 8;
+                gs->raw = false;
+                inflateReset2(&gs->strm, 31);
+            } else {
+                inflateReset(&gs->strm);
             }
         }
-        else {
-            files++;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            gs->eof = true;    // 손상되었거나 멤버 뒤의 쓰레기 데이터
         }
-        c = c->next_sibling;
     }
-    // 항상 대상 디렉터리 자신도 하나의 directory 로 카운트
-    dirs++;
+    return len - gs->strm.avail_out;
+}
 
-    printf("\n%d directories, %d files\n\n", dirs, files);
+static void gz_stream_close(GzStream *gs) {
+    inflateEnd(&gs->strm);
 }
 
-// print 명령어
-void command_print(const char* path, int max_lines) {
-    // 대상 노드 찾기 및 inode 읽기
-    Node* tgt = find_node(root, path);
-    struct ext2_inode ino;
-    read_inode(img_fd, tgt->inode_no, &ino);
+// 전체를 한 번 풀며 체크포인트 색인 생성 (zlib의 zran 방식)
+static int gz_build_index(GzImage *gz) {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 31) != Z_OK) return -1;
+    unsigned char *in = malloc(GZ_INBUF);
+    unsigned char *window = malloc(GZ_WINSIZE);
+    uint64_t in_off = 0, totin = 0, totout = 0, last = 0;
+    int cap = 0, ret = Z_OK;
+    bool ended = false;        // 멤버 하나 이상을 끝까지 풀었는지
 
-    // --- 1) 모든 데이터 블록 번호 모으기 ---
-    uint32_t *blocks = NULL;
-    int nblocks = collect_data_blocks(img_fd, &ino, block_size, &blocks);
+    // 파일 시작: gzip 헤더부터 푸는 체크포인트 (창 불필요)
+    cap = 64;
+    gz->points = calloc(cap, sizeof(GzPoint));
+    gz->points[0].bits = -1;
+    gz->npoints = 1;
 
-    // 출력 제한(max_lines)이 있을 경우, 실제 출력 전에
-    //  파일에 줄이 더 있는지(has_more) 미리 검사
-    // --- 2) has_more 검사 (줄 제한이 있을 때만) ---
-    bool has_more = false;
-    if (max_lines > 0) {
-        char *buf = malloc(block_size);
-        int counted = 0;
-        for (int bi = 0; bi < nblocks && !has_more; bi++) {
-            off_t off = (off_t)blocks[bi] * block_size;
-            ssize_t got = pread(img_fd, buf, block_size, off);
-            if (got <= 0) break;
-            for (char *p = buf; p < buf + got; p++) {
-                if (*p == '\n' && ++counted > max_lines) {
-                    has_more = true;
-                    break;
-                }
+    strm.avail_out = 0;
+    while (1) {
+        if (strm.avail_in == 0) {
+            ssize_t n = pread(gz->fd, in, GZ_INBUF, (off_t)in_off);
+            if (n <= 0) break;
+            in_off += (uint64_t)n;
+            strm.next_in = in;
+            strm.avail_in = (uInt)n;
+        }
+        if (strm.avail_out == 0) {
+            strm.next_out = window;
+            strm.avail_out = GZ_WINSIZE;
+        }
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        ret = inflate(&strm, Z_BLOCK);
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+        if (ret == Z_STREAM_END) {
+            ended = true;
+            inflateReset(&strm);   // 다음 멤버 (없으면 입력이 끝나며 종료)
+            continue;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            if (ended) break;      // 멤버 뒤의 패딩 등은 무시
+            free(in);
+            free(window);
+            inflateEnd(&strm);
+            return -1;
+        }
+        // 마지막 블록이 아닌 블록 경계에서 GZ_SPAN마다 체크포인트
+        if ((strm.data_type & 128) && !(strm.data_type & 64) && totout - last >= GZ_SPAN) {
+            if (gz->npoints == cap) {
+                cap *= 2;
+                gz->points = realloc(gz->points, sizeof(GzPoint) * cap);
             }
+            GzPoint *p = &gz->points[gz->npoints++];
+            memset(p, 0, sizeof(*p));
+            p->out = totout;
+            p->in = totin;
+            p->bits = strm.data_type & 7;
+            // 원형 버퍼인 window를 오래된 순서로 펴서 저장
+            unsigned left = strm.avail_out;
+            if (left) memcpy(p->window, window + GZ_WINSIZE - left, left);
+            if (left < GZ_WINSIZE) memcpy(p->window + left, window, GZ_WINSIZE - left);
+            last = totout;
         }
-        free(buf);
     }
+    free(in);
+    free(window);
+    inflateEnd(&strm);
+    if (!ended) return -1;
+    gz->usize = totout;
+    return 0;
+}
 
+// 색인 파일 경로: 이미지 옆에 "<이미지>.gzidx"
+// 경로가 너무 길면 -1 (색인 없이 매번 새로 만듦)
+static int gz_index_path(const char *img, char *buf, size_t len) {
+    int n = snprintf(buf, len, "%s%s", img, GZIDX_SUFFIX);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
 
-    // --- 3) 실제 출력 ---
-    char *tmp = malloc(block_size);
-    char *line_buf = NULL;
-    size_t line_cap = 0, line_len = 0;
-    int printed = 0;
+// 색인 파일: 헤더 뒤에 체크포인트마다 GzPointRec + 압축한 창 (창은 대부분 0이라 잘 줄어듦)
+static int gz_index_load(GzImage *gz, const char *path, const struct stat *st) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    GzIndexHeader h;
+    int ret = -1;
+    if (fread(&h, sizeof(h), 1, fp) == 1
+        && memcmp(h.magic, GZIDX_MAGIC, 8) == 0 && h.version == GZIDX_VERSION
+        && h.span == GZ_SPAN && h.npoints > 0 && h.npoints < INT_MAX
+        && h.img_size == (uint64_t)st->st_size
+        && h.img_mtime_sec == st->st_mtim.tv_sec && h.img_mtime_nsec == st->st_mtim.tv_nsec) {
+        gz->points = malloc(sizeof(GzPoint) * h.npoints);
+        unsigned char *cbuf = malloc(compressBound(GZ_WINSIZE));
+        uint64_t i;
+        for (i = 0; i < h.npoints; i++) {
+            GzPointRec r;
+            GzPoint *p = &gz->points[i];
+            uLongf wlen = GZ_WINSIZE;
+            if (fread(&r, sizeof(r), 1, fp) != 1 || r.clen > compressBound(GZ_WINSIZE)
+                || fread(cbuf, 1, r.clen, fp) != r.clen
+                || uncompress(p->window, &wlen, cbuf, r.clen) != Z_OK || wlen != GZ_WINSIZE)
+                break;
+            p->out = r.out;
+            p->in = r.in;
+            p->bits = r.bits;
+            p->pad = 0;
+        }
+        free(cbuf);
+        if (i == h.npoints) {
+            gz->npoints = (int)h.npoints;
+            gz->usize = h.usize;
+            ret = 0;
+        } else {
+            free(gz->points);
+            gz->points = NULL;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
 
-    for (int bi = 0;
-         bi < nblocks && (max_lines == 0 || printed < max_lines);
-         bi++)
-    {
-        off_t off = (off_t)blocks[bi] * block_size;
-        ssize_t got = pread(img_fd, tmp, block_size, off);
-        if (got <= 0) break;
+// 임시 파일에 쓴 뒤 rename (중간에 실패해도 깨진 색인이 남지 않음)
+static int gz_index_save(const GzImage *gz, const char *path, const struct stat *st) {
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    if (n < 0 || (size_t)n >= sizeof(tmp))
+        return -1;
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return -1;
+    GzIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GZIDX_MAGIC, 8);
+    h.version = GZIDX_VERSION;
+    h.span = GZ_SPAN;
+    h.npoints = (uint64_t)gz->npoints;
+    h.usize = gz->usize;
+    h.img_size = st->st_size;
+    h.img_mtime_sec = st->st_mtim.tv_sec;
+    h.img_mtime_nsec = st->st_mtim.tv_nsec;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    unsigned char *cbuf = malloc(compressBound(GZ_WINSIZE));
+    for (int i = 0; ok && i < gz->npoints; i++) {
+        const GzPoint *p = &gz->points[i];
+        uLongf clen = compressBound(GZ_WINSIZE);
+        GzPointRec r = { .out = p->out, .in = p->in, .bits = p->bits };
+        ok = compress2(cbuf, &clen, p->window, GZ_WINSIZE, Z_BEST_SPEED) == Z_OK;
+        r.clen = (uint32_t)clen;
+        ok = ok && fwrite(&r, sizeof(r), 1, fp) == 1 && fwrite(cbuf, 1, clen, fp) == clen;
+    }
+    free(cbuf);
+    if (fclose(fp) != 0) ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
 
-        size_t pos = 0;
-        while (pos < (size_t)got && (max_lines == 0 || printed < max_lines)) {
-            // 다음 개행까지 또는 블록 끝까지 chunk 길이 계산
-            char *nl = memchr(tmp + pos, '\n', got - pos);
-            size_t chunk_len = nl
-                               ? (size_t)(nl - (tmp + pos) + 1)
-                               : (size_t)(got - pos);
+// 열린 gzip 이미지 목록 (imgdiff로 두 이미지를 함께 읽을 수 있으므로 fd로 찾음)
+static GzImage *gz_list;
+static pthread_mutex_t gz_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
-            // line_buf 확장
-            if (line_len + chunk_len + 1 > line_cap) {
-                line_cap = (line_len + chunk_len + 1) * 2;
-                line_buf = realloc(line_buf, line_cap);
-            }
-            // 조각 누적
-            memcpy(line_buf + line_len, tmp + pos, chunk_len);
-            line_len += chunk_len;
-            line_buf[line_len] = '\0';
+// fd에 해당하는 gzip 이미지 (없으면 NULL)
+GzImage *gz_find(int fd) {
+    if (!__atomic_load_n(&gz_list, __ATOMIC_ACQUIRE)) return NULL;
+    pthread_mutex_lock(&gz_list_lock);
+    GzImage *g = gz_list;
+    while (g && g->fd != fd)
+        g = g->next;
+    pthread_mutex_unlock(&gz_list_lock);
+    return g;
+}
+
+// fd가 gzip 파일인지 (매직 1f 8b)
+bool gz_detect(int fd) {
+    unsigned char magic[2];
+    return pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
 
-            pos += chunk_len;
+// gzip 이미지 열기: 저장된 색인이 유효하면 읽고, 아니면 만들어 저장
+GzImage *gz_open(int fd, const char *path) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        return NULL;
+    }
+    GzImage *gz = calloc(1, sizeof(GzImage));
+    gz->fd = fd;
+    pthread_mutex_init(&gz->lock, NULL);
 
-            if (nl) {
-                // 완성된 한 줄 출력
-                fwrite(line_buf, 1, line_len, stdout);
-                printed++;
-                line_len = 0;  // 다음 줄을 위해 버퍼 리셋
-            }
+    char ipath[PATH_MAX];
+    bool have_ipath = gz_index_path(path, ipath, sizeof(ipath)) == 0;
+    if (!have_ipath || gz_index_load(gz, ipath, &st) < 0) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (gz_build_index(gz) < 0) {
+            fprintf(stderr, "Error: '%s' is not a valid gzip file\n", path);
+            free(gz->points);
+            pthread_mutex_destroy(&gz->lock);
+            free(gz);
+            return NULL;
         }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        bool saved = have_ipath && gz_index_save(gz, ipath, &st) == 0;
+        fprintf(stderr, "gzip: indexed %llu bytes with %d checkpoints in %.3f ms%s%s\n",
+                (unsigned long long)gz->usize, gz->npoints, ms,
+                saved ? ", saved to " : " (index not saved)", saved ? ipath : "");
     }
-    free(tmp);
-    free(line_buf);
-    free(blocks);
 
+    // 청크 캐시: 해시(청크 번호 → 칸)와 LRU 이중 연결 리스트
+    gz->chunks = calloc(GZ_CACHE_CHUNKS, sizeof(GzChunk));
+    gz->hash = malloc(sizeof(int) * GZ_CACHE_CHUNKS * 2);
+    for (int i = 0; i < GZ_CACHE_CHUNKS * 2; i++)
+        gz->hash[i] = -1;
+    gz->lru_head = gz->lru_tail = -1;
 
-    // --- 4) 더 볼 내용이 있으면 빈 줄 추가 ---
-    if (max_lines > 0 && printed == max_lines && has_more) {
-        putchar('\n');
+    // reload로 같은 fd의 색인을 다시 만들 때는 새 색인이 앞에 있어야 먼저 찾힘
+    pthread_mutex_lock(&gz_list_lock);
+    gz->next = gz_list;
+    __atomic_store_n(&gz_list, gz, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&gz_list_lock);
+    return gz;
+}
+
+void gz_close(GzImage *gz) {
+    if (!gz) return;
+    pthread_mutex_lock(&gz_list_lock);
+    GzImage **pp = &gz_list;
+    while (*pp && *pp != gz)
+        pp = &(*pp)->next;
+    if (*pp) *pp = gz->next;
+    pthread_mutex_unlock(&gz_list_lock);
+    if (gz->cur) {
+        gz_stream_close(gz->cur);
+        free(gz->cur);
     }
+    free(gz->cbuf);
+    for (int i = 0; i < GZ_CACHE_CHUNKS; i++)
+        free(gz->chunks[i].data);
+    free(gz->chunks);
+    free(gz->hash);
+    free(gz->points);
+    pthread_mutex_destroy(&gz->lock);
+    free(gz);
+}
 
+static uint32_t gz_chunk_hash(uint64_t no) {
+    return (uint32_t)((no * 0x9E3779B97F4A7C15ull) >> 40) % (GZ_CACHE_CHUNKS * 2);
+}
 
+static void gz_lru_unlink(GzImage *gz, int i) {
+    GzChunk *c = &gz->chunks[i];
+    if (c->lru_prev >= 0) gz->chunks[c->lru_prev].lru_next = c->lru_next;
+    else gz->lru_head = c->lru_next;
+    if (c->lru_next >= 0) gz->chunks[c->lru_next].lru_prev = c->lru_prev;
+    else gz->lru_tail = c->lru_prev;
 }
 
-// help 명령어
-void command_help(const char* cmd) {
-    if (cmd == NULL) {
-        // 기본 help
-        command_help_all();
+static void gz_lru_push_front(GzImage *gz, int i) {
+    GzChunk *c = &gz->chunks[i];
+    c->lru_prev = -1;
+    c->lru_next = gz->lru_head;
+    if (gz->lru_head >= 0) gz->chunks[gz->lru_head].lru_prev = i;
+    gz->lru_head = i;
+    if (gz->lru_tail < 0) gz->lru_tail = i;
+}
+
+// 캐시에서 청크 찾기 (있으면 가장 최근 사용으로 옮김)
+static GzChunk *gz_cache_find(GzImage *gz, uint64_t no) {
+    for (int i = gz->hash[gz_chunk_hash(no)]; i >= 0; i = gz->chunks[i].hash_next) {
+        if (gz->chunks[i].no != no) continue;
+        if (gz->lru_head != i) {
+            gz_lru_unlink(gz, i);
+            gz_lru_push_front(gz, i);
+        }
+        return &gz->chunks[i];
     }
-    // tree 명령어 help
-    else if (strcmp(cmd, "tree") == 0) {
-        command_help_tree();
+    return NULL;
+}
+
+// 청크를 캐시에 넣음: 빈 칸이 없으면 가장 오래 쓰지 않은 청크를 내보냄
+static void gz_cache_put(GzImage *gz, uint64_t no, const unsigned char *data, uint32_t len) {
+    if (gz_cache_find(gz, no)) return;
+    int i;
+    if (gz->nchunks < GZ_CACHE_CHUNKS) {
+        i = gz->nchunks++;
+        gz->chunks[i].data = malloc(GZ_CHUNK);
+    } else {
+        i = gz->lru_tail;
+        gz_lru_unlink(gz, i);
+        int *pp = &gz->hash[gz_chunk_hash(gz->chunks[i].no)];
+        while (*pp != i)
+            pp = &gz->chunks[*pp].hash_next;
+        *pp = gz->chunks[i].hash_next;
     }
-    // print 명령어 help
-    else if (strcmp(cmd, "print") == 0) {
-        command_help_print();
+    GzChunk *c = &gz->chunks[i];
+    c->no = no;
+    c->len = len;
+    memcpy(c->data, data, len);
+    uint32_t h = gz_chunk_hash(no);
+    c->hash_next = gz->hash[h];
+    gz->hash[h] = i;
+    gz_lru_push_front(gz, i);
+}
+
+// 청크 no를 풀어 캐시에 넣음: 앞 체크포인트부터 풀며 지나가는 완전한 청크도 함께 캐시
+// 직전에 풀던 스트림이 no 앞(같은 체크포인트 구간 이후)에 멈춰 있으면 처음부터 다시 풀지 않고 이어서 품
+// (0으로 채운 영역은 deflate 블록이 길어 체크포인트 간격이 수 MB가 되므로 순서대로 읽는 적재에서 중요)
+static int gz_load_chunk(GzImage *gz, uint64_t no) {
+    uint64_t target = no * GZ_CHUNK;
+    int lo = 0, hi = gz->npoints - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (gz->points[mid].out <= target) lo = mid;
+        else hi = mid - 1;
     }
+    const GzPoint *p = &gz->points[lo];
 
-    // help 명령어 help
-    else if (strcmp(cmd, "help") == 0) {
-        command_help_help();
+    GzStream *gs = gz->cur;
+    if (!gs || gs->eof || gz->cur_pos > target || gz->cur_pos < p->out) {
+        if (gs) gz_stream_close(gs);
+        else gs = gz->cur = malloc(sizeof(GzStream));
+        if (gz_stream_open(gs, gz->fd, p) < 0) {
+            free(gs);
+            gz->cur = NULL;
+            return -1;
+        }
+        gz->cur_pos = p->out;
     }
-    // exit 명령어 help
-    else if (strcmp(cmd, "exit") == 0) {
-        command_help_exit();
+    if (!gz->cbuf) gz->cbuf = malloc(GZ_CHUNK);
+    unsigned char *cbuf = gz->cbuf;
+    uint64_t start = gz->cur_pos, pos = start;
+    int ret = -1;
+    while (1) {
+        uint64_t cno = pos / GZ_CHUNK;
+        uint64_t cstart = cno * GZ_CHUNK;
+        size_t want = GZ_CHUNK - (size_t)(pos - cstart);
+        size_t got = gz_stream_read(gs, cbuf + (pos - cstart), want);
+        pos += got;
+        // 시작 위치 앞부분이 없는 청크(체크포인트가 청크 중간)는 캐시하지 않음
+        if (cstart >= start && pos > cstart)
+            gz_cache_put(gz, cno, cbuf, (uint32_t)(pos - cstart));
+        if (cno >= no) {
+            ret = (pos > target) ? 0 : -1;
+            break;
+        }
+        if (gs->eof) break;
     }
-    else {
-        // 올바르지 않은 명령어
-        fprintf(stderr, "invalid command -- '%s'\n", cmd);
-        command_help_all();
+    gz->cur_pos = pos;
+    gz->misses++;
+    stat_add(STAT_GZ_MISSES, 1);
+    return ret;
+}
+
+// 압축 해제 기준 오프셋 off에서 len 바이트 읽기 (pread와 같은 의미, 여러 스레드에서 호출 가능)
+ssize_t gz_pread(GzImage *gz, void *buf, size_t len, off_t off) {
+    if (off < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t done = 0;
+    pthread_mutex_lock(&gz->lock);
+    while (done < len && (uint64_t)off + done < gz->usize) {
+        uint64_t pos = (uint64_t)off + done;
+        uint64_t no = pos / GZ_CHUNK;
+        GzChunk *c = gz_cache_find(gz, no);
+        if (c) {
+            gz->hits++;
+            stat_add(STAT_GZ_HITS, 1);
+        } else if (gz_load_chunk(gz, no) < 0 || !(c = gz_cache_find(gz, no))) {
+            break;
+        }
+        size_t in_chunk = (size_t)(pos - no * GZ_CHUNK);
+        if (in_chunk >= c->len) break;
+        size_t n = c->len - in_chunk;
+        if (n > len - done) n = len - done;
+        memcpy((char *)buf + done, c->data + in_chunk, n);
+        done += n;
     }
+    pthread_mutex_unlock(&gz->lock);
+    if (done == 0 && len > 0 && (uint64_t)off < gz->usize) {
+        errno = EIO;
+        return -1;
+    }
+    return (ssize_t)done;
 }
 
-// 기본 help 명령어
-void command_help_all() {
-    printf("Usage :\n");
-    printf("  > tree <PATH> [OPTION]... : display the directory structure if <PATH> is a directory\n");
-    printf("    -r : display the directory structure recursively if <PATH> is a directory\n");
-    printf("    -s : display the directory structure if <PATH> is a directory, including the size of each file\n");
-    printf("    -p : display the directory structure if <PATH> is a directory, including the permissions of each directory and file\n");
-    printf("  > print <PATH> [OPTION]... : print the contents on the standard output if <PATH> is a file\n");
-    printf("    -n <line_number> : print only the first <line_number> lines of its contents on the standard output if <PATH> is file\n");
-    printf("  > help [COMMAND] : show commands for program\n");
-    printf("  > exit : exit program\n");
+// ---------------------------------------------------------------------------
+// 공유 블록 캐시 (open으로 연 모든 이미지가 메모리 예산 하나를 나눠 씀)
+// ---------------------------------------------------------------------------
+
+// 키는 (이미지, 세대, 블록 번호), 내용은 128비트 해시 + 비교로 찾아 같은 블록 내용은 한 번만 저장
+// (같은 원본에서 만든 이미지들, 0으로 채운 블록 등은 예산을 한 번만 씀)
+// 예산을 넘으면 가장 오래 쓰지 않은 키부터 버리고, 가리키는 키가 없어진 내용을 해제
+static pthread_mutex_t bc_lock = PTHREAD_MUTEX_INITIALIZER;
+static BcImage *bc_images;       // 등록된 이미지 목록 (읽기는 잠금 없이, 바꾸는 것은 명령 사이에만)
+static uint32_t bc_next_id = 1;
+static BcKey **bc_keys;          // 키 해시 버킷
+static BcData **bc_datas;        // 내용 해시 버킷
+static uint32_t bc_nbuckets;     // 두 해시의 버킷 수 (2의 거듭제곱)
+static BcKey *bc_lru_head, *bc_lru_tail;
+static uint64_t bc_nkeys, bc_ndatas;
+static size_t bc_used;           // 키 + 내용이 쓰는 바이트 (bcache_budget과 비교)
+
+static uint32_t bc_key_slot(uint32_t id, uint32_t gen, uint64_t blk) {
+    uint64_t h = blk * 0x9E3779B97F4A7C15ULL ^ ((uint64_t)id << 32 | gen) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    return (uint32_t)h & (bc_nbuckets - 1);
 }
 
-// tree 명령어 help
-void command_help_tree() {
-    printf("Usage :\n");
-    printf("  > tree <PATH> [OPTION]... : display the directory structure if <PATH> is a directory\n");
-    printf("    -r : display the directory structure recursively if <PATH> is a directory\n");
-    printf("    -s : display the directory structure if <PATH> is a directory, including the size of each file\n");
-    printf("    -p : display the directory structure if <PATH> is a directory, including the permissions of each directory and file\n");
+// fd에 해당하는 캐시 이미지 (캐시를 쓰지 않는 이미지면 NULL)
+BcImage *bcache_find(int fd) {
+    for (BcImage *im = __atomic_load_n(&bc_images, __ATOMIC_ACQUIRE); im; im = im->next)
+        if (im->fd == fd)
+            return im;
+    return NULL;
 }
-// print 명령어 help
-void command_help_print() {
-    printf("Usage :\n");
-    printf("  > print <PATH> [OPTION]... : print the contents on the standard output if <PATH> is a file\n");
-    printf("    -n <line_number> : print only the first <line_number> lines of its contents on the standard output if <PATH> is file\n");
+
+// 이미지를 캐시에 등록 (예산이 0이면 아무것도 하지 않음)
+void bcache_register(int fd, uint32_t block_size) {
+    if (bcache_budget == 0 || bcache_find(fd)) return;
+    pthread_mutex_lock(&bc_lock);
+    if (!bc_keys) {
+        // 블록 하나(1KB 이상)당 버킷 하나 정도가 되도록
+        bc_nbuckets = 1024;
+        while (bc_nbuckets < (1u << 20) && (size_t)bc_nbuckets * 1024 < bcache_budget)
+            bc_nbuckets *= 2;
+        bc_keys = calloc(bc_nbuckets, sizeof(BcKey*));
+        bc_datas = calloc(bc_nbuckets, sizeof(BcData*));
+    }
+    BcImage *im = calloc(1, sizeof(BcImage));
+    im->fd = fd;
+    im->id = bc_next_id++;
+    im->block_size = block_size;
+    im->next = bc_images;
+    __atomic_store_n(&bc_images, im, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&bc_lock);
 }
-// exit 명령어 help
-void command_help_exit() {
-    printf("Usage :\n");
-    printf("  > exit : exit program\n");
+
+// 키 하나 제거: 내용을 가리키는 키가 더 없으면 내용도 해제
+static void bc_key_remove(BcKey *k) {
+    BcKey **p = &bc_keys[bc_key_slot(k->id, k->gen, k->blk)];
+    while (*p != k)
+        p = &(*p)->hnext;
+    *p = k->hnext;
+    if (k->lru_prev) k->lru_prev->lru_next = k->lru_next;
+    else bc_lru_head = k->lru_next;
+    if (k->lru_next) k->lru_next->lru_prev = k->lru_prev;
+    else bc_lru_tail = k->lru_prev;
+
+    BcData *d = k->data;
+    if (--d->refs == 0) {
+        BcData **dp = &bc_datas[(uint32_t)d->h1 & (bc_nbuckets - 1)];
+        while (*dp != d)
+            dp = &(*dp)->hnext;
+        *dp = d->hnext;
+        bc_used -= sizeof(BcData) + d->len;
+        bc_ndatas--;
+        free(d);
+    }
+    bc_used -= sizeof(BcKey);
+    bc_nkeys--;
+    free(k);
 }
-// help 명령어 help
-void command_help_help() {
-    printf("Usage :\n");
-    printf("  > help [COMMAND] : show commands for program\n");
+
+// 이미지 id의 키를 모두 제거
+static void bc_purge(uint32_t id) {
+    BcKey *k = bc_lru_head;
+    while (k) {
+        BcKey *next = k->lru_next;
+        if (k->id == id)
+            bc_key_remove(k);
+        k = next;
+    }
 }
 
+// 이미지가 바뀌었을 때 (reload, import): 세대를 올려 진행 중인 읽기가 옛 내용을 넣지 못하게 하고 모두 버림
+void bcache_invalidate(int fd) {
+    BcImage *im = bcache_find(fd);
+    if (!im) return;
+    pthread_mutex_lock(&bc_lock);
+    im->gen++;
+    bc_purge(im->id);
+    pthread_mutex_unlock(&bc_lock);
+}
 
-// 전체 경로 길이와 각 구성 요소 길이 검사
-bool validate_path(const char *path) {
-    size_t len = strlen(path);
-    if (len > PATH_MAX_LEN) {
-        fprintf(stderr, "Error: path length %zu exceeds maximum %d bytes\n",
-                len, PATH_MAX_LEN);
-        return false;
+// 이미지를 닫을 때: 목록에서 빼고 블록을 모두 버림
+void bcache_unregister(int fd) {
+    pthread_mutex_lock(&bc_lock);
+    BcImage **p = &bc_images;
+    while (*p && (*p)->fd != fd)
+        p = &(*p)->next;
+    BcImage *im = *p;
+    if (im) {
+        __atomic_store_n(p, im->next, __ATOMIC_RELEASE);
+        bc_purge(im->id);
     }
-    // 각 디렉터리/파일 이름 부분 검사
-    // strdupa나 strdup을 쓰지 않고 안전하게 복사
-    char buf[PATH_MAX_LEN + 1];
-    strncpy(buf, path, PATH_MAX_LEN);
-    buf[PATH_MAX_LEN] = '\0';
+    pthread_mutex_unlock(&bc_lock);
+    free(im);
+}
 
-    char *p = buf;
-    char *tok;
-    while ((tok = strsep(&p, "/")) != NULL) {
-        if (strlen(tok) > EXT2_NAME_LEN) {
-            fprintf(stderr,
-                    "Error: component '%s' length %zu exceeds maximum %d bytes\n",
-                    tok, strlen(tok), EXT2_NAME_LEN);
-            return false;
+// 캐시에서 블록 찾기 (찾으면 LRU 맨 앞으로), bc_lock을 잡고 호출
+static BcKey *bc_lookup(const BcImage *im, uint64_t blk) {
+    BcKey *k = bc_keys[bc_key_slot(im->id, im->gen, blk)];
+    while (k && (k->id != im->id || k->gen != im->gen || k->blk != blk))
+        k = k->hnext;
+    if (k && k != bc_lru_head) {
+        k->lru_prev->lru_next = k->lru_next;
+        if (k->lru_next) k->lru_next->lru_prev = k->lru_prev;
+        else bc_lru_tail = k->lru_prev;
+        k->lru_prev = NULL;
+        k->lru_next = bc_lru_head;
+        bc_lru_head->lru_prev = k;
+        bc_lru_head = k;
+    }
+    return k;
+}
+
+// 읽은 연속 블록 n개를 캐시에 넣음 (읽기 시작할 때의 세대 gen이 지났으면 버림)
+// 해시는 잠금 밖에서 계산하고, 같은 내용이 이미 있으면 그 내용을 함께 가리킴
+static void bc_store(BcImage *im, uint32_t gen, uint64_t blk, const unsigned char *buf, uint32_t n) {
+    if (n == 0) return;
+    uint32_t bs = im->block_size;
+    DupHash *hs = malloc(sizeof(DupHash) * n);
+    for (uint32_t i = 0; i < n; i++) {
+        dup_hash_init(&hs[i], 0);
+        dup_hash_update(&hs[i], (const char *)buf + (size_t)i * bs, bs);
+        dup_hash_final(&hs[i], bs);
+    }
+    pthread_mutex_lock(&bc_lock);
+    for (uint32_t i = 0; i < n && gen == im->gen; i++) {
+        const unsigned char *src = buf + (size_t)i * bs;
+        uint32_t ks = bc_key_slot(im->id, gen, blk + i);
+        BcKey *k = bc_keys[ks];
+        while (k && (k->id != im->id || k->gen != gen || k->blk != blk + i))
+            k = k->hnext;
+        if (k) continue;     // 다른 스레드가 먼저 넣음
+
+        uint32_t ds = (uint32_t)hs[i].h1 & (bc_nbuckets - 1);
+        BcData *d = bc_datas[ds];
+        while (d && (d->h1 != hs[i].h1 || d->h2 != hs[i].h2 || d->len != bs || memcmp(d->data, src, bs) != 0))
+            d = d->hnext;
+        if (!d) {
+            d = malloc(sizeof(BcData) + bs);
+            d->h1 = hs[i].h1;
+            d->h2 = hs[i].h2;
+            d->len = bs;
+            d->refs = 0;
+            memcpy(d->data, src, bs);
+            d->hnext = bc_datas[ds];
+            bc_datas[ds] = d;
+            bc_used += sizeof(BcData) + bs;
+            bc_ndatas++;
         }
+        d->refs++;
+
+        k = malloc(sizeof(BcKey));
+        k->id = im->id;
+        k->gen = gen;
+        k->blk = blk + i;
+        k->data = d;
+        k->hnext = bc_keys[ks];
+        bc_keys[ks] = k;
+        k->lru_prev = NULL;
+        k->lru_next = bc_lru_head;
+        if (bc_lru_head) bc_lru_head->lru_prev = k;
+        else bc_lru_tail = k;
+        bc_lru_head = k;
+        bc_used += sizeof(BcKey);
+        bc_nkeys++;
     }
+    while (bc_used > bcache_budget && bc_lru_tail)
+        bc_key_remove(bc_lru_tail);
+    pthread_mutex_unlock(&bc_lock);
+    free(hs);
+}
+
+// 블록 blk의 내용 중 [off, off+len) 요청과 겹치는 부분을 dst(요청 버퍼)로 복사, 복사한 바이트 수
+static size_t bc_copy_part(uint32_t bs, uint64_t blk, const unsigned char *src, size_t valid,
+                           void *dst, size_t len, off_t off) {
+    uint64_t bstart = blk * bs, rstart = (uint64_t)off, rend = (uint64_t)off + len;
+    uint64_t s = bstart > rstart ? bstart : rstart;
+    uint64_t e = bstart + valid < rend ? bstart + valid : rend;
+    if (e <= s) return 0;
+    memcpy((char *)dst + (s - rstart), src + (s - bstart), (size_t)(e - s));
+    return (size_t)(e - s);
+}
+
+// 요청 하나에 걸친 블록이 모두 캐시에 있으면 복사하고 true, bc_lock을 잡고 호출
+static bool bc_serve(const BcImage *im, void *buf, size_t len, off_t off) {
+    uint32_t bs = im->block_size;
+    uint64_t first = (uint64_t)off / bs, last = ((uint64_t)off + len - 1) / bs;
+    for (uint64_t b = first; b <= last; b++)
+        if (!bc_lookup(im, b)) return false;
+    for (uint64_t b = first; b <= last; b++)
+        bc_copy_part(bs, b, bc_lookup(im, b)->data->data, bs, buf, len, off);
     return true;
 }
 
-// 경로 문자열(path)에 해당하는 노드를 트리에서 찾아 반환
-// current: 상대 경로 탐색 시 기준이 될 노드 (대부분 root)
-// path   : 절대("/") 또는 상대(".") 경로, 또는 "dir/sub/file" 등
-Node* find_node(Node* current, const char* path) {
-    if (strcmp(path, "/") == 0 || strcmp(path, ".") == 0)
-        return root;   // "/" 또는 "." 는 언제나 루트 디렉토리
+// 캐시를 거치는 작은 읽기 (pread와 같은 의미): 없는 블록만 이어지는 것끼리 블록 단위로 읽어 채움
+ssize_t bcache_pread(BcImage *im, void *buf, size_t len, off_t off) {
+    if (len == 0 || off < 0)
+        return img_pread_raw(im->fd, buf, len, off);
+    uint32_t bs = im->block_size;
+    uint64_t first = (uint64_t)off / bs, last = ((uint64_t)off + len - 1) / bs;
+    uint32_t nb = (uint32_t)(last - first + 1);
+    bool hit[BCACHE_MAX_REQ_BLOCKS + 1];
+    uint32_t nhit = 0;
 
-    // 절대 경로라면 root부터, 상대 경로면 current 노드부터 탐색 시작
-    Node* cur = (path[0] == '/') ? root : current;
-    char* buf = strdup(path);
-    char* tok = strtok(buf, "/");
-    // 토큰(디렉토리/파일 이름)마다 하위 노드로 이동
-    while (tok && cur) {
-        Node* child = cur->first_child;
-        Node* next = NULL;
-        // 현재 노드(cur)의 자식들 중에서 이름이 일치하는 노드 찾기
-        while (child) {
-            if (strcmp(child->name, tok) == 0) {
-                next = child;
-                break;
-            }
-            child = child->next_sibling;
+    pthread_mutex_lock(&bc_lock);
+    uint32_t gen = im->gen;
+    for (uint32_t i = 0; i < nb; i++) {
+        BcKey *k = bc_lookup(im, first + i);
+        hit[i] = k != NULL;
+        if (k) {
+            bc_copy_part(bs, first + i, k->data->data, bs, buf, len, off);
+            nhit++;
         }
-        // 찾은 자식으로 현재 위치 이동
-        cur = next;
-        tok = strtok(NULL, "/");
     }
-    // 복제했던 메모리 해제
-    free(buf);
-    return cur;
+    pthread_mutex_unlock(&bc_lock);
+    stat_add(STAT_BCACHE_HITS, nhit);
+    if (nhit == nb)
+        return (ssize_t)len;
+    stat_add(STAT_BCACHE_MISSES, nb - nhit);
+
+    // 요청 앞에서부터 이어서 채운 바이트 수 (파일 끝이나 오류에서 멈춤)
+    uint64_t valid_end = (uint64_t)off + len;
+    unsigned char *tmp = malloc((size_t)nb * bs);
+    for (uint32_t i = 0; i < nb; ) {
+        if (hit[i]) { i++; continue; }
+        uint32_t j = i;
+        while (j + 1 < nb && !hit[j + 1])
+            j++;
+        size_t want = (size_t)(j - i + 1) * bs, got = 0;
+        while (got < want) {
+            ssize_t r = img_pread_raw(im->fd, tmp + got, want - got, (off_t)((first + i) * bs + got));
+            if (r <= 0) break;
+            got += (size_t)r;
+        }
+        bc_store(im, gen, first + i, tmp, (uint32_t)(got / bs));
+        for (uint32_t k = i; k <= j; k++) {
+            size_t at = (size_t)(k - i) * bs;
+            bc_copy_part(bs, first + k, tmp + at, got > at ? (got - at < bs ? got - at : bs) : 0, buf, len, off);
+        }
+        if (got < want && (first + i) * bs + got < valid_end)
+            valid_end = (first + i) * bs + got;
+        i = j + 1;
+    }
+    free(tmp);
+    if (valid_end <= (uint64_t)off)
+        return -1;
+    return (ssize_t)(valid_end - (uint64_t)off);
 }
 
+static int bc_u64_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
 
-// 트리 구조의 모든 노드를 재귀적으로 해제하는 함수
-void free_tree(Node* n) {
-    //  자식 노드부터 순회하며 재귀적으로 해제
-    Node* c = n->first_child;
-    while (c) {
-        Node* next = c->next_sibling;  // 다음 형제 노드를 미리 저장
-        free_tree(c);   // 자식 서브트리 해제
-        c = next;       // 다음 형제로 이동
+// 캐시를 거치는 일괄 읽기 (io_read_batch와 같은 의미)
+// 블록이 모두 캐시에 있는 요청은 바로 채우고, 나머지 요청들의 블록은 중복을 없애고 이어지는 것끼리 묶어
+// 큰 요청(파일 내용)과 함께 한 번의 일괄 읽기로 처리
+int bcache_read_batch(BcImage *im, IoReq *reqs, int n) {
+    uint32_t bs = im->block_size;
+    size_t max_len = (size_t)BCACHE_MAX_REQ_BLOCKS * bs;
+    char *state = calloc(n ? n : 1, 1);   // 0: 캐시에서 채움, 1: 캐시 실패, 2: 캐시 우회
+    uint64_t *need = NULL;
+    size_t nneed = 0, cap = 0;
+    int nbig = 0;
+    uint64_t hits = 0;
+
+    pthread_mutex_lock(&bc_lock);
+    uint32_t gen = im->gen;
+    for (int i = 0; i < n; i++) {
+        IoReq *r = &reqs[i];
+        if (r->len == 0 || r->len > max_len || r->off < 0) {
+            state[i] = 2;
+            nbig++;
+            continue;
+        }
+        uint64_t first = (uint64_t)r->off / bs, last = ((uint64_t)r->off + r->len - 1) / bs;
+        if (bc_serve(im, r->buf, r->len, r->off)) {
+            r->res = (ssize_t)r->len;
+            hits += last - first + 1;
+            continue;
+        }
+        state[i] = 1;
+        for (uint64_t b = first; b <= last; b++) {
+            if (nneed == cap) {
+                cap = cap ? cap * 2 : 64;
+                need = realloc(need, sizeof(uint64_t) * cap);
+            }
+            need[nneed++] = b;
+        }
     }
-    //  현재 노드의 리소스 해제
-    free(n->name);  // strdup으로 할당된 이름 문자열 메모리 해제
-    free(n);   // 노드 구조체 메모리 해제
+    pthread_mutex_unlock(&bc_lock);
+    stat_add(STAT_BCACHE_HITS, hits);
+    if (nneed == 0 && nbig == 0) {
+        free(state);
+        return 0;
+    }
+
+    // 필요한 블록 정렬/중복 제거 후 이어지는 블록끼리 요청 하나로
+    if (nneed > 1)
+        qsort(need, nneed, sizeof(uint64_t), bc_u64_cmp);
+    size_t u = 0;
+    for (size_t i = 0; i < nneed; i++)
+        if (u == 0 || need[i] != need[u - 1])
+            need[u++] = need[i];
+    nneed = u;
+    stat_add(STAT_BCACHE_MISSES, nneed);
+
+    unsigned char *data = malloc(nneed ? nneed * bs : 1);
+    size_t *run_at = malloc(sizeof(size_t) * (nneed + 1));   // 각 묶음의 첫 need 인덱스
+    IoReq *raw = malloc(sizeof(IoReq) * (nneed + nbig + 1));
+    int nraw = 0;
+    for (size_t i = 0; i < nneed; ) {
+        size_t j = i + 1;
+        while (j < nneed && need[j] == need[j - 1] + 1 && j - i < BCACHE_RUN_BLOCKS)
+            j++;
+        run_at[nraw] = i;
+        raw[nraw].buf = data + i * bs;
+        raw[nraw].len = (j - i) * bs;
+        raw[nraw].off = (off_t)(need[i] * bs);
+        nraw++;
+        i = j;
+    }
+    int nruns = nraw;
+    run_at[nruns] = nneed;
+    for (int i = 0; i < n; i++)
+        if (state[i] == 2)
+            raw[nraw++] = reqs[i];
+
+    int failed = 0;
+    io_read_batch_raw(im->fd, raw, nraw);
+
+    // 큰 요청 결과 돌려주기
+    for (int i = 0, k = nruns; i < n; i++) {
+        if (state[i] != 2) continue;
+        reqs[i].res = raw[k++].res;
+        if (reqs[i].res != (ssize_t)reqs[i].len) failed++;
+    }
+
+    // 블록마다 유효한 바이트 수 (파일 끝에서 짧게 읽힌 묶음), 온전히 읽은 블록만 캐시에 넣음
+    uint32_t *valid = malloc(sizeof(uint32_t) * (nneed ? nneed : 1));
+    for (int r = 0; r < nruns; r++) {
+        size_t got = raw[r].res > 0 ? (size_t)raw[r].res : 0;
+        for (size_t k = run_at[r]; k < run_at[r + 1]; k++) {
+            size_t at = (k - run_at[r]) * bs;
+            valid[k] = got > at ? (uint32_t)(got - at < bs ? got - at : bs) : 0;
+        }
+        bc_store(im, gen, need[run_at[r]], data + run_at[r] * bs, (uint32_t)(got / bs));
+    }
+
+    // 캐시에 없던 요청 채우기: 앞에서부터 이어서 채운 만큼이 res
+    for (int i = 0; i < n; i++) {
+        if (state[i] != 1) continue;
+        IoReq *r = &reqs[i];
+        uint64_t first = (uint64_t)r->off / bs, last = ((uint64_t)r->off + r->len - 1) / bs;
+        size_t done = 0;
+        for (uint64_t b = first; b <= last; b++) {
+            uint64_t *pos = bsearch(&b, need, nneed, sizeof(uint64_t), bc_u64_cmp);
+            size_t k = (size_t)(pos - need);
+            size_t c = bc_copy_part(bs, b, data + k * bs, valid[k], r->buf, r->len, r->off);
+            done += c;
+            if (valid[k] < bs) break;
+        }
+        r->res = (ssize_t)(done < r->len ? done : r->len);
+        if (r->res != (ssize_t)r->len) failed++;
+    }
+
+    free(valid);
+    free(raw);
+    free(run_at);
+    free(data);
+    free(need);
+    free(state);
+    return failed;
 }
 
-int collect_data_blocks(int img_fd,
-                               const struct ext2_inode *ino,
-                               unsigned int block_size,
-                               uint32_t **out_blocks)
-{
-    unsigned int ptrs_per_block = block_size / sizeof(uint32_t);
-    // direct(12) + single + double*ptrs_per + triple*ptrs_per*ptrs_per
-    int cap = 12 + ptrs_per_block + ptrs_per_block*ptrs_per_block + ptrs_per_block*ptrs_per_block*ptrs_per_block;
-    uint32_t *blocks = malloc(sizeof(uint32_t) * cap);
-    int cnt = 0;
+// 캐시 사용량: 캐시한 블록 수, 그중 서로 다른 내용 수, 쓰는 바이트
+void bcache_usage(uint64_t *keys, uint64_t *unique, uint64_t *bytes) {
+    pthread_mutex_lock(&bc_lock);
+    *keys = bc_nkeys;
+    *unique = bc_ndatas;
+    *bytes = bc_used;
+    pthread_mutex_unlock(&bc_lock);
+}
 
-    // 1) direct blocks
-    for (int i = 0; i < 12; i++)
-        if (ino->i_block[i])
-            blocks[cnt++] = ino->i_block[i];
-
-    // 2) single indirect
-    if (ino->i_block[12]) {
-        uint32_t *ptrs = malloc(block_size);
-        pread(img_fd, ptrs, block_size, (off_t)ino->i_block[12] * block_size);
-        for (unsigned i = 0; i < ptrs_per_block; i++)
-            if (ptrs[i])
-                blocks[cnt++] = ptrs[i];
-        free(ptrs);
-    }
-
-    // 3) double indirect
-    if (ino->i_block[13]) {
-        uint32_t *ind = malloc(block_size);
-        pread(img_fd, ind, block_size, (off_t)ino->i_block[13] * block_size);
-        for (unsigned i = 0; i < ptrs_per_block; i++) {
-            if (!ind[i]) continue;
-            uint32_t *ptrs = malloc(block_size);
-            pread(img_fd, ptrs, block_size, (off_t)ind[i] * block_size);
-            for (unsigned j = 0; j < ptrs_per_block; j++)
-                if (ptrs[j])
-                    blocks[cnt++] = ptrs[j];
-            free(ptrs);
-        }
-        free(ind);
-    }
-
-    // 4) triple indirect
-    if (ino->i_block[14]) {
-        uint32_t *dbl = malloc(block_size);
-        pread(img_fd, dbl, block_size, (off_t)ino->i_block[14] * block_size);
-        for (unsigned i = 0; i < ptrs_per_block; i++) {
-            if (!dbl[i]) continue;
-            uint32_t *ind = malloc(block_size);
-            pread(img_fd, ind, block_size, (off_t)dbl[i] * block_size);
-            for (unsigned j = 0; j < ptrs_per_block; j++) {
-                if (!ind[j]) continue;
-                uint32_t *ptrs = malloc(block_size);
-                pread(img_fd, ptrs, block_size, (off_t)ind[j] * block_size);
-                for (unsigned k = 0; k < ptrs_per_block; k++)
-                    if (ptrs[k])
-                        blocks[cnt++] = ptrs[k];
-                free(ptrs);
-            }
-            free(ind);
-        }
-        free(dbl);
+// ---------------------------------------------------------------------------
+// inode 테이블 미리 읽기 (--prefetch)
+// ---------------------------------------------------------------------------
+
+// 시작 이미지의 inode 테이블을 그룹 순서대로 작은 단위로 읽어 페이지 캐시를 채움
+// 스레드는 I/O idle 클래스 + 가장 낮은 CPU 우선순위로 돌고, 명령이 실행 중이면(prefetch_busy) 멈춤
+// 이미지 fd를 복제해 쓰므로 use/close로 이미지를 바꿔도 영향이 없음
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+static int prefetch_busy;            // 실행 중인 명령 수
+static bool prefetch_stop;
+static bool prefetch_running;
+static bool prefetch_used;           // 시작한 적이 있음 (스레드가 끝난 뒤에도 stats에 표시)
+static pthread_t prefetch_tid;
+static int prefetch_fd = -1;
+static uint32_t prefetch_block_size;
+static uint32_t prefetch_itable_blocks;   // 그룹 하나의 inode 테이블 블록 수
+static uint32_t *prefetch_tables;    // 읽을 그룹들의 inode 테이블 시작 블록
+static uint32_t prefetch_ntables;
+static uint32_t prefetch_done;       // 다 읽은 그룹 수
+static uint64_t prefetch_bytes;      // 읽은 바이트
+static uint64_t prefetch_pauses;     // 명령 때문에 멈춘 횟수
+static double prefetch_ms;           // 마지막 그룹까지 걸린 시간 (명령 때문에 멈춘 시간 제외)
+static double prefetch_paused_ms;    // 명령 때문에 멈춰 있던 시간
+static bool prefetch_complete;       // 모든 그룹을 다 읽음 (prefetch_ms가 유효)
+
+static void *prefetch_worker(void *arg) {
+    (void)arg;
+    // 다른 I/O가 없을 때만 디스크를 쓰고, CPU도 양보 (지원하지 않는 커널이면 그냥 진행)
+    syscall(SYS_ioprio_set, PREFETCH_IOPRIO_WHO, 0, PREFETCH_IOPRIO_IDLE);
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t chunk = (size_t)PREFETCH_CHUNK_BLOCKS * prefetch_block_size;
+    char *buf = malloc(chunk);
+    bool stop = false;
+    for (uint32_t i = 0; i < prefetch_ntables && !stop; i++) {
+        for (uint32_t tb = 0; tb < prefetch_itable_blocks && !stop; tb += PREFETCH_CHUNK_BLOCKS) {
+            // 명령이 끝날 때까지 대기
+            pthread_mutex_lock(&prefetch_lock);
+            if (prefetch_busy && !prefetch_stop) {
+                struct timespec p0, p1;
+                clock_gettime(CLOCK_MONOTONIC, &p0);
+                __atomic_add_fetch(&prefetch_pauses, 1, __ATOMIC_RELAXED);
+                while (prefetch_busy && !prefetch_stop)
+                    pthread_cond_wait(&prefetch_cond, &prefetch_lock);
+                clock_gettime(CLOCK_MONOTONIC, &p1);
+                double pms = (p1.tv_sec - p0.tv_sec) * 1e3 + (p1.tv_nsec - p0.tv_nsec) / 1e6;
+                prefetch_paused_ms += pms;
+            }
+            stop = prefetch_stop;
+            pthread_mutex_unlock(&prefetch_lock);
+            if (stop) break;
+
+            uint32_t nb = prefetch_itable_blocks - tb < PREFETCH_CHUNK_BLOCKS
+                          ? prefetch_itable_blocks - tb : PREFETCH_CHUNK_BLOCKS;
+            ssize_t got = pread(prefetch_fd, buf, (size_t)nb * prefetch_block_size,
+                                (off_t)(prefetch_tables[i] + tb) * prefetch_block_size);
+            if (got > 0)
+                __atomic_add_fetch(&prefetch_bytes, (uint64_t)got, __ATOMIC_RELAXED);
+        }
+        if (!stop)
+            __atomic_add_fetch(&prefetch_done, 1, __ATOMIC_RELAXED);
+    }
+    free(buf);
+    if (!stop) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        pthread_mutex_lock(&prefetch_lock);
+        prefetch_ms = ms - prefetch_paused_ms;
+        prefetch_complete = true;
+        pthread_mutex_unlock(&prefetch_lock);
+    }
+    return NULL;
+}
+
+// 현재(시작) 이미지로 미리 읽기 스레드 시작
+void prefetch_start(void) {
+    if (img_gz) {
+        fprintf(stderr, "prefetch: not used for compressed images\n");
+        return;
+    }
+    prefetch_fd = dup(img_fd);
+    if (prefetch_fd < 0) {
+        perror("prefetch: dup");
+        return;
+    }
+    prefetch_block_size = block_size;
+    prefetch_itable_blocks = (inodes_per_group * inode_size + block_size - 1) / block_size;
+    prefetch_tables = malloc(sizeof(uint32_t) * (group_count ? group_count : 1));
+    prefetch_ntables = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        // 초기화되지 않은 inode 테이블(ext4 INODE_UNINIT)은 읽을 필요 없음
+        if ((gdt[g].bg_pad & EXT4_BG_INODE_UNINIT) && ext4_group_flags_valid())
+            continue;
+        prefetch_tables[prefetch_ntables++] = gdt[g].bg_inode_table;
+    }
+    if (pthread_create(&prefetch_tid, NULL, prefetch_worker, NULL) != 0) {
+        perror("prefetch: pthread_create");
+        close(prefetch_fd);
+        free(prefetch_tables);
+        return;
     }
+    prefetch_running = true;
+    prefetch_used = true;
+}
 
-    *out_blocks = blocks;
-    return cnt;
+// 명령 시작(busy)/끝: 실행 중인 명령이 없을 때만 미리 읽기 진행
+void prefetch_hold(bool busy) {
+    if (!prefetch_running) return;
+    pthread_mutex_lock(&prefetch_lock);
+    if (busy)
+        prefetch_busy++;
+    else if (--prefetch_busy == 0)
+        pthread_cond_signal(&prefetch_cond);
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+// 종료할 때: 진행 중이면 지금 읽는 단위까지만 하고 멈춤
+// 카운터는 그대로 두므로 이후의 stats(--stats 종료 출력)에도 최종 값이 나옴
+void prefetch_finish(void) {
+    if (!prefetch_running) return;
+    pthread_mutex_lock(&prefetch_lock);
+    prefetch_stop = true;
+    pthread_cond_signal(&prefetch_cond);
+    pthread_mutex_unlock(&prefetch_lock);
+    pthread_join(prefetch_tid, NULL);
+    close(prefetch_fd);
+    free(prefetch_tables);
+    prefetch_tables = NULL;
+    prefetch_running = false;
+}
+
+// stats 한 줄: 진행 상황
+void prefetch_report(FILE *out) {
+    if (!prefetch_used) return;
+    uint32_t done = __atomic_load_n(&prefetch_done, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&prefetch_lock);
+    bool complete = prefetch_complete;
+    double ms = prefetch_ms, paused_ms = prefetch_paused_ms;
+    pthread_mutex_unlock(&prefetch_lock);
+    fprintf(out, "prefetch: %u of %u inode tables, %.1f MB read, paused %llu times (%.3f ms) for commands",
+            done, prefetch_ntables, __atomic_load_n(&prefetch_bytes, __ATOMIC_RELAXED) / (1024.0 * 1024.0),
+            (unsigned long long)__atomic_load_n(&prefetch_pauses, __ATOMIC_RELAXED), paused_ms);
+    if (complete)
+        fprintf(out, ", finished in %.3f ms of reading", ms);
+    fputc('\n', out);
 }
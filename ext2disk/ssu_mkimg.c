@@ -0,0 +1,886 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// ssu_ext2 벤치마크용 ext2 이미지 생성기
+// 지정한 모양(깊이, 팬아웃, 큰 디렉토리, 간접 블록을 쓰는 큰 파일, 희소 파일)의
+// 트리를 mke2fs 없이 직접 써서 e2fsck로 검사해도 깨끗한 이미지를 만듦
+// 같은 옵션이면 항상 바이트 단위로 같은 이미지가 나오도록 시간/UUID/내용을 고정
+
+#define SUPERBLOCK_OFFSET 1024
+#define EXT2_SUPER_MAGIC 0xEF53
+#define EXT2_ROOT_INO 2
+#define EXT2_GOOD_OLD_FIRST_INO 11
+#define EXT2_INODE_SIZE 128
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+#define MKIMG_TIME 1700000000u      // 모든 inode/슈퍼블록 시간 (재현 가능한 이미지)
+#define MKIMG_MAX_FILES 16          // -L / -P 로 만들 수 있는 파일 수
+#define MKIMG_WRITE_BLOCKS 256      // 연속 데이터 블록을 모아 한 번에 쓰는 최대 블록 수
+#define MKIMG_NAME_LEN 32
+
+// 슈퍼블록 (rev 1에서 쓰는 필드까지, 나머지는 0)
+struct ext2_super_block {
+    uint32_t s_inodes_count;
+    uint32_t s_blocks_count;
+    uint32_t s_r_blocks_count;
+    uint32_t s_free_blocks_count;
+    uint32_t s_free_inodes_count;
+    uint32_t s_first_data_block;
+    uint32_t s_log_block_size;
+    uint32_t s_log_frag_size;
+    uint32_t s_blocks_per_group;
+    uint32_t s_frags_per_group;
+    uint32_t s_inodes_per_group;
+    uint32_t s_mtime;
+    uint32_t s_wtime;
+    uint16_t s_mnt_count;
+    int16_t  s_max_mnt_count;
+    uint16_t s_magic;
+    uint16_t s_state;
+    uint16_t s_errors;
+    uint16_t s_minor_rev_level;
+    uint32_t s_lastcheck;
+    uint32_t s_checkinterval;
+    uint32_t s_creator_os;
+    uint32_t s_rev_level;
+    uint16_t s_def_resuid;
+    uint16_t s_def_resgid;
+    uint32_t s_first_ino;
+    uint16_t s_inode_size;
+    uint16_t s_block_group_nr;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    char     s_volume_name[16];
+    char     s_last_mounted[64];
+    uint8_t  s_padding[1024 - 200];
+};
+
+// 그룹 디스크립터 (32바이트)
+struct ext2_group_desc {
+    uint32_t bg_block_bitmap;
+    uint32_t bg_inode_bitmap;
+    uint32_t bg_inode_table;
+    uint16_t bg_free_blocks_count;
+    uint16_t bg_free_inodes_count;
+    uint16_t bg_used_dirs_count;
+    uint16_t bg_pad;
+    uint32_t bg_reserved[3];
+};
+
+// inode (128바이트)
+struct ext2_inode {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks;
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[15];
+    uint32_t i_generation;
+    uint32_t i_file_acl;
+    uint32_t i_size_high;
+    uint32_t i_faddr;
+    uint8_t  i_osd2[12];
+};
+
+// 만들 트리의 항목 하나
+typedef struct Entry {
+    char name[MKIMG_NAME_LEN];
+    uint8_t type;            // EXT2_FT_REG_FILE / EXT2_FT_DIR
+    uint32_t ino;
+    int parent;              // 부모 항목 번호 (루트는 자기 자신)
+    int *kids;               // 디렉토리의 자식 항목 번호
+    int nkids, cap;
+    int nsubdirs;
+    uint64_t size;           // 파일 크기 (디렉토리는 블록 수로 계산)
+    uint32_t *present;       // 희소 파일에서 데이터가 있는 논리 블록 (NULL이면 전부)
+    int npresent;
+} Entry;
+
+// 간접 블록 한 단계의 현재 버퍼 (논리 블록이 증가하는 순서로만 채우므로 높이마다 하나면 충분)
+typedef struct IndLevel {
+    uint32_t phys;
+    uint32_t *buf;
+} IndLevel;
+
+// 생성기 전체 상태
+typedef struct Gen {
+    // 모양 옵션
+    uint32_t block_size;
+    int depth, fanout, files;
+    uint64_t file_size;
+    int huge;
+    uint64_t large[MKIMG_MAX_FILES];
+    int nlarge;
+    uint64_t sparse[MKIMG_MAX_FILES];
+    int nsparse;
+    uint64_t min_bytes;
+    uint32_t seed;
+    // 항목
+    Entry *ents;
+    int nents, cap;
+    // 레이아웃
+    uint32_t ptrs;           // 블록 하나에 들어가는 블록 번호 수
+    uint32_t groups, blocks_per_group, inodes_per_group, itable_blocks, gdt_blocks;
+    uint32_t blocks_count, inodes_count, first_data;
+    bool large_file;
+    uint8_t *bbm, *ibm;      // 전체 블록/inode 비트맵 (그룹마다 블록 하나 크기)
+    struct ext2_group_desc *gds;
+    uint32_t cursor;         // 다음 할당 후보 블록
+    // 쓰기
+    int fd;
+    bool counting;           // true면 할당/쓰기 없이 블록 수만 셈
+    uint64_t counted;
+    IndLevel lv[4];
+    uint8_t *wbuf;           // 연속 데이터 블록 모음
+    uint32_t wstart, wcount;
+    uint8_t *itbuf;          // 현재 그룹의 inode 테이블
+    int itgroup;
+    uint8_t *pattern;        // 파일 내용 기본 패턴 (블록 하나)
+    uint64_t data_blocks, ind_blocks, dir_blocks, bytes_written;
+} Gen;
+
+static void die(const char *msg) {
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+static void *xcalloc(size_t n, size_t sz) {
+    void *p = calloc(n ? n : 1, sz);
+    if (!p) die("calloc");
+    return p;
+}
+
+// "64M", "4G", "512K" 같은 크기 문자열 해석
+static bool parse_size(const char *s, uint64_t *out) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno || end == s) return false;
+    uint64_t mul = 1;
+    if (*end == 'k' || *end == 'K') mul = 1ULL << 10, end++;
+    else if (*end == 'm' || *end == 'M') mul = 1ULL << 20, end++;
+    else if (*end == 'g' || *end == 'G') mul = 1ULL << 30, end++;
+    if (*end != '\0') return false;
+    *out = v * mul;
+    return true;
+}
+
+static bool parse_int(const char *s, int lo, int hi, int *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno || end == s || *end != '\0' || v < lo || v > hi) return false;
+    *out = (int)v;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// 트리 모양 만들기
+// ---------------------------------------------------------------------------
+
+static int add_entry(Gen *g, int parent, const char *name, uint8_t type, uint64_t size) {
+    if (g->nents == g->cap) {
+        g->cap = g->cap ? g->cap * 2 : 1024;
+        g->ents = realloc(g->ents, sizeof(Entry) * g->cap);
+        if (!g->ents) die("realloc");
+    }
+    int id = g->nents++;
+    Entry *e = &g->ents[id];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->type = type;
+    e->size = size;
+    e->parent = parent < 0 ? id : parent;
+    if (parent >= 0) {
+        Entry *p = &g->ents[parent];
+        if (p->nkids == p->cap) {
+            p->cap = p->cap ? p->cap * 2 : 8;
+            p->kids = realloc(p->kids, sizeof(int) * p->cap);
+            if (!p->kids) die("realloc");
+        }
+        p->kids[p->nkids++] = id;
+        if (type == EXT2_FT_DIR) p->nsubdirs++;
+    }
+    return id;
+}
+
+// 파일 크기를 평균 file_size 근처에서 항목마다 다르게 (seed가 같으면 같은 값)
+static uint64_t vary_size(const Gen *g, uint32_t n) {
+    uint32_t h = (n + 1) * 2654435761u ^ g->seed * 2246822519u;
+    h ^= h >> 15;
+    return g->file_size * (h % 200) / 100;
+}
+
+// 깊이 depth까지 디렉토리마다 하위 디렉토리 fanout개와 파일 files개
+static void add_level(Gen *g, int dir, int level, uint32_t *serial) {
+    char name[MKIMG_NAME_LEN];
+    for (int i = 0; i < g->files; i++) {
+        snprintf(name, sizeof(name), "file%03d.txt", i);
+        add_entry(g, dir, name, EXT2_FT_REG_FILE, vary_size(g, (*serial)++));
+    }
+    if (level >= g->depth) return;
+    for (int i = 0; i < g->fanout; i++) {
+        snprintf(name, sizeof(name), "d%02d", i);
+        int sub = add_entry(g, dir, name, EXT2_FT_DIR, 0);
+        add_level(g, sub, level + 1, serial);
+    }
+}
+
+// 희소 파일: 직접/단일/이중/삼중 간접 영역의 첫 블록과 마지막 블록에만 데이터
+static void make_sparse(Gen *g, Entry *e) {
+    uint64_t nblocks = (e->size + g->block_size - 1) / g->block_size;
+    uint64_t p = g->ptrs;
+    uint64_t marks[] = { 0, EXT2_NDIR_BLOCKS, EXT2_NDIR_BLOCKS + p,
+                         EXT2_NDIR_BLOCKS + p + p * p, nblocks ? nblocks - 1 : 0 };
+    e->present = xcalloc(5, sizeof(uint32_t));
+    for (int i = 0; i < 5; i++) {
+        if (marks[i] >= nblocks) continue;
+        if (e->npresent && e->present[e->npresent - 1] >= marks[i]) continue;
+        e->present[e->npresent++] = (uint32_t)marks[i];
+    }
+}
+
+static void build_shape(Gen *g) {
+    char name[MKIMG_NAME_LEN];
+    int root = add_entry(g, -1, "", EXT2_FT_DIR, 0);
+    add_entry(g, root, "lost+found", EXT2_FT_DIR, 0);
+    uint32_t serial = 0;
+    if (g->depth >= 0) {
+        int tree = add_entry(g, root, "tree", EXT2_FT_DIR, 0);
+        add_level(g, tree, 0, &serial);
+    }
+    if (g->huge > 0) {
+        int huge = add_entry(g, root, "huge", EXT2_FT_DIR, 0);
+        for (int i = 0; i < g->huge; i++) {
+            snprintf(name, sizeof(name), "entry%07d", i);
+            add_entry(g, huge, name, EXT2_FT_REG_FILE, 0);
+        }
+    }
+    for (int i = 0; i < g->nlarge; i++) {
+        snprintf(name, sizeof(name), "large%d", i);
+        add_entry(g, root, name, EXT2_FT_REG_FILE, g->large[i]);
+    }
+    for (int i = 0; i < g->nsparse; i++) {
+        snprintf(name, sizeof(name), "sparse%d", i);
+        int id = add_entry(g, root, name, EXT2_FT_REG_FILE, g->sparse[i]);
+        make_sparse(g, &g->ents[id]);
+    }
+}
+
+// 루트와 lost+found를 빼고 트리 순서(깊이 우선)대로 inode 번호 부여
+static void assign_inodes(Gen *g, int id, uint32_t *next) {
+    Entry *e = &g->ents[id];
+    if (id == 0) e->ino = EXT2_ROOT_INO;
+    else if (id == 1) e->ino = EXT2_GOOD_OLD_FIRST_INO;
+    else e->ino = (*next)++;
+    for (int i = 0; i < e->nkids; i++)
+        assign_inodes(g, e->kids[i], next);
+}
+
+// ---------------------------------------------------------------------------
+// 디렉토리 블록
+// ---------------------------------------------------------------------------
+
+static uint16_t rec_len_of(size_t name_len) {
+    return (uint16_t)((8 + name_len + 3) & ~3u);
+}
+
+static void put_dirent(uint8_t *p, uint32_t ino, uint16_t rec_len, const char *name, uint8_t type) {
+    size_t len = strlen(name);
+    memcpy(p, &ino, 4);
+    memcpy(p + 4, &rec_len, 2);
+    p[6] = (uint8_t)len;
+    p[7] = type;
+    memcpy(p + 8, name, len);
+}
+
+// 디렉토리 내용 배치: out이 NULL이면 블록 수만 계산
+// 블록의 마지막 엔트리가 남은 공간을 차지하도록 rec_len을 늘림
+static uint32_t dir_layout(const Gen *g, const Entry *e, uint8_t *out) {
+    uint32_t bs = g->block_size, nb = 1, off = 0;
+    uint8_t *last = NULL;
+    for (int i = -2; i < e->nkids; i++) {
+        const char *name = i == -2 ? "." : i == -1 ? ".." : g->ents[e->kids[i]].name;
+        uint32_t ino = i == -2 ? e->ino : i == -1 ? g->ents[e->parent].ino : g->ents[e->kids[i]].ino;
+        uint8_t type = i < 0 ? EXT2_FT_DIR : g->ents[e->kids[i]].type;
+        uint16_t len = rec_len_of(strlen(name));
+        if (off + len > bs) {
+            if (out && last) {
+                uint16_t rl;
+                memcpy(&rl, last + 4, 2);
+                rl = (uint16_t)(rl + bs - off);
+                memcpy(last + 4, &rl, 2);
+            }
+            nb++;
+            off = 0;
+        }
+        if (out) {
+            last = out + (size_t)(nb - 1) * bs + off;
+            put_dirent(last, ino, len, name, type);
+        }
+        off += len;
+    }
+    if (out && last) {
+        uint16_t rl;
+        memcpy(&rl, last + 4, 2);
+        rl = (uint16_t)(rl + bs - off);
+        memcpy(last + 4, &rl, 2);
+    }
+    return nb;
+}
+
+// ---------------------------------------------------------------------------
+// 블록 할당과 쓰기
+// ---------------------------------------------------------------------------
+
+static bool bit_test(const uint8_t *map, uint32_t bit) {
+    return map[bit / 8] & (1 << (bit % 8));
+}
+
+static void bit_set(uint8_t *map, uint32_t bit) {
+    map[bit / 8] |= (uint8_t)(1 << (bit % 8));
+}
+
+// 블록 비트맵은 그룹마다 블록 하나 크기로 이어 붙여 둠
+static bool blk_used(const Gen *g, uint32_t blk) {
+    uint32_t r = blk - g->first_data;
+    return bit_test(g->bbm + (size_t)(r / g->blocks_per_group) * g->block_size, r % g->blocks_per_group);
+}
+
+static void blk_mark(Gen *g, uint32_t blk) {
+    uint32_t r = blk - g->first_data;
+    bit_set(g->bbm + (size_t)(r / g->blocks_per_group) * g->block_size, r % g->blocks_per_group);
+}
+
+static void pwrite_all(int fd, const void *buf, size_t len, off_t off) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            die("pwrite");
+        }
+        p += n;
+        off += n;
+        len -= (size_t)n;
+    }
+}
+
+// 앞에서부터 차례로 빈 블록 하나 할당 (메타데이터 영역은 이미 표시되어 있어 건너뜀)
+static uint32_t alloc_block(Gen *g) {
+    if (g->counting) {
+        g->counted++;
+        return 1;
+    }
+    while (g->cursor < g->blocks_count && blk_used(g, g->cursor))
+        g->cursor++;
+    if (g->cursor >= g->blocks_count) {
+        fprintf(stderr, "ssu_mkimg: out of blocks\n");
+        exit(EXIT_FAILURE);
+    }
+    blk_mark(g, g->cursor);
+    return g->cursor++;
+}
+
+static void flush_data(Gen *g) {
+    if (g->wcount == 0) return;
+    pwrite_all(g->fd, g->wbuf, (size_t)g->wcount * g->block_size, (off_t)g->wstart * g->block_size);
+    g->bytes_written += (uint64_t)g->wcount * g->block_size;
+    g->wcount = 0;
+}
+
+// 데이터 블록 하나를 쓰기 모음에 추가 (물리적으로 이어지지 않으면 먼저 내보냄)
+static uint8_t *queue_data(Gen *g, uint32_t phys) {
+    if (g->wcount && (phys != g->wstart + g->wcount || g->wcount == MKIMG_WRITE_BLOCKS))
+        flush_data(g);
+    if (g->wcount == 0) g->wstart = phys;
+    return g->wbuf + (size_t)g->wcount++ * g->block_size;
+}
+
+static void flush_level(Gen *g, int h) {
+    IndLevel *L = &g->lv[h];
+    if (L->phys == 0) return;
+    if (!g->counting) {
+        pwrite_all(g->fd, L->buf, g->block_size, (off_t)L->phys * g->block_size);
+        g->bytes_written += g->block_size;
+    }
+    L->phys = 0;
+}
+
+// 논리 블록 번호를 i_block 인덱스와 간접 블록 안 인덱스들로 나눔 (반환값: 간접 단계 수)
+static int block_to_path(const Gen *g, uint64_t lb, uint32_t off[4]) {
+    uint64_t p = g->ptrs;
+    if (lb < EXT2_NDIR_BLOCKS) {
+        off[0] = (uint32_t)lb;
+        return 0;
+    }
+    lb -= EXT2_NDIR_BLOCKS;
+    if (lb < p) {
+        off[0] = 12;
+        off[1] = (uint32_t)lb;
+        return 1;
+    }
+    lb -= p;
+    if (lb < p * p) {
+        off[0] = 13;
+        off[1] = (uint32_t)(lb / p);
+        off[2] = (uint32_t)(lb % p);
+        return 2;
+    }
+    lb -= p * p;
+    off[0] = 14;
+    off[1] = (uint32_t)(lb / (p * p));
+    off[2] = (uint32_t)(lb / p % p);
+    off[3] = (uint32_t)(lb % p);
+    return 3;
+}
+
+// 논리 블록 lb에 데이터 블록을 할당하고 i_block/간접 블록에 기록
+// 새 간접 블록은 그 블록이 가리키는 데이터 바로 앞에 오도록 데이터보다 먼저 할당
+static uint32_t map_block(Gen *g, struct ext2_inode *in, uint64_t lb) {
+    uint32_t off[4];
+    int depth = block_to_path(g, lb, off);
+    uint32_t *slot = &in->i_block[off[0]];
+    for (int h = depth; h >= 1; h--) {
+        IndLevel *L = &g->lv[h];
+        if (*slot == 0) {
+            flush_level(g, h);
+            L->phys = alloc_block(g);
+            memset(L->buf, 0, g->block_size);
+            *slot = L->phys;
+            g->ind_blocks++;
+        }
+        slot = &L->buf[off[depth - h + 1]];
+    }
+    *slot = alloc_block(g);
+    return *slot;
+}
+
+static void finish_file(Gen *g) {
+    for (int h = 1; h <= 3; h++)
+        flush_level(g, h);
+}
+
+// 파일 블록 내용: 기본 패턴 앞에 inode/논리 블록 번호를 넣어 블록마다 다르게
+static void fill_block(const Gen *g, uint8_t *dst, uint32_t ino, uint64_t lb, uint32_t len) {
+    memcpy(dst, g->pattern, len);
+    char head[32];
+    int n = snprintf(head, sizeof(head), "%08u %010llu ", ino, (unsigned long long)lb);
+    memcpy(dst, head, (size_t)n < len ? (size_t)n : len);
+    if (len < g->block_size) memset(dst + len, 0, g->block_size - len);
+}
+
+// 항목 하나의 블록을 할당하고(counting이면 세기만) 내용을 씀, 반환값: 할당한 블록 수
+static uint64_t write_entry(Gen *g, Entry *e, struct ext2_inode *in) {
+    uint32_t bs = g->block_size;
+    uint64_t before_ind = g->ind_blocks, ndata = 0;
+    if (e->type == EXT2_FT_DIR) {
+        uint32_t nb = dir_layout(g, e, NULL);
+        uint8_t *buf = g->counting ? NULL : xcalloc(nb, bs);
+        if (buf) dir_layout(g, e, buf);
+        for (uint32_t b = 0; b < nb; b++) {
+            uint32_t phys = map_block(g, in, b);
+            if (buf) memcpy(queue_data(g, phys), buf + (size_t)b * bs, bs);
+        }
+        free(buf);
+        e->size = (uint64_t)nb * bs;
+        ndata = nb;
+        g->dir_blocks += nb;
+    } else {
+        uint64_t nblocks = (e->size + bs - 1) / bs;
+        uint64_t n = e->present ? (uint64_t)e->npresent : nblocks;
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t lb = e->present ? e->present[i] : i;
+            uint32_t phys = map_block(g, in, lb);
+            if (!g->counting) {
+                uint64_t rest = e->size - lb * bs;
+                fill_block(g, queue_data(g, phys), e->ino, lb, rest < bs ? (uint32_t)rest : bs);
+            }
+        }
+        ndata = n;
+        g->data_blocks += n;
+    }
+    finish_file(g);
+    return ndata + (g->ind_blocks - before_ind);
+}
+
+// ---------------------------------------------------------------------------
+// 레이아웃 계산
+// ---------------------------------------------------------------------------
+
+static bool has_backup(uint32_t group) {
+    if (group <= 1) return true;
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint32_t n = group;
+        while (n % base == 0) n /= base;
+        if (n == 1) return true;
+    }
+    return false;
+}
+
+static uint32_t group_first_block(const Gen *g, uint32_t group) {
+    return g->first_data + group * g->blocks_per_group;
+}
+
+// 그룹 안 메타데이터 배치: [슈퍼블록 + GDT 사본] 블록 비트맵, inode 비트맵, inode 테이블
+static uint32_t group_overhead(const Gen *g, uint32_t group) {
+    return (has_backup(group) ? 1 + g->gdt_blocks : 0) + 2 + g->itable_blocks;
+}
+
+// 필요한 블록/inode 수를 담을 수 있는 가장 작은 그룹 수와 그룹당 inode 수 결정
+static void plan_layout(Gen *g, uint64_t need_blocks, uint64_t need_inodes) {
+    uint32_t bs = g->block_size;
+    uint32_t per_block = bs / EXT2_INODE_SIZE;
+    g->blocks_per_group = bs * 8;
+    g->first_data = bs == 1024 ? 1 : 0;
+    uint64_t want = need_blocks + need_blocks / 50 + 64;
+    if (g->min_bytes / bs > want) want = g->min_bytes / bs;
+    uint64_t inodes = need_inodes + need_inodes / 20 + 16;
+    for (uint64_t groups = 1; groups < (1ULL << 32) / g->blocks_per_group; groups++) {
+        uint64_t ipg = (inodes + groups - 1) / groups;
+        ipg = (ipg + per_block - 1) / per_block * per_block;
+        ipg = (ipg + 7) / 8 * 8;
+        if (ipg > g->blocks_per_group) continue;
+        g->groups = (uint32_t)groups;
+        g->inodes_per_group = (uint32_t)ipg;
+        g->itable_blocks = (uint32_t)(ipg * EXT2_INODE_SIZE / bs);
+        g->gdt_blocks = (uint32_t)((groups * sizeof(struct ext2_group_desc) + bs - 1) / bs);
+        uint64_t capacity = 0;
+        bool fits = true;
+        for (uint32_t k = 0; k < groups; k++) {
+            uint32_t over = group_overhead(g, k);
+            if (over >= g->blocks_per_group) fits = false;
+            else capacity += g->blocks_per_group - over;
+        }
+        if (!fits || capacity < want) continue;
+        g->blocks_count = g->first_data + (uint32_t)groups * g->blocks_per_group;
+        g->inodes_count = (uint32_t)(groups * ipg);
+        return;
+    }
+    fprintf(stderr, "ssu_mkimg: requested shape does not fit in a 32-bit block count\n");
+    exit(EXIT_FAILURE);
+}
+
+// 모든 그룹의 메타데이터 블록을 비트맵에 표시하고 디스크립터 위치 기록
+static void mark_metadata(Gen *g) {
+    for (uint32_t k = 0; k < g->groups; k++) {
+        uint32_t b = group_first_block(g, k);
+        uint32_t over = group_overhead(g, k);
+        struct ext2_group_desc *gd = &g->gds[k];
+        uint32_t meta = has_backup(k) ? 1 + g->gdt_blocks : 0;
+        gd->bg_block_bitmap = b + meta;
+        gd->bg_inode_bitmap = b + meta + 1;
+        gd->bg_inode_table = b + meta + 2;
+        for (uint32_t i = 0; i < over; i++)
+            blk_mark(g, b + i);
+        // inode 비트맵의 그룹 inode 수 이후 비트는 1로 채움
+        uint8_t *ibm = g->ibm + (size_t)k * g->block_size;
+        for (uint32_t i = g->inodes_per_group; i < g->block_size * 8; i++)
+            bit_set(ibm, i);
+    }
+    // 예약 inode 1..10
+    for (uint32_t ino = 1; ino < EXT2_GOOD_OLD_FIRST_INO; ino++)
+        bit_set(g->ibm, ino - 1);
+}
+
+// ---------------------------------------------------------------------------
+// inode 테이블
+// ---------------------------------------------------------------------------
+
+static void flush_itable(Gen *g) {
+    if (g->itgroup < 0) return;
+    size_t len = (size_t)g->itable_blocks * g->block_size;
+    pwrite_all(g->fd, g->itbuf, len, (off_t)g->gds[g->itgroup].bg_inode_table * g->block_size);
+    g->bytes_written += len;
+    g->itgroup = -1;
+}
+
+// inode 번호는 증가하는 순서로만 오므로 현재 그룹 테이블 하나만 들고 있다가 그룹이 바뀌면 씀
+static void put_inode(Gen *g, uint32_t ino, const struct ext2_inode *in, bool is_dir) {
+    uint32_t group = (ino - 1) / g->inodes_per_group;
+    uint32_t idx = (ino - 1) % g->inodes_per_group;
+    if ((int)group != g->itgroup) {
+        flush_itable(g);
+        memset(g->itbuf, 0, (size_t)g->itable_blocks * g->block_size);
+        g->itgroup = (int)group;
+    }
+    memcpy(g->itbuf + (size_t)idx * EXT2_INODE_SIZE, in, sizeof(*in));
+    bit_set(g->ibm + (size_t)group * g->block_size, idx);
+    if (is_dir) g->gds[group].bg_used_dirs_count++;
+}
+
+static void fill_inode(Gen *g, Entry *e, struct ext2_inode *in, uint64_t blocks) {
+    in->i_mode = e->type == EXT2_FT_DIR ? 040755 : 0100644;
+    in->i_size = (uint32_t)e->size;
+    in->i_size_high = (uint32_t)(e->size >> 32);
+    if (e->size > 0x7FFFFFFFULL) g->large_file = true;
+    in->i_atime = in->i_ctime = in->i_mtime = MKIMG_TIME;
+    in->i_links_count = (uint16_t)(e->type == EXT2_FT_DIR ? 2 + e->nsubdirs : 1);
+    in->i_blocks = (uint32_t)(blocks * (g->block_size / 512));
+}
+
+// ---------------------------------------------------------------------------
+// 그룹 디스크립터, 비트맵, 슈퍼블록
+// ---------------------------------------------------------------------------
+
+static void write_metadata(Gen *g) {
+    uint32_t bs = g->block_size;
+    uint64_t free_blocks = 0, free_inodes = 0;
+    for (uint32_t k = 0; k < g->groups; k++) {
+        uint8_t *bbm = g->bbm + (size_t)k * bs;
+        uint8_t *ibm = g->ibm + (size_t)k * bs;
+        uint32_t fb = 0, fi = 0;
+        for (uint32_t i = 0; i < g->blocks_per_group; i++)
+            if (!bit_test(bbm, i)) fb++;
+        for (uint32_t i = 0; i < g->inodes_per_group; i++)
+            if (!bit_test(ibm, i)) fi++;
+        g->gds[k].bg_free_blocks_count = (uint16_t)fb;
+        g->gds[k].bg_free_inodes_count = (uint16_t)fi;
+        free_blocks += fb;
+        free_inodes += fi;
+        pwrite_all(g->fd, bbm, bs, (off_t)g->gds[k].bg_block_bitmap * bs);
+        pwrite_all(g->fd, ibm, bs, (off_t)g->gds[k].bg_inode_bitmap * bs);
+        g->bytes_written += 2ULL * bs;
+    }
+
+    struct ext2_super_block s;
+    memset(&s, 0, sizeof(s));
+    s.s_inodes_count = g->inodes_count;
+    s.s_blocks_count = g->blocks_count;
+    s.s_free_blocks_count = (uint32_t)free_blocks;
+    s.s_free_inodes_count = (uint32_t)free_inodes;
+    s.s_first_data_block = g->first_data;
+    s.s_log_block_size = s.s_log_frag_size = (uint32_t)__builtin_ctz(bs >> 10);
+    s.s_blocks_per_group = s.s_frags_per_group = g->blocks_per_group;
+    s.s_inodes_per_group = g->inodes_per_group;
+    s.s_wtime = s.s_lastcheck = MKIMG_TIME;
+    s.s_max_mnt_count = -1;
+    s.s_magic = EXT2_SUPER_MAGIC;
+    s.s_state = 1;       // 깨끗하게 언마운트됨
+    s.s_errors = 1;      // 오류 시 계속
+    s.s_rev_level = 1;
+    s.s_first_ino = EXT2_GOOD_OLD_FIRST_INO;
+    s.s_inode_size = EXT2_INODE_SIZE;
+    s.s_feature_incompat = EXT2_FEATURE_INCOMPAT_FILETYPE;
+    s.s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER
+                          | (g->large_file ? EXT2_FEATURE_RO_COMPAT_LARGE_FILE : 0);
+    for (int i = 0; i < 16; i++)
+        s.s_uuid[i] = (uint8_t)((g->seed + 1) * 131u * (i + 7) >> 3);
+    s.s_uuid[6] = (uint8_t)((s.s_uuid[6] & 0x0F) | 0x40);
+    s.s_uuid[8] = (uint8_t)((s.s_uuid[8] & 0x3F) | 0x80);
+    snprintf(s.s_volume_name, sizeof(s.s_volume_name), "ssu_bench");
+
+    // 슈퍼블록과 GDT는 sparse_super 규칙에 맞는 모든 그룹에 사본
+    size_t gdt_len = (size_t)g->gdt_blocks * bs;
+    uint8_t *gdt = xcalloc(1, gdt_len);
+    memcpy(gdt, g->gds, sizeof(struct ext2_group_desc) * g->groups);
+    for (uint32_t k = 0; k < g->groups; k++) {
+        if (!has_backup(k)) continue;
+        uint32_t b = group_first_block(g, k);
+        s.s_block_group_nr = (uint16_t)k;
+        off_t sb_off = k == 0 ? SUPERBLOCK_OFFSET : (off_t)b * bs;
+        pwrite_all(g->fd, &s, sizeof(s), sb_off);
+        pwrite_all(g->fd, gdt, gdt_len, (off_t)(b + 1) * bs);
+        g->bytes_written += sizeof(s) + gdt_len;
+    }
+    free(gdt);
+}
+
+// ---------------------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage Error : %s [OPTION]... <IMAGE>\n", prog);
+    fprintf(stderr, "  -b <1024|2048|4096> : block size (default 4096)\n");
+    fprintf(stderr, "  -d <DEPTH> : depth of the directory tree under /tree, -1 for none (default 3)\n");
+    fprintf(stderr, "  -f <FANOUT> : subdirectories per directory (default 4)\n");
+    fprintf(stderr, "  -n <FILES> : regular files per directory (default 8)\n");
+    fprintf(stderr, "  -S <SIZE> : average regular file size, e.g. 4K (default 4K)\n");
+    fprintf(stderr, "  -H <ENTRIES> : add /huge with <ENTRIES> empty files\n");
+    fprintf(stderr, "  -L <SIZE> : add a dense file /largeN of <SIZE> bytes (repeatable)\n");
+    fprintf(stderr, "  -P <SIZE> : add a sparse file /sparseN of <SIZE> bytes (repeatable)\n");
+    fprintf(stderr, "  -s <SIZE> : minimum image size\n");
+    fprintf(stderr, "  -r <SEED> : seed for file sizes and UUID (default 1)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    Gen gen;
+    Gen *g = &gen;
+    memset(g, 0, sizeof(*g));
+    g->block_size = 4096;
+    g->depth = 3;
+    g->fanout = 4;
+    g->files = 8;
+    g->file_size = 4096;
+    g->seed = 1;
+    g->itgroup = -1;
+
+    int opt, v;
+    uint64_t size;
+    while ((opt = getopt(argc, argv, "b:d:f:n:S:H:L:P:s:r:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if (!parse_int(optarg, 1024, 4096, &v) || (v != 1024 && v != 2048 && v != 4096)) usage(argv[0]);
+            g->block_size = (uint32_t)v;
+            break;
+        case 'd':
+            if (!parse_int(optarg, -1, 64, &g->depth)) usage(argv[0]);
+            break;
+        case 'f':
+            if (!parse_int(optarg, 0, 1 << 20, &g->fanout)) usage(argv[0]);
+            break;
+        case 'n':
+            if (!parse_int(optarg, 0, 1 << 20, &g->files)) usage(argv[0]);
+            break;
+        case 'S':
+            if (!parse_size(optarg, &g->file_size)) usage(argv[0]);
+            break;
+        case 'H':
+            if (!parse_int(optarg, 0, 1 << 24, &g->huge)) usage(argv[0]);
+            break;
+        case 'L':
+        case 'P':
+            if (!parse_size(optarg, &size)) usage(argv[0]);
+            if (opt == 'L' && g->nlarge < MKIMG_MAX_FILES) g->large[g->nlarge++] = size;
+            else if (opt == 'P' && g->nsparse < MKIMG_MAX_FILES) g->sparse[g->nsparse++] = size;
+            else usage(argv[0]);
+            break;
+        case 's':
+            if (!parse_size(optarg, &g->min_bytes)) usage(argv[0]);
+            break;
+        case 'r':
+            if (!parse_int(optarg, 0, INT32_MAX, &v)) usage(argv[0]);
+            g->seed = (uint32_t)v;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1) usage(argv[0]);
+    const char *path = argv[optind];
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint32_t bs = g->block_size;
+    g->ptrs = bs / 4;
+    for (int h = 1; h <= 3; h++)
+        g->lv[h].buf = xcalloc(1, bs);
+
+    // 1) 트리 모양과 inode 번호
+    build_shape(g);
+    uint32_t next_ino = EXT2_GOOD_OLD_FIRST_INO + 1;
+    assign_inodes(g, 0, &next_ino);
+    uint64_t max_bytes = (EXT2_NDIR_BLOCKS + (uint64_t)g->ptrs + (uint64_t)g->ptrs * g->ptrs
+                          + (uint64_t)g->ptrs * g->ptrs * g->ptrs) * bs;
+    for (int i = 0; i < g->nents; i++) {
+        if (g->ents[i].type == EXT2_FT_REG_FILE && g->ents[i].size > max_bytes) {
+            fprintf(stderr, "ssu_mkimg: /%s is larger than %llu bytes, the limit for %u-byte blocks\n",
+                    g->ents[i].name, (unsigned long long)max_bytes, bs);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // 2) 필요한 블록 수를 세고 그룹 레이아웃 결정
+    g->counting = true;
+    uint64_t need = 0;
+    struct ext2_inode scratch;
+    for (int i = 0; i < g->nents; i++) {
+        memset(&scratch, 0, sizeof(scratch));
+        need += write_entry(g, &g->ents[i], &scratch);
+    }
+    g->counting = false;
+    g->data_blocks = g->ind_blocks = g->dir_blocks = 0;
+    plan_layout(g, need, next_ino);
+
+    g->bbm = xcalloc(g->groups, bs);
+    g->ibm = xcalloc(g->groups, bs);
+    g->gds = xcalloc(g->groups, sizeof(struct ext2_group_desc));
+    g->wbuf = xcalloc(MKIMG_WRITE_BLOCKS, bs);
+    g->itbuf = xcalloc(g->itable_blocks, bs);
+    g->pattern = xcalloc(1, bs);
+    static const char line[] = "the quick brown fox jumps over the lazy dog 0123456789 ssu_ext2\n";
+    for (uint32_t i = 0; i < bs; i++)
+        g->pattern[i] = (uint8_t)line[i % (sizeof(line) - 1)];
+    mark_metadata(g);
+    g->cursor = g->first_data;
+
+    g->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (g->fd < 0) die(path);
+    if (ftruncate(g->fd, (off_t)g->blocks_count * bs) < 0) die("ftruncate");
+
+    // 3) inode 번호 순서로 블록을 할당하며 내용과 inode 기록
+    // ents[0]=루트(2), ents[1]=lost+found(11), 나머지는 inode 번호 12부터
+    Entry **byino = xcalloc(g->nents, sizeof(Entry *));
+    byino[0] = &g->ents[0];
+    byino[1] = &g->ents[1];
+    for (int i = 2; i < g->nents; i++)
+        byino[g->ents[i].ino - (EXT2_GOOD_OLD_FIRST_INO + 1) + 2] = &g->ents[i];
+    for (int i = 0; i < g->nents; i++) {
+        Entry *e = byino[i];
+        struct ext2_inode in;
+        memset(&in, 0, sizeof(in));
+        uint64_t blocks = write_entry(g, e, &in);
+        fill_inode(g, e, &in, blocks);
+        put_inode(g, e->ino, &in, e->type == EXT2_FT_DIR);
+    }
+    flush_data(g);
+    flush_itable(g);
+    free(byino);
+
+    // 4) 비트맵, 그룹 디스크립터, 슈퍼블록
+    write_metadata(g);
+    if (fsync(g->fd) < 0) die("fsync");
+    close(g->fd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int ndirs = 0, nfiles = 0;
+    for (int i = 0; i < g->nents; i++) {
+        if (g->ents[i].type == EXT2_FT_DIR) ndirs++;
+        else nfiles++;
+    }
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%s: %u blocks of %u bytes in %u groups, %u inodes (%u per group)\n",
+           path, g->blocks_count, bs, g->groups, g->inodes_count, g->inodes_per_group);
+    printf("%d directories, %d files; %llu data blocks, %llu directory blocks, %llu indirect blocks\n",
+           ndirs, nfiles, (unsigned long long)g->data_blocks, (unsigned long long)g->dir_blocks,
+           (unsigned long long)g->ind_blocks);
+    printf("%llu bytes written in %.3f s\n", (unsigned long long)g->bytes_written, sec);
+
+    for (int i = 0; i < g->nents; i++) {
+        free(g->ents[i].kids);
+        free(g->ents[i].present);
+    }
+    free(g->ents);
+    for (int h = 1; h <= 3; h++)
+        free(g->lv[h].buf);
+    free(g->bbm);
+    free(g->ibm);
+    free(g->gds);
+    free(g->wbuf);
+    free(g->itbuf);
+    free(g->pattern);
+    return 0;
+}